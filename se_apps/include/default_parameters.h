@@ -35,6 +35,10 @@ const int default_rendering_rate = 4;
 const int default_tracking_rate = 1;
 const Eigen::Vector3i default_volume_resolution(256, 256, 256);
 const Eigen::Vector3f default_volume_size(2.f, 2.f, 2.f);
+const int default_voxel_block_size = 8;
+const bool default_block_size_sweep = false;
+const bool default_prune = false;
+const float default_prune_tolerance = 0.f;
 const Eigen::Vector3f default_initial_pos_factor(0.5f, 0.5f, 0.0f);
 const bool default_no_gui = false;
 const bool default_render_volume_fullsize = false;
@@ -56,7 +60,7 @@ inline std::string pyramid2str(std::vector<int> v) {
 
 }
 
-static std::string short_options = "a:qc:d:f:g:G:hi:l:m:k:o:p:r:s:t:v:y:z:FC:M";
+static std::string short_options = "a:B:qc:d:f:g:G:hi:l:m:k:o:p:Pr:s:St:T:v:y:z:FC:M";
 
 static struct option long_options[] =
 {
@@ -80,6 +84,9 @@ static struct option long_options[] =
   {"pyramid-levels",     required_argument, 0, 'y'},
   {"rendering-rate",     required_argument, 0, 'z'},
   {"voxel-block-size",   required_argument, 0, 'B'},
+  {"block-size-sweep",   no_argument, 0, 'S'},
+  {"prune",              no_argument, 0, 'P'},
+  {"prune-tolerance",    required_argument, 0, 'T'},
   {"bilateral-filter",   no_argument, 0, 'F'},
   {"colour-voxels",      no_argument, 0, 'C'},
   {"multi-res",          no_argument, 0, 'M'},
@@ -92,6 +99,7 @@ static struct option long_options[] =
 inline
 void print_arguments() {
   std::cerr << "-b  (--block-read)                        : default is False: Block on read " << std::endl;
+  std::cerr << "-B  (--voxel-block-size)                  : default is " << default_voxel_block_size << " (4, 8 or 16)" << std::endl;
   std::cerr << "-c  (--compute-size-ratio)                : default is " << default_compute_size_ratio << "   (same size)      " << std::endl;
   std::cerr << "-e  (--invert-y)                          : default is False: Block on read " << std::endl;
   std::cerr << "-d  (--dump-volume) <filename>            : Output volume file              " << std::endl;
@@ -104,10 +112,13 @@ void print_arguments() {
   std::cerr << "-o  (--log-file) <filename>               : default is stdout               " << std::endl;
   std::cerr << "-m  (--mu)                                : default is " << default_mu << "               " << std::endl;
   std::cerr << "-p  (--init-pose)                         : default is " << default_initial_pos_factor.x() << "," << default_initial_pos_factor.y() << "," << default_initial_pos_factor.z() << "     " << std::endl;
+  std::cerr << "-P  (--prune)                             : default is disabled: collapse uniform occupancy blocks once out of view" << std::endl;
   std::cerr << "-q  (--no-gui)                            : default is to display gui"<<std::endl;
   std::cerr << "-r  (--integration-rate)                  : default is " << default_integration_rate << "     " << std::endl;
+  std::cerr << "-S  (--block-size-sweep)                  : default is disabled: benchmark every voxel block size" << std::endl;
   std::cerr << "-s  (--volume-size)                       : default is " << default_volume_size.x() << "," << default_volume_size.y() << "," << default_volume_size.z() << "      " << std::endl;
   std::cerr << "-t  (--tracking-rate)                     : default is " << default_tracking_rate << "     " << std::endl;
+  std::cerr << "-T  (--prune-tolerance)                   : default is " << default_prune_tolerance << " (lossless)" << std::endl;
   std::cerr << "-v  (--volume-resolution)                 : default is " << default_volume_resolution.x() << "," << default_volume_resolution.y() << "," << default_volume_resolution.z() << "    " << std::endl;
   std::cerr << "-y  (--pyramid-levels)                    : default is 10,5,4     " << std::endl;
   std::cerr << "-z  (--rendering-rate)                    : default is " << default_rendering_rate << std::endl;
@@ -202,6 +213,10 @@ Configuration parseArgs(unsigned int argc, char ** argv) {
   config.rendering_rate = default_rendering_rate;
   config.volume_resolution = default_volume_resolution;
   config.volume_size = default_volume_size;
+  config.voxel_block_size = default_voxel_block_size;
+  config.block_size_sweep = default_block_size_sweep;
+  config.prune = default_prune;
+  config.prune_tolerance = default_prune_tolerance;
   config.initial_pos_factor = default_initial_pos_factor;
   //initial_pose_quant.setIdentity();
   //invert_y = false;
@@ -421,6 +436,36 @@ Configuration parseArgs(unsigned int argc, char ** argv) {
           flagErr++;
         }
 
+        break;
+      case 'B':    //   -B  (--voxel-block-size)
+        config.voxel_block_size = atoi(optarg);
+        std::cerr << "update voxel_block_size to " 
+          << config.voxel_block_size << std::endl;
+        if (config.voxel_block_size != 4 && config.voxel_block_size != 8 
+            && config.voxel_block_size != 16) {
+          std::cerr
+            << "ERROR: --voxel-block-size (-B) must be 4, 8 or 16 (was "
+            << optarg << ")\n";
+          flagErr++;
+        }
+        break;
+      case 'P':    //   -P  (--prune)
+        config.prune = true;
+        std::cerr << "occupancy pruning enabled" << std::endl;
+        break;
+      case 'T':    //   -T  (--prune-tolerance)
+        config.prune_tolerance = atof(optarg);
+        std::cerr << "update prune_tolerance to " 
+          << config.prune_tolerance << std::endl;
+        if (config.prune_tolerance < 0.f) {
+          std::cerr << "ERROR: --prune-tolerance (-T) must be >= 0 (was "
+            << optarg << ")\n";
+          flagErr++;
+        }
+        break;
+      case 'S':    //   -S  (--block-size-sweep)
+        config.block_size_sweep = true;
+        std::cerr << "benchmarking every voxel block size" << std::endl;
         break;
       case 'y': {
                   std::istringstream dotargs(optarg);
@@ -27,48 +27,45 @@
 
 PerfStats Stats;
 
-/***
- * This program loop over a scene recording
+/*
+ * Accumulated per-stage timings (in seconds) and map statistics of a run.
  */
+struct RunSummary {
+  unsigned int block_side = 0;
+  unsigned int frames = 0;
+  double stages[6] = {0, 0, 0, 0, 0, 0};
+  size_t memory = 0;
+  size_t pruned = 0;
+};
+
+static const char * stage_names[6] = {"acquisition", "preprocessing", 
+  "tracking", "integration", "raycasting", "rendering"};
+
+template <unsigned int BlockSide>
+void saveMap(DenseSLAMSystem& pipeline, const std::string& filename) {
+  std::shared_ptr<DiscreteMap<FieldType, BlockSide> > map_ptr;
+  pipeline.getMap(map_ptr);
+  if(map_ptr) map_ptr->save(filename);
+}
 
-int main(int argc, char ** argv) {
-
-	Configuration config = parseArgs(argc, argv);
-
-	// ========= CHECK ARGS =====================
-
-	std::ostream* logstream = &std::cout;
-	std::ofstream logfilestream;
-	assert(config.compute_size_ratio > 0);
-	assert(config.integration_rate > 0);
-	assert(config.volume_size.x() > 0);
-	assert(config.volume_resolution.x() > 0);
-
-	if (config.log_file != "") {
-		logfilestream.open(config.log_file.c_str());
-		logstream = &logfilestream;
-	}
-	if (config.input_file == "") {
-		std::cerr << "No input found." << std::endl;
-		print_arguments();
-		exit(1);
-	}
-
-	// ========= READER INITIALIZATION  =========
-
-	DepthReader * reader;
-
+DepthReader * createReader(const Configuration& config) {
 	if (is_file(config.input_file)) {
-		reader = new RawDepthReader(config.input_file, config.fps,
-				config.blocking_read);
-
-	} else {
-		reader = new SceneDepthReader(config.input_file, config.fps,
+		return new RawDepthReader(config.input_file, config.fps,
 				config.blocking_read);
 	}
+	return new SceneDepthReader(config.input_file, config.fps,
+			config.blocking_read);
+}
 
-	std::cout.precision(10);
-	std::cerr.precision(10);
+/***
+ * Run the pipeline over the whole scene recording
+ */
+RunSummary run(const Configuration& config, std::ostream* logstream,
+    bool save_map) {
+
+	// ========= READER INITIALIZATION  =========
+
+	DepthReader * reader = createReader(config);
 
   Eigen::Vector3f init_pose = config.initial_pos_factor.cwiseProduct(config.volume_size);
 	const uint2 inputSize = reader->getinputSize();
@@ -97,16 +94,21 @@ int main(int argc, char ** argv) {
 			sizeof(uchar4) * computationSize.x * computationSize.y);
 
 	uint frame = 0;
+  std::vector<int> pyramid = config.pyramid;
 
 	DenseSLAMSystem pipeline(
       Eigen::Vector2i(computationSize.x, computationSize.y), 
       config.volume_resolution, config.volume_size, 
       init_pose,
-      config.pyramid, config);
+      pyramid, config);
+
+  RunSummary summary;
+  summary.block_side = pipeline.getBlockSide();
      
 	std::chrono::time_point<std::chrono::steady_clock> timings[7];
 	timings[0] = std::chrono::steady_clock::now();
 
+	*logstream << "# kernel isa " << pipeline.getKernelISA() << std::endl;
 	*logstream
 			<< "frame\tacquisition\tpreprocessing\ttracking\tintegration\traycasting\trendering\tcomputation\ttotal    \tX          \tY          \tZ         \ttracked   \tintegrated"
 			<< std::endl;
@@ -172,13 +174,26 @@ int main(int argc, char ** argv) {
       << tracked << "        \t" << integrated // tracked and integrated flags
       << std::endl;
 
+    for (int i = 0; i < 6; ++i) {
+      summary.stages[i] += 
+        std::chrono::duration<double>(timings[i + 1] - timings[i]).count();
+    }
+
 		frame++;
 		timings[0] = std::chrono::steady_clock::now();
 	}
-
-    std::shared_ptr<se::Octree<FieldType> > map_ptr;
-    pipeline.getMap(map_ptr);
-    map_ptr->save("test.bin");
+  summary.frames = frame;
+  summary.memory = pipeline.getMapMemory();
+  summary.pruned = pipeline.getPrunedMemory();
+  *logstream << "# map memory " << summary.memory / (1024.0 * 1024.0) 
+    << " MB, saved by pruning " << summary.pruned / (1024.0 * 1024.0) 
+    << " MB" << std::endl;
+
+  if (save_map) {
+    saveMap<4>(pipeline, "test.bin");
+    saveMap<8>(pipeline, "test.bin");
+    saveMap<16>(pipeline, "test.bin");
+  }
     
     // ==========     DUMP VOLUME      =========
 
@@ -195,7 +210,62 @@ int main(int argc, char ** argv) {
 	free(depthRender);
 	free(trackRender);
 	free(volumeRender);
-	return 0;
-
+	delete reader;
+	return summary;
 }
 
+int main(int argc, char ** argv) {
+
+	Configuration config = parseArgs(argc, argv);
+
+	// ========= CHECK ARGS =====================
+
+	std::ostream* logstream = &std::cout;
+	std::ofstream logfilestream;
+	assert(config.compute_size_ratio > 0);
+	assert(config.integration_rate > 0);
+	assert(config.volume_size.x() > 0);
+	assert(config.volume_resolution.x() > 0);
+
+	if (config.log_file != "") {
+		logfilestream.open(config.log_file.c_str());
+		logstream = &logfilestream;
+	}
+	if (config.input_file == "") {
+		std::cerr << "No input found." << std::endl;
+		print_arguments();
+		exit(1);
+	}
+
+	std::cout.precision(10);
+	std::cerr.precision(10);
+
+  if (!config.block_size_sweep) {
+    run(config, logstream, true);
+    return 0;
+  }
+
+  // ========= VOXEL BLOCK SIZE SWEEP =========
+
+  std::vector<RunSummary> summaries;
+  for (int block_side : {4, 8, 16}) {
+    Configuration sweep_config = config;
+    sweep_config.voxel_block_size = block_side;
+    *logstream << "# voxel block size " << block_side << std::endl;
+    summaries.push_back(run(sweep_config, logstream, false));
+  }
+
+  *logstream << "block_size\tframes\tmemory[MB]\tpruned[MB]";
+  for (int i = 0; i < 6; ++i) *logstream << "\t" << stage_names[i] << "[ms]";
+  *logstream << std::endl;
+  for (const RunSummary& s : summaries) {
+    const double frames = std::max(s.frames, 1u);
+    *logstream << s.block_side << "\t" << s.frames << "\t" 
+      << s.memory / (1024.0 * 1024.0) << "\t" << s.pruned / (1024.0 * 1024.0);
+    for (int i = 0; i < 6; ++i) {
+      *logstream << "\t" << 1000.0 * s.stages[i] / frames;
+    }
+    *logstream << std::endl;
+  }
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "octree.hpp"
+#include "utils/block_layout.hpp"
+#include "perf_counter.hpp"
+
+/*
+ * Compares the row-major and Z-order intra-block layouts on the access 
+ * patterns of raycasting (random trilinear interpolation and gradients) and
+ * meshing (sweeping every 2x2x2 cell of every block). Both field types store 
+ * one float per voxel and differ only in their block_layout.
+ */
+
+struct LinearTag {};
+struct MortonTag {};
+
+template <>
+struct voxel_traits<LinearTag> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+template <>
+struct voxel_traits<MortonTag> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+namespace se {
+template <>
+struct block_layout<MortonTag> {
+  typedef morton_layout type;
+};
+}
+
+static const int volume_size = 512;
+static const int filled_size = 256;
+static const int num_samples = 1000000;
+
+struct Measurement {
+  double ms;
+  uint64_t l1d_misses;
+  uint64_t llc_misses;
+  float checksum;
+};
+
+template <typename F>
+Measurement measure(F f) {
+  se::bench::PerfCounter l1d(se::bench::PerfCounter::L1D_READ_MISSES);
+  se::bench::PerfCounter llc(se::bench::PerfCounter::LLC_MISSES);
+  l1d.start();
+  llc.start();
+  const auto begin = std::chrono::steady_clock::now();
+  const float checksum = f();
+  const auto end = std::chrono::steady_clock::now();
+  llc.stop();
+  l1d.stop();
+  return {std::chrono::duration<double, std::milli>(end - begin).count(),
+    l1d.value(), llc.value(), checksum};
+}
+
+template <typename T>
+void fill(se::Octree<T>& map) {
+  map.init(volume_size, volume_size);
+  const int side = se::VoxelBlock<T>::side;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < filled_size; z += side)
+    for(int y = 0; y < filled_size; y += side)
+      for(int x = 0; x < filled_size; x += side)
+        keys.push_back(map.hash(x, y, z));
+  map.allocate(keys.data(), keys.size());
+
+  std::vector<se::VoxelBlock<T>*> blocks;
+  map.getBlockList(blocks, false);
+  for(auto block : blocks) {
+    const Eigen::Vector3i base = block->coordinates();
+    for(int z = 0; z < side; ++z)
+      for(int y = 0; y < side; ++y)
+        for(int x = 0; x < side; ++x) {
+          const Eigen::Vector3i pos = base + Eigen::Vector3i(x, y, z);
+          block->data(pos, std::sin(0.1f * pos(0)) + std::cos(0.07f * pos(1))
+              - 0.01f * pos(2));
+        }
+  }
+}
+
+template <typename T>
+void run(const char * name, const std::vector<Eigen::Vector3f>& samples) {
+  se::Octree<T> map;
+  fill(map);
+  auto select = [](const float v) { return v; };
+
+  const Measurement interp = measure([&]() {
+    float acc = 0.f;
+    for(const auto& p : samples) acc += map.interp(p, select);
+    return acc;
+  });
+
+  const Measurement grad = measure([&]() {
+    float acc = 0.f;
+    for(const auto& p : samples) acc += map.grad(p, select).sum();
+    return acc;
+  });
+
+  std::vector<se::VoxelBlock<T>*> blocks;
+  map.getBlockList(blocks, false);
+  const Measurement sweep = measure([&]() {
+    const int side = se::VoxelBlock<T>::side;
+    float acc = 0.f;
+    for(auto block : blocks) {
+      const Eigen::Vector3i base = block->coordinates();
+      for(int z = 0; z < side - 1; ++z)
+        for(int y = 0; y < side - 1; ++y)
+          for(int x = 0; x < side - 1; ++x) {
+            float values[8];
+            block->gather(base + Eigen::Vector3i(x, y, z), values);
+            for(int i = 0; i < 8; ++i) acc += values[i];
+          }
+    }
+    return acc;
+  });
+
+  const Measurement* rows[3] = {&interp, &grad, &sweep};
+  const char* labels[3] = {"interp", "grad", "cell sweep"};
+  for(int i = 0; i < 3; ++i) {
+    std::printf("%-8s %-12s %10.2f %16llu %16llu   (%g)\n", name, labels[i], 
+        rows[i]->ms, (unsigned long long) rows[i]->l1d_misses,
+        (unsigned long long) rows[i]->llc_misses, rows[i]->checksum);
+  }
+}
+
+int main() {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> dis(1.f, filled_size - 3.f);
+  std::vector<Eigen::Vector3f> samples(num_samples);
+  for(auto& p : samples) p = Eigen::Vector3f(dis(gen), dis(gen), dis(gen));
+
+  se::bench::PerfCounter probe(se::bench::PerfCounter::L1D_READ_MISSES);
+  if(!probe.valid()) {
+    std::printf("perf counters unavailable, reporting timings only\n");
+  }
+
+  std::printf("%-8s %-12s %10s %16s %16s\n", "layout", "workload", "time [ms]",
+      "L1D read misses", "LLC misses");
+  run<LinearTag>("linear", samples);
+  run<MortonTag>("morton", samples);
+  return 0;
+}
@@ -0,0 +1,227 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "octree.hpp"
+#include "functors/projective_functor.hpp"
+#include <se/utils/isa.hpp>
+#include <se/utils/simd.hpp>
+#include <se/constant_parameters.h>
+#include <se/volume_traits.hpp>
+#include <se/functors/row_kernel.hpp>
+#include <se/image/image.hpp>
+#include <se/image/depth_pyramid.hpp>
+
+#define SE_KERNEL_SOURCE "integration_simd_kernels.cpp"
+#include "kernel_variants.hpp"
+#undef SE_KERNEL_SOURCE
+
+/*
+ * Per-voxel against vectorised row updates of sdf_update and bfusion_update.
+ * The same voxels are stored as arrays of structs, updated one voxel at a 
+ * time through VoxelBlockHandler, and as structures of arrays, updated a
+ * block row at a time by the SIMD kernels. Both run the copy compiled for
+ * se::isa::selected(), as the pipeline does, hence the binary needs no 
+ * -march flag and SE_ISA selects a lower instruction set. Reports the 
+ * integration time per frame and the largest difference between the two 
+ * resulting fields.
+ */
+
+/*
+ * Invoke f on the integration_kernels compiled for the instruction set l, or
+ * on the closest one below it.
+ */
+template <typename F>
+void dispatch_integration(const se::isa::level l, F f) {
+  switch(l) {
+#ifdef SE_KERNEL_VARIANTS
+    case se::isa::level::avx512:
+      f(se::kernels::avx512::integration_kernels());
+      break;
+    case se::isa::level::avx2:
+      f(se::kernels::avx2::integration_kernels());
+      break;
+    case se::isa::level::sse42:
+      f(se::kernels::sse42::integration_kernels());
+      break;
+#endif
+    default:
+      f(se::kernels::generic::integration_kernels());
+  }
+}
+
+struct SDFRows {};
+struct OFusionRows {};
+
+template <>
+struct voxel_traits<SDFRows> {
+  typedef voxel_traits<SDF>::value_type value_type;
+  typedef se::soa_storage storage_type;
+  static inline value_type empty(){ return voxel_traits<SDF>::empty(); }
+  static inline value_type initValue(){ return voxel_traits<SDF>::initValue(); }
+};
+
+template <>
+struct voxel_traits<OFusionRows> {
+  typedef voxel_traits<OFusion>::value_type value_type;
+  typedef se::soa_storage storage_type;
+  static inline value_type empty(){ return voxel_traits<OFusion>::empty(); }
+  static inline value_type initValue(){ return voxel_traits<OFusion>::initValue(); }
+};
+
+static const int volume_size = 512;
+static const float volume_dim = 5.12f;
+static const int num_frames = 10;
+static const float mu = 0.1f;
+static const Eigen::Vector2i frame_size(640, 480);
+static const float focal = 525.f;
+
+static float scene_depth(const int u, const int v) {
+  const float xn = (u - frame_size(0) / 2) / focal;
+  const float yn = (v - frame_size(1) / 2) / focal;
+  return 2.f / (1.f - 0.3f * xn + 0.1f * yn);
+}
+
+struct Scene {
+  Eigen::Matrix4f K;
+  std::vector<Sophus::SE3f, Eigen::aligned_allocator<Sophus::SE3f> > Tcw;
+  std::vector<std::vector<float> > frames;
+};
+
+static Scene make_scene() {
+  Scene scene;
+  scene.K = Eigen::Matrix4f::Identity();
+  scene.K(0, 0) = scene.K(1, 1) = focal;
+  scene.K(0, 2) = frame_size(0) / 2;
+  scene.K(1, 2) = frame_size(1) / 2;
+  std::mt19937 gen(42);
+  std::normal_distribution<float> noise(0.f, 0.005f);
+  for(int f = 0; f < num_frames; ++f) {
+    // Small sideways motion so that the voxels see different pixels
+    Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+    pose.topRightCorner<3, 1>() = 
+      Eigen::Vector3f(volume_dim / 2 + 0.005f * f, volume_dim / 2, 0.f);
+    scene.Tcw.push_back(Sophus::SE3f(pose).inverse());
+    std::vector<float> depth(frame_size.prod());
+    for(int v = 0; v < frame_size(1); ++v)
+      for(int u = 0; u < frame_size(0); ++u)
+        depth[u + v * frame_size(0)] = scene_depth(u, v) + noise(gen);
+    scene.frames.push_back(depth);
+  }
+  return scene;
+}
+
+template <typename T>
+void allocate_band(se::Octree<T>& map, const Scene& scene) {
+  map.init(volume_size, volume_dim);
+  std::vector<se::key_t> keys;
+  const float voxel = volume_dim / volume_size;
+  const float scale = volume_size / volume_dim;
+  for(int v = 0; v < frame_size(1); v += 2)
+    for(int u = 0; u < frame_size(0); u += 2) {
+      const float d = scene_depth(u, v);
+      for(float t = d - 3 * mu; t < d + mu; t += 4 * voxel) {
+        const Eigen::Vector3f p((u - scene.K(0, 2)) / focal * t, 
+            (v - scene.K(1, 2)) / focal * t, t);
+        const Eigen::Vector3i vox = ((scene.Tcw[0].inverse() * p) * scale).cast<int>();
+        keys.push_back(map.hash(vox(0), vox(1), vox(2)));
+      }
+    }
+  map.allocate(keys.data(), keys.size());
+}
+
+template <typename T>
+double integrate(se::Octree<T>& map, const Scene& scene, const bool occupancy) {
+  const float voxel = volume_dim / volume_size;
+  double ms = 0.0;
+  for(int f = 0; f < num_frames; ++f) {
+    const auto begin = std::chrono::steady_clock::now();
+    dispatch_integration(se::isa::selected(), [&](auto kernels) {
+      if(occupancy) {
+        kernels.ofusion(map, scene.Tcw[f], scene.K, frame_size, 
+            scene.frames[f].data(), mu, f / 30.f, voxel);
+      } else {
+        kernels.sdf(map, scene.Tcw[f], scene.K, frame_size, 
+            scene.frames[f].data(), mu);
+      }
+    });
+    const auto end = std::chrono::steady_clock::now();
+    ms += std::chrono::duration<double, std::milli>(end - begin).count();
+  }
+  return ms / num_frames;
+}
+
+template <typename VoxelT, typename RowT>
+void compare(const char * name, const Scene& scene, const bool occupancy) {
+  se::Octree<VoxelT> voxelwise;
+  se::Octree<RowT> rowwise;
+  allocate_band(voxelwise, scene);
+  allocate_band(rowwise, scene);
+  const double voxel_ms = integrate(voxelwise, scene, occupancy);
+  const double row_ms = integrate(rowwise, scene, occupancy);
+
+  std::vector<se::VoxelBlock<VoxelT>*> blocks;
+  voxelwise.getBlockList(blocks, false);
+  const int side = se::VoxelBlock<VoxelT>::side;
+  double max_x = 0.0, max_y = 0.0;
+  long updated = 0;
+  for(auto block : blocks) {
+    const Eigen::Vector3i base = block->coordinates();
+    const se::VoxelBlock<RowT> * other = rowwise.fetch(base(0), base(1), base(2));
+    for(int i = 0; i < side * side * side; ++i) {
+      const auto a = block->data(i);
+      const auto b = other->data(i);
+      max_x = std::max(max_x, (double) std::fabs(a.x - b.x));
+      max_y = std::max(max_y, (double) std::fabs(a.y - b.y));
+      updated += a.y != voxel_traits<VoxelT>::initValue().y;
+    }
+  }
+  std::printf("%-10s %8d blocks %10ld voxels %10.2f %10.2f %8.2fx %12g %12g\n", 
+      name, voxelwise.leavesCount(), updated, voxel_ms, row_ms, 
+      voxel_ms / row_ms, max_x, max_y);
+}
+
+int main() {
+  const Scene scene = make_scene();
+  dispatch_integration(se::isa::selected(), [](auto kernels) {
+      std::printf("isa %s, lanes per row chunk: %d\n", 
+          se::isa::name(se::isa::selected()), se::simd::row_width<BLOCK_SIDE, 
+            decltype(kernels)::lanes>::value);
+    });
+  std::printf("%-10s %15s %17s %10s %10s %9s %12s %12s\n", "update", "", 
+      "updated", "voxel [ms]", "row [ms]", "speedup", "max dx", "max dy");
+  compare<SDF, SDFRows>("sdf", scene, false);
+  compare<OFusion, OFusionRows>("bfusion", scene, true);
+  return 0;
+}
@@ -0,0 +1,64 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+/*
+ * Integration updates of integration_simd_bench.cpp, compiled once per 
+ * instruction set by kernel_variants.hpp like the pipeline kernels.cpp. No 
+ * include guard.
+ */
+#include "bfusion/mapping_impl.hpp"
+#include "kfusion/mapping_impl.hpp"
+
+struct integration_kernels {
+  static constexpr int lanes = SE_KERNEL_LANES;
+
+  struct flatten_call {
+    template <typename F>
+    __attribute__((flatten)) void operator()(const F& f) const { f(); }
+  };
+
+  template <typename MapT>
+  static void sdf(MapT& map, const Sophus::SE3f& Tcw, const Eigen::Matrix4f& K,
+      const Eigen::Vector2i& frame_size, const float * depth, const float mu) {
+    se::functor::projective_map(map, Tcw, K, frame_size, 
+        sdf_update<lanes>(depth, frame_size, mu, 100), flatten_call());
+  }
+
+  template <typename MapT>
+  static void ofusion(MapT& map, const Sophus::SE3f& Tcw, 
+      const Eigen::Matrix4f& K, const Eigen::Vector2i& frame_size, 
+      const float * depth, const float mu, const float timestamp, 
+      const float voxel_size) {
+    se::functor::projective_map(map, Tcw, K, frame_size, 
+        bfusion_update<lanes>(depth, frame_size, mu, timestamp, voxel_size), 
+        flatten_call());
+  }
+};
@@ -0,0 +1,149 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "utils/morton_utils.hpp"
+
+/*
+ * Compares the Morton encoders and decoders on random coordinates of a 
+ * 4096^3 volume: the inline single code version (magic masks unless built
+ * with BMI2), each batch variant the CPU supports, and the runtime dispatched
+ * batch overloads. Run with SE_ISA=generic or avx2 to see the dispatch fall
+ * back. Times are the best of several repetitions, per code.
+ */
+
+static const std::size_t num_keys = 1 << 22;
+static const int repetitions = 10;
+
+template <typename F>
+double best_ns(F f) {
+  double best = 1e30;
+  for(int r = 0; r < repetitions; ++r) {
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(end - begin)
+      .count() / num_keys;
+    if(ns < best) best = ns;
+  }
+  return best;
+}
+
+int main() {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> dis(0, 4095);
+  std::vector<Eigen::Vector3i> coords(num_keys);
+  for(auto& c : coords) c = Eigen::Vector3i(dis(gen), dis(gen), dis(gen));
+  std::vector<se::key_t> keys(num_keys);
+  std::vector<Eigen::Vector3i> decoded(num_keys);
+
+  auto encode_checksum = [&]() {
+    se::key_t acc = 0;
+    for(auto k : keys) acc ^= k;
+    return (unsigned long long) acc;
+  };
+  auto decode_checksum = [&]() {
+    long long acc = 0;
+    for(const auto& c : decoded) acc += c.x() - c.y() + 2 * c.z();
+    return acc;
+  };
+
+  std::printf("bmi2 %s, isa %s\n", se::isa::fast_bmi2() ? "fast" : "off",
+      se::isa::name(se::isa::selected()));
+  std::printf("%-10s %-10s %10s\n", "method", "operation", "ns/code");
+
+  const double single_enc = best_ns([&]() {
+    for(std::size_t i = 0; i < num_keys; ++i) 
+      keys[i] = compute_morton(coords[i].x(), coords[i].y(), coords[i].z());
+  });
+  std::printf("%-10s %-10s %10.3f   (%llx)\n", "single", "encode", 
+      single_enc, encode_checksum());
+  const double single_dec = best_ns([&]() {
+    for(std::size_t i = 0; i < num_keys; ++i) 
+      decoded[i] = unpack_morton(keys[i]);
+  });
+  std::printf("%-10s %-10s %10.3f   (%lld)\n", "single", "decode", 
+      single_dec, decode_checksum());
+
+  const double magic_enc = best_ns([&]() {
+    se::morton::encode_magic(coords.data(), num_keys, keys.data());
+  });
+  std::printf("%-10s %-10s %10.3f   (%llx)\n", "magic", "encode", 
+      magic_enc, encode_checksum());
+  const double magic_dec = best_ns([&]() {
+    se::morton::decode_magic(keys.data(), num_keys, decoded.data());
+  });
+  std::printf("%-10s %-10s %10.3f   (%lld)\n", "magic", "decode", 
+      magic_dec, decode_checksum());
+
+#if defined(SE_SIMD_X86)
+  if(se::isa::detect() >= se::isa::level::avx2) {
+    const double avx2_enc = best_ns([&]() {
+      se::morton::encode_avx2(coords.data(), num_keys, keys.data());
+    });
+    std::printf("%-10s %-10s %10.3f   (%llx)\n", "avx2", "encode", 
+        avx2_enc, encode_checksum());
+    const double avx2_dec = best_ns([&]() {
+      se::morton::decode_avx2(keys.data(), num_keys, decoded.data());
+    });
+    std::printf("%-10s %-10s %10.3f   (%lld)\n", "avx2", "decode", 
+        avx2_dec, decode_checksum());
+  }
+
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("bmi2")) {
+    const double bmi2_enc = best_ns([&]() {
+      se::morton::encode_bmi2(coords.data(), num_keys, keys.data());
+    });
+    std::printf("%-10s %-10s %10.3f   (%llx)\n", "bmi2", "encode", 
+        bmi2_enc, encode_checksum());
+    const double bmi2_dec = best_ns([&]() {
+      se::morton::decode_bmi2(keys.data(), num_keys, decoded.data());
+    });
+    std::printf("%-10s %-10s %10.3f   (%lld)\n", "bmi2", "decode", 
+        bmi2_dec, decode_checksum());
+  }
+#endif
+
+  const double batch_enc = best_ns([&]() {
+    compute_morton(coords.data(), num_keys, keys.data());
+  });
+  std::printf("%-10s %-10s %10.3f   (%llx)\n", "batch", "encode", 
+      batch_enc, encode_checksum());
+  const double batch_dec = best_ns([&]() {
+    unpack_morton(keys.data(), num_keys, decoded.data());
+  });
+  std::printf("%-10s %-10s %10.3f   (%lld)\n", "batch", "decode", 
+      batch_dec, decode_checksum());
+  return 0;
+}
@@ -0,0 +1,181 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "octree.hpp"
+#include "functors/projective_functor.hpp"
+#include "perf_counter.hpp"
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Measures projective_functor::apply, the integration sweep over every 
+ * visible voxel block, on a densely allocated volume. The same source is 
+ * built twice, with plain heap pages and with SE_HUGE_PAGES, so that the 
+ * data TLB misses of the two page allocators can be compared. Also reports
+ * how many blocks are backed by the NUMA node of the thread integrating them.
+ */
+
+template <>
+struct voxel_traits<float> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+static const int volume_size = 512;
+static const float volume_dim = 5.12f;
+static const int filled_size = 384;
+static const int num_frames = 20;
+
+/* NUMA node of the calling thread, 0 where unknown. */
+static int current_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned int cpu = 0, node = 0;
+  if(syscall(SYS_getcpu, &cpu, &node, NULL) == 0) return node;
+#endif
+  return 0;
+}
+
+/* NUMA node backing each address, negative where unknown. */
+static std::vector<int> page_nodes(std::vector<void *> addresses) {
+  std::vector<int> status(addresses.size(), -1);
+#if defined(__linux__) && defined(SYS_move_pages)
+  // Without a node list move_pages only reports the placement
+  if(syscall(SYS_move_pages, 0, addresses.size(), addresses.data(), NULL, 
+        status.data(), 0) != 0) {
+    std::fill(status.begin(), status.end(), -1);
+  }
+#endif
+  return status;
+}
+
+/* Records the node of the thread integrating each block, by slot. */
+struct node_recorder {
+  template <typename HandlerT>
+  void operator()(HandlerT&, const Eigen::Vector3i&, const Eigen::Vector3f&, 
+      const Eigen::Vector2f&) {}
+
+  void operator()(VoxelBlockHandler<float>&, const Eigen::Vector3i& voxel,
+      const Eigen::Vector3f&, const Eigen::Vector2f&) {
+    nodes[map->fetch(voxel(0), voxel(1), voxel(2))->slot()] = current_node();
+  }
+
+  se::Octree<float> * map;
+  int * nodes;
+};
+
+/* Slow orbit around the volume centre, one metre away from it */
+static Sophus::SE3f camera_pose(const int frame) {
+  const float angle = 0.02f * frame;
+  const Eigen::Vector3f centre = Eigen::Vector3f::Constant(volume_dim / 2);
+  Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+  pose.topLeftCorner<3, 3>() = 
+    Eigen::AngleAxisf(angle, Eigen::Vector3f::UnitY()).toRotationMatrix();
+  pose.topRightCorner<3, 1>() = centre - 
+    pose.topLeftCorner<3, 3>() * Eigen::Vector3f(0.f, 0.f, 3.5f);
+  return Sophus::SE3f(pose).inverse();
+}
+
+int main() {
+  se::Octree<float> map;
+  map.init(volume_size, volume_dim);
+  const int side = se::Octree<float>::blockSide;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < filled_size; z += side)
+    for(int y = 0; y < filled_size; y += side)
+      for(int x = 0; x < filled_size; x += side)
+        keys.push_back(map.hash(x, y, z));
+  map.allocate(keys.data(), keys.size());
+
+  Eigen::Matrix4f K = Eigen::Matrix4f::Identity();
+  K(0, 0) = K(1, 1) = 525.f;
+  K(0, 2) = 319.5f;
+  K(1, 2) = 239.5f;
+  const Eigen::Vector2i frame_size(640, 480);
+
+  auto update = [](auto& handler, const Eigen::Vector3i&, 
+      const Eigen::Vector3f& pos, const Eigen::Vector2f&) {
+    handler.set(0.9f * handler.get() + 0.1f * pos(2));
+  };
+
+  se::bench::PerfCounter dtlb(se::bench::PerfCounter::DTLB_READ_MISSES);
+  if(!dtlb.valid()) {
+    std::printf("perf counters unavailable, reporting timings only\n");
+  }
+#ifdef SE_HUGE_PAGES
+  std::printf("block pages: transparent huge pages\n");
+#else
+  std::printf("block pages: heap\n");
+#endif
+  std::printf("blocks: %d, block size: %d bytes\n", map.leavesCount(), 
+      se::VoxelBlock<float>::size());
+  std::printf("%-6s %10s %18s\n", "frame", "time [ms]", "dTLB read misses");
+
+  double total = 0.0;
+  uint64_t total_misses = 0;
+  for(int f = 0; f < num_frames; ++f) {
+    const Sophus::SE3f Tcw = camera_pose(f);
+    dtlb.start();
+    const auto begin = std::chrono::steady_clock::now();
+    se::functor::projective_map(map, Tcw, K, frame_size, update);
+    const auto end = std::chrono::steady_clock::now();
+    dtlb.stop();
+    const double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+    total += ms;
+    total_misses += dtlb.value();
+    std::printf("%-6d %10.2f %18llu\n", f, ms, (unsigned long long) dtlb.value());
+  }
+  std::printf("%-6s %10.2f %18llu\n", "mean", total / num_frames, 
+      (unsigned long long) (total_misses / num_frames));
+
+  // Blocks are placed by the threads of allocate, compare with the threads 
+  // of one more integration
+  const auto& blocks = map.getBlockBuffer();
+  std::vector<int> integrated(blocks.size(), -1);
+  se::functor::projective_map(map, camera_pose(num_frames), K, frame_size, 
+      node_recorder{&map, integrated.data()});
+  std::vector<void *> addresses;
+  for(unsigned int i = 0; i < blocks.size(); ++i) addresses.push_back(blocks[i]);
+  const std::vector<int> placed = page_nodes(addresses);
+  int local = 0, known = 0;
+  for(unsigned int i = 0; i < blocks.size(); ++i) {
+    if(integrated[i] < 0 || placed[i] < 0) continue;
+    ++known;
+    local += integrated[i] == placed[i];
+  }
+  std::printf("blocks on the node of their integrating thread: %d of %d\n", 
+      local, known);
+  return 0;
+}
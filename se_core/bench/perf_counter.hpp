@@ -0,0 +1,125 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef PERF_COUNTER_HPP
+#define PERF_COUNTER_HPP
+
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace se {
+namespace bench {
+
+/*! \brief Thin wrapper around a single Linux perf_event hardware counter. 
+ * When the counter cannot be opened (non-Linux, containers, restrictive 
+ * perf_event_paranoid) valid() is false and value() returns zero, so that 
+ * benchmarks still report timings.
+ */
+class PerfCounter {
+  public:
+    enum Event {
+      L1D_READ_MISSES,  /* L1 data cache read misses */
+      LLC_MISSES,       /* last level cache misses */
+      DTLB_READ_MISSES  /* data TLB read misses */
+    };
+
+    PerfCounter(const Event event) : fd_(-1) {
+#ifdef __linux__
+      struct perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      if(event == L1D_READ_MISSES) {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | 
+          (PERF_COUNT_HW_CACHE_OP_READ << 8) | 
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      } else if(event == DTLB_READ_MISSES) {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | 
+          (PERF_COUNT_HW_CACHE_OP_READ << 8) | 
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      } else {
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      }
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+      (void) event;
+#endif
+    }
+
+    ~PerfCounter() {
+#ifdef __linux__
+      if(fd_ >= 0) close(fd_);
+#endif
+    }
+
+    bool valid() const { return fd_ >= 0; }
+
+    void start() {
+#ifdef __linux__
+      if(!valid()) return;
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+      if(!valid()) return;
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    uint64_t value() const {
+      uint64_t count = 0;
+#ifdef __linux__
+      if(valid() && read(fd_, &count, sizeof(count)) != sizeof(count)) 
+        count = 0;
+#endif
+      return count;
+    }
+
+  private:
+    PerfCounter(const PerfCounter&) = delete;
+    long fd_;
+};
+}
+}
+#endif
@@ -0,0 +1,228 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "octree.hpp"
+#include "functors/projective_functor.hpp"
+#include <se/volume_traits.hpp>
+#include "kfusion/mapping_impl.hpp"
+#include "bfusion/mapping_impl.hpp"
+
+/*
+ * Accuracy against memory of the quantized voxel types. Noisy depth frames 
+ * of a slanted plane are integrated into SDF/SDF16 and OFusion/OFusion16 
+ * maps with the same allocation, then the decoded fields and the surface 
+ * crossings along the camera rays are compared to the floating point maps.
+ */
+
+static const int volume_size = 256;
+static const float volume_dim = 2.56f;
+static const int num_frames = 10;
+static const float mu = 0.1f;
+static const Eigen::Vector2i frame_size(160, 120);
+static const float focal = 120.f;
+
+struct Scene {
+  Eigen::Matrix4f K;
+  Sophus::SE3f Tcw;
+  std::vector<std::vector<float> > frames;
+};
+
+/*
+ * Depth of the plane z = 1.5 + 0.2 x in camera coordinates.
+ */
+static float plane_depth(const int u, const int v) {
+  const float xn = (u - frame_size(0) / 2) / focal;
+  (void) v;
+  return 1.5f / (1.f - 0.2f * xn);
+}
+
+static Scene make_scene() {
+  Scene scene;
+  scene.K = Eigen::Matrix4f::Identity();
+  scene.K(0, 0) = scene.K(1, 1) = focal;
+  scene.K(0, 2) = frame_size(0) / 2;
+  scene.K(1, 2) = frame_size(1) / 2;
+  Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+  pose.topRightCorner<3, 1>() = Eigen::Vector3f(volume_dim / 2, volume_dim / 2, 0.f);
+  scene.Tcw = Sophus::SE3f(pose).inverse();
+
+  std::mt19937 gen(42);
+  std::normal_distribution<float> noise(0.f, 0.003f);
+  for(int f = 0; f < num_frames; ++f) {
+    std::vector<float> depth(frame_size.prod());
+    for(int v = 0; v < frame_size(1); ++v)
+      for(int u = 0; u < frame_size(0); ++u)
+        depth[u + v * frame_size(0)] = plane_depth(u, v) + noise(gen);
+    scene.frames.push_back(depth);
+  }
+  return scene;
+}
+
+/*
+ * World position in voxels of the point at depth d along pixel (u, v).
+ */
+static Eigen::Vector3f ray_point(const Scene& scene, const int u, const int v, 
+    const float d) {
+  const Eigen::Vector3f p((u - scene.K(0, 2)) / focal * d, 
+      (v - scene.K(1, 2)) / focal * d, d);
+  return (scene.Tcw.inverse() * p) * (volume_size / volume_dim);
+}
+
+template <typename T>
+void allocate_band(se::Octree<T>& map, const Scene& scene) {
+  map.init(volume_size, volume_dim);
+  std::vector<se::key_t> keys;
+  const float voxel = volume_dim / volume_size;
+  for(int v = 0; v < frame_size(1); ++v)
+    for(int u = 0; u < frame_size(0); ++u) {
+      const float d = plane_depth(u, v);
+      for(float t = d - 3 * mu; t < d + mu; t += voxel) {
+        const Eigen::Vector3i p = ray_point(scene, u, v, t).cast<int>();
+        keys.push_back(map.hash(p(0), p(1), p(2)));
+      }
+    }
+  map.allocate(keys.data(), keys.size());
+}
+
+template <typename T>
+double integrate(se::Octree<T>& map, const Scene& scene, const bool occupancy) {
+  const float voxel = volume_dim / volume_size;
+  double ms = 0.0;
+  for(int f = 0; f < num_frames; ++f) {
+    const auto begin = std::chrono::steady_clock::now();
+    if(occupancy) {
+      bfusion_update<> funct(scene.frames[f].data(), frame_size, mu, 
+          f / 30.f, voxel);
+      se::functor::projective_map(map, scene.Tcw, scene.K, frame_size, funct);
+    } else {
+      sdf_update<> funct(scene.frames[f].data(), frame_size, mu, 100);
+      se::functor::projective_map(map, scene.Tcw, scene.K, frame_size, funct);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    ms += std::chrono::duration<double, std::milli>(end - begin).count();
+  }
+  return ms / num_frames;
+}
+
+/*
+ * Depth of the first crossing of the surface along pixel (u, v), 0 if none.
+ */
+template <typename T>
+float surface_depth(const se::Octree<T>& map, const Scene& scene, const int u,
+    const int v, const bool occupancy) {
+  auto select = [](const auto& val) { return decode_voxel(val).x; };
+  const float d = plane_depth(u, v);
+  const float step = 0.25f * volume_dim / volume_size;
+  float t = d - mu / 2;
+  float f_t = map.interp(ray_point(scene, u, v, t), select);
+  for(; t < d + mu / 2; t += step) {
+    const float f_tt = map.interp(ray_point(scene, u, v, t + step), select);
+    const bool hit = occupancy ? (f_t <= SURF_BOUNDARY && f_tt > SURF_BOUNDARY) :
+      (f_t > 0.f && f_tt < 0.f);
+    if(hit) return t + step * (f_t - SURF_BOUNDARY) / (f_t - f_tt);
+    f_t = f_tt;
+  }
+  return 0.f;
+}
+
+template <typename FloatT, typename QuantT>
+void compare(const char * name, const Scene& scene, const bool occupancy) {
+  se::Octree<FloatT> reference;
+  se::Octree<QuantT> quantized;
+  allocate_band(reference, scene);
+  allocate_band(quantized, scene);
+  const double ref_ms = integrate(reference, scene, occupancy);
+  const double quant_ms = integrate(quantized, scene, occupancy);
+
+  // Decoded field error over the observed voxels
+  std::vector<se::VoxelBlock<FloatT>*> blocks;
+  reference.getBlockList(blocks, false);
+  const int side = se::VoxelBlock<FloatT>::side;
+  double sq_err = 0.0, max_err = 0.0;
+  long observed = 0;
+  for(auto block : blocks) {
+    const Eigen::Vector3i base = block->coordinates();
+    const se::VoxelBlock<QuantT> * other = 
+      quantized.fetch(base(0), base(1), base(2));
+    for(int i = 0; i < side * side * side; ++i) {
+      const Eigen::Vector3i pos = base + 
+        Eigen::Vector3i(i % side, (i / side) % side, i / (side * side));
+      const auto ref = block->data(pos);
+      if(ref.y == 0.f) continue;
+      const double err = std::fabs(ref.x - decode_voxel(other->data(pos)).x);
+      sq_err += err * err;
+      max_err = std::max(max_err, err);
+      ++observed;
+    }
+  }
+
+  // Surface crossings along the camera rays
+  double surf_err = 0.0, surf_max = 0.0, truth_ref = 0.0, truth_quant = 0.0;
+  int crossings = 0;
+  for(int v = 2; v < frame_size(1) - 2; v += 2)
+    for(int u = 2; u < frame_size(0) - 2; u += 2) {
+      const float d_ref = surface_depth(reference, scene, u, v, occupancy);
+      const float d_quant = surface_depth(quantized, scene, u, v, occupancy);
+      if(d_ref == 0.f || d_quant == 0.f) continue;
+      const double err = std::fabs(d_ref - d_quant);
+      surf_err += err;
+      surf_max = std::max(surf_max, err);
+      truth_ref += std::fabs(d_ref - plane_depth(u, v));
+      truth_quant += std::fabs(d_quant - plane_depth(u, v));
+      ++crossings;
+    }
+
+  const int n = reference.leavesCount();
+  std::printf("%s: %d blocks, %ld observed voxels\n", name, n, observed);
+  std::printf("  %-10s %6d B/voxel %10.2f MB %10.2f ms/frame %12.3f mm to truth\n", 
+      "float", (int) sizeof(typename voxel_traits<FloatT>::value_type),
+      n * sizeof(se::VoxelBlock<FloatT>) / 1e6, ref_ms, 
+      1e3 * truth_ref / crossings);
+  std::printf("  %-10s %6d B/voxel %10.2f MB %10.2f ms/frame %12.3f mm to truth\n", 
+      "quantized", (int) sizeof(typename voxel_traits<QuantT>::value_type),
+      n * sizeof(se::VoxelBlock<QuantT>) / 1e6, quant_ms,
+      1e3 * truth_quant / crossings);
+  std::printf("  field error: rms %g, max %g\n", std::sqrt(sq_err / observed), 
+      max_err);
+  std::printf("  surface error over %d rays: mean %.4f mm, max %.4f mm\n", 
+      crossings, 1e3 * surf_err / crossings, 1e3 * surf_max);
+}
+
+int main() {
+  const Scene scene = make_scene();
+  compare<SDF, SDF16>("TSDF", scene, false);
+  compare<OFusion, OFusion16>("Occupancy", scene, true);
+  return 0;
+}
@@ -39,8 +39,8 @@ inline float3 voxelToPos(const int3 p, const float voxelSize){
 
 namespace algorithms {
 
-  template <typename T>
-    void integratePass(se::VoxelBlock<T> ** blockList, unsigned int list_size, 
+  template <typename T, unsigned int BlockSide>
+    void integratePass(se::VoxelBlock<T, BlockSide> ** blockList, unsigned int list_size, 
         const float * depth, uint2 depthSize, const float voxelSize, 
         const Matrix4 invTrack, const Matrix4 K, const float mu, 
         const float maxweight, const int current_frame) {
@@ -31,6 +31,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef MESHING_HPP
 #define MESHING_HPP
+#include <mutex>
 #include "../octree.hpp"
 #include "edge_tables.h"
 
@@ -86,21 +87,26 @@ namespace meshing {
       return Eigen::Vector3f::Constant(0);
     }
 
-  template <typename FieldType, typename PointT>
-    inline void gather_points( const se::VoxelBlock<FieldType>* cached, PointT points[8], 
+  template <typename FieldType, unsigned int BlockSide, typename PointT>
+    inline void gather_points( const se::VoxelBlock<FieldType, BlockSide>* cached, PointT points[8], 
         const int x, const int y, const int z) {
-      points[0] = cached->data(Eigen::Vector3i(x, y, z)); 
-      points[1] = cached->data(Eigen::Vector3i(x+1, y, z));
-      points[2] = cached->data(Eigen::Vector3i(x+1, y, z+1));
-      points[3] = cached->data(Eigen::Vector3i(x, y, z+1));
-      points[4] = cached->data(Eigen::Vector3i(x, y+1, z));
-      points[5] = cached->data(Eigen::Vector3i(x+1, y+1, z));
-      points[6] = cached->data(Eigen::Vector3i(x+1, y+1, z+1));
-      points[7] = cached->data(Eigen::Vector3i(x, y+1, z+1));
+      // Marching cubes corner order differs from the gather order.
+      typename se::VoxelBlock<FieldType, BlockSide>::value_type values[8];
+      cached->gather(Eigen::Vector3i(x, y, z), values);
+      points[0] = values[0];
+      points[1] = values[1];
+      points[2] = values[5];
+      points[3] = values[4];
+      points[4] = values[2];
+      points[5] = values[3];
+      points[6] = values[7];
+      points[7] = values[6];
     }
 
-  template <typename FieldType, template <typename FieldT> class MapT, typename PointT>
-  inline void gather_points(const MapT<FieldType>& volume, PointT points[8], 
+  template <typename FieldType, unsigned int BlockSide, 
+           template <typename FieldT, unsigned int BlockSideT> class MapT, 
+           typename PointT>
+  inline void gather_points(const MapT<FieldType, BlockSide>& volume, PointT points[8], 
                  const int x, const int y, const int z) {
                points[0] = volume.get_fine(x, y, z); 
                points[1] = volume.get_fine(x+1, y, z);
@@ -112,17 +118,18 @@ namespace meshing {
                points[7] = volume.get_fine(x, y+1, z+1);
              }
 
-  template <typename FieldType, template <typename FieldT> class MapT,
+  template <typename FieldType, unsigned int BlockSide, 
+  template <typename FieldT, unsigned int BlockSideT> class MapT,
   typename InsidePredicate>
-  uint8_t compute_index(const MapT<FieldType>& volume, 
-  const se::VoxelBlock<FieldType>* cached, InsidePredicate inside,
+  uint8_t compute_index(const MapT<FieldType, BlockSide>& volume, 
+  const se::VoxelBlock<FieldType, BlockSide>* cached, InsidePredicate inside,
   const unsigned x, const unsigned y, const unsigned z){
-    unsigned int blockSize =  se::VoxelBlock<FieldType>::side;
+    unsigned int blockSize =  BlockSide;
     unsigned int local = ((x % blockSize == blockSize - 1) << 2) | 
       ((y % blockSize == blockSize - 1) << 1) |
       ((z % blockSize) == blockSize - 1);
 
-    typename MapT<FieldType>::value_type points[8];
+    typename MapT<FieldType, BlockSide>::value_type points[8];
     if(!local) gather_points(cached, points, x, y, z);
     else gather_points(volume, points, x, y, z);
 
@@ -156,15 +163,17 @@ namespace meshing {
 
 }
 namespace algorithms {
-  template <typename FieldType, typename FieldSelector, 
-            typename InsidePredicate, typename TriangleType>
-    void marching_cube(Octree<FieldType>& volume, FieldSelector select, 
+  template <typename FieldType, unsigned int BlockSide, 
+            template <typename FieldT, unsigned int BlockSideT> class MapT,
+            typename FieldSelector, typename InsidePredicate, 
+            typename TriangleType>
+    void marching_cube(MapT<FieldType, BlockSide>& volume, FieldSelector select, 
         InsidePredicate inside, std::vector<TriangleType>& triangles)
     {
 
       using namespace meshing;
       std::stringstream points, polygons;
-      std::vector<se::VoxelBlock<FieldType>*> blocklist;
+      std::vector<se::VoxelBlock<FieldType, BlockSide>*> blocklist;
       std::mutex lck;
       const int size = volume.size();
       const int dim = volume.dim();
@@ -174,24 +183,25 @@ namespace algorithms {
 
 #pragma omp parallel for
       for(size_t i = 0; i < blocklist.size(); i++){
-        se::VoxelBlock<FieldType> * leaf = static_cast<se::VoxelBlock<FieldType> *>(blocklist[i]);  
-        int edge = se::VoxelBlock<FieldType>::side;
+        se::VoxelBlock<FieldType, BlockSide> * leaf = static_cast<se::VoxelBlock<FieldType, BlockSide> *>(blocklist[i]);  
+        int edge = se::VoxelBlock<FieldType, BlockSide>::side;
         int x, y, z ; 
         const Eigen::Vector3i& start = leaf->coordinates();
         const Eigen::Vector3i top = 
           (leaf->coordinates() + Eigen::Vector3i::Constant(edge)).cwiseMin(
               Eigen::Vector3i::Constant(size-1));
+        const typename MapT<FieldType, BlockSide>::cursor_type cursor(volume);
         for(x = start(0); x < top(0); x++){
           for(y = start(1); y < top(1); y++){
             for(z = start(2); z < top(2); z++){
 
-              uint8_t index = meshing::compute_index(volume, leaf, inside, x, y, z);
+              uint8_t index = meshing::compute_index(cursor, leaf, inside, x, y, z);
 
                 int * edges = triTable[index]; 
               for(unsigned int e = 0; edges[e] != -1 && e < 16; e += 3){
-                Eigen::Vector3f v1 = interp_vertexes(volume, select, x, y, z, edges[e]);
-                Eigen::Vector3f v2 = interp_vertexes(volume, select, x, y, z, edges[e+1]);
-                Eigen::Vector3f v3 = interp_vertexes(volume, select, x, y, z, edges[e+2]);
+                Eigen::Vector3f v1 = interp_vertexes(cursor, select, x, y, z, edges[e]);
+                Eigen::Vector3f v2 = interp_vertexes(cursor, select, x, y, z, edges[e+1]);
+                Eigen::Vector3f v3 = interp_vertexes(cursor, select, x, y, z, edges[e+2]);
                 if(checkVertex(v1, dim) || checkVertex(v2, dim) || checkVertex(v3, dim)) continue;
                 Triangle temp = Triangle();
                 temp.vertexes[0] = v1;
@@ -0,0 +1,234 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "../octree_defines.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Data parallel primitives. Inputs are split in contiguous chunks, one per
+ * thread, which are processed in two passes: a first pass counts, an 
+ * exclusive scan over the chunks' counts yields where each chunk writes and
+ * a second pass writes. Chunks depend on the number of threads available 
+ * only, never on the schedule, hence results are deterministic and the 
+ * relative order of the elements is preserved.
+ */
+namespace se {
+namespace algorithms {
+  namespace detail {
+    /*
+     * Below grain elements per chunk threads cost more than they save, the
+     * default suits loops doing a few operations per element.
+     */
+    inline int num_chunks(const size_t n, const size_t grain = 4096) {
+#ifdef _OPENMP
+      const size_t threads = omp_get_max_threads();
+#else
+      const size_t threads = 1;
+#endif
+      return std::max<size_t>(1, std::min(threads, n / grain));
+    }
+
+    inline size_t chunk_begin(const int chunk, const int num_chunks, 
+        const size_t n) {
+      return n * chunk / num_chunks;
+    }
+  }
+
+  /*! \brief Invoke f(begin, end) on contiguous chunks covering [0, n), in 
+   * parallel, with at least grain elements per chunk.
+   */
+  template <typename RangeF>
+    void for_each_chunk(const size_t n, const size_t grain, RangeF f) {
+      const int chunks = detail::num_chunks(n, grain);
+#pragma omp parallel for
+      for(int c = 0; c < chunks; ++c) {
+        f(detail::chunk_begin(c, chunks, n), 
+            detail::chunk_begin(c + 1, chunks, n));
+      }
+    }
+
+  /*! \brief Count in bins[b] the indices i in [0, n) for which bin(i) == b.
+   * bins must hold num_bins entries, which are overwritten.
+   */
+  template <typename BinF>
+    void histogram(const size_t n, const int num_bins, BinF bin, 
+        size_t * bins) {
+      const int chunks = detail::num_chunks(n);
+      std::vector<size_t> local(chunks * num_bins, 0);
+#pragma omp parallel for
+      for(int c = 0; c < chunks; ++c) {
+        size_t * h = local.data() + c * num_bins;
+        const size_t end = detail::chunk_begin(c + 1, chunks, n);
+        for(size_t i = detail::chunk_begin(c, chunks, n); i < end; ++i) {
+          ++h[bin(i)];
+        }
+      }
+      std::fill(bins, bins + num_bins, 0);
+      for(int c = 0; c < chunks; ++c) {
+        for(int b = 0; b < num_bins; ++b) bins[b] += local[c * num_bins + b];
+      }
+    }
+
+  /*! \brief Write value(i), in order, for every i in [0, n) satisfying 
+   * keep(i). The output is obtained from out(count), called once with the 
+   * number of elements kept before any is written. 
+   * \return number of elements written
+   */
+  template <typename KeepF, typename ValueF, typename OutF>
+    size_t compact(const size_t n, KeepF keep, ValueF value, OutF out) {
+      const int chunks = detail::num_chunks(n);
+      std::vector<size_t> offset(chunks + 1, 0);
+#pragma omp parallel for
+      for(int c = 0; c < chunks; ++c) {
+        size_t count = 0;
+        const size_t end = detail::chunk_begin(c + 1, chunks, n);
+        for(size_t i = detail::chunk_begin(c, chunks, n); i < end; ++i) {
+          count += keep(i) ? 1 : 0;
+        }
+        offset[c + 1] = count;
+      }
+      for(int c = 0; c < chunks; ++c) offset[c + 1] += offset[c];
+
+      auto * dst = out(offset[chunks]);
+#pragma omp parallel for
+      for(int c = 0; c < chunks; ++c) {
+        size_t o = offset[c];
+        const size_t end = detail::chunk_begin(c + 1, chunks, n);
+        for(size_t i = detail::chunk_begin(c, chunks, n); i < end; ++i) {
+          if(keep(i)) dst[o++] = value(i);
+        }
+      }
+      return offset[chunks];
+    }
+
+  /*! \brief Copy to out, which must hold n elements, the elements of in for 
+   * which keep(i) holds. in and out must not overlap.
+   * \return number of elements written
+   */
+  template <typename T, typename KeepF>
+    size_t compact(const T * in, const size_t n, T * out, KeepF keep) {
+      return compact(n, keep, [in](const size_t i) { return in[i]; }, 
+          [out](size_t) { return out; });
+    }
+
+  /*! \brief Copy to out the elements of in for which keep(i) holds, out is
+   * resized accordingly.
+   */
+  template <typename T, typename KeepF>
+    void compact(const T * in, const size_t n, std::vector<T>& out, 
+        KeepF keep) {
+      compact(n, keep, [in](const size_t i) { return in[i]; }, 
+          [&out](size_t count) { out.resize(count); return out.data(); });
+    }
+
+  /*! \brief Parallel counterpart of std::unique_copy on a sorted range. in 
+   * and out must not overlap.
+   * \return number of elements written
+   */
+  template <typename T>
+    size_t unique_copy(const T * in, const size_t n, T * out) {
+      return compact(in, n, out, 
+          [in](const size_t i) { return i == 0 || in[i] != in[i - 1]; });
+    }
+
+  /*! \brief Sort keys in ascending order with a least significant digit 
+   * radix sort, one pass per byte. Bytes equal across all keys, such as the
+   * unused high bits of morton codes, are skipped. buffer must hold n keys
+   * and is clobbered. The sort is stable.
+   */
+  inline void radix_sort(se::key_t * keys, const size_t n, 
+      se::key_t * buffer) {
+    if(n < 2) return;
+    se::key_t any = 0;
+    se::key_t all = ~se::key_t(0);
+#pragma omp parallel for reduction(|:any) reduction(&:all)
+    for(size_t i = 0; i < n; ++i) {
+      any |= keys[i];
+      all &= keys[i];
+    }
+    const se::key_t varying = any ^ all;
+
+    const int radix = 256;
+    const int chunks = detail::num_chunks(n);
+    std::vector<size_t> offset(chunks * radix);
+    se::key_t * src = keys;
+    se::key_t * dst = buffer;
+    for(int shift = 0; shift < 64; shift += 8) {
+      if(((varying >> shift) & 0xFF) == 0) continue;
+
+      std::fill(offset.begin(), offset.end(), 0);
+#pragma omp parallel for
+      for(int c = 0; c < chunks; ++c) {
+        size_t * h = offset.data() + c * radix;
+        const size_t end = detail::chunk_begin(c + 1, chunks, n);
+        for(size_t i = detail::chunk_begin(c, chunks, n); i < end; ++i) {
+          ++h[(src[i] >> shift) & 0xFF];
+        }
+      }
+
+      // Digit major, chunk minor: equal digits keep the order of the chunks
+      size_t sum = 0;
+      for(int d = 0; d < radix; ++d) {
+        for(int c = 0; c < chunks; ++c) {
+          const size_t count = offset[c * radix + d];
+          offset[c * radix + d] = sum;
+          sum += count;
+        }
+      }
+
+#pragma omp parallel for
+      for(int c = 0; c < chunks; ++c) {
+        size_t * o = offset.data() + c * radix;
+        const size_t end = detail::chunk_begin(c + 1, chunks, n);
+        for(size_t i = detail::chunk_begin(c, chunks, n); i < end; ++i) {
+          dst[o[(src[i] >> shift) & 0xFF]++] = src[i];
+        }
+      }
+      std::swap(src, dst);
+    }
+    if(src != keys) std::memcpy(keys, src, sizeof(se::key_t) * n);
+  }
+
+  /*! \brief Same as above, with a scratch buffer allocated internally.
+   */
+  inline void radix_sort(se::key_t * keys, const size_t n) {
+    std::vector<se::key_t> buffer(n);
+    radix_sort(keys, n, buffer.data());
+  }
+}
+}
+#endif
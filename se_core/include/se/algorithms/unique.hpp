@@ -30,6 +30,7 @@
 #ifndef UNIQUE_HPP
 #define UNIQUE_HPP
 #include <se/octant_ops.hpp>
+#include "parallel.hpp"
 
 namespace se {
 namespace algorithms {
@@ -60,6 +61,17 @@ namespace algorithms {
       return e + 1;
     }
 
+  /*! \brief Parallel, out of place filter_ancestors: a key of the sorted 
+   * range in is dropped when the next key is its descendant. 
+   * \return number of keys written to out
+   */
+  inline size_t filter_ancestors(const se::key_t* in, const size_t num_keys,
+      se::key_t* out, const int max_depth) {
+    return compact(in, num_keys, out, [in, num_keys, max_depth](size_t i) { 
+        return i + 1 == num_keys || !descendant(in[i + 1], in[i], max_depth);
+      });
+  }
+
   template <typename KeyT>
     inline int unique_multiscale(KeyT* keys, int num_keys,
         const KeyT , const unsigned current_level){
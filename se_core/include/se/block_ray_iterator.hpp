@@ -0,0 +1,175 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+#ifndef SE_BLOCK_RAY_ITERATOR_HPP
+#define SE_BLOCK_RAY_ITERATOR_HPP
+#include <cmath>
+#include "node.hpp"
+#include "Eigen/Dense"
+
+/*****************************************************************************
+ *
+ *
+ * Ray iterator over the voxel blocks of a map without child pointers
+ *
+ * Walks the regular grid of voxel blocks with a 3D-DDA, see:
+ * J. Amanatides and A. Woo, A Fast Voxel Traversal Algorithm for Ray Tracing.
+ * It exposes the same interface as se::ray_iterator. MapT may be any map 
+ * with a cheap fetch of the block containing a voxel, e.g. se::LinearOctree.
+ * 
+*****************************************************************************/
+
+namespace se {
+template <typename T, unsigned int BlockSide, typename MapT>
+class block_ray_iterator;
+}
+
+template <typename T, unsigned int BlockSide, typename MapT>
+class se::block_ray_iterator {
+
+  public:
+    block_ray_iterator(const MapT& m, const Eigen::Vector3f& origin, 
+        const Eigen::Vector3f& direction, float nearPlane, float farPlane) : map_(m) {
+
+      const float epsilon = exp2f(-log2(map_.size()));
+      for(int i = 0; i < 3; ++i) {
+        direction_(i) = fabsf(direction(i)) < epsilon ? 
+          copysignf(epsilon, direction(i)) : direction(i);
+      }
+      origin_ = origin;
+      block_dim_ = map_.dim() * BlockSide / map_.size();
+      num_blocks_ = map_.size() / BlockSide;
+
+      /* Clip the ray against the volume cube [0, dim]^3 */
+      const Eigen::Vector3f inv_dir = direction_.cwiseInverse();
+      const Eigen::Vector3f t_lower = -origin_.cwiseProduct(inv_dir);
+      const Eigen::Vector3f t_upper = (Eigen::Vector3f::Constant(map_.dim()) - 
+          origin_).cwiseProduct(inv_dir);
+      t_min_init_ = fmaxf(t_lower.cwiseMin(t_upper).maxCoeff(), nearPlane);
+      t_max_init_ = fminf(t_lower.cwiseMax(t_upper).minCoeff(), farPlane);
+      t_min_ = t_min_init_;
+      state_ = t_min_init_ <= t_max_init_ ? INIT : FINISHED;
+
+      /* Initialise the DDA at the block containing the entry point */
+      const Eigen::Vector3f entry = origin_ + t_min_init_ * direction_;
+      for(int i = 0; i < 3; ++i) {
+        block_(i) = std::min(std::max(static_cast<int>(
+                std::floor(entry(i) / block_dim_)), 0), num_blocks_ - 1);
+        step_(i) = direction_(i) > 0.f ? 1 : -1;
+        t_delta_(i) = block_dim_ * fabsf(inv_dir(i));
+        const float boundary = (block_(i) + (step_(i) > 0)) * block_dim_;
+        t_next_(i) = (boundary - origin_(i)) * inv_dir(i);
+      }
+    };
+
+    /*
+     * Returns the next allocated block along the ray direction.
+     */
+    VoxelBlock<T, BlockSide>* next() {
+
+      if(state_ == ADVANCE) advance_ray();
+      else if (state_ == FINISHED) return nullptr;
+
+      while(t_min_ <= t_max_init_ && inside()) {
+        VoxelBlock<T, BlockSide> * block = map_.fetch(block_(0) * BlockSide, 
+            block_(1) * BlockSide, block_(2) * BlockSide);
+        if(block) {
+          state_ = ADVANCE;
+          return block;
+        }
+        advance_ray();
+      }
+      state_ = FINISHED;
+      return nullptr;
+    }
+
+    /*
+     * \brief Returns the minimum distance in meters to be travelled along
+     * the ray to intersect the voxel cube.
+     */
+    float tmin() { return t_min_init_; }
+
+    /*
+     * \brief Returns the minimum distance in meters to be travelled along
+     * the ray to exit the voxel cube.
+     */
+    float tmax() { return t_max_init_; }
+
+    /*
+     * \brief Returns the minimum distance in meters to be travelled along
+     * the ray to reach the currently intersected block.
+     */
+    float tcmin() { return t_min_; }
+
+    /*
+     * \brief Returns the minimum distance in meters to be travelled along
+     * the ray to exit the currently intersected block.
+     */
+    float tcmax() { return t_next_.minCoeff(); }
+
+  private:
+    typedef enum STATE {
+      INIT,
+      ADVANCE,
+      FINISHED
+    } STATE;
+
+    inline bool inside() const {
+      return (block_.array() >= 0).all() && (block_.array() < num_blocks_).all();
+    }
+
+    /* 
+     * Step into the neighbouring block across the closest boundary.
+     */
+    inline void advance_ray() {
+      int axis = 0;
+      if(t_next_(1) < t_next_(axis)) axis = 1;
+      if(t_next_(2) < t_next_(axis)) axis = 2;
+      t_min_ = t_next_(axis);
+      block_(axis) += step_(axis);
+      t_next_(axis) += t_delta_(axis);
+    }
+
+    const MapT& map_;
+    Eigen::Vector3f origin_;
+    Eigen::Vector3f direction_;
+    float block_dim_;
+    int num_blocks_;
+    Eigen::Vector3i block_;
+    Eigen::Vector3i step_;
+    Eigen::Vector3f t_delta_;
+    Eigen::Vector3f t_next_;
+    float t_min_;
+    float t_min_init_;
+    float t_max_init_;
+    STATE state_;
+};
+#endif
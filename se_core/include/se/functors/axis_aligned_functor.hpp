@@ -41,23 +41,24 @@
 namespace se {
   namespace functor {
 
-    template <typename FieldType, template <typename FieldT> class MapT, 
+    template <typename FieldType, unsigned int BlockSide,
+              template <typename FieldT, unsigned int BlockSideT> class MapT, 
               typename UpdateF>
 
       class axis_aligned {
         public:
-        axis_aligned(MapT<FieldType>& map, UpdateF f) : _map(map), _function(f),
+        axis_aligned(MapT<FieldType, BlockSide>& map, UpdateF f) : _map(map), _function(f),
         _min(Eigen::Vector3i::Constant(0)), 
         _max(Eigen::Vector3i::Constant(map.size())){ }
 
-        axis_aligned(MapT<FieldType>& map, UpdateF f, const Eigen::Vector3i min,
+        axis_aligned(MapT<FieldType, BlockSide>& map, UpdateF f, const Eigen::Vector3i min,
             const Eigen::Vector3i max) : _map(map), _function(f),
         _min(min), _max(max){ }
 
-        void update_block(se::VoxelBlock<FieldType> * block) {
+        void update_block(se::VoxelBlock<FieldType, BlockSide> * block) {
           Eigen::Vector3i blockCoord = block->coordinates();
           unsigned int y, z, x; 
-          Eigen::Vector3i blockSide = Eigen::Vector3i::Constant(se::VoxelBlock<FieldType>::side);
+          Eigen::Vector3i blockSide = Eigen::Vector3i::Constant(se::VoxelBlock<FieldType, BlockSide>::side);
           Eigen::Vector3i start = blockCoord.cwiseMax(_min);
           Eigen::Vector3i last = (blockCoord + blockSide).cwiseMin(_max);
 
@@ -65,14 +66,15 @@ namespace se {
             for (y = start(1); y < last(1); ++y) {
               for (x = start(0); x < last(0); ++x) {
                 Eigen::Vector3i vox = Eigen::Vector3i(x, y, z);
-                VoxelBlockHandler<FieldType> handler = {block, vox};
+                VoxelBlockHandler<FieldType, BlockSide> handler = {block, vox};
                 _function(handler, vox);
               }
             }
           }
         }
 
-        void update_node(se::Node<FieldType> * node) { 
+        template <typename NodeT>
+        void update_node(NodeT * node) { 
           Eigen::Vector3i voxel = Eigen::Vector3i(unpack_morton(node->code_));
 #pragma omp simd
           for(int i = 0; i < 8; ++i) {
@@ -81,7 +83,7 @@ namespace se {
             if(!(se::math::in(voxel(0), _min(0), _max(0)) && 
                  se::math::in(voxel(1), _min(1), _max(1)) && 
                  se::math::in(voxel(2), _min(2), _max(2)))) continue;
-            NodeHandler<FieldType> handler = {node, i};
+            NodeHandler<FieldType, NodeT> handler = {node, i};
             _function(handler, voxel);
           }
         }
@@ -92,19 +94,19 @@ namespace se {
           size_t list_size = block_list.size();
 #pragma omp parallel for
           for(unsigned int i = 0; i < list_size; ++i){
-            update_block(block_list[i]);
+            if(block_list.used(i)) update_block(block_list[i]);
           }
 
           auto& nodes_list = _map.getNodesBuffer();
           list_size = nodes_list.size();
 #pragma omp parallel for
           for(unsigned int i = 0; i < list_size; ++i){
-            update_node(nodes_list[i]);
+            if(nodes_list.used(i)) update_node(nodes_list[i]);
           }
         }
 
       private:
-        MapT<FieldType>& _map; 
+        MapT<FieldType, BlockSide>& _map; 
         UpdateF _function; 
         Eigen::Vector3i _min;
         Eigen::Vector3i _max;
@@ -115,18 +117,20 @@ namespace se {
      * \param map Octree on which the function is going to be applied.
      * \param funct Update function to be applied.
      */
-    template <typename FieldType, template <typename FieldT> class MapT, 
+    template <typename FieldType, unsigned int BlockSide,
+              template <typename FieldT, unsigned int BlockSideT> class MapT, 
               typename UpdateF>
-    void axis_aligned_map(MapT<FieldType>& map, UpdateF funct) {
-    axis_aligned<FieldType, MapT, UpdateF> aa_functor(map, funct);
+    void axis_aligned_map(MapT<FieldType, BlockSide>& map, UpdateF funct) {
+    axis_aligned<FieldType, BlockSide, MapT, UpdateF> aa_functor(map, funct);
     aa_functor.apply();
     }
 
-    template <typename FieldType, template <typename FieldT> class MapT, 
+    template <typename FieldType, unsigned int BlockSide,
+              template <typename FieldT, unsigned int BlockSideT> class MapT, 
               typename UpdateF>
-    void axis_aligned_map(MapT<FieldType>& map, UpdateF funct,
+    void axis_aligned_map(MapT<FieldType, BlockSide>& map, UpdateF funct,
         const Eigen::Vector3i& min, const Eigen::Vector3i& max) {
-    axis_aligned<FieldType, MapT, UpdateF> aa_functor(map, funct, min,  max);
+    axis_aligned<FieldType, BlockSide, MapT, UpdateF> aa_functor(map, funct, min,  max);
     aa_functor.apply();
     }
   }
@@ -41,44 +41,59 @@ class DataHandlerBase {
   }
 };
 
-template<typename FieldType>
+template<typename FieldType, unsigned int BlockSide = BLOCK_SIDE>
 class VoxelBlockHandler : 
-  DataHandlerBase<VoxelBlockHandler<FieldType>, se::VoxelBlock<FieldType> > {
+  DataHandlerBase<VoxelBlockHandler<FieldType, BlockSide>, 
+    se::VoxelBlock<FieldType, BlockSide> > {
 
 public:
-  VoxelBlockHandler(se::VoxelBlock<FieldType>* ptr, Eigen::Vector3i v) : 
+  VoxelBlockHandler(se::VoxelBlock<FieldType, BlockSide>* ptr, Eigen::Vector3i v) : 
     _block(ptr), _voxel(v) {}
 
-  typename se::VoxelBlock<FieldType>::value_type get() {
+  typename se::VoxelBlock<FieldType, BlockSide>::value_type get() {
     return _block->data(_voxel);
   }
 
-  void set(const typename se::VoxelBlock<FieldType>::value_type& val) {
+  void set(const typename se::VoxelBlock<FieldType, BlockSide>::value_type& val) {
     _block->data(_voxel, val);
   }
 
+  /*! \brief Contiguous x and y fields of the block row holding the voxel,
+   * see VoxelBlock::row_x. The voxel sits at row_offset() in the row.
+   */
+  auto row_x() { 
+    const Eigen::Vector3i local = _voxel - _block->coordinates();
+    return _block->row_x(local(1), local(2));
+  }
+
+  auto row_y() { 
+    const Eigen::Vector3i local = _voxel - _block->coordinates();
+    return _block->row_y(local(1), local(2));
+  }
+
+  int row_offset() const { return _voxel(0) - _block->coordinates()(0); }
+
   private:
-    se::VoxelBlock<FieldType> * _block;  
+    se::VoxelBlock<FieldType, BlockSide> * _block;  
     Eigen::Vector3i _voxel;
 };
 
-template<typename FieldType>
-class NodeHandler: DataHandlerBase<NodeHandler<FieldType>, se::Node<FieldType> > {
+template<typename FieldType, typename NodeT = se::Node<FieldType> >
+class NodeHandler: DataHandlerBase<NodeHandler<FieldType, NodeT>, NodeT > {
   public:
-    NodeHandler(se::Node<FieldType>* ptr, int i) : _node(ptr), _idx(i) {}
+    NodeHandler(NodeT* ptr, int i) : _node(ptr), _idx(i) {}
 
-    typename se::Node<FieldType>::value_type get() {
+    typename NodeT::value_type get() {
       return _node->value_[_idx];
     }
 
-    void set(const typename se::Node<FieldType>::value_type& val) {
+    void set(const typename NodeT::value_type& val) {
       _node->value_[_idx] = val;
     }
 
   private:
-    se::Node<FieldType> * _node; 
+    NodeT * _node; 
     int _idx; 
 };
 
-
 #endif
@@ -30,55 +30,150 @@
 #ifndef PROJECTIVE_FUNCTOR_HPP
 #define PROJECTIVE_FUNCTOR_HPP
 #include <functional>
+#include <limits>
 #include <vector>
 
 #include <sophus/se3.hpp>
 #include "../utils/math_utils.h"
 #include "../algorithms/filter.hpp"
+#include "../geometry/frustum.hpp"
 #include "../node.hpp"
 #include "../functors/data_handler.hpp"
+#include "../functors/row_kernel.hpp"
+#include "../utils/isa.hpp"
 
 namespace se {
 namespace functor {
-  template <typename FieldType, template <typename FieldT> class MapT, 
+
+/*! \brief Whether UpdateF can tell that it leaves a whole octant unchanged,
+ * through a member
+ *
+ *   bool skip_octant(const Eigen::Vector2i& lower, const Eigen::Vector2i& upper,
+ *       const float z_min) const;
+ *
+ * where [lower, upper] bounds the pixels the voxels of the octant project to
+ * and z_min is their smallest camera depth. projective_functor then skips 
+ * the per-voxel projections of the octants for which it returns true.
+ */
+template <typename UpdateF, typename = void>
+struct has_octant_skip : std::false_type {};
+
+template <typename UpdateF>
+struct has_octant_skip<UpdateF, typename internal::make_void<
+  decltype(std::declval<const UpdateF&>().skip_octant(
+        std::declval<const Eigen::Vector2i&>(), 
+        std::declval<const Eigen::Vector2i&>(), 0.f))>::type> 
+  : std::true_type {};
+  template <typename FieldType, unsigned int BlockSide,
+            template <typename FieldT, unsigned int BlockSideT> class MapT, 
             typename UpdateF>
   class projective_functor {
 
     public:
       EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-      projective_functor(MapT<FieldType>& map, UpdateF f, const Sophus::SE3f& Tcw, 
-          const Eigen::Matrix4f& K, const Eigen::Vector2i framesize) : 
-        _map(map), _function(f), _Tcw(Tcw), _K(K), _frame_size(framesize) {
+      typedef typename MapT<FieldType, BlockSide>::node_type node_type;
+
+      /*! \brief depth_range bounds the camera depths the update function
+       * may modify, blocks outside it are not visited.
+       */
+      projective_functor(MapT<FieldType, BlockSide>& map, UpdateF f, const Sophus::SE3f& Tcw, 
+          const Eigen::Matrix4f& K, const Eigen::Vector2i framesize,
+          const Eigen::Vector2f& depth_range = default_depth_range()) : 
+        _map(map), _function(f), _Tcw(Tcw), _K(K), _frame_size(framesize),
+        _depth_range(depth_range) {
       } 
 
+      static Eigen::Vector2f default_depth_range() {
+        return Eigen::Vector2f(0.0001f, std::numeric_limits<float>::infinity());
+      }
+
+      /*! \brief Collect the active blocks and the blocks intersecting the 
+       * camera frustum, the latter by se::geometry::frustum_visit (a 
+       * top-down walk culling octants out of view). Active blocks out of view are visited 
+       * so that they get deactivated. The same walk collects the nodes in 
+       * view, nodes allocated for the current frame among them.
+       */
       void build_active_list() {
-        using namespace std::placeholders;
-        /* Retrieve the active list */ 
-        const se::MemoryPool<se::VoxelBlock<FieldType> >& block_array = 
-          _map.getBlockBuffer();
-
-        /* Predicates definition */
-        const float voxel_size = _map.dim()/_map.size();
-        auto in_frustum_predicate = 
-          std::bind(algorithms::in_frustum<se::VoxelBlock<FieldType>>, _1, 
-              voxel_size, _K*_Tcw.matrix(), _frame_size); 
-        auto is_active_predicate = [](const se::VoxelBlock<FieldType>* b) {
-          return b->active();
-        };
-
-        algorithms::filter(_active_list, block_array, is_active_predicate,
-            in_frustum_predicate);
+        const geometry::frustum view(_K, _Tcw, _frame_size, _depth_range(0),
+            _depth_range(1));
+        std::vector<se::VoxelBlock<FieldType, BlockSide>*> visible;
+        geometry::frustum_visit(_map, view, 
+            [&visible](se::VoxelBlock<FieldType, BlockSide>* block) {
+              visible.push_back(block);
+            },
+            [this](node_type* node) {
+              _node_list.push_back(node);
+            });
+
+        active_set& active = _map.activeBlocks();
+        const auto& block_array = _map.getBlockBuffer();
+        const std::vector<unsigned int>& slots = active.slots();
+        _active_list.reserve(slots.size() + visible.size());
+        for(const unsigned int slot : slots) 
+          _active_list.push_back(block_array[slot]);
+        for(auto block : visible) 
+          if(!active.contains(block->slot())) _active_list.push_back(block);
       }
 
-      void update_block(se::VoxelBlock<FieldType> * block, const float voxel_size) {
+      /*! \brief Whether the update function leaves unchanged the voxels 
+       * of the cube [corner, corner + extent], in metres, see 
+       * has_octant_skip. in_frame tells whether any of them may project 
+       * inside the frame.
+       */
+      bool skip_octant(const Eigen::Vector3f& corner, const float extent, 
+          bool& in_frame, std::true_type) const {
+        const Eigen::Matrix3f K = _K.topLeftCorner<3,3>();
+        Eigen::Vector2f lower = Eigen::Vector2f::Constant(
+            std::numeric_limits<float>::infinity());
+        Eigen::Vector2f upper = -lower;
+        float z_min = std::numeric_limits<float>::infinity();
+        for(int i = 0; i < 8; ++i) {
+          const Eigen::Vector3f dir((i & 1) > 0, (i & 2) > 0, (i & 4) > 0);
+          const Eigen::Vector3f pos = _Tcw * (corner + extent * dir);
+          // The projection of the cube is bounded by its corners' only if 
+          // it lies in front of the camera
+          if(pos(2) < 0.0001f) return false;
+          const Eigen::Vector3f pix_hom = K * pos;
+          const Eigen::Vector2f pixel = pix_hom.head<2>() / pix_hom(2) + 
+            Eigen::Vector2f::Constant(0.5f);
+          lower = lower.cwiseMin(pixel);
+          upper = upper.cwiseMax(pixel);
+          z_min = fminf(z_min, pos(2));
+        }
+        const Eigen::Vector2f last = _frame_size.cast<float>() - 
+          Eigen::Vector2f::Constant(1.5f);
+        in_frame = (upper.array() >= 0.5f).all() && 
+          (lower.array() <= last.array()).all();
+        if(!in_frame) return true;
+        const Eigen::Vector2i lo = lower.cwiseMax(Eigen::Vector2f::Zero()).
+          template cast<int>();
+        const Eigen::Vector2i hi = upper.cwiseMin(last).template cast<int>();
+        return _function.skip_octant(lo, hi, z_min);
+      }
+
+      bool skip_octant(const Eigen::Vector3f&, const float, bool&, 
+          std::false_type) const {
+        return false;
+      }
+
+      void update_block(se::VoxelBlock<FieldType, BlockSide> * block, const float voxel_size) {
 
         const Eigen::Vector3i blockCoord = block->coordinates();
+        bool in_frame;
+        if(skip_octant(voxel_size * blockCoord.cast<float>(), 
+              voxel_size * (se::VoxelBlock<FieldType, BlockSide>::side - 1), 
+              in_frame, has_octant_skip<UpdateF>())) {
+          if(in_frame) _map.activate(block);
+          else _map.deactivate(block);
+          return;
+        }
+
         const Eigen::Vector3f delta = _Tcw.rotationMatrix() * Eigen::Vector3f(voxel_size, 0, 0);
         const Eigen::Vector3f cameraDelta = _K.topLeftCorner<3,3>() * delta;
         bool is_visible = false;
 
         unsigned int y, z, blockSide; 
-        blockSide = se::VoxelBlock<FieldType>::side;
+        blockSide = se::VoxelBlock<FieldType, BlockSide>::side;
         unsigned int ylast = blockCoord(1) + blockSide;
         unsigned int zlast = blockCoord(2) + blockSide;
 
@@ -88,30 +183,61 @@ namespace functor {
             Eigen::Vector3f start = _Tcw * Eigen::Vector3f((pix(0)) * voxel_size, 
                 (pix(1)) * voxel_size, (pix(2)) * voxel_size);
             Eigen::Vector3f camerastart = _K.topLeftCorner<3,3>() * start;
-#pragma omp simd
-            for (unsigned int x = 0; x < blockSide; ++x){
-              pix(0) = x + blockCoord(0); 
-              const Eigen::Vector3f camera_voxel = camerastart + (x*cameraDelta);
-              const Eigen::Vector3f pos = start + (x*delta);
-              if (pos(2) < 0.0001f) continue;
-
-              const float inverse_depth = 1.f / camera_voxel(2);
-              const Eigen::Vector2f pixel = Eigen::Vector2f(
-                  camera_voxel(0) * inverse_depth + 0.5f,
-                  camera_voxel(1) * inverse_depth + 0.5f);
-              if (pixel(0) < 0.5f || pixel(0) > _frame_size(0) - 1.5f || 
-                  pixel(1) < 0.5f || pixel(1) > _frame_size(1) - 1.5f) continue;
-              is_visible = true;
-
-              VoxelBlockHandler<FieldType> handler = {block, pix};
-              _function(handler, pix, pos, pixel);
-            }
+            is_visible |= update_row(block, pix, start, delta, camerastart, 
+                cameraDelta, has_row_update<UpdateF, 
+                se::VoxelBlock<FieldType, BlockSide> >());
           }
-        block->active(is_visible);
+        if(is_visible) _map.activate(block);
+        else _map.deactivate(block);
+      }
+
+      /*
+       * Vectorised update of a block row by the update functor.
+       */
+      bool update_row(se::VoxelBlock<FieldType, BlockSide> * block, 
+          const Eigen::Vector3i& pix, const Eigen::Vector3f& start,
+          const Eigen::Vector3f& delta, const Eigen::Vector3f& camerastart, 
+          const Eigen::Vector3f& cameraDelta, std::true_type) {
+        const Eigen::Vector3i local = pix - block->coordinates();
+        return _function.update_row(block, local(1), local(2), start, delta,
+            camerastart, cameraDelta);
+      }
+
+      bool update_row(se::VoxelBlock<FieldType, BlockSide> * block, 
+          Eigen::Vector3i pix, const Eigen::Vector3f& start,
+          const Eigen::Vector3f& delta, const Eigen::Vector3f& camerastart, 
+          const Eigen::Vector3f& cameraDelta, std::false_type) {
+        const int blockSide = se::VoxelBlock<FieldType, BlockSide>::side;
+        const int x0 = pix(0);
+        bool is_visible = false;
+#pragma omp simd
+        for (int x = 0; x < blockSide; ++x){
+          pix(0) = x + x0; 
+          const Eigen::Vector3f camera_voxel = camerastart + (x*cameraDelta);
+          const Eigen::Vector3f pos = start + (x*delta);
+          if (pos(2) < 0.0001f) continue;
+
+          const float inverse_depth = 1.f / camera_voxel(2);
+          const Eigen::Vector2f pixel = Eigen::Vector2f(
+              camera_voxel(0) * inverse_depth + 0.5f,
+              camera_voxel(1) * inverse_depth + 0.5f);
+          if (pixel(0) < 0.5f || pixel(0) > _frame_size(0) - 1.5f || 
+              pixel(1) < 0.5f || pixel(1) > _frame_size(1) - 1.5f) continue;
+          is_visible = true;
+
+          VoxelBlockHandler<FieldType, BlockSide> handler = {block, pix};
+          _function(handler, pix, pos, pixel);
+        }
+        return is_visible;
       }
 
-      void update_node(se::Node<FieldType> * node, const float voxel_size) { 
+      template <typename NodeT>
+      void update_node(NodeT * node, const float voxel_size) { 
         const Eigen::Vector3i voxel = Eigen::Vector3i(unpack_morton(node->code_));
+        bool in_frame;
+        if(skip_octant(voxel_size * voxel.cast<float>(), 
+              0.5f * voxel_size * node->side_, in_frame, 
+              has_octant_skip<UpdateF>())) return;
         const Eigen::Vector3f delta = _Tcw.rotationMatrix() * Eigen::Vector3f::Constant(0.5f * voxel_size * node->side_);
         const Eigen::Vector3f delta_c = _K.topLeftCorner<3,3>() * delta;
         Eigen::Vector3f base_cam = _Tcw * (voxel_size * voxel.cast<float> ());
@@ -131,49 +257,76 @@ namespace functor {
           if (pixel(0) < 0.5f || pixel(0) > _frame_size(0) - 1.5f || 
               pixel(1) < 0.5f || pixel(1) > _frame_size(1) - 1.5f) continue;
 
-          NodeHandler<FieldType> handler = {node, i};
+          NodeHandler<FieldType, NodeT> handler = {node, i};
           _function(handler, voxel + dir, vox_cam, pixel);
         }
       }
 
-      void apply() {
+      /*! \brief Update the active blocks and the nodes in view. Each block
+       * update is run through call, see se::isa::inline_call.
+       */
+      template <typename BlockCall>
+      void apply(BlockCall call) {
 
         build_active_list();
         const float voxel_size = _map.dim() / _map.size();
         size_t list_size = _active_list.size();
 #pragma omp parallel for
         for(unsigned int i = 0; i < list_size; ++i){
-          update_block(_active_list[i], voxel_size);
+          se::VoxelBlock<FieldType, BlockSide> * block = _active_list[i];
+          call([this, block, voxel_size]() { 
+            update_block(block, voxel_size); 
+          });
         }
         _active_list.clear();
 
-        auto& nodes_list = _map.getNodesBuffer();
-        list_size = nodes_list.size();
+        list_size = _node_list.size();
 #pragma omp parallel for
-          for(unsigned int i = 0; i < list_size; ++i){
-            update_node(nodes_list[i], voxel_size);
-         }
+        for(unsigned int i = 0; i < list_size; ++i){
+          update_node(_node_list[i], voxel_size);
+        }
+        _node_list.clear();
+      }
+
+      void apply() {
+        apply(se::isa::inline_call());
       }
 
     private:
-      MapT<FieldType>& _map; 
+      MapT<FieldType, BlockSide>& _map; 
       UpdateF _function; 
       Sophus::SE3f _Tcw;
       Eigen::Matrix4f _K;
       Eigen::Vector2i _frame_size;
-      std::vector<se::VoxelBlock<FieldType>*> _active_list;
+      Eigen::Vector2f _depth_range;
+      std::vector<se::VoxelBlock<FieldType, BlockSide>*> _active_list;
+      std::vector<node_type*> _node_list;
   };
 
-  template <typename FieldType, template <typename FieldT> class MapT, 
+  template <typename FieldType, unsigned int BlockSide,
+            template <typename FieldT, unsigned int BlockSideT> class MapT, 
             typename UpdateF>
-  void projective_map(MapT<FieldType>& map, const Sophus::SE3f& Tcw, 
+  void projective_map(MapT<FieldType, BlockSide>& map, const Sophus::SE3f& Tcw, 
           const Eigen::Matrix4f& K, const Eigen::Vector2i framesize,
           UpdateF funct) {
 
-    projective_functor<FieldType, MapT, UpdateF> 
+    projective_functor<FieldType, BlockSide, MapT, UpdateF> 
       it(map, funct, Tcw, K, framesize);
     it.apply();
   }
+
+  template <typename FieldType, unsigned int BlockSide,
+            template <typename FieldT, unsigned int BlockSideT> class MapT, 
+            typename UpdateF, typename BlockCall>
+  void projective_map(MapT<FieldType, BlockSide>& map, const Sophus::SE3f& Tcw, 
+          const Eigen::Matrix4f& K, const Eigen::Vector2i framesize,
+          UpdateF funct, BlockCall call, const Eigen::Vector2f& depth_range = 
+          projective_functor<FieldType, BlockSide, MapT, UpdateF>::default_depth_range()) {
+
+    projective_functor<FieldType, BlockSide, MapT, UpdateF> 
+      it(map, funct, Tcw, K, framesize, depth_range);
+    it.apply(call);
+  }
 }
 }
 #endif
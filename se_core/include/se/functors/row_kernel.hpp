@@ -0,0 +1,112 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef ROW_KERNEL_HPP
+#define ROW_KERNEL_HPP
+#include <type_traits>
+#include <utility>
+#include <Eigen/Dense>
+#include "../node.hpp"
+#include "../utils/simd.hpp"
+
+namespace se {
+namespace functor {
+
+/*! \brief Whether UpdateF updates whole rows of the voxel blocks BlockT, 
+ * through a member
+ *
+ *   bool update_row(BlockT * block, const int y, const int z, 
+ *       const Eigen::Vector3f& pos, const Eigen::Vector3f& delta,
+ *       const Eigen::Vector3f& pix_hom, const Eigen::Vector3f& pix_delta);
+ *
+ * where (y, z) is the block-local row, pos and pix_hom the camera and 
+ * homogeneous pixel coordinates of its first voxel, delta and pix_delta 
+ * their increments along x. It returns whether any voxel of the row 
+ * projected inside the frame. projective_functor falls back to per-voxel 
+ * updates otherwise.
+ */
+template <typename UpdateF, typename BlockT, typename = void>
+struct has_row_update : std::false_type {};
+
+template <typename UpdateF, typename BlockT>
+struct has_row_update<UpdateF, BlockT, typename internal::make_void<
+  decltype(std::declval<UpdateF&>().update_row(std::declval<BlockT *>(), 
+        0, 0, std::declval<const Eigen::Vector3f&>(), 
+        std::declval<const Eigen::Vector3f&>(),
+        std::declval<const Eigen::Vector3f&>(), 
+        std::declval<const Eigen::Vector3f&>()))>::type> : std::true_type {};
+
+/*! \brief Whether BlockT stores its voxels as contiguous rows of XT and YT
+ * fields, see soa_storage.
+ */
+template <typename BlockT, typename XT, typename YT, typename = void>
+struct soa_rows : std::false_type {};
+
+template <typename BlockT, typename XT, typename YT>
+struct soa_rows<BlockT, XT, YT, typename internal::make_void<
+  typename BlockT::storage_type::x_type>::type> : std::integral_constant<bool,
+  std::is_same<typename BlockT::layout_type, linear_layout>::value &&
+  std::is_same<typename BlockT::storage_type::x_type, XT>::value &&
+  std::is_same<typename BlockT::storage_type::y_type, YT>::value> {};
+
+/*! \brief W consecutive voxels of a block row projected into the depth 
+ * frame, with the same rounding and bounds as the per-voxel update.
+ */
+template <int W>
+struct row_lanes {
+  typedef simd::vfloat<W> vfloat;
+  vfloat x, y, z;  // Camera coordinates
+  typename vfloat::mask_type visible; // In front of the camera, inside the frame
+  vfloat depth;    // Depth sample at the voxel pixel, 0 where not visible
+
+  SE_SIMD_INLINE row_lanes(const int offset, const Eigen::Vector3f& pos, 
+      const Eigen::Vector3f& delta, const Eigen::Vector3f& pix_hom, 
+      const Eigen::Vector3f& pix_delta, const float * depth_frame, 
+      const Eigen::Vector2i& frame_size) {
+    const vfloat i = vfloat::iota() + vfloat(offset);
+    x = vfloat(pos(0)) + i * vfloat(delta(0));
+    y = vfloat(pos(1)) + i * vfloat(delta(1));
+    z = vfloat(pos(2)) + i * vfloat(delta(2));
+    const vfloat inverse_depth = vfloat(1.f) / 
+      (vfloat(pix_hom(2)) + i * vfloat(pix_delta(2)));
+    const vfloat px = (vfloat(pix_hom(0)) + i * vfloat(pix_delta(0))) * 
+      inverse_depth + vfloat(0.5f);
+    const vfloat py = (vfloat(pix_hom(1)) + i * vfloat(pix_delta(1))) * 
+      inverse_depth + vfloat(0.5f);
+    visible = (z >= vfloat(0.0001f)) & 
+      (px >= vfloat(0.5f)) & (px <= vfloat(frame_size(0) - 1.5f)) &
+      (py >= vfloat(0.5f)) & (py <= vfloat(frame_size(1) - 1.5f));
+    depth = gather(depth_frame, truncate(px) + truncate(py) * frame_size(0), 
+        visible, vfloat(0.f));
+  }
+};
+}
+}
+#endif
@@ -0,0 +1,369 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <sophus/se3.hpp>
+#include "../node.hpp"
+#include "../octree.hpp"
+#include "../hash_map.hpp"
+#include "../linear_octree.hpp"
+
+namespace se {
+namespace geometry {
+
+enum class frustum_status {
+  outside,
+  intersects,
+  inside
+};
+
+/*! \brief Viewing volume of a pinhole camera: the points projecting inside
+ * a frame of frame_size, with one pixel of slack around the pixels that
+ * se::functor::projective_functor updates, and lying between the near and
+ * far depths. Stored as six world-space half-spaces n.p + d >= 0.
+ */
+class frustum {
+  public:
+    frustum(const Eigen::Matrix4f& K, const Sophus::SE3f& Tcw, 
+        const Eigen::Vector2i& frame_size, const float near_plane, 
+        const float far_plane) {
+      const Eigen::Matrix3f k = K.topLeftCorner<3, 3>();
+      const Eigen::Matrix3f R = Tcw.rotationMatrix();
+      const Eigen::Vector3f t = Tcw.translation();
+
+      /* Camera frame planes, the image borders pass through the centre */
+      Eigen::Matrix<float, 3, 6> normals;
+      Eigen::Matrix<float, 6, 1> offsets = Eigen::Matrix<float, 6, 1>::Zero();
+      normals.col(0) = k.row(0).transpose() + k.row(2).transpose();
+      normals.col(1) = (frame_size(0) - 1) * k.row(2).transpose() - 
+        k.row(0).transpose();
+      normals.col(2) = k.row(1).transpose() + k.row(2).transpose();
+      normals.col(3) = (frame_size(1) - 1) * k.row(2).transpose() - 
+        k.row(1).transpose();
+      normals.col(4) = Eigen::Vector3f(0.f, 0.f, 1.f);
+      normals.col(5) = Eigen::Vector3f(0.f, 0.f, -1.f);
+      offsets(4) = -near_plane;
+      offsets(5) = far_plane;
+
+      for(int i = 0; i < 6; ++i) {
+        normals_.col(i) = R.transpose() * normals.col(i);
+        offsets_(i) = normals.col(i).dot(t) + offsets(i);
+        extents_(i) = 0.5f * normals_.col(i).cwiseAbs().sum();
+      }
+
+      /* Bounding box of the eight corners, the pixel borders are at -1 and 
+       * frame_size - 1 as for the planes above */
+      const float inf = std::numeric_limits<float>::infinity();
+      lower_ = Eigen::Vector3f::Constant(-inf);
+      upper_ = Eigen::Vector3f::Constant(inf);
+      if(!std::isfinite(far_plane)) return;
+      const Eigen::Matrix3f k_inv = k.inverse();
+      std::swap(lower_, upper_);
+      for(int i = 0; i < 8; ++i) {
+        const float u = (i & 1) ? frame_size(0) - 1 : -1.f;
+        const float v = (i & 2) ? frame_size(1) - 1 : -1.f;
+        const float z = (i & 4) ? far_plane : near_plane;
+        const Eigen::Vector3f corner = R.transpose() * 
+          (z * (k_inv * Eigen::Vector3f(u, v, 1.f)) - t);
+        lower_ = lower_.cwiseMin(corner);
+        upper_ = upper_.cwiseMax(corner);
+      }
+    }
+
+    /*! \brief Classify the axis aligned cube of side side whose lower corner
+     * is corner. For each plane only the corners nearest and farthest along
+     * its normal are tested, which is the eight corner test without 
+     * enumerating the corners. The test is conservative: a cube close to an 
+     * edge of the frustum may be reported as intersecting, a cube 
+     * overlapping the frustum is never reported outside.
+     */
+    frustum_status classify(const Eigen::Vector3f& corner, 
+        const float side) const {
+      const Eigen::Vector3f centre = corner + 
+        Eigen::Vector3f::Constant(0.5f * side);
+      frustum_status status = frustum_status::inside;
+      for(int i = 0; i < 6; ++i) {
+        const float distance = normals_.col(i).dot(centre) + offsets_(i);
+        const float reach = extents_(i) * side;
+        if(distance < -reach) return frustum_status::outside;
+        if(distance < reach) status = frustum_status::intersects;
+      }
+      return status;
+    }
+
+    /*! \brief Axis aligned bounding box of the frustum in the world frame,
+     * unbounded if the far plane is at infinity.
+     */
+    const Eigen::Vector3f& lower() const { return lower_; }
+    const Eigen::Vector3f& upper() const { return upper_; }
+
+  private:
+    Eigen::Matrix<float, 3, 6> normals_;
+    Eigen::Matrix<float, 6, 1> offsets_;
+    Eigen::Matrix<float, 6, 1> extents_;
+    Eigen::Vector3f lower_;
+    Eigen::Vector3f upper_;
+};
+
+/*! \brief Visit the octants of map which intersect the frustum view, 
+ * calling block_op on each voxel block and node_op on each node, the root 
+ * included. The octree is walked top-down and a subtree outside the frustum
+ * is culled as a whole, hence the cost depends on the visible part of the 
+ * map rather than on its total size. Subtrees inside the frustum are 
+ * visited without further tests.
+ * \param map octree map
+ * \param view frustum in the world frame of the map
+ * \param block_op function taking a se::VoxelBlock pointer
+ * \param node_op function taking a se::Node pointer
+ */
+template <typename FieldType, unsigned int BlockSide, typename BlockOp,
+          typename NodeOp>
+void frustum_visit(const Octree<FieldType, BlockSide>& map, 
+    const frustum& view, BlockOp block_op, NodeOp node_op) {
+
+  typedef struct stack_entry { 
+    se::Node<FieldType, BlockSide>* node_ptr;
+    Eigen::Vector3i coordinates;
+    int side;
+    bool inside;
+  } stack_entry;
+
+  se::Node<FieldType, BlockSide>* node = map.root();
+  if(!node) return;
+  const float voxel_size = map.dim() / map.size();
+
+  stack_entry stack[Octree<FieldType, BlockSide>::max_depth*8 + 1];
+  size_t stack_idx = 0;
+  stack[stack_idx++] = {node, Eigen::Vector3i::Zero(), map.size(), false};
+
+  while(stack_idx != 0) {
+    const stack_entry current = stack[--stack_idx];
+    node = current.node_ptr;
+
+    bool inside = current.inside;
+    if(!inside) {
+      const frustum_status status = view.classify(
+          voxel_size * current.coordinates.template cast<float>(), 
+          voxel_size * current.side);
+      if(status == frustum_status::outside) continue;
+      inside = status == frustum_status::inside;
+    }
+
+    if(node->isLeaf()) {
+      block_op(static_cast<se::VoxelBlock<FieldType, BlockSide>*>(node));
+      continue;
+    }
+    node_op(node);
+
+    const int side = current.side / 2;
+    for(int i = 0; i < 8; ++i) {
+      se::Node<FieldType, BlockSide>* child = node->child(i);
+      if(!child) continue;
+      stack[stack_idx++] = {child, current.coordinates + 
+        side * Eigen::Vector3i((i & 1) > 0, (i & 2) > 0, (i & 4) > 0), 
+        side, inside};
+    }
+  }
+}
+
+/*! \brief frustum_visit on se::LinearOctree. Same top-down walk as on 
+ * se::Octree, children are found from the children mask of their parent 
+ * and looked up by morton code.
+ * \param map linear octree map
+ * \param view frustum in the world frame of the map
+ * \param block_op function taking a se::VoxelBlock pointer
+ * \param node_op function taking a se::LinearNode pointer
+ */
+template <typename FieldType, unsigned int BlockSide, typename BlockOp,
+          typename NodeOp>
+void frustum_visit(const LinearOctree<FieldType, BlockSide>& map, 
+    const frustum& view, BlockOp block_op, NodeOp node_op) {
+
+  typedef struct stack_entry { 
+    se::LinearNode<FieldType>* node_ptr;
+    se::VoxelBlock<FieldType, BlockSide>* block_ptr;
+    Eigen::Vector3i coordinates;
+    int side;
+    bool inside;
+  } stack_entry;
+
+  se::LinearNode<FieldType>* node = map.root();
+  if(!node) return;
+  const float voxel_size = map.dim() / map.size();
+
+  stack_entry stack[LinearOctree<FieldType, BlockSide>::max_depth*8 + 1];
+  size_t stack_idx = 0;
+  stack[stack_idx++] = {node, NULL, Eigen::Vector3i::Zero(), map.size(), 
+    false};
+
+  while(stack_idx != 0) {
+    const stack_entry current = stack[--stack_idx];
+
+    bool inside = current.inside;
+    if(!inside) {
+      const frustum_status status = view.classify(
+          voxel_size * current.coordinates.template cast<float>(), 
+          voxel_size * current.side);
+      if(status == frustum_status::outside) continue;
+      inside = status == frustum_status::inside;
+    }
+
+    if(current.block_ptr) {
+      block_op(current.block_ptr);
+      continue;
+    }
+    node = current.node_ptr;
+    node_op(node);
+
+    const int side = current.side / 2;
+    const int depth = keyops::level(node->code_) + 1;
+    for(int i = 0; i < 8; ++i) {
+      if(!(node->children_mask_ & (1 << i))) continue;
+      const Eigen::Vector3i coords = current.coordinates + 
+        side * Eigen::Vector3i((i & 1) > 0, (i & 2) > 0, (i & 4) > 0);
+      stack_entry child = {NULL, NULL, coords, side, inside};
+      if(side == static_cast<int>(BlockSide)) {
+        child.block_ptr = map.fetch(coords(0), coords(1), coords(2));
+      } else {
+        child.node_ptr = map.fetch_octant(coords(0), coords(1), coords(2), 
+            depth);
+      }
+      stack[stack_idx++] = child;
+    }
+  }
+}
+
+/*! \brief frustum_visit on se::HashMap, which stores no internal nodes, 
+ * hence node_op is never called. The block grid within the bounding box of
+ * the frustum is walked top-down as an octree would be, culling the cubes 
+ * outside the frustum, and the map is probed for each block left. When the
+ * box holds more blocks than the map, e.g. for a far plane at infinity, the
+ * allocated blocks are tested one by one instead.
+ * \param map hash map
+ * \param view frustum in the world frame of the map
+ * \param block_op function taking a se::VoxelBlock pointer
+ */
+template <typename FieldType, unsigned int BlockSide, typename BlockOp,
+          typename NodeOp>
+void frustum_visit(const HashMap<FieldType, BlockSide>& map, 
+    const frustum& view, BlockOp block_op, NodeOp) {
+
+  typedef struct stack_entry { 
+    Eigen::Vector3i coordinates;
+    int side;
+    bool inside;
+  } stack_entry;
+
+  if(map.size() == 0) return;
+  const float voxel_size = map.dim() / map.size();
+  const int block_side = BlockSide;
+
+  // Blocks [first, last] covered by the bounding box, in voxels
+  const Eigen::Vector3f max_voxel = Eigen::Vector3f::Constant(map.size() - 1);
+  const Eigen::Vector3i first = ((view.lower() / voxel_size).cwiseMax(
+        Eigen::Vector3f::Zero()).cwiseMin(max_voxel).template cast<int>() / 
+      block_side) * block_side;
+  const Eigen::Vector3i last = ((view.upper() / voxel_size).cwiseMax(
+        Eigen::Vector3f::Zero()).cwiseMin(max_voxel).template cast<int>() / 
+      block_side) * block_side;
+  const Eigen::Vector3i count = (last - first) / block_side + 
+    Eigen::Vector3i::Constant(1);
+
+  const auto& blocks = map.getBlockBuffer();
+  if(static_cast<size_t>(count(0)) * count(1) * count(2) > blocks.size()) {
+    for(size_t i = 0; i < blocks.size(); ++i) {
+      if(!blocks.used(i)) continue;
+      const auto block = blocks[i];
+      if(view.classify(voxel_size * block->coordinates().template cast<float>(),
+            voxel_size * block_side) != frustum_status::outside) 
+        block_op(block);
+    }
+    return;
+  }
+
+  stack_entry stack[HashMap<FieldType, BlockSide>::max_depth*8 + 1];
+  size_t stack_idx = 0;
+  stack[stack_idx++] = {Eigen::Vector3i::Zero(), map.size(), false};
+
+  while(stack_idx != 0) {
+    const stack_entry current = stack[--stack_idx];
+    const Eigen::Vector3i upper = current.coordinates + 
+      Eigen::Vector3i::Constant(current.side - 1);
+    if((upper.array() < first.array()).any() || 
+       (current.coordinates.array() > last.array()).any()) continue;
+
+    bool inside = current.inside;
+    if(!inside) {
+      const frustum_status status = view.classify(
+          voxel_size * current.coordinates.template cast<float>(), 
+          voxel_size * current.side);
+      if(status == frustum_status::outside) continue;
+      inside = status == frustum_status::inside;
+    }
+
+    if(current.side == block_side) {
+      const Eigen::Vector3i& c = current.coordinates;
+      se::VoxelBlock<FieldType, BlockSide>* block = map.fetch(c(0), c(1), c(2));
+      if(block) block_op(block);
+      continue;
+    }
+
+    const int side = current.side / 2;
+    for(int i = 0; i < 8; ++i) {
+      stack[stack_idx++] = {current.coordinates + 
+        side * Eigen::Vector3i((i & 1) > 0, (i & 2) > 0, (i & 4) > 0), 
+        side, inside};
+    }
+  }
+}
+
+/*! \brief Append to out the voxel blocks of map which intersect the frustum
+ * view, see frustum_visit.
+ * \param out list of visible blocks
+ * \param map octree, hash map or linear octree
+ * \param view frustum in the world frame of the map
+ */
+template <typename FieldType, unsigned int BlockSide,
+          template <typename FieldT, unsigned int BlockSideT> class MapT>
+void frustum_blocks(std::vector<se::VoxelBlock<FieldType, BlockSide>*>& out,
+    const MapT<FieldType, BlockSide>& map, const frustum& view) {
+  frustum_visit(map, view, 
+      [&out](se::VoxelBlock<FieldType, BlockSide>* block) { 
+        out.push_back(block); 
+      },
+      [](typename MapT<FieldType, BlockSide>::node_type*) {});
+}
+}
+}
+#endif
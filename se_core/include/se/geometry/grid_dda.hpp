@@ -0,0 +1,164 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef GRID_DDA_HPP
+#define GRID_DDA_HPP
+#include <cmath>
+#include <limits>
+#include <Eigen/Dense>
+
+namespace se {
+namespace geometry {
+
+/*! \brief Amanatides-Woo traversal of the cells of a size^3 voxel grid
+ * crossed by the segment origin + t * direction, t in [t_begin, t_end]. 
+ * Positions are expressed in voxel units and cells are cubes of side voxels
+ * aligned to multiples of side, i.e. octants of a given level. Every cell
+ * the segment crosses inside the grid is visited exactly once, in order of
+ * increasing t. The cell side may be changed while walking, see next(int).
+ */
+class grid_dda {
+  public:
+    grid_dda(const Eigen::Vector3f& origin, const Eigen::Vector3f& direction,
+        const float t_begin, const float t_end, const int side, 
+        const int size) : origin_(origin), direction_(direction), 
+    size_(size) {
+      const float inf = std::numeric_limits<float>::infinity();
+
+      /* Clip the segment against the grid */
+      t_ = t_begin;
+      t_end_ = t_end;
+      for(int i = 0; i < 3; ++i) {
+        if(direction_(i) == 0.f) {
+          inv_(i) = inf;
+          if(origin_(i) < 0.f || origin_(i) >= size_) t_end_ = -inf;
+          continue;
+        }
+        inv_(i) = 1.f / direction_(i);
+        const float t0 = (0.f - origin_(i)) * inv_(i);
+        const float t1 = (size_ - origin_(i)) * inv_(i);
+        t_ = std::max(t_, std::min(t0, t1));
+        t_end_ = std::min(t_end_, std::max(t0, t1));
+      }
+      if(t_ < t_end_) start(side);
+    }
+
+    /*! \brief True while the current cell is crossed by the segment.
+     */
+    bool valid() const { return t_ < t_end_; }
+
+    /*! \brief Lower corner of the current cell, in voxels.
+     */
+    const Eigen::Vector3i& cell() const { return cell_; }
+
+    /*! \brief Side of the current cell, in voxels.
+     */
+    int side() const { return side_; }
+
+    /*! \brief Parameter at which the segment enters the current cell.
+     */
+    float t_entry() const { return t_; }
+
+    /*! \brief Parameter at which the segment leaves the current cell.
+     */
+    float t_exit() const { 
+      return std::min(t_end_, t_max_.minCoeff());
+    }
+
+    /*! \brief Step to the next cell along the segment.
+     */
+    void next() {
+      int axis;
+      t_ = t_max_.minCoeff(&axis);
+      cell_(axis) += step_(axis) * side_;
+      t_max_(axis) += delta_(axis);
+      if(cell_(axis) < 0 || cell_(axis) >= size_) t_ = t_end_;
+    }
+
+    /*! \brief Step to the cell of side side containing the segment right
+     * after the current cell. Cells of different sides can overlap, so when 
+     * coarsening part of the current cell may be covered again.
+     */
+    void next(const int side) {
+      if(side == side_) {
+        next();
+        return;
+      }
+      t_ = t_max_.minCoeff();
+      if(t_ < t_end_) start(side);
+    }
+
+  private:
+
+    /*
+     * Locate the cell of side side containing the segment just after t_.
+     * On a cell boundary the cell ahead along the direction is chosen.
+     */
+    void start(const int side) {
+      const float inf = std::numeric_limits<float>::infinity();
+      side_ = side;
+      const Eigen::Vector3f p = origin_ + t_ * direction_;
+      for(int i = 0; i < 3; ++i) {
+        const float c = p(i) / side_;
+        int idx = direction_(i) < 0.f ? 
+          static_cast<int>(std::ceil(c)) - 1 : static_cast<int>(std::floor(c));
+        idx = std::max(0, std::min(idx, size_ / side_ - 1));
+        cell_(i) = idx * side_;
+        if(direction_(i) > 0.f) {
+          step_(i) = 1;
+          t_max_(i) = (cell_(i) + side_ - origin_(i)) * inv_(i);
+          delta_(i) = side_ * inv_(i);
+        } else if(direction_(i) < 0.f) {
+          step_(i) = -1;
+          t_max_(i) = (cell_(i) - origin_(i)) * inv_(i);
+          delta_(i) = -side_ * inv_(i);
+        } else {
+          step_(i) = 0;
+          t_max_(i) = inf;
+          delta_(i) = inf;
+        }
+      }
+    }
+
+    Eigen::Vector3f origin_;
+    Eigen::Vector3f direction_;
+    Eigen::Vector3f inv_;
+    Eigen::Vector3f t_max_;
+    Eigen::Vector3f delta_;
+    Eigen::Vector3i cell_;
+    Eigen::Vector3i step_;
+    float t_;
+    float t_end_;
+    int side_;
+    int size_;
+};
+}
+}
+#endif
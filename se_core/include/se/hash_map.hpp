@@ -0,0 +1,636 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+#ifndef HASH_MAP_HPP
+#define HASH_MAP_HPP
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "utils/math_utils.h"
+#include "octree_defines.h"
+#include "voxel_traits.hpp"
+#include "utils/morton_utils.hpp"
+#include "octant_ops.hpp"
+
+#include "node.hpp"
+#include "utils/memory_pool.hpp"
+#include "utils/active_set.hpp"
+#include "algorithms/parallel.hpp"
+#include "interpolation/interp.hpp"
+
+namespace se {
+
+template <typename T, unsigned int BlockSide, typename MapT>
+class block_ray_iterator;
+
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+class hash_cursor;
+
+/*! \brief Voxel hashing map. Voxel blocks are indexed by their morton key in
+ * an open-addressing hash table with linear probing, hence a block lookup is
+ * a constant number of probes instead of a walk from the root. Only voxel 
+ * blocks are stored: there are no internal nodes, so an allocation key 
+ * coarser than the block level is expanded into the blocks it covers, up to
+ * max_expand_levels above the block level. Coarser keys are rejected by 
+ * allocate, hence the bfusion allocation never emits them for this map. It 
+ * exposes the same interface as se::Octree used by VolumeTemplate, the 
+ * functors and the allocation kernels.
+ */
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+class HashMap
+{
+
+public:
+
+  typedef voxel_traits<T> traits_type;
+  typedef typename traits_type::value_type value_type;
+  typedef MemoryPool<VoxelBlock<T, BlockSide>, block_page_allocator> 
+    block_pool_type;
+  typedef Node<T, BlockSide> node_type;
+  typedef block_ray_iterator<T, BlockSide, HashMap<T, BlockSide> > 
+    ray_iterator_type;
+  typedef hash_cursor<T, BlockSide> cursor_type;
+  value_type empty() const { return traits_type::empty(); }
+  value_type init_val() const { return traits_type::initValue(); }
+
+  // # of voxels per side in a voxel block
+  static constexpr unsigned int blockSide = BlockSide;
+  // maximum tree depth in bits
+  static constexpr unsigned int max_depth = ((sizeof(key_t)*8)/3);
+  // Tree depth at which blocks are found
+  static constexpr unsigned int block_depth = max_depth - math::log2_const(BlockSide);
+  // Levels above the block level from which allocation keys are expanded
+  // into blocks, i.e. at most 8^max_expand_levels blocks per key.
+  static constexpr int max_expand_levels = 2;
+
+  HashMap() : size_(0), dim_(0.f), max_level_(0), leaves_level_(0), 
+    capacity_(0), shift_(0) {
+  };
+
+  /*! \brief Initialises the map attributes
+   * \param size number of voxels per side of the cube
+   * \param dim cube extension per side, in meter
+   */
+  void init(int size, float dim);
+
+  inline int size() const { return size_; }
+  inline float dim() const { return dim_; }
+
+  /*! \brief Sets voxel value at coordinates (x,y,z), if the containing block 
+   * is allocated. This method is not thread safe.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  void set(const int x, const int y, const int z, const value_type val);
+
+  /*! \brief Retrieves voxel value at coordinates (x,y,z). Voxels of non 
+   * allocated blocks hold the initial value.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  value_type get(const int x, const int y, const int z) const;
+  value_type get_fine(const int x, const int y, const int z) const;
+
+  /*! \brief Fetch the voxel block at which contains voxel  (x,y,z)
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  VoxelBlock<T, BlockSide> * fetch(const int x, const int y, const int z) const;
+
+  /*! \brief Fetch the octant containing (x,y,z) at level depth. Only voxel 
+   * blocks are stored, hence NULL is returned above the block level.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   * \param depth level to be searched
+   */
+  VoxelBlock<T, BlockSide> * fetch_octant(const int x, const int y, 
+      const int z, const int depth) const;
+
+  /*! \brief Insert the voxel block containing (x,y,z). Not thread safe.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  VoxelBlock<T, BlockSide> * insert(const int x, const int y, const int z);
+
+  /*! \brief Interp voxel value at voxel position  (x,y,z)
+   * \param pos three-dimensional coordinates in which each component belongs 
+   * to the interval [0, size]
+   */
+  template <typename FieldSelect>
+  float interp(const Eigen::Vector3f& pos, FieldSelect f) const;
+
+  /*! \brief Compute the gradient at voxel position  (x,y,z)
+   * \param pos three-dimensional coordinates in which each component belongs 
+   * to the interval [0, size]
+   */
+  template <typename FieldSelect>
+  Eigen::Vector3f grad(const Eigen::Vector3f& pos, FieldSelect selector) const;
+
+  /*! \brief Get the list of allocated block. If the active switch is set to
+   * true then only the visible blocks are retrieved.
+   * \param blocklist output vector of allocated blocks
+   * \param active boolean switch. Set to true to retrieve visible, allocated 
+   * blocks, false to retrieve all allocated blocks.
+   */
+  void getBlockList(std::vector<VoxelBlock<T, BlockSide> *>& blocklist, bool active);
+
+  /*! \brief Mark block as active, i.e. to be visited by the next 
+   * integration. Blocks are activated when allocated. Thread safe.
+   */
+  void activate(VoxelBlock<T, BlockSide> * block) {
+    active_blocks_.activate(block);
+  }
+
+  /*! \brief Mark block as inactive. Thread safe.
+   */
+  void deactivate(VoxelBlock<T, BlockSide> * block) {
+    active_blocks_.deactivate(block);
+  }
+
+  /*! \brief Slots in getBlockBuffer() of the active blocks, see 
+   * se::Octree::activeBlocks.
+   */
+  active_set& activeBlocks(){ return active_blocks_; }
+  block_pool_type& getBlockBuffer(){ return block_buffer_; };
+  // Always empty, kept for interface compatibility with se::Octree.
+  MemoryPool<Node<T, BlockSide> >& getNodesBuffer(){ return nodes_buffer_; };
+  const block_pool_type& getBlockBuffer() const { 
+    return block_buffer_; 
+  };
+  const MemoryPool<Node<T, BlockSide> >& getNodesBuffer() const { return nodes_buffer_; };
+
+  /*! \brief Computes the morton code of the block containing voxel 
+   * at coordinates (x,y,z)
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  key_t hash(const int x, const int y, const int z) const {
+    return keyops::encode(x, y, z, leaves_level_, max_level_);   
+  }
+
+  key_t hash(const int x, const int y, const int z, key_t scale) const {
+    return keyops::encode(x, y, z, scale, max_level_); 
+  }
+
+  /*! \brief allocate a set of voxel blocks via their positional key. Keys 
+   * may contain duplicates. Keys finer than the block level allocate their 
+   * block, coarser ones the blocks they cover if at most max_expand_levels 
+   * above the block level. Table slots are claimed with a compare-and-swap, 
+   * hence the insertion runs in parallel without locks.
+   * \param keys collection of voxel block keys to be allocated (i.e. their 
+   * morton number)
+   * \param number of keys in the keys array
+   * \return false if keys more than max_expand_levels above the block level
+   * were skipped, which is reported on std::cerr
+   */
+  bool allocate(key_t *keys, int num_elem);
+
+  void save(const std::string& filename);
+  void load(const std::string& filename);
+
+  /*! \brief Counts the number of blocks allocated
+   * \return number of voxel blocks allocated
+   */
+  int leavesCount() const { 
+    return block_buffer_.size() - block_buffer_.free_count(); 
+  }
+
+  /*! \brief Counts the number of internal nodes
+   * \return always zero
+   */
+  int nodeCount() const { return 0; }
+
+  /*! \brief Number of slots of the hash table
+   */
+  size_t capacity() const { return capacity_; }
+
+private:
+
+  struct Slot {
+    std::atomic<key_t> key;
+    std::atomic<VoxelBlock<T, BlockSide> *> block;
+  };
+
+  // Morton codes always carry the level bits, hence no key is all ones.
+  static constexpr key_t empty_key = ~key_t(0);
+
+  int size_;
+  float dim_;
+  int max_level_;
+  int leaves_level_;
+  size_t capacity_;
+  unsigned int shift_;
+  std::unique_ptr<Slot[]> table_;
+  block_pool_type block_buffer_;
+  MemoryPool<Node<T, BlockSide> > nodes_buffer_;
+  active_set active_blocks_;
+
+  // Fibonacci hashing: the top bits of the product index the table.
+  inline size_t slot_of(const key_t key) const {
+    return (key * 0x9E3779B97F4A7C15ull) >> shift_;
+  }
+
+  VoxelBlock<T, BlockSide> * find(const key_t key) const;
+
+  // Lock-free insertion of a block key. The block is acquired from the pool, 
+  // which must have been reserved beforehand, and initialised before its key
+  // is published so that nothing can fail in between.
+  VoxelBlock<T, BlockSide> * insert_key(const key_t key);
+
+  // Grow the table to hold at least n blocks at half load. Not thread safe.
+  void reserve_slots(const size_t n);
+
+  // Block level key of a key at the block level or below
+  inline key_t block_key(const key_t key) const {
+    const unsigned int shift = MAX_BITS - max_level_ - 1;
+    return (keyops::code(key) & MASK[leaves_level_ + shift]) | leaves_level_;
+  }
+
+  value_type get(const int x, const int y, const int z, 
+      const VoxelBlock<T, BlockSide>* cached) const;
+};
+
+template <typename T, unsigned int BlockSide>
+void HashMap<T, BlockSide>::init(int size, float dim) {
+  size_ = size;
+  dim_ = dim;
+  max_level_ = log2(size);
+  leaves_level_ = max_level_ - math::log2_const(blockSide);
+  reserve_slots(1024);
+}
+
+template <typename T, unsigned int BlockSide>
+void HashMap<T, BlockSide>::reserve_slots(const size_t n) {
+  size_t capacity = std::max(capacity_, size_t(1024));
+  while(capacity < 2 * n) capacity *= 2;
+  if(capacity == capacity_) return;
+
+  capacity_ = capacity;
+  shift_ = 64 - math::log2_const(static_cast<int>(capacity));
+  table_.reset(new Slot[capacity_]);
+  for(size_t i = 0; i < capacity_; ++i) {
+    table_[i].key.store(empty_key, std::memory_order_relaxed);
+    table_[i].block.store(NULL, std::memory_order_relaxed);
+  }
+
+  // Re-insert the existing blocks
+  const size_t num_blocks = block_buffer_.size();
+  for(size_t i = 0; i < num_blocks; ++i) {
+    if(!block_buffer_.used(i)) continue;
+    VoxelBlock<T, BlockSide> * b = block_buffer_[i];
+    size_t idx = slot_of(b->code_);
+    while(table_[idx].key.load(std::memory_order_relaxed) != empty_key) 
+      idx = (idx + 1) & (capacity_ - 1);
+    table_[idx].key.store(b->code_, std::memory_order_relaxed);
+    table_[idx].block.store(b, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, unsigned int BlockSide>
+inline VoxelBlock<T, BlockSide> * HashMap<T, BlockSide>::find(
+    const key_t key) const {
+  if(!table_) return NULL;
+  size_t idx = slot_of(key);
+  while(true) {
+    const key_t k = table_[idx].key.load(std::memory_order_acquire);
+    if(k == key) return table_[idx].block.load(std::memory_order_acquire);
+    if(k == empty_key) return NULL;
+    idx = (idx + 1) & (capacity_ - 1);
+  }
+}
+
+template <typename T, unsigned int BlockSide>
+VoxelBlock<T, BlockSide> * HashMap<T, BlockSide>::insert_key(const key_t key) {
+  size_t idx = slot_of(key);
+  VoxelBlock<T, BlockSide> * block = NULL;
+  while(true) {
+    key_t k = table_[idx].key.load(std::memory_order_acquire);
+    if(k == empty_key) {
+      if(!block) {
+        unsigned int block_slot;
+        block = block_buffer_.acquire_block(block_slot);
+        block->slot(block_slot);
+        block->code_ = key;
+        block->side_ = blockSide;
+        block->coordinates(Eigen::Vector3i(unpack_morton(keyops::code(key))));
+      }
+      if(table_[idx].key.compare_exchange_strong(k, key, 
+            std::memory_order_acq_rel)) {
+        table_[idx].block.store(block, std::memory_order_release);
+        activate(block);
+        return block;
+      }
+      // Lost the race, k now holds the winning key.
+    }
+    if(k == key) {
+      if(block) block_buffer_.release_block(block);
+      // The winning thread stores its block right after the key
+      VoxelBlock<T, BlockSide> * b;
+      while(!(b = table_[idx].block.load(std::memory_order_acquire))) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+      }
+      return b;
+    }
+    idx = (idx + 1) & (capacity_ - 1);
+  }
+}
+
+template <typename T, unsigned int BlockSide>
+inline VoxelBlock<T, BlockSide> * HashMap<T, BlockSide>::fetch(const int x, 
+    const int y, const int z) const {
+  return find(hash(x, y, z));
+}
+
+template <typename T, unsigned int BlockSide>
+inline VoxelBlock<T, BlockSide> * HashMap<T, BlockSide>::fetch_octant(
+    const int x, const int y, const int z, const int depth) const {
+  if(depth < leaves_level_) return NULL;
+  return fetch(x, y, z);
+}
+
+template <typename T, unsigned int BlockSide>
+inline void HashMap<T, BlockSide>::set(const int x, const int y, const int z, 
+    const value_type val) {
+  VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+  if(!block) return;
+  block->data(Eigen::Vector3i(x, y, z), val);
+}
+
+template <typename T, unsigned int BlockSide>
+inline typename HashMap<T, BlockSide>::value_type HashMap<T, BlockSide>::get(
+    const int x, const int y, const int z) const {
+  return get_fine(x, y, z);
+}
+
+template <typename T, unsigned int BlockSide>
+inline typename HashMap<T, BlockSide>::value_type HashMap<T, BlockSide>::get_fine(
+    const int x, const int y, const int z) const {
+  const VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+  if(!block) {
+    return init_val();
+  }
+  return block->data(Eigen::Vector3i(x, y, z));
+}
+
+template <typename T, unsigned int BlockSide>
+inline typename HashMap<T, BlockSide>::value_type HashMap<T, BlockSide>::get(
+    const int x, const int y, const int z, 
+    const VoxelBlock<T, BlockSide>* cached) const {
+
+  if(cached != NULL){
+    const Eigen::Vector3i pos = Eigen::Vector3i(x, y, z);
+    const Eigen::Vector3i lower = cached->coordinates();
+    const Eigen::Vector3i upper = lower + Eigen::Vector3i::Constant(blockSide-1);
+    const int contained = 
+      ((pos.array() >= lower.array()) && (pos.array() <= upper.array())).all();
+    if(contained){
+      return cached->data(pos);
+    }
+  }
+  return get_fine(x, y, z);
+}
+
+template <typename T, unsigned int BlockSide>
+VoxelBlock<T, BlockSide> * HashMap<T, BlockSide>::insert(const int x, 
+    const int y, const int z) {
+  reserve_slots(block_buffer_.size() + 1);
+  return insert_key(hash(x, y, z));
+}
+
+template <typename T, unsigned int BlockSide>
+template <typename FieldSelector>
+float HashMap<T, BlockSide>::interp(const Eigen::Vector3f& pos, 
+    FieldSelector select) const {
+  
+  return se::interp(*this, pos, select);
+}
+
+template <typename T, unsigned int BlockSide>
+template <typename FieldSelector>
+Eigen::Vector3f HashMap<T, BlockSide>::grad(const Eigen::Vector3f& pos, 
+    FieldSelector select) const {
+  return se::grad(cursor_type(*this), pos, select);
+}
+
+template <typename T, unsigned int BlockSide>
+bool HashMap<T, BlockSide>::allocate(key_t *keys, int num_elem){
+
+  if(num_elem < 1) return true;
+
+  // Map keys at or below the block level onto their block in place and 
+  // expand the coarser ones, unless too coarse, into the blocks they cover.
+  std::vector<Eigen::Vector3i> corners;
+  int last = 0;
+  int skipped = 0;
+  for(int i = 0; i < num_elem; ++i) {
+    const int level = keyops::level(keys[i]);
+    if(level >= leaves_level_) {
+      keys[last++] = block_key(keys[i]);
+      continue;
+    }
+    if(leaves_level_ - level > max_expand_levels) {
+      ++skipped;
+      continue;
+    }
+    const Eigen::Vector3i base = keyops::decode(keys[i]);
+    const int side = size_ >> level;
+    for(int z = 0; z < side; z += blockSide)
+      for(int y = 0; y < side; y += blockSide)
+        for(int x = 0; x < side; x += blockSide)
+          corners.push_back(base + Eigen::Vector3i(x, y, z));
+  }
+  num_elem = last;
+  std::vector<key_t> expanded(corners.size());
+  if(!expanded.empty()) {
+    // The corners are block aligned, their codes only lack the level
+    compute_morton(corners.data(), corners.size(), expanded.data());
+    for(key_t& k : expanded) k |= leaves_level_;
+    expanded.insert(expanded.end(), keys, keys + num_elem);
+    keys = expanded.data();
+    num_elem = expanded.size();
+  }
+
+  // Sorting removes duplicates and lays the new blocks out in morton order.
+  algorithms::radix_sort(keys, num_elem);
+  num_elem = std::unique(keys, keys+num_elem) - keys;
+
+  reserve_slots(block_buffer_.size() + num_elem);
+  block_buffer_.reserve(num_elem);
+
+#pragma omp parallel for
+  for(int i = 0; i < num_elem; ++i) {
+    insert_key(keys[i]);
+  }
+
+  if(skipped > 0) {
+    std::cerr << "HashMap::allocate: skipped " << skipped << " keys more than "
+      << max_expand_levels << " levels above the block level" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+template <typename T, unsigned int BlockSide>
+void HashMap<T, BlockSide>::getBlockList(
+    std::vector<VoxelBlock<T, BlockSide>*>& blocklist, bool active) {
+  if(active) {
+    for(const unsigned int slot : active_blocks_.slots()) 
+      blocklist.push_back(block_buffer_[slot]);
+    return;
+  }
+  // Released pool slots are recycled and must not be handed out
+  const size_t num_blocks = block_buffer_.size();
+  for(size_t i = 0; i < num_blocks; ++i) 
+    if(block_buffer_.used(i)) blocklist.push_back(block_buffer_[i]);
+}
+
+/*
+ * Same file layout as Octree::save with an empty node section, so that maps
+ * can be exchanged between the two backends.
+ */
+template <typename T, unsigned int BlockSide>
+void HashMap<T, BlockSide>::save(const std::string& filename) {
+  std::ofstream os (filename, std::ios::binary); 
+  internal::write_header(os);
+  os.write(reinterpret_cast<char *>(&size_), sizeof(size_));
+  os.write(reinterpret_cast<char *>(&dim_), sizeof(dim_));
+
+  size_t n = 0;
+  os.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+
+  n = block_buffer_.size() - block_buffer_.free_count();
+  os.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+  for(size_t i = 0; i < block_buffer_.size(); ++i)
+    if(block_buffer_.used(i)) internal::serialise(os, *block_buffer_[i]);
+}
+
+template <typename T, unsigned int BlockSide>
+void HashMap<T, BlockSide>::load(const std::string& filename) {
+  std::ifstream is (filename, std::ios::binary); 
+  const uint32_t version = internal::read_header(is);
+  int size;
+  float dim;
+  is.read(reinterpret_cast<char *>(&size), sizeof(size));
+  is.read(reinterpret_cast<char *>(&dim), sizeof(dim));
+
+  init(size, dim);
+
+  // Internal nodes carry no voxel data for this backend.
+  size_t n = 0;
+  is.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+  for(size_t i = 0; i < n; ++i) {
+    Node<T, BlockSide> tmp;
+    internal::deserialise(tmp, is, version);
+  }
+
+  is.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+  for(size_t i = 0; i < n; ++i) {
+    VoxelBlock<T, BlockSide> tmp;
+    internal::deserialise(tmp, is);
+    Eigen::Vector3i coords = tmp.coordinates();
+    VoxelBlock<T, BlockSide> * b = insert(coords(0), coords(1), coords(2));
+    b->storage() = tmp.storage();
+  }
+}
+
+/*! \brief Point query accessor remembering the last block it fetched, the 
+ * counterpart of se::octree_cursor. Not thread safe: use one per thread.
+ */
+template <typename T, unsigned int BlockSide>
+class hash_cursor {
+
+  public:
+    typedef voxel_traits<T> traits_type;
+    typedef typename traits_type::value_type value_type;
+
+    hash_cursor(const HashMap<T, BlockSide>& m) : map_(m), last_(NULL) {
+      leaves_level_ = log2(map_.size()) - math::log2_const(BlockSide);
+    }
+
+    inline int size() const { return map_.size(); }
+    inline float dim() const { return map_.dim(); }
+
+    VoxelBlock<T, BlockSide> * fetch(const int x, const int y, const int z) const {
+      if(last_) {
+        const Eigen::Vector3i offset = Eigen::Vector3i(x, y, z) - 
+          last_->coordinates();
+        if((offset.array() >= 0).all() && 
+           (offset.array() < static_cast<int>(BlockSide)).all()) return last_;
+      }
+      VoxelBlock<T, BlockSide> * block = map_.fetch(x, y, z);
+      if(block) last_ = block;
+      return block;
+    }
+
+    VoxelBlock<T, BlockSide> * fetch_octant(const int x, const int y, 
+        const int z, const int depth) const {
+      if(depth < leaves_level_) return NULL;
+      return fetch(x, y, z);
+    }
+
+    value_type get(const int x, const int y, const int z) const {
+      return get_fine(x, y, z);
+    }
+
+    value_type get_fine(const int x, const int y, const int z) const {
+      const VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+      if(!block) return traits_type::initValue();
+      return block->data(Eigen::Vector3i(x, y, z));
+    }
+
+    template <typename FieldSelect>
+    float interp(const Eigen::Vector3f& pos, FieldSelect select) const {
+      return se::interp(*this, pos, select);
+    }
+
+    void reset() { last_ = NULL; }
+
+  private:
+    const HashMap<T, BlockSide>& map_;
+    int leaves_level_;
+    mutable VoxelBlock<T, BlockSide> * last_;
+};
+}
+#endif
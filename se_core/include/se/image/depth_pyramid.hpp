@@ -0,0 +1,160 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef DEPTH_PYRAMID_HPP
+#define DEPTH_PYRAMID_HPP
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <Eigen/Dense>
+#include "image.hpp"
+
+namespace se {
+/*! \brief Minimum and maximum valid depth over square tiles of a depth 
+ * image. Level 0 tiles are base_side pixels wide, each further level merges
+ * 2x2 tiles of the previous one, up to a single tile covering the image.
+ * Pixels without a measurement (depth 0) are ignored: a tile without any has
+ * minimum +inf and maximum 0.
+ */
+class depth_pyramid {
+  public:
+    static constexpr int base_side = 8;
+
+    /*! \brief Compute the tiles of depth, reusing the storage of the 
+     * previous image if it had the same size.
+     */
+    void build(const Image<float>& depth) {
+      const int width = depth.width();
+      const int height = depth.height();
+      const float inf = std::numeric_limits<float>::infinity();
+      if(levels_.empty() || size_ != Eigen::Vector2i(width, height)) {
+        size_ = Eigen::Vector2i(width, height);
+        levels_.clear();
+        levels_.push_back(level((width + base_side - 1) / base_side, 
+              (height + base_side - 1) / base_side));
+        while(levels_.back().width > 1 || levels_.back().height > 1) 
+          levels_.push_back(level((levels_.back().width + 1) / 2, 
+                (levels_.back().height + 1) / 2));
+      }
+      level& base = levels_[0];
+#pragma omp parallel for
+      for(int ty = 0; ty < base.height; ++ty) {
+        for(int tx = 0; tx < base.width; ++tx) {
+          float lo = inf;
+          float hi = 0.f;
+          const int ylast = std::min((ty + 1) * base_side, height);
+          const int xlast = std::min((tx + 1) * base_side, width);
+          for(int y = ty * base_side; y < ylast; ++y)
+            for(int x = tx * base_side; x < xlast; ++x) {
+              const float d = depth[x + y * width];
+              if(d > 0.f) {
+                lo = std::min(lo, d);
+                hi = std::max(hi, d);
+              }
+            }
+          base.min[tx + ty * base.width] = lo;
+          base.max[tx + ty * base.width] = hi;
+        }
+      }
+
+      for(size_t l = 1; l < levels_.size(); ++l) {
+        const level& fine = levels_[l - 1];
+        level& coarse = levels_[l];
+        for(int ty = 0; ty < coarse.height; ++ty) 
+          for(int tx = 0; tx < coarse.width; ++tx) {
+            float lo = inf;
+            float hi = 0.f;
+            for(int y = 2 * ty; y < std::min(2 * ty + 2, fine.height); ++y)
+              for(int x = 2 * tx; x < std::min(2 * tx + 2, fine.width); ++x) {
+                lo = std::min(lo, fine.min[x + y * fine.width]);
+                hi = std::max(hi, fine.max[x + y * fine.width]);
+              }
+            coarse.min[tx + ty * coarse.width] = lo;
+            coarse.max[tx + ty * coarse.width] = hi;
+          }
+      }
+    }
+
+    /*! \brief Minimum and maximum valid depth over the pixels 
+     * [lower, upper], which must lie inside the image. The range is taken 
+     * over the coarsest tiles, at most 2x2, covering the pixels hence may be
+     * wider than theirs. (+inf, 0) if none has a measurement.
+     */
+    Eigen::Vector2f range(const Eigen::Vector2i& lower, 
+        const Eigen::Vector2i& upper) const {
+      const int side = base_side; // Eigen takes the scalar by reference
+      Eigen::Vector2i lo = lower / side;
+      Eigen::Vector2i hi = upper / side;
+      size_t l = 0;
+      for(; l + 1 < levels_.size() && ((hi - lo).array() > 1).any(); ++l) {
+        lo /= 2;
+        hi /= 2;
+      }
+      const level& tiles = levels_[l];
+      Eigen::Vector2f result(std::numeric_limits<float>::infinity(), 0.f);
+      for(int y = lo.y(); y <= hi.y(); ++y)
+        for(int x = lo.x(); x <= hi.x(); ++x) {
+          result(0) = std::min(result(0), tiles.min[x + y * tiles.width]);
+          result(1) = std::max(result(1), tiles.max[x + y * tiles.width]);
+        }
+      return result;
+    }
+
+    /*! \brief Range of the whole image.
+     */
+    Eigen::Vector2f range() const {
+      const level& top = levels_.back();
+      return Eigen::Vector2f(top.min[0], top.max[0]);
+    }
+
+    /*! \brief Whether level 0 tile (tx, ty) has no measurement.
+     */
+    bool empty(const int tx, const int ty) const {
+      return levels_[0].max[tx + ty * levels_[0].width] == 0.f;
+    }
+
+    int levels() const { return levels_.size(); }
+    Eigen::Vector2i size() const { return size_; }
+
+  private:
+    struct level {
+      level(const int w, const int h) : width(w), height(h), 
+        min(w * h), max(w * h) {}
+      int width;
+      int height;
+      std::vector<float> min;
+      std::vector<float> max;
+    };
+
+    Eigen::Vector2i size_;
+    std::vector<level> levels_;
+};
+}
+#endif
@@ -0,0 +1,112 @@
+/*
+    Copyright 2016 Emanuele Vespa, Imperial College London 
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+    may be used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef INTERP_HPP
+#define INTERP_HPP
+#include "interp_gather.hpp"
+#include "../utils/math_utils.h"
+
+namespace se {
+
+/*
+ * Trilinear interpolation of the field chosen by select at voxel position 
+ * pos. fetcher is a map or one of its cursors, queried through fetch and 
+ * get_fine by gather_points.
+ */
+template <typename FetcherT, typename FieldSelector>
+inline float interp(const FetcherT& fetcher, const Eigen::Vector3f& pos, 
+    FieldSelector select) {
+  const Eigen::Vector3i base = math::floorf(pos).cast<int>();
+  const Eigen::Vector3f factor = math::fracf(pos);
+  const Eigen::Vector3i lower = base.cwiseMax(Eigen::Vector3i::Constant(0));
+
+  float points[8];
+  gather_points(fetcher, lower, select, points);
+
+  return (((points[0] * (1 - factor(0))
+          + points[1] * factor(0)) * (1 - factor(1))
+          + (points[2] * (1 - factor(0))
+          + points[3] * factor(0)) * factor(1))
+          * (1 - factor(2))
+          + ((points[4] * (1 - factor(0))
+          + points[5] * factor(0))
+          * (1 - factor(1))
+          + (points[6] * (1 - factor(0))
+          + points[7] * factor(0))
+          * factor(1)) * factor(2));
+}
+
+/*
+ * Gradient of the field chosen by select at voxel position pos, in world 
+ * units: central differences computed at the eight corners surrounding pos
+ * and trilinearly interpolated. fetcher is a map or one of its cursors, 
+ * queried through fetch and get_fine.
+ */
+template <typename FetcherT, typename FieldSelector>
+inline Eigen::Vector3f grad(const FetcherT& fetcher, const Eigen::Vector3f& pos,
+    FieldSelector select) {
+  const int size = fetcher.size();
+  const float scale = 0.5f * fetcher.dim() / size;
+  const Eigen::Vector3i base = Eigen::Vector3i(math::floorf(pos).cast<int>());
+  const Eigen::Vector3f factor = math::fracf(pos);
+
+  Eigen::Vector3f gradient;
+  if(grad_local(fetcher.fetch(base(0), base(1), base(2)), base, factor, 
+        select, gradient)) return scale * gradient;
+
+  const Eigen::Vector3i max = Eigen::Vector3i::Constant(size - 1);
+  const Eigen::Vector3i zero = Eigen::Vector3i::Constant(0);
+  // Backward and forward samples for the lower and upper corner
+  const Eigen::Vector3i lower_lower = (base - Eigen::Vector3i::Constant(1)).cwiseMax(zero);
+  const Eigen::Vector3i lower_upper = base.cwiseMax(zero);
+  const Eigen::Vector3i upper_lower = (base + Eigen::Vector3i::Constant(1)).cwiseMin(max);
+  const Eigen::Vector3i upper_upper = (base + Eigen::Vector3i::Constant(2)).cwiseMin(max);
+  const Eigen::Vector3i corner[2] = {lower_upper, upper_lower};
+  const Eigen::Vector3i backward[2] = {lower_lower, lower_upper};
+  const Eigen::Vector3i forward[2] = {upper_lower, upper_upper};
+
+  for(int axis = 0; axis < 3; ++axis) {
+    float res = 0.f;
+    for(int i = 0; i < 8; ++i) {
+      const int c[3] = {i & 1, (i & 2) >> 1, (i & 4) >> 2};
+      Eigen::Vector3i f(corner[c[0]](0), corner[c[1]](1), corner[c[2]](2));
+      Eigen::Vector3i b = f;
+      f(axis) = forward[c[axis]](axis);
+      b(axis) = backward[c[axis]](axis);
+      const float weight = (c[0] ? factor(0) : 1 - factor(0)) *
+                           (c[1] ? factor(1) : 1 - factor(1)) *
+                           (c[2] ? factor(2) : 1 - factor(2));
+      res += weight * (select(fetcher.get_fine(f(0), f(1), f(2))) - 
+                       select(fetcher.get_fine(b(0), b(1), b(2))));
+    }
+    gradient(axis) = res;
+  }
+  return scale * gradient;
+}
+}
+#endif
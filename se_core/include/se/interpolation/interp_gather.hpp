@@ -40,42 +40,51 @@ static const Eigen::Vector3i interp_offsets[8] =
   {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {1, 1, 0}, 
    {0, 0, 1}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
 
-template <typename FieldType, typename FieldSelector>
-inline void gather_local(const se::VoxelBlock<FieldType>* block, const Eigen::Vector3i& base, 
+/*
+ * Value of a voxel whose block is not allocated: the map's get_fine returns
+ * the stored value of pruned regions and the initial value elsewhere.
+ */
+template <typename MapIndexT, typename FieldSelector>
+inline float missing_point(const MapIndexT& fetcher, const Eigen::Vector3i& base,
+    FieldSelector select, const unsigned int offset) {
+  const Eigen::Vector3i p = base + interp_offsets[offset];
+  return select(fetcher.get_fine(p(0), p(1), p(2)));
+}
+
+template <typename MapIndexT, typename FieldType, unsigned int BlockSide, 
+          typename FieldSelector>
+inline void gather_local(const MapIndexT& fetcher, 
+    const se::VoxelBlock<FieldType, BlockSide>* block, const Eigen::Vector3i& base, 
     FieldSelector select, float points[8]) {
 
   if(!block) {
-    points[0] = select(se::VoxelBlock<FieldType>::empty());
-    points[1] = select(se::VoxelBlock<FieldType>::empty());
-    points[2] = select(se::VoxelBlock<FieldType>::empty());
-    points[3] = select(se::VoxelBlock<FieldType>::empty());
-    points[4] = select(se::VoxelBlock<FieldType>::empty());
-    points[5] = select(se::VoxelBlock<FieldType>::empty());
-    points[6] = select(se::VoxelBlock<FieldType>::empty());
-    points[7] = select(se::VoxelBlock<FieldType>::empty());
+    for(unsigned int i = 0; i < 8; ++i) 
+      points[i] = missing_point(fetcher, base, select, i);
     return;
   }
 
-  points[0] = select(block->data(base + interp_offsets[0]));
-  points[1] = select(block->data(base + interp_offsets[1]));
-  points[2] = select(block->data(base + interp_offsets[2]));
-  points[3] = select(block->data(base + interp_offsets[3]));
-  points[4] = select(block->data(base + interp_offsets[4]));
-  points[5] = select(block->data(base + interp_offsets[5]));
-  points[6] = select(block->data(base + interp_offsets[6]));
-  points[7] = select(block->data(base + interp_offsets[7]));
+  typename se::VoxelBlock<FieldType, BlockSide>::value_type values[8];
+  block->gather(base, values);
+  points[0] = select(values[0]);
+  points[1] = select(values[1]);
+  points[2] = select(values[2]);
+  points[3] = select(values[3]);
+  points[4] = select(values[4]);
+  points[5] = select(values[5]);
+  points[6] = select(values[6]);
+  points[7] = select(values[7]);
   return;
 }
 
-template <typename FieldType, typename FieldSelector>
-inline void gather_4(const se::VoxelBlock<FieldType>* block, const Eigen::Vector3i& base, 
+template <typename MapIndexT, typename FieldType, unsigned int BlockSide, 
+          typename FieldSelector>
+inline void gather_4(const MapIndexT& fetcher, 
+    const se::VoxelBlock<FieldType, BlockSide>* block, const Eigen::Vector3i& base, 
     FieldSelector select, const unsigned int offsets[4], float points[8]) {
 
   if(!block) {
-    points[offsets[0]] = select(se::VoxelBlock<FieldType>::empty());
-    points[offsets[1]] = select(se::VoxelBlock<FieldType>::empty());
-    points[offsets[2]] = select(se::VoxelBlock<FieldType>::empty());
-    points[offsets[3]] = select(se::VoxelBlock<FieldType>::empty());
+    for(unsigned int i = 0; i < 4; ++i) 
+      points[offsets[i]] = missing_point(fetcher, base, select, offsets[i]);
     return;
   }
 
@@ -86,14 +95,16 @@ inline void gather_4(const se::VoxelBlock<FieldType>* block, const Eigen::Vector
   return;
 }
 
-template <typename FieldType, typename FieldSelector>
-inline void gather_2(const se::VoxelBlock<FieldType>* block, 
+template <typename MapIndexT, typename FieldType, unsigned int BlockSide, 
+          typename FieldSelector>
+inline void gather_2(const MapIndexT& fetcher, 
+    const se::VoxelBlock<FieldType, BlockSide>* block, 
     const Eigen::Vector3i& base, FieldSelector select, 
     const unsigned int offsets[2], float points[8]) {
 
   if(!block) {
-    points[offsets[0]] = select(se::VoxelBlock<FieldType>::empty());
-    points[offsets[1]] = select(se::VoxelBlock<FieldType>::empty());
+    for(unsigned int i = 0; i < 2; ++i) 
+      points[offsets[i]] = missing_point(fetcher, base, select, offsets[i]);
     return;
   }
 
@@ -102,13 +113,14 @@ inline void gather_2(const se::VoxelBlock<FieldType>* block,
   return;
 }
 
-template <typename FieldType, template<typename FieldT> class MapIndex,
+template <typename FieldType, unsigned int BlockSide, 
+         template<typename FieldT, unsigned int BlockSideT> class MapIndex,
          class FieldSelector>
-inline void gather_points(const MapIndex<FieldType>& fetcher, 
+inline void gather_points(const MapIndex<FieldType, BlockSide>& fetcher, 
     const Eigen::Vector3i& base, 
     FieldSelector select, float points[8]) {
  
-  unsigned int blockSize =  se::VoxelBlock<FieldType>::side;
+  unsigned int blockSize =  se::VoxelBlock<FieldType, BlockSide>::side;
   unsigned int crossmask = ((base(0) % blockSize == blockSize - 1) << 2) | 
                            ((base(1) % blockSize == blockSize - 1) << 1) |
                            ((base(2) % blockSize) == blockSize - 1);
@@ -116,30 +128,30 @@ inline void gather_points(const MapIndex<FieldType>& fetcher,
   switch(crossmask) {
     case 0: /* all local */
       {
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_local(block, base, select, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_local(fetcher, block, base, select, points);
       }
       break;
     case 1: /* z crosses */
       {
         const unsigned int offs1[4] = {0, 1, 2, 3};
         const unsigned int offs2[4] = {4, 5, 6, 7};
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_4(block, base, select, offs1, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_4(fetcher, block, base, select, offs1, points);
         const Eigen::Vector3i base1 = base + interp_offsets[offs2[0]];
         block = fetcher.fetch(base1(0), base1(1), base1(2));
-        gather_4(block, base, select, offs2, points);
+        gather_4(fetcher, block, base, select, offs2, points);
       }
       break;
     case 2: /* y crosses */ 
       {
         const unsigned int offs1[4] = {0, 1, 4, 5};
         const unsigned int offs2[4] = {2, 3, 6, 7};
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_4(block, base, select, offs1, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_4(fetcher, block, base, select, offs1, points);
         const Eigen::Vector3i base1 = base + interp_offsets[offs2[0]];
         block = fetcher.fetch(base1(0), base1(1), base1(2));
-        gather_4(block, base, select, offs2, points);
+        gather_4(fetcher, block, base, select, offs2, points);
       }
       break;
     case 3: /* y, z cross */ 
@@ -151,25 +163,25 @@ inline void gather_points(const MapIndex<FieldType>& fetcher,
         const Eigen::Vector3i base2 = base + interp_offsets[offs2[0]];
         const Eigen::Vector3i base3 = base + interp_offsets[offs3[0]];
         const Eigen::Vector3i base4 = base + interp_offsets[offs4[0]];
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_2(block, base, select, offs1, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_2(fetcher, block, base, select, offs1, points);
         block = fetcher.fetch(base2(0), base2(1), base2(2));
-        gather_2(block, base, select, offs2, points);
+        gather_2(fetcher, block, base, select, offs2, points);
         block = fetcher.fetch(base3(0), base3(1), base3(2));
-        gather_2(block, base, select, offs3, points);
+        gather_2(fetcher, block, base, select, offs3, points);
         block = fetcher.fetch(base4(0), base4(1), base4(2));
-        gather_2(block, base, select, offs4, points);
+        gather_2(fetcher, block, base, select, offs4, points);
       }
       break;
     case 4: /* x crosses */ 
       {
         const unsigned int offs1[4] = {0, 2, 4, 6};
         const unsigned int offs2[4] = {1, 3, 5, 7};
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_4(block, base, select, offs1, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_4(fetcher, block, base, select, offs1, points);
         const Eigen::Vector3i base1 = base + interp_offsets[offs2[0]];
         block = fetcher.fetch(base1(0), base1(1), base1(2));
-        gather_4(block, base, select, offs2, points);
+        gather_4(fetcher, block, base, select, offs2, points);
       }
       break;
     case 5: /* x,z cross */ 
@@ -181,14 +193,14 @@ inline void gather_points(const MapIndex<FieldType>& fetcher,
         const Eigen::Vector3i base2 = base + interp_offsets[offs2[0]];
         const Eigen::Vector3i base3 = base + interp_offsets[offs3[0]];
         const Eigen::Vector3i base4 = base + interp_offsets[offs4[0]];
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_2(block, base, select, offs1, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_2(fetcher, block, base, select, offs1, points);
         block = fetcher.fetch(base2(0), base2(1), base2(2));
-        gather_2(block, base, select, offs2, points);
+        gather_2(fetcher, block, base, select, offs2, points);
         block = fetcher.fetch(base3(0), base3(1), base3(2));
-        gather_2(block, base, select, offs3, points);
+        gather_2(fetcher, block, base, select, offs3, points);
         block = fetcher.fetch(base4(0), base4(1), base4(2));
-        gather_2(block, base, select, offs4, points);
+        gather_2(fetcher, block, base, select, offs4, points);
       }
       break;
     case 6: /* x,y cross */ 
@@ -200,14 +212,14 @@ inline void gather_points(const MapIndex<FieldType>& fetcher,
         const Eigen::Vector3i base2 = base + interp_offsets[offs2[0]];
         const Eigen::Vector3i base3 = base + interp_offsets[offs3[0]];
         const Eigen::Vector3i base4 = base + interp_offsets[offs4[0]];
-        se::VoxelBlock<FieldType> * block = fetcher.fetch(base(0), base(1), base(2));
-        gather_2(block, base, select, offs1, points);
+        se::VoxelBlock<FieldType, BlockSide> * block = fetcher.fetch(base(0), base(1), base(2));
+        gather_2(fetcher, block, base, select, offs1, points);
         block = fetcher.fetch(base2(0), base2(1), base2(2));
-        gather_2(block, base, select, offs2, points);
+        gather_2(fetcher, block, base, select, offs2, points);
         block = fetcher.fetch(base3(0), base3(1), base3(2));
-        gather_2(block, base, select, offs3, points);
+        gather_2(fetcher, block, base, select, offs3, points);
         block = fetcher.fetch(base4(0), base4(1), base4(2));
-        gather_2(block, base, select, offs4, points);
+        gather_2(fetcher, block, base, select, offs4, points);
       }
       break;
 
@@ -235,5 +247,54 @@ inline void gather_points(const MapIndex<FieldType>& fetcher,
       break;
   }
 }
+
+/*
+ * Gradient from the 4x4x4 window around base, gathered as eight 2x2x2 cells.
+ * Central differences are trilinearly interpolated as in Octree::grad. 
+ * Returns false if the window is not contained in block.
+ */
+template <typename FieldType, unsigned int BlockSide, typename FieldSelector>
+inline bool grad_local(const se::VoxelBlock<FieldType, BlockSide>* block, 
+    const Eigen::Vector3i& base, const Eigen::Vector3f& factor, 
+    FieldSelector select, Eigen::Vector3f& gradient) {
+
+  if(!block) return false;
+  const Eigen::Vector3i offset = base - block->coordinates();
+  if((offset.array() < 1).any() || 
+     (offset.array() > static_cast<int>(BlockSide) - 3).any()) return false;
+
+  // window[(x+1) + (y+1)*4 + (z+1)*16] holds the sample at base + (x, y, z)
+  float window[64];
+  for(int k = 0; k < 2; ++k)
+    for(int j = 0; j < 2; ++j)
+      for(int i = 0; i < 2; ++i) {
+        typename se::VoxelBlock<FieldType, BlockSide>::value_type cell[8];
+        block->gather(base + Eigen::Vector3i(2*i - 1, 2*j - 1, 2*k - 1), cell);
+        for(int c = 0; c < 8; ++c) {
+          const int x = 2*i + (c & 1);
+          const int y = 2*j + ((c >> 1) & 1);
+          const int z = 2*k + ((c >> 2) & 1);
+          window[x + y*4 + z*16] = select(cell[c]);
+        }
+      }
+
+  const int stride[3] = {1, 4, 16};
+  for(int a = 0; a < 3; ++a) {
+    float diff[8];
+    for(int c = 0; c < 8; ++c) {
+      const int centre = ((c & 1) + 1) + (((c >> 1) & 1) + 1)*4 + 
+        (((c >> 2) & 1) + 1)*16;
+      diff[c] = window[centre + stride[a]] - window[centre - stride[a]];
+    }
+    gradient(a) = (((diff[0] * (1 - factor(0)) + diff[1] * factor(0))
+          * (1 - factor(1))
+          + (diff[2] * (1 - factor(0)) + diff[3] * factor(0)) * factor(1))
+        * (1 - factor(2))
+      + ((diff[4] * (1 - factor(0)) + diff[5] * factor(0)) * (1 - factor(1))
+          + (diff[6] * (1 - factor(0)) + diff[7] * factor(0)) * factor(1))
+        * factor(2));
+  }
+  return true;
+}
 }
 #endif
@@ -31,29 +31,76 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef SE_SERIALISE_HPP
 #define SE_SERIALISE_HPP
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
+#include <vector>
 #include "../octree_defines.h"
 #include "Eigen/Dense"
 
 namespace se {
 
-  template <typename T>
+  template <typename T, unsigned int BlockSide>
   class Node;
 
-  template <typename T>
+  template <typename T, unsigned int BlockSide>
   class VoxelBlock;
 
+  /*
+   * Map files start with map_magic followed by the format version. Files 
+   * written before the header was introduced start with the map size instead
+   * and are read as version 0, whose nodes carry no pruned mask.
+   */
+  constexpr char map_magic[4] = {'S', 'E', 'M', 'P'};
+  constexpr uint32_t map_version = 1;
+
   namespace internal {
+    /*
+     * \brief Write the magic number and format version of a map file.
+     * \param out binary output file
+     */
+    inline std::ofstream& write_header(std::ofstream& out) {
+      out.write(map_magic, sizeof(map_magic));
+      out.write(reinterpret_cast<const char *>(&map_version), 
+          sizeof(map_version));
+      return out;
+    }
+
+    /*
+     * \brief Read the header of a map file, leaving in at the map size.
+     * Throws std::runtime_error on files of a newer format version.
+     * \param in binary input file
+     * \return format version of the file, 0 for files without a header
+     */
+    inline uint32_t read_header(std::ifstream& in) {
+      char magic[sizeof(map_magic)];
+      in.read(magic, sizeof(magic));
+      if(!in || std::memcmp(magic, map_magic, sizeof(magic)) != 0) {
+        in.clear();
+        in.seekg(0);
+        return 0;
+      }
+      uint32_t version = 0;
+      in.read(reinterpret_cast<char *>(&version), sizeof(version));
+      if(!in || version > map_version) 
+        throw std::runtime_error("Unsupported map file format version");
+      return version;
+    }
+
     /*
      * \brief Write node's data to output file out. We do not serialise child
-     * pointers and mask as those will be reconstructed when deserialising.
+     * pointers and mask as those will be reconstructed when deserialising, 
+     * the pruned mask is written as it cannot.
      * \param out binary output file
      * \param node Node to be serialised
      */
-    template <typename T>
-    std::ofstream& serialise(std::ofstream& out, Node<T>& node) {
+    template <typename T, unsigned int BlockSide>
+    std::ofstream& serialise(std::ofstream& out, Node<T, BlockSide>& node) {
       out.write(reinterpret_cast<char *>(&node.code_), sizeof(key_t));
       out.write(reinterpret_cast<char *>(&node.side_), sizeof(int));
+      out.write(reinterpret_cast<char *>(&node.pruned_mask_), 
+          sizeof(node.pruned_mask_));
       out.write(reinterpret_cast<char *>(&node.value_), sizeof(node.value_));
       return out;
     }
@@ -63,11 +110,18 @@ namespace se {
      * pointers and mask as those will be reconstructed when deserialising.
      * \param out binary output file
      * \param node Node to be serialised
+     * \param version format version of the file, see read_header
      */
-    template <typename T>
-    void deserialise(Node<T>& node, std::ifstream& in) {
+    template <typename T, unsigned int BlockSide>
+    void deserialise(Node<T, BlockSide>& node, std::ifstream& in, 
+        const uint32_t version = map_version) {
       in.read(reinterpret_cast<char *>(&node.code_), sizeof(key_t));
       in.read(reinterpret_cast<char *>(&node.side_), sizeof(int));
+      node.pruned_mask_ = 0;
+      if(version >= 1) {
+        in.read(reinterpret_cast<char *>(&node.pruned_mask_), 
+            sizeof(node.pruned_mask_));
+      }
       in.read(reinterpret_cast<char *>(&node.value_), sizeof(node.value_));
     }
 
@@ -76,12 +130,20 @@ namespace se {
      * \param out binary output file
      * \param node Node to be serialised
      */
-    template <typename T>
-    std::ofstream& serialise(std::ofstream& out, VoxelBlock<T>& block) {
+    template <typename T, unsigned int BlockSide>
+    std::ofstream& serialise(std::ofstream& out, VoxelBlock<T, BlockSide>& block) {
       out.write(reinterpret_cast<char *>(&block.code_), sizeof(key_t));
       out.write(reinterpret_cast<char *>(&block.coordinates_), sizeof(Eigen::Vector3i));
-      out.write(reinterpret_cast<char *>(&block.voxel_block_), 
-          sizeof(block.voxel_block_));
+      // Voxels are written as a linear array of values whatever the storage 
+      // and layout of the block, as they were before those existed.
+      typedef typename VoxelBlock<T, BlockSide>::value_type value_type;
+      std::vector<value_type> voxels(BlockSide * BlockSide * BlockSide);
+      for(unsigned int z = 0, i = 0; z < BlockSide; ++z)
+        for(unsigned int y = 0; y < BlockSide; ++y)
+          for(unsigned int x = 0; x < BlockSide; ++x, ++i)
+            voxels[i] = block.voxel_block_[block.index(x, y, z)];
+      out.write(reinterpret_cast<char *>(voxels.data()), 
+          voxels.size() * sizeof(value_type));
       return out;
     }
 
@@ -91,11 +153,18 @@ namespace se {
      * \param out binary output file
      * \param node Node to be serialised
      */
-    template <typename T>
-    void deserialise(VoxelBlock<T>& block, std::ifstream& in) {
+    template <typename T, unsigned int BlockSide>
+    void deserialise(VoxelBlock<T, BlockSide>& block, std::ifstream& in) {
       in.read(reinterpret_cast<char *>(&block.code_), sizeof(key_t));
       in.read(reinterpret_cast<char *>(&block.coordinates_), sizeof(Eigen::Vector3i));
-      in.read(reinterpret_cast<char *>(&block.voxel_block_), sizeof(block.voxel_block_));
+      typedef typename VoxelBlock<T, BlockSide>::value_type value_type;
+      std::vector<value_type> voxels(BlockSide * BlockSide * BlockSide);
+      in.read(reinterpret_cast<char *>(voxels.data()), 
+          voxels.size() * sizeof(value_type));
+      for(unsigned int z = 0, i = 0; z < BlockSide; ++z)
+        for(unsigned int y = 0; y < BlockSide; ++y)
+          for(unsigned int x = 0; x < BlockSide; ++x, ++i)
+            block.voxel_block_.set(block.index(x, y, z), voxels[i]);
     }
   }
 }
@@ -0,0 +1,785 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+#ifndef LINEAR_OCTREE_HPP
+#define LINEAR_OCTREE_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "utils/math_utils.h"
+#include "octree_defines.h"
+#include "voxel_traits.hpp"
+#include "utils/morton_utils.hpp"
+#include "octant_ops.hpp"
+
+#include "node.hpp"
+#include "utils/memory_pool.hpp"
+#include "utils/active_set.hpp"
+#include "algorithms/parallel.hpp"
+#include "algorithms/unique.hpp"
+#include "interpolation/interp.hpp"
+
+namespace se {
+
+template <typename T, unsigned int BlockSide, typename MapT>
+class block_ray_iterator;
+
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+class linear_cursor;
+
+/*! \brief Pointer-free octant of a LinearOctree. The tree topology is not 
+ * stored in the node: children are found by looking up their morton code in 
+ * the sorted octant arrays of the owning tree, hence no child pointers nor 
+ * vtable are needed.
+ */
+template <typename T>
+class LinearNode {
+
+public:
+  typedef voxel_traits<T> traits_type;
+  typedef typename traits_type::value_type value_type;
+  value_type empty() const { return traits_type::empty(); }
+  value_type init_val() const { return traits_type::initValue(); }
+
+  value_type value_[8];
+  key_t code_;
+  unsigned int side_;
+  unsigned char children_mask_;
+
+  LinearNode(){
+    code_ = 0;
+    side_ = 0;
+    children_mask_ = 0;
+    for (unsigned int i = 0; i < 8; i++){
+      value_[i] = init_val();
+    }
+  }
+};
+
+/*! \brief Linear octree. Internal nodes and voxel blocks are kept in memory
+ * pools and indexed by morton-sorted key arrays holding 32-bit pool indices.
+ * Point queries are resolved by binary search on the contiguous key arrays
+ * instead of walking child pointers from the root. It exposes the same
+ * interface as se::Octree used by VolumeTemplate and the functors.
+ *
+ * The memory saving is limited to the internal nodes. Voxel blocks are plain
+ * se::VoxelBlock, shared with the functors and kernels written against
+ * se::Octree, and still carry the eight unused child pointers inherited from
+ * se::Node (64 bytes per block).
+ */
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+class LinearOctree
+{
+
+public:
+
+  typedef voxel_traits<T> traits_type;
+  typedef typename traits_type::value_type value_type;
+  typedef MemoryPool<VoxelBlock<T, BlockSide>, block_page_allocator> 
+    block_pool_type;
+  typedef LinearNode<T> node_type;
+  typedef block_ray_iterator<T, BlockSide, LinearOctree<T, BlockSide> > 
+    ray_iterator_type;
+  typedef linear_cursor<T, BlockSide> cursor_type;
+  value_type empty() const { return traits_type::empty(); }
+  value_type init_val() const { return traits_type::initValue(); }
+
+  // # of voxels per side in a voxel block
+  static constexpr unsigned int blockSide = BlockSide;
+  // maximum tree depth in bits
+  static constexpr unsigned int max_depth = ((sizeof(key_t)*8)/3);
+  // Tree depth at which blocks are found
+  static constexpr unsigned int block_depth = max_depth - math::log2_const(BlockSide);
+
+  LinearOctree(){
+  };
+
+  /*! \brief Initialises the octree attributes
+   * \param size number of voxels per side of the cube
+   * \param dim cube extension per side, in meter
+   */
+  void init(int size, float dim);
+
+  inline int size() const { return size_; }
+  inline float dim() const { return dim_; }
+  inline LinearNode<T>* root() const { 
+    return nodes_.size() == 0 ? NULL : nodes_buffer_[nodes_.root()]; 
+  }
+
+  /*! \brief Sets voxel value at coordinates (x,y,z), if the containing block 
+   * is allocated. This method is not thread safe.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  void set(const int x, const int y, const int z, const value_type val);
+
+  /*! \brief Retrieves voxel value at coordinates (x,y,z). If the voxel block
+   * is not allocated the value stored at the deepest allocated ancestor is 
+   * returned.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  value_type get(const int x, const int y, const int z) const;
+  value_type get_fine(const int x, const int y, const int z) const;
+
+  /*! \brief Fetch the voxel block at which contains voxel  (x,y,z)
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  VoxelBlock<T, BlockSide> * fetch(const int x, const int y, const int z) const;
+
+  /*! \brief Fetch the internal node (x,y,z) at level depth. Voxel blocks are 
+   * stored separately and must be retrieved via fetch.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   * \param depth level to be searched, must be smaller than the blocks level
+   */
+  LinearNode<T> * fetch_octant(const int x, const int y, const int z, 
+      const int depth) const;
+
+  /*! \brief Insert the voxel block containing (x,y,z), allocating all the
+   * missing ancestors. Cheaper than allocate for a single block, as the 
+   * octants are inserted one by one without sorting. Not thread safe.
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  VoxelBlock<T, BlockSide> * insert(const int x, const int y, const int z);
+
+  /*! \brief Interp voxel value at voxel position  (x,y,z)
+   * \param pos three-dimensional coordinates in which each component belongs 
+   * to the interval [0, size]
+   */
+  template <typename FieldSelect>
+  float interp(const Eigen::Vector3f& pos, FieldSelect f) const;
+
+  /*! \brief Compute the gradient at voxel position  (x,y,z)
+   * \param pos three-dimensional coordinates in which each component belongs 
+   * to the interval [0, size]
+   */
+  template <typename FieldSelect>
+  Eigen::Vector3f grad(const Eigen::Vector3f& pos, FieldSelect selector) const;
+
+  /*! \brief Get the list of allocated block. If the active switch is set to
+   * true then only the visible blocks are retrieved.
+   * \param blocklist output vector of allocated blocks
+   * \param active boolean switch. Set to true to retrieve visible, allocated 
+   * blocks, false to retrieve all allocated blocks.
+   */
+  void getBlockList(std::vector<VoxelBlock<T, BlockSide> *>& blocklist, bool active);
+
+  /*! \brief Mark block as active, i.e. to be visited by the next 
+   * integration. Blocks are activated when allocated. Thread safe.
+   */
+  void activate(VoxelBlock<T, BlockSide> * block) {
+    active_blocks_.activate(block);
+  }
+
+  /*! \brief Mark block as inactive. Thread safe.
+   */
+  void deactivate(VoxelBlock<T, BlockSide> * block) {
+    active_blocks_.deactivate(block);
+  }
+
+  /*! \brief Slots in getBlockBuffer() of the active blocks, see 
+   * se::Octree::activeBlocks.
+   */
+  active_set& activeBlocks(){ return active_blocks_; }
+  block_pool_type& getBlockBuffer(){ return block_buffer_; };
+  MemoryPool<LinearNode<T> >& getNodesBuffer(){ return nodes_buffer_; };
+  const block_pool_type& getBlockBuffer() const { 
+    return block_buffer_; 
+  };
+  const MemoryPool<LinearNode<T> >& getNodesBuffer() const { return nodes_buffer_; };
+
+  /*! \brief Computes the morton code of the block containing voxel 
+   * at coordinates (x,y,z)
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   */
+  key_t hash(const int x, const int y, const int z) {
+    const int scale = max_level_ - math::log2_const(blockSide); // depth of blocks
+    return keyops::encode(x, y, z, scale, max_level_);   
+  }
+
+  key_t hash(const int x, const int y, const int z, key_t scale) {
+    return keyops::encode(x, y, z, scale, max_level_); 
+  }
+
+  /*! \brief allocate a set of voxel blocks via their positional key  
+   * \param keys collection of voxel block keys to be allocated (i.e. their 
+   * morton number)
+   * \param number of keys in the keys array
+   */
+  bool allocate(key_t *keys, int num_elem);
+
+  void save(const std::string& filename);
+  void load(const std::string& filename);
+
+  /*! \brief Counts the number of blocks allocated
+   * \return number of voxel blocks allocated
+   */
+  int leavesCount() const { return blocks_.size(); }
+
+  /*! \brief Counts the number of internal nodes
+   * \return number of internal nodes
+   */
+  int nodeCount() const { return nodes_.size(); }
+
+private:
+
+  int size_;
+  float dim_;
+  int max_level_;
+  int leaves_level_;
+  block_pool_type block_buffer_;
+  MemoryPool<LinearNode<T> > nodes_buffer_;
+  active_set active_blocks_;
+
+  /*
+   * Morton sorted octant keys and the pool index of the matching octant.
+   * Keys live in a main array and a small side array, both sorted. A batch
+   * which is small compared to the map is merged into the side array only, 
+   * and the side array is merged into the main one once it grows past 
+   * about the square root of it. Allocating a few blocks then costs time
+   * proportional to the side array instead of the whole map.
+   */
+  class octant_index {
+    public:
+      size_t size() const { return keys_.size() + side_keys_.size(); }
+      uint32_t root() const { return idx_[0]; }
+
+      // Pool index of key or -1 if not found.
+      long int find(const key_t key) const {
+        const long int pos = search(keys_, key);
+        if(pos >= 0) return idx_[pos];
+        const long int side = search(side_keys_, key);
+        return side < 0 ? -1 : static_cast<long int>(side_idx_[side]);
+      }
+
+      // Largest key not greater than query and its pool index, false if 
+      // there is none.
+      bool predecessor(const key_t query, key_t& key, uint32_t& idx) const {
+        auto it = std::upper_bound(keys_.begin(), keys_.end(), query);
+        auto side = std::upper_bound(side_keys_.begin(), side_keys_.end(), 
+            query);
+        const bool in_main = it != keys_.begin();
+        const bool in_side = side != side_keys_.begin();
+        if(in_side && (!in_main || *(side - 1) > *(it - 1))) {
+          key = *(side - 1);
+          idx = side_idx_[std::distance(side_keys_.begin(), side) - 1];
+          return true;
+        }
+        if(!in_main) return false;
+        key = *(it - 1);
+        idx = idx_[std::distance(keys_.begin(), it) - 1];
+        return true;
+      }
+
+      // Insert sorted keys, none of which is present, with their indices.
+      void insert(const std::vector<key_t>& keys, 
+          const std::vector<uint32_t>& idx) {
+        if(keys.empty()) return;
+        if(8 * keys.size() >= keys_.size()) {
+          merge(keys_, idx_, keys, idx);
+          return;
+        }
+        merge(side_keys_, side_idx_, keys, idx);
+        const size_t limit = std::max<size_t>(256, 
+            4 * std::sqrt(static_cast<double>(keys_.size())));
+        if(side_keys_.size() > limit) {
+          merge(keys_, idx_, side_keys_, side_idx_);
+          side_keys_.clear();
+          side_idx_.clear();
+        }
+      }
+
+      // Invoke f(key, idx) on every octant in morton order.
+      template <typename F>
+      void for_each(F f) const {
+        size_t i = 0, j = 0;
+        while(i < keys_.size() || j < side_keys_.size()) {
+          if(j == side_keys_.size() || 
+             (i < keys_.size() && keys_[i] < side_keys_[j])) {
+            f(keys_[i], idx_[i]);
+            ++i;
+          } else {
+            f(side_keys_[j], side_idx_[j]);
+            ++j;
+          }
+        }
+      }
+
+    private:
+      std::vector<key_t> keys_;
+      std::vector<uint32_t> idx_;
+      std::vector<key_t> side_keys_;
+      std::vector<uint32_t> side_idx_;
+
+      // Returns the position of key in the sorted array or -1 if not found.
+      static long int search(const std::vector<key_t>& keys, 
+          const key_t key) {
+        auto it = std::lower_bound(keys.begin(), keys.end(), key);
+        if(it == keys.end() || *it != key) return -1;
+        return std::distance(keys.begin(), it);
+      }
+
+      // Merge the sorted new keys in the sorted key array, in place.
+      static void merge(std::vector<key_t>& keys, std::vector<uint32_t>& idx,
+          const std::vector<key_t>& new_keys, 
+          const std::vector<uint32_t>& new_idx) {
+        const size_t old_size = keys.size();
+        keys.resize(old_size + new_keys.size());
+        idx.resize(old_size + new_keys.size());
+        // Merge from the back so that it can be done in place.
+        long int i = old_size - 1;
+        long int j = new_keys.size() - 1;
+        for(long int k = keys.size() - 1; j >= 0; --k) {
+          if(i >= 0 && keys[i] > new_keys[j]) {
+            keys[k] = keys[i];
+            idx[k] = idx[i];
+            --i;
+          } else {
+            keys[k] = new_keys[j];
+            idx[k] = new_idx[j];
+            --j;
+          }
+        }
+      }
+  };
+
+  octant_index nodes_;
+  octant_index blocks_;
+
+  // Returns the deepest allocated internal node containing voxel (x,y,z). 
+  const LinearNode<T>* deepest_ancestor(const int x, const int y, 
+      const int z) const;
+
+  // Morton code of voxel (x,y,z) truncated at the given level
+  inline key_t octant_key(const int x, const int y, const int z, 
+      const int level) const {
+    return keyops::encode(x, y, z, level, max_level_);
+  }
+
+  // Link octant k, just allocated, to its parent.
+  void link(const key_t k) {
+    const int level = keyops::level(k);
+    LinearNode<T> * p = nodes_buffer_[nodes_.find(parent(k, max_level_))];
+    p->children_mask_ |= (1 << child_id(k, level, max_level_));
+  }
+
+  value_type get(const int x, const int y, const int z, 
+      const VoxelBlock<T, BlockSide>* cached) const;
+};
+
+template <typename T, unsigned int BlockSide>
+void LinearOctree<T, BlockSide>::init(int size, float dim) {
+  size_ = size;
+  dim_ = dim;
+  max_level_ = log2(size);
+  leaves_level_ = max_level_ - math::log2_const(blockSide);
+  unsigned int idx;
+  LinearNode<T> * root = nodes_buffer_.acquire_block(idx);
+  root->side_ = size;
+  nodes_.insert({0}, {idx});
+}
+
+template <typename T, unsigned int BlockSide>
+inline VoxelBlock<T, BlockSide> * LinearOctree<T, BlockSide>::fetch(const int x, const int y, 
+   const int z) const {
+  const long int idx = blocks_.find(octant_key(x, y, z, leaves_level_));
+  return idx < 0 ? NULL : block_buffer_[idx];
+}
+
+template <typename T, unsigned int BlockSide>
+inline LinearNode<T> * LinearOctree<T, BlockSide>::fetch_octant(const int x, const int y, 
+   const int z, const int depth) const {
+  if(depth >= leaves_level_) return NULL;
+  const long int idx = nodes_.find(octant_key(x, y, z, depth));
+  return idx < 0 ? NULL : nodes_buffer_[idx];
+}
+
+/*
+ * The key arrays are sorted by code and level, i.e. octants are stored in 
+ * pre-order. The last node preceding the query point is either its deepest
+ * ancestor or it lies in a subtree rooted at a sibling of one of its
+ * ancestors. Either way the deepest ancestor is found at the level of the
+ * common prefix of the two codes, which is guaranteed to be allocated. The
+ * predecessor over the main and side arrays is the larger of the two.
+ */
+template <typename T, unsigned int BlockSide>
+inline const LinearNode<T>* LinearOctree<T, BlockSide>::deepest_ancestor(const int x, 
+    const int y, const int z) const {
+  const key_t query = octant_key(x, y, z, leaves_level_) | SCALE_MASK;
+  key_t prev;
+  uint32_t prev_idx;
+  if(!nodes_.predecessor(query, prev, prev_idx)) return NULL;
+  const key_t diff = keyops::code(prev) ^ keyops::code(query);
+  const unsigned int shift = MAX_BITS - max_level_ - 1;
+  int level = keyops::level(prev);
+  while(level > 0 && (diff & MASK[level + shift])) --level;
+  if(level == keyops::level(prev)) return nodes_buffer_[prev_idx];
+  return nodes_buffer_[nodes_.find(octant_key(x, y, z, level))];
+}
+
+template <typename T, unsigned int BlockSide>
+inline void LinearOctree<T, BlockSide>::set(const int x, const int y, const int z, 
+    const value_type val) {
+  VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+  if(!block) return;
+  block->data(Eigen::Vector3i(x, y, z), val);
+}
+
+template <typename T, unsigned int BlockSide>
+inline typename LinearOctree<T, BlockSide>::value_type LinearOctree<T, BlockSide>::get(const int x,
+    const int y, const int z) const {
+  const VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+  if(block) {
+    return block->data(Eigen::Vector3i(x, y, z));
+  }
+  const LinearNode<T> * n = deepest_ancestor(x, y, z);
+  if(!n) {
+    return init_val();
+  }
+  const int level = keyops::level(n->code_);
+  const int childid = child_id(octant_key(x, y, z, level + 1), level + 1,
+      max_level_);
+  return n->value_[childid];
+}
+
+template <typename T, unsigned int BlockSide>
+inline typename LinearOctree<T, BlockSide>::value_type LinearOctree<T, BlockSide>::get_fine(
+    const int x, const int y, const int z) const {
+  const VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+  if(!block) {
+    return init_val();
+  }
+  return block->data(Eigen::Vector3i(x, y, z));
+}
+
+template <typename T, unsigned int BlockSide>
+inline typename LinearOctree<T, BlockSide>::value_type LinearOctree<T, BlockSide>::get(const int x,
+   const int y, const int z, const VoxelBlock<T, BlockSide>* cached) const {
+
+  if(cached != NULL){
+    const Eigen::Vector3i pos = Eigen::Vector3i(x, y, z);
+    const Eigen::Vector3i lower = cached->coordinates();
+    const Eigen::Vector3i upper = lower + Eigen::Vector3i::Constant(blockSide-1);
+    const int contained = 
+      ((pos.array() >= lower.array()) && (pos.array() <= upper.array())).all();
+    if(contained){
+      return cached->data(pos);
+    }
+  }
+  return get_fine(x, y, z);
+}
+
+template <typename T, unsigned int BlockSide>
+VoxelBlock<T, BlockSide> * LinearOctree<T, BlockSide>::insert(const int x, const int y, const int z) {
+  VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+  if(block) return block;
+
+  unsigned int idx;
+  for(int level = 1; level < leaves_level_; ++level) {
+    const key_t k = octant_key(x, y, z, level);
+    if(nodes_.find(k) >= 0) continue;
+    LinearNode<T> * n = nodes_buffer_.acquire_block(idx);
+    n->code_ = k;
+    n->side_ = size_ >> level;
+    nodes_.insert({k}, {idx});
+    link(k);
+  }
+
+  const key_t k = octant_key(x, y, z, leaves_level_);
+  block = block_buffer_.acquire_block(idx);
+  block->slot(idx);
+  block->code_ = k;
+  block->side_ = blockSide;
+  block->coordinates(keyops::decode(k));
+  blocks_.insert({k}, {idx});
+  link(k);
+  activate(block);
+  return block;
+}
+
+template <typename T, unsigned int BlockSide>
+template <typename FieldSelector>
+float LinearOctree<T, BlockSide>::interp(const Eigen::Vector3f& pos, 
+    FieldSelector select) const {
+  
+  return se::interp(*this, pos, select);
+}
+
+template <typename T, unsigned int BlockSide>
+template <typename FieldSelector>
+Eigen::Vector3f LinearOctree<T, BlockSide>::grad(const Eigen::Vector3f& pos, 
+    FieldSelector select) const {
+  return se::grad(cursor_type(*this), pos, select);
+}
+
+template <typename T, unsigned int BlockSide>
+bool LinearOctree<T, BlockSide>::allocate(key_t *keys, int num_elem){
+
+  if(num_elem < 1) return true;
+  algorithms::radix_sort(keys, num_elem);
+  num_elem = algorithms::filter_ancestors(keys, num_elem, max_level_);
+
+  // Expand every key into the octants on its root-to-leaf path.
+  std::vector<size_t> offset(num_elem + 1, 0);
+  for(int i = 0; i < num_elem; ++i) {
+    offset[i + 1] = offset[i] + std::min(keyops::level(keys[i]), leaves_level_);
+  }
+  const unsigned int shift = MAX_BITS - max_level_ - 1;
+  std::vector<key_t> octants(offset[num_elem]);
+#pragma omp parallel for
+  for(int i = 0; i < num_elem; ++i) {
+    key_t * dst = octants.data() + offset[i];
+    const int level = offset[i + 1] - offset[i];
+    for(int l = 1; l <= level; ++l) {
+      dst[l - 1] = (keyops::code(keys[i]) & MASK[l + shift]) | l;
+    }
+  }
+  std::vector<key_t> distinct(octants.size());
+  algorithms::radix_sort(octants.data(), octants.size(), distinct.data());
+  distinct.resize(algorithms::unique_copy(octants.data(), octants.size(), 
+        distinct.data()));
+
+  // Look the octants up once: 1 marks a missing node, 2 a missing block.
+  const key_t * in = distinct.data();
+  std::vector<unsigned char> missing(distinct.size());
+#pragma omp parallel for
+  for(unsigned int i = 0; i < distinct.size(); ++i) {
+    if(keyops::level(in[i]) < leaves_level_) {
+      missing[i] = nodes_.find(in[i]) < 0 ? 1 : 0;
+    } else {
+      missing[i] = blocks_.find(in[i]) < 0 ? 2 : 0;
+    }
+  }
+  std::vector<key_t> new_nodes;
+  std::vector<key_t> new_blocks;
+  algorithms::compact(in, distinct.size(), new_nodes, 
+      [&](const size_t i) { return missing[i] == 1; });
+  algorithms::compact(in, distinct.size(), new_blocks, 
+      [&](const size_t i) { return missing[i] == 2; });
+
+  std::vector<uint32_t> node_idx(new_nodes.size());
+  std::vector<uint32_t> block_idx(new_blocks.size());
+  nodes_buffer_.reserve(new_nodes.size());
+  block_buffer_.reserve(new_blocks.size());
+  for(uint32_t& i : node_idx) nodes_buffer_.acquire_block(i);
+  for(uint32_t& i : block_idx) block_buffer_.acquire_block(i);
+
+#pragma omp parallel for
+  for(unsigned int i = 0; i < new_nodes.size(); ++i) {
+    LinearNode<T> * n = nodes_buffer_[node_idx[i]];
+    n->code_ = new_nodes[i];
+    n->side_ = size_ >> keyops::level(new_nodes[i]);
+  }
+
+  std::vector<key_t> block_codes(new_blocks.size());
+  std::vector<Eigen::Vector3i> corners(new_blocks.size());
+  for(unsigned int i = 0; i < new_blocks.size(); ++i) {
+    block_codes[i] = keyops::code(new_blocks[i]);
+  }
+  unpack_morton(block_codes.data(), block_codes.size(), corners.data());
+
+#pragma omp parallel for
+  for(unsigned int i = 0; i < new_blocks.size(); ++i) {
+    VoxelBlock<T, BlockSide> * b = block_buffer_[block_idx[i]];
+    b->slot(block_idx[i]);
+    b->code_ = new_blocks[i];
+    b->side_ = blockSide;
+    b->coordinates(corners[i]);
+    activate(b);
+  }
+
+  nodes_.insert(new_nodes, node_idx);
+  blocks_.insert(new_blocks, block_idx);
+
+  for(const key_t& k : new_nodes) link(k);
+  for(const key_t& k : new_blocks) link(k);
+  return true;
+}
+
+template <typename T, unsigned int BlockSide>
+void LinearOctree<T, BlockSide>::getBlockList(std::vector<VoxelBlock<T, BlockSide>*>& blocklist, 
+    bool active){
+  if(active) {
+    for(const unsigned int slot : active_blocks_.slots()) 
+      blocklist.push_back(block_buffer_[slot]);
+    return;
+  }
+  blocks_.for_each([&](key_t, const uint32_t idx) {
+      blocklist.push_back(block_buffer_[idx]);
+    });
+}
+
+/*
+ * Same file layout as Octree::save, so that maps can be exchanged between 
+ * the two backends.
+ */
+template <typename T, unsigned int BlockSide>
+void LinearOctree<T, BlockSide>::save(const std::string& filename) {
+  std::ofstream os (filename, std::ios::binary); 
+  internal::write_header(os);
+  os.write(reinterpret_cast<char *>(&size_), sizeof(size_));
+  os.write(reinterpret_cast<char *>(&dim_), sizeof(dim_));
+
+  size_t n = nodes_.size();
+  os.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+  nodes_.for_each([&](key_t, const uint32_t idx) {
+      const LinearNode<T> * node = nodes_buffer_[idx];
+      Node<T, BlockSide> tmp;
+      tmp.code_ = node->code_;
+      tmp.side_ = node->side_;
+      std::memcpy(tmp.value_, node->value_, sizeof(tmp.value_));
+      internal::serialise(os, tmp);
+    });
+
+  n = blocks_.size();
+  os.write(reinterpret_cast<char *>(&n), sizeof(size_t));
+  blocks_.for_each([&](key_t, const uint32_t idx) {
+      internal::serialise(os, *block_buffer_[idx]);
+    });
+}
+
+template <typename T, unsigned int BlockSide>
+void LinearOctree<T, BlockSide>::load(const std::string& filename) {
+  std::ifstream is (filename, std::ios::binary); 
+  const uint32_t version = internal::read_header(is);
+  int size;
+  float dim;
+  is.read(reinterpret_cast<char *>(&size), sizeof(size));
+  is.read(reinterpret_cast<char *>(&dim), sizeof(dim));
+
+  init(size, dim);
+
+  // Octants are read first and allocated in a single batch.
+  size_t n = 0;
+  is.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+  std::vector<Node<T, BlockSide> > nodes(n);
+  for(size_t i = 0; i < n; ++i) internal::deserialise(nodes[i], is, version);
+
+  is.read(reinterpret_cast<char *>(&n), sizeof(size_t));
+  std::vector<VoxelBlock<T, BlockSide> > blocks(n);
+  for(size_t i = 0; i < n; ++i) internal::deserialise(blocks[i], is);
+
+  std::vector<key_t> keys;
+  keys.reserve(nodes.size() + blocks.size());
+  for(const auto& node : nodes) keys.push_back(node.code_);
+  for(const auto& block : blocks) keys.push_back(block.code_);
+  allocate(keys.data(), keys.size());
+
+  for(const auto& node : nodes) {
+    const Eigen::Vector3i coords = keyops::decode(node.code_);
+    LinearNode<T> * dst = fetch_octant(coords(0), coords(1), coords(2), 
+        keyops::level(node.code_));
+    std::memcpy(dst->value_, node.value_, sizeof(dst->value_));
+  }
+  for(auto& block : blocks) {
+    const Eigen::Vector3i coords = block.coordinates();
+    fetch(coords(0), coords(1), coords(2))->storage() = block.storage();
+  }
+}
+
+/*! \brief Point query accessor remembering the last block it fetched, the 
+ * counterpart of se::octree_cursor. Not thread safe: use one per thread.
+ */
+template <typename T, unsigned int BlockSide>
+class linear_cursor {
+
+  public:
+    typedef voxel_traits<T> traits_type;
+    typedef typename traits_type::value_type value_type;
+
+    linear_cursor(const LinearOctree<T, BlockSide>& m) : map_(m), last_(NULL) {
+    }
+
+    inline int size() const { return map_.size(); }
+    inline float dim() const { return map_.dim(); }
+
+    VoxelBlock<T, BlockSide> * fetch(const int x, const int y, const int z) const {
+      if(last_) {
+        const Eigen::Vector3i offset = Eigen::Vector3i(x, y, z) - 
+          last_->coordinates();
+        if((offset.array() >= 0).all() && 
+           (offset.array() < static_cast<int>(BlockSide)).all()) return last_;
+      }
+      VoxelBlock<T, BlockSide> * block = map_.fetch(x, y, z);
+      if(block) last_ = block;
+      return block;
+    }
+
+    /*! \brief Fetch the internal node (x,y,z) at level depth, see 
+     * LinearOctree::fetch_octant. Use fetch for voxel blocks.
+     */
+    LinearNode<T> * fetch_octant(const int x, const int y, const int z, 
+        const int depth) const {
+      return map_.fetch_octant(x, y, z, depth);
+    }
+
+    /*! \brief Same semantics as LinearOctree::get
+     */
+    value_type get(const int x, const int y, const int z) const {
+      const VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+      if(!block) return map_.get(x, y, z);
+      return block->data(Eigen::Vector3i(x, y, z));
+    }
+
+    value_type get_fine(const int x, const int y, const int z) const {
+      const VoxelBlock<T, BlockSide> * block = fetch(x, y, z);
+      if(!block) return traits_type::initValue();
+      return block->data(Eigen::Vector3i(x, y, z));
+    }
+
+    template <typename FieldSelect>
+    float interp(const Eigen::Vector3f& pos, FieldSelect select) const {
+      return se::interp(*this, pos, select);
+    }
+
+    void reset() { last_ = NULL; }
+
+  private:
+    const LinearOctree<T, BlockSide>& map_;
+    mutable VoxelBlock<T, BlockSide> * last_;
+};
+}
+#endif // LINEAR_OCTREE_HPP
@@ -38,10 +38,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "octree_defines.h"
 #include "utils/math_utils.h"
 #include "utils/memory_pool.hpp"
+#include "utils/block_layout.hpp"
+#include "utils/block_storage.hpp"
 #include "io/se_serialise.hpp"
 
 namespace se { 
-template <typename T>
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
 class Node {
 
 public:
@@ -50,23 +52,31 @@ public:
   value_type empty() const { return traits_type::empty(); }
   value_type init_val() const { return traits_type::initValue(); }
 
-  value_type value_[8];
+  // Traversal data first so that a tree walk only touches the leading
+  // cache lines of the node.
+protected:
+  Node *child_ptr_[8];
+public:
   key_t code_;
   unsigned int side_;
   unsigned char children_mask_;
+  // Children collapsed by Octree::prune, whose value_ holds their voxels
+  unsigned char pruned_mask_;
+  value_type value_[8];
 
   Node(){
+    static_assert(sizeof(Node) <= 8 * sizeof(value_type) + 
+        8 * sizeof(Node *) + 16, "Node exceeds its size budget"); 
     code_ = 0;
     side_ = 0;
     children_mask_ = 0;
+    pruned_mask_ = 0;
     for (unsigned int i = 0; i < 8; i++){
       value_[i]     = init_val();
       child_ptr_[i] = NULL;
     }
   }
 
-    virtual ~Node(){};
-
     Node *& child(const int x, const int y, 
         const int z) {
       return child_ptr_[x + y*2 + z*4];
@@ -76,23 +86,27 @@ public:
       return child_ptr_[offset];
     }
 
-    virtual bool isLeaf(){ return false; }
+    /*! \brief Voxel blocks are the only octants whose side is BlockSide,
+     * hence no type tag nor virtual dispatch is required. Relies on the 
+     * root being larger than a block, which Octree::init asserts.
+     */
+    bool isLeaf() const { return side_ == BlockSide; }
 
-
-protected:
-    Node *child_ptr_[8];
 private:
     friend std::ofstream& internal::serialise <> (std::ofstream& out, Node& node);
-    friend void internal::deserialise <> (Node& node, std::ifstream& in);
+    friend void internal::deserialise <> (Node& node, std::ifstream& in, 
+        const uint32_t version);
 };
 
-template <typename T>
-class VoxelBlock: public Node<T> {
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+class VoxelBlock: public Node<T, BlockSide> {
 
   public:
     typedef voxel_traits<T> traits_type;
     typedef typename traits_type::value_type value_type;
-    static constexpr unsigned int side = BLOCK_SIDE;
+    typedef typename block_layout<T>::type layout_type;
+    typedef typename block_storage<T>::type storage_policy;
+    static constexpr unsigned int side = BlockSide;
     static constexpr unsigned int sideSq = side*side;
 
     static constexpr value_type empty() { 
@@ -102,14 +116,21 @@ class VoxelBlock: public Node<T> {
       return traits_type::initValue();
     }
 
+    typedef typename storage_policy::template array<value_type, 
+            side*sideSq> storage_type;
+
     VoxelBlock(){
+      static_assert(sizeof(VoxelBlock) <= sizeof(Node<T, BlockSide>) + 
+          sizeof(voxel_block_) + 24 + alignof(storage_type) - 1, 
+          "VoxelBlock exceeds its size budget");
+      this->side_ = side;
       coordinates_ = Eigen::Vector3i::Constant(0);
+      slot_ = 0;
+      active_ = false;
       for (unsigned int i = 0; i < side*sideSq; i++)
-        voxel_block_[i] = initValue();
+        voxel_block_.set(i, initValue());
     }
 
-    bool isLeaf(){ return true; }
-
     Eigen::Vector3i coordinates() const { return coordinates_; }
     void coordinates(const Eigen::Vector3i& c){ coordinates_ = c; }
 
@@ -119,49 +140,87 @@ class VoxelBlock: public Node<T> {
     value_type data(const int i) const;
     void data(const int i, const value_type& value);
 
+    /*! \brief Gather the 2x2x2 neighbourhood whose lower corner is pos, in
+     * interp_offsets order. All eight voxels must lie inside the block.
+     */
+    void gather(const Eigen::Vector3i& pos, value_type values[8]) const;
+
+    /*! \brief Storage index of the voxel at block-local offset (x, y, z). */
+    static unsigned int index(const int x, const int y, const int z) {
+      return layout_type::template index<side>(x, y, z);
+    }
+
+    /*! \brief Contiguous x field of the side voxels of block-local row 
+     * (y, z). Requires soa_storage and linear_layout.
+     */
+    auto row_x(const int y, const int z) {
+      static_assert(std::is_same<layout_type, linear_layout>::value, 
+          "Rows are contiguous in linear_layout only");
+      return voxel_block_.x() + index(0, y, z);
+    }
+
+    /*! \brief Contiguous y field of the side voxels of block-local row 
+     * (y, z). Requires soa_storage and linear_layout.
+     */
+    auto row_y(const int y, const int z) {
+      static_assert(std::is_same<layout_type, linear_layout>::value, 
+          "Rows are contiguous in linear_layout only");
+      return voxel_block_.y() + index(0, y, z);
+    }
+
     void active(const bool a){ active_ = a; }
     bool active() const { return active_; }
 
-    value_type * getBlockRawPtr(){ return voxel_block_; }
-    static constexpr int size(){ return sizeof(VoxelBlock<T>); }
+    /*! \brief Slot of the block in the memory pool of its map. */
+    unsigned int slot() const { return slot_; }
+    void slot(const unsigned int s){ slot_ = s; }
+
+    storage_type& storage(){ return voxel_block_; }
+    static constexpr int size(){ return sizeof(VoxelBlock); }
     
   private:
     VoxelBlock(const VoxelBlock&) = delete;
     Eigen::Vector3i coordinates_;
-    value_type voxel_block_[side*sideSq]; // Brick of data.
+    unsigned int slot_;
     bool active_;
+    storage_type voxel_block_; // Brick of data.
 
     friend std::ofstream& internal::serialise <> (std::ofstream& out, 
         VoxelBlock& node);
     friend void internal::deserialise <> (VoxelBlock& node, std::ifstream& in);
 };
 
-template <typename T>
-inline typename VoxelBlock<T>::value_type 
-VoxelBlock<T>::data(const Eigen::Vector3i& pos) const {
+template <typename T, unsigned int BlockSide>
+inline typename VoxelBlock<T, BlockSide>::value_type 
+VoxelBlock<T, BlockSide>::data(const Eigen::Vector3i& pos) const {
   Eigen::Vector3i offset = pos - coordinates_;
-  const value_type& data = voxel_block_[offset(0) + offset(1)*side +
-                                         offset(2)*sideSq];
-  return data;
+  return voxel_block_[index(offset(0), offset(1), offset(2))];
 }
 
-template <typename T>
-inline void VoxelBlock<T>::data(const Eigen::Vector3i& pos, 
+template <typename T, unsigned int BlockSide>
+inline void VoxelBlock<T, BlockSide>::data(const Eigen::Vector3i& pos, 
                                 const value_type &value){
   Eigen::Vector3i offset = pos - coordinates_;
-  voxel_block_[offset(0) + offset(1)*side + offset(2)*sideSq] = value;
+  voxel_block_.set(index(offset(0), offset(1), offset(2)), value);
+}
+
+template <typename T, unsigned int BlockSide>
+inline void VoxelBlock<T, BlockSide>::gather(const Eigen::Vector3i& pos, 
+    value_type values[8]) const {
+  Eigen::Vector3i offset = pos - coordinates_;
+  layout_type::template gather<side>(voxel_block_, offset(0), offset(1), 
+      offset(2), values);
 }
 
-template <typename T>
-inline typename VoxelBlock<T>::value_type 
-VoxelBlock<T>::data(const int i) const {
-  const value_type& data = voxel_block_[i];
-  return data;
+template <typename T, unsigned int BlockSide>
+inline typename VoxelBlock<T, BlockSide>::value_type 
+VoxelBlock<T, BlockSide>::data(const int i) const {
+  return voxel_block_[i];
 }
 
-template <typename T>
-inline void VoxelBlock<T>::data(const int i, const value_type &value){
-  voxel_block_[i] = value;
+template <typename T, unsigned int BlockSide>
+inline void VoxelBlock<T, BlockSide>::data(const int i, const value_type &value){
+  voxel_block_.set(i, value);
 }
 }
 #endif
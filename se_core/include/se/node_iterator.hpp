@@ -36,21 +36,24 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace se {
 
-template <typename T>
+template <typename T, unsigned int BlockSide>
 class node_iterator {
 
   public:
 
-  node_iterator(const Octree<T>& m): map_(m){
+  node_iterator(const Octree<T, BlockSide>& m): map_(m){
     state_ = BRANCH_NODES;
     last = 0;
   };
 
-  Node<T> *  next() {
+  Node<T, BlockSide> *  next() {
     switch(state_) {
       case BRANCH_NODES:
+        // Released slots can come in long runs after a prune or deallocate
+        while(last < map_.nodes_buffer_.size() && 
+            !map_.nodes_buffer_.used(last)) ++last;
         if(last < map_.nodes_buffer_.size()) {
-          Node<T>* n = map_.nodes_buffer_[last++];
+          Node<T, BlockSide>* n = map_.nodes_buffer_[last++];
           return n;
         } else {
           last = 0;
@@ -59,8 +62,10 @@ class node_iterator {
         }
         break;
       case LEAF_NODES:
+        while(last < map_.block_buffer_.size() && 
+            !map_.block_buffer_.used(last)) ++last;
         if(last < map_.block_buffer_.size()) {
-          VoxelBlock<T>* n = map_.block_buffer_[last++];
+          VoxelBlock<T, BlockSide>* n = map_.block_buffer_[last++];
           return n;
               /* the above int init required due to odr-use of static member */
         } else {
@@ -81,7 +86,7 @@ class node_iterator {
     FINISHED
   } ITER_STATE;
 
-  const Octree<T>& map_;
+  const Octree<T, BlockSide>& map_;
   ITER_STATE state_;
   size_t last;
 };
@@ -55,6 +55,59 @@ namespace se {
     inline Eigen::Vector3i decode(const se::key_t key) {
       return unpack_morton(key & ~SCALE_MASK);
     }
+
+    /*! \brief Per axis sum of the coordinates encoded in the Morton codes a 
+     * and b, computed on the codes themselves (dilated integer addition). 
+     * Coordinates wrap modulo 2^21 like compute_morton, so adding the code of
+     * a negative offset subtracts. Neither code may carry scale bits.
+     */
+    inline se::key_t add(const se::key_t a, const se::key_t b) {
+      using se::morton::mask_x;
+      using se::morton::mask_y;
+      using se::morton::mask_z;
+      return (((a | ~mask_x) + (b & mask_x)) & mask_x) |
+             (((a | ~mask_y) + (b & mask_y)) & mask_y) |
+             (((a | ~mask_z) + (b & mask_z)) & mask_z);
+    }
+
+    /*! \brief Per axis difference a - b of Morton codes, see add. */
+    inline se::key_t sub(const se::key_t a, const se::key_t b) {
+      using se::morton::mask_x;
+      using se::morton::mask_y;
+      using se::morton::mask_z;
+      return (((a & mask_x) - (b & mask_x)) & mask_x) |
+             (((a & mask_y) - (b & mask_y)) & mask_y) |
+             (((a & mask_z) - (b & mask_z)) & mask_z);
+    }
+
+    /*! \brief True if the octant lies inside a volume of side 2^max_depth.
+     * Keys stepped past either end of an axis by add or sub fail this test.
+     */
+    inline bool inside(const se::key_t key, const int max_depth) {
+      return (code(key) >> (3 * max_depth)) == 0;
+    }
+
+    /*! \brief Key of the octant dx, dy and dz octant sides away from key, 
+     * at the same level, without decoding key. Check the result with inside.
+     */
+    inline se::key_t neighbour(const se::key_t key, const int dx, 
+        const int dy, const int dz, const int max_depth) {
+      const int side = 1 << (max_depth - level(key));
+      return add(code(key), compute_morton(dx * side, dy * side, dz * side)) 
+        | level(key);
+    }
+
+    /*! \brief One axis of a Morton code stepped by -side, 0 and +side, where 
+     * bit is the position of side on that axis. Combining the steps of the 
+     * three axes with a bitwise or gives any of the 27 octants around code.
+     */
+    inline void axis_steps(se::key_t steps[3], const se::key_t code, 
+        const se::key_t axis_mask, const int bit) {
+      const se::key_t c = code & axis_mask;
+      steps[0] = (c - (se::key_t(1) << bit)) & axis_mask;
+      steps[1] = c;
+      steps[2] = ((c | ~axis_mask) + (se::key_t(1) << bit)) & axis_mask;
+    }
   }
 }
 
@@ -141,28 +194,30 @@ inline void exterior_neighbours(se::key_t result[7],
     const se::key_t octant, const int level, const int max_depth) {
 
   const int idx = child_id(octant, level, max_depth);
-  Eigen::Vector3i dir = Eigen::Vector3i((idx & 1) ? 1 : -1,
-                       (idx & 2) ? 1 : -1,
-                       (idx & 4) ? 1 : -1);
-  Eigen::Vector3i base = far_corner(octant, level, max_depth);
-  dir(0) = se::math::in(base(0) + dir(0) , 0, (1 << max_depth) - 1) ? dir(0) : 0;
-  dir(1) = se::math::in(base(1) + dir(1) , 0, (1 << max_depth) - 1) ? dir(1) : 0;
-  dir(2) = se::math::in(base(2) + dir(2) , 0, (1 << max_depth) - 1) ? dir(2) : 0;
-
- result[0] = se::keyops::encode(base(0) + dir(0), base(1) + 0, base(2) + 0, 
-     level, max_depth);
- result[1] = se::keyops::encode(base(0) + 0, base(1) + dir(1), base(2) + 0, 
-     level, max_depth); 
- result[2] = se::keyops::encode(base(0) + dir(0), base(1) + dir(1), base(2) + 0, 
-     level, max_depth); 
- result[3] = se::keyops::encode(base(0) + 0, base(1) + 0, base(2) + dir(2), 
-     level, max_depth); 
- result[4] = se::keyops::encode(base(0) + dir(0), base(1) + 0, base(2) + dir(2), 
-     level, max_depth); 
- result[5] = se::keyops::encode(base(0) + 0, base(1) + dir(1), base(2) + dir(2), 
-     level, max_depth); 
- result[6] = se::keyops::encode(base(0) + dir(0), base(1) + dir(1), 
-     base(2) + dir(2), level, max_depth); 
+  const int shift = 3 * (max_depth - level);
+  const se::key_t code = se::keyops::code(octant);
+  se::key_t x[3], y[3], z[3];
+  se::keyops::axis_steps(x, code, se::morton::mask_x, shift);
+  se::keyops::axis_steps(y, code, se::morton::mask_y, shift + 1);
+  se::keyops::axis_steps(z, code, se::morton::mask_z, shift + 2);
+
+  /* Step away from the siblings along each axis, unless it leaves the 
+   * volume */
+  const int limit = 3 * max_depth;
+  se::key_t ex = (idx & 1) ? x[2] : x[0];
+  se::key_t ey = (idx & 2) ? y[2] : y[0];
+  se::key_t ez = (idx & 4) ? z[2] : z[0];
+  if(ex >> limit) ex = x[1];
+  if(ey >> limit) ey = y[1];
+  if(ez >> limit) ez = z[1];
+
+  result[0] = ex   | y[1] | z[1] | level;
+  result[1] = x[1] | ey   | z[1] | level;
+  result[2] = ex   | ey   | z[1] | level;
+  result[3] = x[1] | y[1] | ez   | level;
+  result[4] = ex   | y[1] | ez   | level;
+  result[5] = x[1] | ey   | ez   | level;
+  result[6] = ex   | ey   | ez   | level;
 }
 
 /*
@@ -181,4 +236,39 @@ inline void siblings(se::key_t result[8],
     result[i] = p | (i << shift);
   }
 }
+
+/*
+ * \brief Computes the keys of the (up to) 26 octants sharing a face, an edge
+ * or a corner with an octant, at its level, directly on its morton code.
+ * Neighbours outside the volume are skipped, the others are written in 
+ * z, y, x major order of their offsets from -1 to 1.
+ * \param result 26-vector containing the neighbours
+ * \param octant
+ * \param max_depth max depth of the tree on which the octant lives
+ * \return number of neighbours written to result
+ */
+inline int neighbours(se::key_t result[26], const se::key_t octant,
+    const int max_depth) {
+  const int level = se::keyops::level(octant);
+  const int shift = 3 * (max_depth - level);
+  const se::key_t code = se::keyops::code(octant);
+  se::key_t x[3], y[3], z[3];
+  se::keyops::axis_steps(x, code, se::morton::mask_x, shift);
+  se::keyops::axis_steps(y, code, se::morton::mask_y, shift + 1);
+  se::keyops::axis_steps(z, code, se::morton::mask_z, shift + 2);
+
+  const int limit = 3 * max_depth;
+  int n = 0;
+  for(int k = 0; k < 3; ++k) {
+    if(z[k] >> limit) continue;
+    for(int j = 0; j < 3; ++j) {
+      if(y[j] >> limit) continue;
+      for(int i = 0; i < 3; ++i) {
+        if((x[i] >> limit) || (i == 1 && j == 1 && k == 1)) continue;
+        result[n++] = x[i] | y[j] | z[k] | level;
+      }
+    }
+  }
+  return n;
+}
 #endif
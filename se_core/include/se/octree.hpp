@@ -32,6 +32,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef OCTREE_H
 #define OCTREE_H
 
+#include <cassert>
 #include <cstring>
 #include <algorithm>
 #include "utils/math_utils.h"
@@ -40,17 +41,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "utils/morton_utils.hpp"
 #include "octant_ops.hpp"
 
-#if defined(_OPENMP) && !defined(__clang__)
-#include <parallel/algorithm>
-#endif
-
 #include <tuple>
 #include <queue>
 #include "node.hpp"
 #include "utils/memory_pool.hpp"
+#include "utils/active_set.hpp"
+#include "algorithms/parallel.hpp"
 #include "algorithms/unique.hpp"
 #include "geometry/aabb_collision.hpp"
-#include "interpolation/interp_gather.hpp"
+#include "interpolation/interp.hpp"
 
 
 inline int __float_as_int(float value){
@@ -79,13 +78,19 @@ inline float __int_as_float(int value){
 
 namespace se {
 
-template <typename T>
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
 class ray_iterator;
 
-template <typename T>
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
 class node_iterator;
 
-template <typename T>
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+class octree_cursor;
+
+/*! \brief Pointer based octree. BlockSide sets the number of voxels per side
+ * of the leaf voxel blocks and must be a power of two in [4, 16].
+ */
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
 class Octree
 {
 
@@ -93,16 +98,27 @@ public:
 
   typedef voxel_traits<T> traits_type;
   typedef typename traits_type::value_type value_type;
+  typedef MemoryPool<VoxelBlock<T, BlockSide>, block_page_allocator> 
+    block_pool_type;
+  typedef Node<T, BlockSide> node_type;
+  typedef ray_iterator<T, BlockSide> ray_iterator_type;
+  typedef octree_cursor<T, BlockSide> cursor_type;
   value_type empty() const { return traits_type::empty(); }
   value_type init_val() const { return traits_type::initValue(); }
 
   // Compile-time constant expressions
   // # of voxels per side in a voxel block
-  static constexpr unsigned int blockSide = BLOCK_SIDE;
+  static constexpr unsigned int blockSide = BlockSide;
   // maximum tree depth in bits
   static constexpr unsigned int max_depth = ((sizeof(key_t)*8)/3);
   // Tree depth at which blocks are found
-  static constexpr unsigned int block_depth = max_depth - math::log2_const(BLOCK_SIDE);
+  static constexpr unsigned int block_depth = max_depth - math::log2_const(BlockSide);
+
+  static_assert(BlockSide >= 4 && BlockSide <= 16 && 
+      (BlockSide & (BlockSide - 1)) == 0, 
+      "BlockSide must be a power of two in [4, 16]");
+  static_assert(SCALE_MASK < (key_t(1) << 3*math::log2_const(BlockSide)), 
+      "Block keys must leave room for the scale bits");
 
 
   Octree(){
@@ -112,14 +128,15 @@ public:
   }
 
   /*! \brief Initialises the octree attributes
-   * \param size number of voxels per side of the cube
+   * \param size number of voxels per side of the cube, larger than a 
+   * voxel block so that the root is never taken for one, see Node::isLeaf
    * \param dim cube extension per side, in meter
    */
   void init(int size, float dim);
 
   inline int size() const { return size_; }
   inline float dim() const { return dim_; }
-  inline Node<T>* root() const { return root_; }
+  inline Node<T, BlockSide>* root() const { return root_; }
 
   /*! \brief Retrieves voxel value at coordinates (x,y,z), if not present it 
    * allocates it. This method is not thread safe.
@@ -142,7 +159,7 @@ public:
    * \param y y coordinate in interval [0, size]
    * \param z z coordinate in interval [0, size]
    */
-  VoxelBlock<T> * fetch(const int x, const int y, const int z) const;
+  VoxelBlock<T, BlockSide> * fetch(const int x, const int y, const int z) const;
 
   /*! \brief Fetch the octant (x,y,z) at level depth
    * \param x x coordinate in interval [0, size]
@@ -150,23 +167,26 @@ public:
    * \param z z coordinate in interval [0, size]
    * \param depth maximum depth to be searched 
    */
-  Node<T> * fetch_octant(const int x, const int y, const int z, 
+  Node<T, BlockSide> * fetch_octant(const int x, const int y, const int z, 
       const int depth) const;
 
-  /*! \brief Insert the octant at (x,y,z). Not thread safe.
+  /*! \brief Insert the octant at (x,y,z). Thread safe: missing octants are
+   * linked with a CAS, threads inserting the same octant get the same node.
+   * Must not run concurrently with deallocate, prune or clear.
    * \param x x coordinate in interval [0, size]
    * \param y y coordinate in interval [0, size]
    * \param z z coordinate in interval [0, size]
    * \param depth target insertion level 
    */
-  Node<T> * insert(const int x, const int y, const int z, const int depth);
+  Node<T, BlockSide> * insert(const int x, const int y, const int z, const int depth);
 
-  /*! \brief Insert the octant (x,y,z) at maximum resolution. Not thread safe.
+  /*! \brief Insert the octant (x,y,z) at maximum resolution. Thread safe,
+   * see above.
    * \param x x coordinate in interval [0, size]
    * \param y y coordinate in interval [0, size]
    * \param z z coordinate in interval [0, size]
    */
-  VoxelBlock<T> * insert(const int x, const int y, const int z);
+  VoxelBlock<T, BlockSide> * insert(const int x, const int y, const int z);
 
   /*! \brief Interp voxel value at voxel position  (x,y,z)
    * \param pos three-dimensional coordinates in which each component belongs 
@@ -193,9 +213,27 @@ public:
    * \param active boolean switch. Set to true to retrieve visible, allocated 
    * blocks, false to retrieve all allocated blocks.
    */
-  void getBlockList(std::vector<VoxelBlock<T> *>& blocklist, bool active);
-  MemoryPool<VoxelBlock<T> >& getBlockBuffer(){ return block_buffer_; };
-  MemoryPool<Node<T> >& getNodesBuffer(){ return nodes_buffer_; };
+  void getBlockList(std::vector<VoxelBlock<T, BlockSide> *>& blocklist, bool active);
+
+  /*! \brief Mark block as active, i.e. to be visited by the next 
+   * integration. Blocks are activated when allocated. Thread safe.
+   */
+  void activate(VoxelBlock<T, BlockSide> * block) {
+    active_blocks_.activate(block);
+  }
+
+  /*! \brief Mark block as inactive. Thread safe.
+   */
+  void deactivate(VoxelBlock<T, BlockSide> * block) {
+    active_blocks_.deactivate(block);
+  }
+
+  /*! \brief Slots in getBlockBuffer() of the active blocks, maintained as
+   * blocks are activated, deactivated and released.
+   */
+  active_set& activeBlocks(){ return active_blocks_; }
+  block_pool_type& getBlockBuffer(){ return block_buffer_; };
+  MemoryPool<Node<T, BlockSide> >& getNodesBuffer(){ return nodes_buffer_; };
   /*! \brief Computes the morton code of the block containing voxel 
    * at coordinates (x,y,z)
    * \param x x coordinate in interval [0, size]
@@ -218,6 +256,56 @@ public:
    */
   bool allocate(key_t *keys, int num_elem);
 
+  /*! \brief Deallocate the octant (x,y,z) at level depth together with its
+   * whole subtree, returning its nodes and blocks to the memory pools. The 
+   * parent keeps its coarse value for the octant. Not thread safe. 
+   * \param x x coordinate in interval [0, size]
+   * \param y y coordinate in interval [0, size]
+   * \param z z coordinate in interval [0, size]
+   * \param depth level of the octant, in [1, leaves level]
+   * \return false if the octant was not allocated
+   */
+  bool deallocate(const int x, const int y, const int z, const int depth);
+
+  /*! \brief Collapse uniform regions. Voxel blocks whose voxels all compare
+   * equal to the first one are released and that value is stored in the 
+   * parent's value_, then nodes left with eight bitwise equal collapsed 
+   * children are released in turn. The collapsed values thus never differ 
+   * from the original voxels by more than what equal accepts. get, 
+   * get_fine, interp and grad return the stored value, and allocating 
+   * inside a collapsed octant restores it. Not thread safe.
+   * \param equal binary predicate comparing two voxel values
+   * \return number of voxel blocks released
+   */
+  template <typename EqualF>
+  int prune(EqualF equal);
+
+  /*! \brief prune restricted to the given blocks, e.g. the ones that left
+   * the view since the last pass. Nodes are collapsed above the released blocks only.
+   * \param blocks distinct allocated voxel blocks
+   * \param equal binary predicate comparing two voxel values
+   * \return number of voxel blocks released
+   */
+  template <typename EqualF>
+  int prune(const std::vector<VoxelBlock<T, BlockSide> *>& blocks, 
+      EqualF equal);
+
+  /*! \brief prune with bitwise comparison of the voxel values. Padding
+   * bytes take part in it and may keep equal voxels apart, value types with 
+   * padding should pass their own comparison.
+   */
+  int prune();
+
+  /*! \brief prune restricted to the given blocks, with bitwise comparison 
+   * of the voxel values
+   */
+  int prune(const std::vector<VoxelBlock<T, BlockSide> *>& blocks);
+
+  /*! \brief Deallocate every octant but the root, keeping the memory pools'
+   * pages for reuse. Not thread safe.
+   */
+  void clear();
+
   void save(const std::string& filename);
   void load(const std::string& filename);
 
@@ -237,45 +325,56 @@ public:
 
 private:
 
-  Node<T> * root_;
+  Node<T, BlockSide> * root_;
   int size_;
   float dim_;
   int max_level_;
-  MemoryPool<VoxelBlock<T> > block_buffer_;
-  MemoryPool<Node<T> > nodes_buffer_;
+  block_pool_type block_buffer_;
+  MemoryPool<Node<T, BlockSide> > nodes_buffer_;
+  active_set active_blocks_;
 
-  friend class ray_iterator<T>;
-  friend class node_iterator<T>;
+  friend class ray_iterator<T, BlockSide>;
+  friend class node_iterator<T, BlockSide>;
 
   // Allocation specific variables
   key_t* keys_at_level_;
   int reserved_;
 
   // Private implementation of cached methods
-  value_type get(const int x, const int y, const int z, VoxelBlock<T>* cached) const;
-  value_type get(const Eigen::Vector3f& pos, VoxelBlock<T>* cached) const;
+  value_type get(const int x, const int y, const int z, VoxelBlock<T, BlockSide>* cached) const;
+  value_type get(const Eigen::Vector3f& pos, VoxelBlock<T, BlockSide>* cached) const;
 
-  // Parallel allocation of a given tree level for a set of input keys.
-  // Pre: levels above target_level must have been already allocated
-  bool allocate_level(key_t * keys, int num_tasks, int target_level);
+  // Allocate the octants of a run of sorted keys, none ancestor of another.
+  // Runs may be allocated concurrently.
+  void allocate_sorted(const key_t * keys, const size_t num_keys);
+
+  // Return the child idx of parent, first allocating it as the octant key
+  // if missing, a voxel block with the given corner if leaf. Children are 
+  // linked with a CAS, the losing thread's octant goes back to its pool.
+  Node<T, BlockSide> * link_child(Node<T, BlockSide> * parent, const int idx,
+      const key_t key, const bool leaf, const Eigen::Vector3i& corner);
 
   void reserveBuffers(const int n);
 
   // General helpers
 
-  int leavesCountRecursive(Node<T> *);
-  int nodeCountRecursive(Node<T> *);
-  void getActiveBlockList(Node<T> *, std::vector<VoxelBlock<T> *>& blocklist);
-  void getAllocatedBlockList(Node<T> *, std::vector<VoxelBlock<T> *>& blocklist);
+  int leavesCountRecursive(Node<T, BlockSide> *);
+  int nodeCountRecursive(Node<T, BlockSide> *);
+  void getActiveBlockList(Node<T, BlockSide> *, std::vector<VoxelBlock<T, BlockSide> *>& blocklist);
+  void getAllocatedBlockList(Node<T, BlockSide> *, std::vector<VoxelBlock<T, BlockSide> *>& blocklist);
+
+  void releaseNode(Node<T, BlockSide> * node);
 
-  void deleteNode(Node<T> ** node);
-  void deallocateTree(){ deleteNode(&root_); }
+  // Move the value of the pruned octant idx of parent into child, not yet
+  // linked. Returns false if the octant is not pruned.
+  bool unprune(const Node<T, BlockSide> * parent, const int idx, 
+      Node<T, BlockSide> * child);
 };
 
 
-template <typename T>
-inline typename Octree<T>::value_type Octree<T>::get(const Eigen::Vector3f& p, 
-    VoxelBlock<T>* cached) const {
+template <typename T, unsigned int BlockSide>
+inline typename Octree<T, BlockSide>::value_type Octree<T, BlockSide>::get(const Eigen::Vector3f& p, 
+    VoxelBlock<T, BlockSide>* cached) const {
 
   const Eigen::Vector3i pos = (p.homogeneous() * 
       Eigen::Vector4f::Constant(size_/dim_)).head<3>().cast<int>();
@@ -290,7 +389,7 @@ inline typename Octree<T>::value_type Octree<T>::get(const Eigen::Vector3f& p,
     }
   }
 
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   if(!n) {
     return empty();
   }
@@ -306,36 +405,36 @@ inline typename Octree<T>::value_type Octree<T>::get(const Eigen::Vector3f& p,
   }
 
   // Get the element in the voxel block
-  return static_cast<VoxelBlock<T>*>(n)->data(pos);
+  return static_cast<VoxelBlock<T, BlockSide>*>(n)->data(pos);
 }
 
-template <typename T>
-inline void  Octree<T>::set(const int x,
+template <typename T, unsigned int BlockSide>
+inline void  Octree<T, BlockSide>::set(const int x,
     const int y, const int z, const value_type val) {
 
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   if(!n) {
     return;
   }
 
   unsigned edge = size_ >> 1;
   for(; edge >= blockSide; edge = edge >> 1){
-    Node<T>* tmp = n->child((x & edge) > 0, (y & edge) > 0, (z & edge) > 0);
+    Node<T, BlockSide>* tmp = n->child((x & edge) > 0, (y & edge) > 0, (z & edge) > 0);
     if(!tmp){
       return;
     }
     n = tmp;
   }
 
-  static_cast<VoxelBlock<T> *>(n)->data(Eigen::Vector3i(x, y, z), val);
+  static_cast<VoxelBlock<T, BlockSide> *>(n)->data(Eigen::Vector3i(x, y, z), val);
 }
 
 
-template <typename T>
-inline typename Octree<T>::value_type Octree<T>::get(const int x,
+template <typename T, unsigned int BlockSide>
+inline typename Octree<T, BlockSide>::value_type Octree<T, BlockSide>::get(const int x,
     const int y, const int z) const {
 
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   if(!n) {
     return init_val();
   }
@@ -343,21 +442,21 @@ inline typename Octree<T>::value_type Octree<T>::get(const int x,
   unsigned edge = size_ >> 1;
   for(; edge >= blockSide; edge = edge >> 1){
     const int childid = ((x & edge) > 0) +  2 * ((y & edge) > 0) +  4*((z & edge) > 0);
-    Node<T>* tmp = n->child(childid);
+    Node<T, BlockSide>* tmp = n->child(childid);
     if(!tmp){
       return n->value_[childid];
     }
     n = tmp;
   }
 
-  return static_cast<VoxelBlock<T> *>(n)->data(Eigen::Vector3i(x, y, z));
+  return static_cast<VoxelBlock<T, BlockSide> *>(n)->data(Eigen::Vector3i(x, y, z));
 }
 
-template <typename T>
-inline typename Octree<T>::value_type Octree<T>::get_fine(const int x,
+template <typename T, unsigned int BlockSide>
+inline typename Octree<T, BlockSide>::value_type Octree<T, BlockSide>::get_fine(const int x,
     const int y, const int z) const {
 
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   if(!n) {
     return init_val();
   }
@@ -366,19 +465,20 @@ inline typename Octree<T>::value_type Octree<T>::get_fine(const int x,
   for(; edge >= blockSide; edge = edge >> 1){
     const int childid = ((x & edge) > 0) +  2 * ((y & edge) > 0) 
       +  4*((z & edge) > 0);
-    Node<T>* tmp = n->child(childid);
+    Node<T, BlockSide>* tmp = n->child(childid);
     if(!tmp){
-      return init_val();
+      return (n->pruned_mask_ & (1 << childid)) ? n->value_[childid] : 
+        init_val();
     }
     n = tmp;
   }
 
-  return static_cast<VoxelBlock<T> *>(n)->data(Eigen::Vector3i(x, y, z));
+  return static_cast<VoxelBlock<T, BlockSide> *>(n)->data(Eigen::Vector3i(x, y, z));
 }
 
-template <typename T>
-inline typename Octree<T>::value_type Octree<T>::get(const int x,
-   const int y, const int z, VoxelBlock<T>* cached) const {
+template <typename T, unsigned int BlockSide>
+inline typename Octree<T, BlockSide>::value_type Octree<T, BlockSide>::get(const int x,
+   const int y, const int z, VoxelBlock<T, BlockSide>* cached) const {
 
   if(cached != NULL){
     const Eigen::Vector3i pos = Eigen::Vector3i(x, y, z);
@@ -390,46 +490,177 @@ inline typename Octree<T>::value_type Octree<T>::get(const int x,
       return cached->data(Eigen::Vector3i(x, y, z));
     }
   }
+  return get_fine(x, y, z);
+}
 
-  Node<T> * n = root_;
-  if(!n) {
-    return init_val();
-  }
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::releaseNode(Node<T, BlockSide> * node){
 
-  unsigned edge = size_ >> 1;
-  for(; edge >= blockSide; edge = edge >> 1){
-    n = n->child((x & edge) > 0, (y & edge) > 0, (z & edge) > 0);
-    if(!n){
-      return init_val();
+  if(node->isLeaf()){
+    VoxelBlock<T, BlockSide> * block = static_cast<VoxelBlock<T, BlockSide> *>(node);
+    active_blocks_.erase(block->slot());
+    block_buffer_.release_block(block);
+    return;
+  }
+  for (int i = 0; i < 8; i++) {
+    if(node->child(i)){
+      releaseNode(node->child(i));
     }
   }
+  nodes_buffer_.release_block(node);
+}
 
-  return static_cast<VoxelBlock<T> *>(n)->data(Eigen::Vector3i(x, y, z));
+template <typename T, unsigned int BlockSide>
+bool Octree<T, BlockSide>::unprune(const Node<T, BlockSide> * parent, 
+    const int idx, Node<T, BlockSide> * child){
+
+  const unsigned char pruned = __atomic_load_n(&parent->pruned_mask_, 
+      __ATOMIC_RELAXED);
+  if(!(pruned & (1 << idx))) return false;
+  const value_type value = parent->value_[idx];
+  if(child->isLeaf()){
+    VoxelBlock<T, BlockSide> * block = static_cast<VoxelBlock<T, BlockSide> *>(child);
+    for(unsigned int i = 0; i < blockSide * blockSide * blockSide; ++i)
+      block->data(i, value);
+  } else {
+    for(int i = 0; i < 8; ++i) child->value_[i] = value;
+    child->pruned_mask_ = 0xFF;
+  }
+  return true;
 }
 
-template <typename T>
-void Octree<T>::deleteNode(Node<T> **node){
+template <typename T, unsigned int BlockSide>
+template <typename EqualF>
+int Octree<T, BlockSide>::prune(EqualF equal){
+  std::vector<VoxelBlock<T, BlockSide> *> blocks;
+  blocks.reserve(block_buffer_.size());
+  for(unsigned int i = 0; i < block_buffer_.size(); ++i){
+    if(block_buffer_.used(i)) blocks.push_back(block_buffer_[i]);
+  }
+  return prune(blocks, equal);
+}
 
-  if(*node){
-    for (int i = 0; i < 8; i++) {
-      if((*node)->child(i)){
-        deleteNode(&(*node)->child(i));
-      }
-    }
-    if(!(*node)->isLeaf()){
-      delete *node;
-      *node = NULL;
+template <typename T, unsigned int BlockSide>
+template <typename EqualF>
+int Octree<T, BlockSide>::prune(
+    const std::vector<VoxelBlock<T, BlockSide> *>& blocks, EqualF equal){
+
+  const int num_blocks = blocks.size();
+  const int num_voxels = blockSide * blockSide * blockSide;
+  std::vector<char> uniform(num_blocks, 0);
+#pragma omp parallel for
+  for(int i = 0; i < num_blocks; ++i){
+    const VoxelBlock<T, BlockSide> * block = blocks[i];
+    const value_type first = block->data(0);
+    int v = 1;
+    while(v < num_voxels && equal(block->data(v), first)) ++v;
+    uniform[i] = v == num_voxels;
+  }
+
+  // Collapse the uniform blocks into their parents
+  const int leaves_level = max_level_ - math::log2_const(blockSide);
+  std::vector<Node<T, BlockSide> *> parents;
+  int released = 0;
+  for(int i = 0; i < num_blocks; ++i){
+    if(!uniform[i]) continue;
+    VoxelBlock<T, BlockSide> * block = blocks[i];
+    const Eigen::Vector3i c = block->coordinates();
+    Node<T, BlockSide> * parent = fetch_octant(c(0), c(1), c(2), leaves_level - 1);
+    const int idx = ((c(0) & blockSide) > 0) + 2 * ((c(1) & blockSide) > 0) + 
+      4 * ((c(2) & blockSide) > 0);
+    parent->value_[idx] = block->data(0);
+    parent->child(idx) = NULL;
+    parent->children_mask_ &= ~(1 << idx);
+    parent->pruned_mask_ |= 1 << idx;
+    active_blocks_.erase(block->slot());
+    block_buffer_.release_block(block);
+    parents.push_back(parent);
+    ++released;
+  }
+
+  // Then the nodes whose children all collapsed to the same value, bottom up.
+  // Children must match exactly, a tolerance would add up across levels.
+  for(int level = leaves_level - 1; level > 0 && !parents.empty(); --level){
+    std::sort(parents.begin(), parents.end());
+    parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+    std::vector<Node<T, BlockSide> *> next;
+    for(Node<T, BlockSide> * n : parents){
+      if(n->pruned_mask_ != 0xFF) continue;
+      int v = 1;
+      while(v < 8 && std::memcmp(&n->value_[v], &n->value_[0], 
+            sizeof(value_type)) == 0) ++v;
+      if(v < 8) continue;
+      const Eigen::Vector3i c = keyops::decode(n->code_);
+      const unsigned edge = n->side_;
+      Node<T, BlockSide> * parent = fetch_octant(c(0), c(1), c(2), level - 1);
+      const int idx = ((c(0) & edge) > 0) + 2 * ((c(1) & edge) > 0) + 
+        4 * ((c(2) & edge) > 0);
+      parent->value_[idx] = n->value_[0];
+      parent->child(idx) = NULL;
+      parent->children_mask_ &= ~(1 << idx);
+      parent->pruned_mask_ |= 1 << idx;
+      nodes_buffer_.release_block(n);
+      next.push_back(parent);
     }
+    parents.swap(next);
   }
+  return released;
+}
+
+template <typename T, unsigned int BlockSide>
+int Octree<T, BlockSide>::prune(){
+  return prune([](const value_type& a, const value_type& b) {
+      return std::memcmp(&a, &b, sizeof(value_type)) == 0;
+  });
+}
+
+template <typename T, unsigned int BlockSide>
+int Octree<T, BlockSide>::prune(
+    const std::vector<VoxelBlock<T, BlockSide> *>& blocks){
+  return prune(blocks, [](const value_type& a, const value_type& b) {
+      return std::memcmp(&a, &b, sizeof(value_type)) == 0;
+  });
+}
+
+template <typename T, unsigned int BlockSide>
+bool Octree<T, BlockSide>::deallocate(const int x, const int y, const int z, 
+    const int depth){
+
+  Node<T, BlockSide> * parent = root_;
+  if(!parent || depth < 1) return false;
+
+  unsigned edge = size_ / 2;
+  for(int d = 1; d < depth && edge >= blockSide; edge /= 2, ++d){
+    parent = parent->child((x & edge) > 0u, (y & edge) > 0u, (z & edge) > 0u);
+    if(!parent || parent->isLeaf()) return false;
+  }
+
+  const int idx = ((x & edge) > 0u) + 2 * ((y & edge) > 0u) + 
+    4 * ((z & edge) > 0u);
+  Node<T, BlockSide> * n = parent->child(idx);
+  if(!n) return false;
+  parent->child(idx) = NULL;
+  parent->children_mask_ &= ~(1 << idx);
+  releaseNode(n);
+  return true;
+}
+
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::clear(){
+  active_blocks_.clear();
+  block_buffer_.clear();
+  nodes_buffer_.clear();
+  root_ = nodes_buffer_.acquire_block();
+  root_->side_ = size_;
 }
 
 
-template <typename T>
-void Octree<T>::init(int size, float dim) {
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::init(int size, float dim) {
+  assert(size > int(blockSide));
   size_ = size;
   dim_ = dim;
   max_level_ = log2(size);
-  nodes_buffer_.reserve(1);
   root_ = nodes_buffer_.acquire_block();
   root_->side_ = size;
   reserved_ = 1024;
@@ -437,11 +668,11 @@ void Octree<T>::init(int size, float dim) {
   std::memset(keys_at_level_, 0, reserved_);
 }
 
-template <typename T>
-inline VoxelBlock<T> * Octree<T>::fetch(const int x, const int y, 
+template <typename T, unsigned int BlockSide>
+inline VoxelBlock<T, BlockSide> * Octree<T, BlockSide>::fetch(const int x, const int y, 
    const int z) const {
 
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   if(!n) {
     return NULL;
   }
@@ -454,14 +685,14 @@ inline VoxelBlock<T> * Octree<T>::fetch(const int x, const int y,
       return NULL;
     }
   }
-  return static_cast<VoxelBlock<T>* > (n);
+  return static_cast<VoxelBlock<T, BlockSide>* > (n);
 }
 
-template <typename T>
-inline Node<T> * Octree<T>::fetch_octant(const int x, const int y, 
+template <typename T, unsigned int BlockSide>
+inline Node<T, BlockSide> * Octree<T, BlockSide>::fetch_octant(const int x, const int y, 
    const int z, const int depth) const {
 
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   if(!n) {
     return NULL;
   }
@@ -477,20 +708,11 @@ inline Node<T> * Octree<T>::fetch_octant(const int x, const int y,
   return n;
 }
 
-template <typename T>
-Node<T> * Octree<T>::insert(const int x, const int y, const int z, 
+template <typename T, unsigned int BlockSide>
+Node<T, BlockSide> * Octree<T, BlockSide>::insert(const int x, const int y, const int z, 
     const int depth) {
 
-  // Make sure we have enough space on buffers
-  const int leaves_level = max_depth - math::log2_const(blockSide);
-  if(depth > (max_depth - leaves_level)) {
-    block_buffer_.reserve(1);
-    nodes_buffer_.reserve(leaves_level);
-  } else {
-    nodes_buffer_.reserve(depth);
-  }
-
-  Node<T> * n = root_;
+  Node<T, BlockSide> * n = root_;
   // Should not happen if octree has been initialised properly
   if(!n) {
     root_ = nodes_buffer_.acquire_block();
@@ -499,250 +721,48 @@ Node<T> * Octree<T>::insert(const int x, const int y, const int z,
     n = root_;
   }
 
-  key_t key = keyops::encode(x, y, z, depth, max_level_);
+  const int leaves_level = max_level_ - log2(blockSide);
+  const int target = std::min(depth, leaves_level);
+  const key_t code = keyops::code(keyops::encode(x, y, z, target, max_level_));
   const unsigned int shift = MAX_BITS - max_level_ - 1;
-
-  unsigned edge = size_ / 2;
-  for(int d = 1; edge >= blockSide && d <= depth; edge /= 2, ++d){
-    const int childid = ((x & edge) > 0) +  2 * ((y & edge) > 0) 
-      +  4*((z & edge) > 0);
-
-    // std::cout << "Level: " << d << std::endl;
-    Node<T>* tmp = n->child(childid);
-    if(!tmp){
-      const key_t prefix = keyops::code(key) & MASK[d + shift];
-      if(edge == blockSide) {
-        tmp = block_buffer_.acquire_block();
-        static_cast<VoxelBlock<T> *>(tmp)->coordinates(
-            Eigen::Vector3i(unpack_morton(prefix)));
-        static_cast<VoxelBlock<T> *>(tmp)->active(true);
-        static_cast<VoxelBlock<T> *>(tmp)->code_ = prefix | d;
-        n->children_mask_ = n->children_mask_ | (1 << childid);
-      } else {
-        tmp = nodes_buffer_.acquire_block();
-        tmp->code_ = prefix | d;
-        tmp->side_ = edge;
-        n->children_mask_ = n->children_mask_ | (1 << childid);
-        // std::cout << "coords: " 
-        //   << keyops::decode(keyops::code(tmp->code_)) << std::endl;
-      }
-      n->child(childid) = tmp;
-    }
-    n = tmp;
+  const Eigen::Vector3i corner = unpack_morton(code & MASK[leaves_level + shift]);
+  for(int level = 1; level <= target; ++level) {
+    n = link_child(n, child_id(code, level, max_level_), 
+        (code & MASK[level + shift]) | level, level == leaves_level, corner);
   }
   return n;
 }
 
-template <typename T>
-VoxelBlock<T> * Octree<T>::insert(const int x, const int y, const int z) {
-  return static_cast<VoxelBlock<T> * >(insert(x, y, z, max_level_));
+template <typename T, unsigned int BlockSide>
+VoxelBlock<T, BlockSide> * Octree<T, BlockSide>::insert(const int x, const int y, const int z) {
+  return static_cast<VoxelBlock<T, BlockSide> * >(insert(x, y, z, max_level_));
 }
 
-template <typename T>
+template <typename T, unsigned int BlockSide>
 template <typename FieldSelector>
-float Octree<T>::interp(const Eigen::Vector3f& pos, FieldSelector select) const {
-  
-  const Eigen::Vector3i base = math::floorf(pos).cast<int>();
-  const Eigen::Vector3f factor = math::fracf(pos);
-  const Eigen::Vector3i lower = base.cwiseMax(Eigen::Vector3i::Constant(0));
-
-  float points[8];
-  gather_points(*this, lower, select, points);
-
-  return (((points[0] * (1 - factor(0))
-          + points[1] * factor(0)) * (1 - factor(1))
-          + (points[2] * (1 - factor(0))
-          + points[3] * factor(0)) * factor(1))
-          * (1 - factor(2))
-          + ((points[4] * (1 - factor(0))
-          + points[5] * factor(0))
-          * (1 - factor(1))
-          + (points[6] * (1 - factor(0))
-          + points[7] * factor(0))
-          * factor(1)) * factor(2));
-}
-
-
-template <typename T>
-Eigen::Vector3f Octree<T>::grad(const Eigen::Vector3f& pos) const {
-
-   Eigen::Vector3i base = Eigen::Vector3i(math::floorf(pos).cast<int>());
-   Eigen::Vector3f factor = math::fracf(pos);
-   Eigen::Vector3i lower_lower = (base - Eigen::Vector3i::Constant(1)).cwiseMax(Eigen::Vector3i::Constant(0));
-   Eigen::Vector3i lower_upper = base.cwiseMax(Eigen::Vector3i::Constant(0));
-   Eigen::Vector3i upper_lower = (base + Eigen::Vector3i::Constant(1)).cwiseMin(
-      Eigen::Vector3i::Constant(size_) - Eigen::Vector3i::Constant(1));
-   Eigen::Vector3i upper_upper = (base + Eigen::Vector3i::Constant(2)).cwiseMin(
-      Eigen::Vector3i::Constant(size_) - Eigen::Vector3i::Constant(1));
-   Eigen::Vector3i & lower = lower_upper;
-   Eigen::Vector3i & upper = upper_lower;
-
-  Eigen::Vector3f gradient;
-
-  VoxelBlock<T> * n = fetch(base(0), base(1), base(2));
-  gradient(0) = (((get(upper_lower(0), lower(1), lower(2), n)(0)
-          - get(lower_lower(0), lower(1), lower(2), n)(0)) * (1 - factor(0))
-        + (get(upper_upper(0), lower(1), lower(2), n)(0)
-          - get(lower_upper(0), lower(1), lower(2), n)(0)) * factor(0))
-      * (1 - factor(1))
-      + ((get(upper_lower(0), upper(1), lower(2), n)(0)
-          - get(lower_lower(0), upper(1), lower(2), n)(0)) * (1 - factor(0))
-        + (get(upper_upper(0), upper(1), lower(2), n)(0)
-          - get(lower_upper(0), upper(1), lower(2), n)(0))
-        * factor(0)) * factor(1)) * (1 - factor(2))
-    + (((get(upper_lower(0), lower(1), upper(2), n)(0)
-            - get(lower_lower(0), lower(1), upper(2), n)(0)) * (1 - factor(0))
-          + (get(upper_upper(0), lower(1), upper(2), n)(0)
-            - get(lower_upper(0), lower(1), upper(2), n)(0))
-          * factor(0)) * (1 - factor(1))
-        + ((get(upper_lower(0), upper(1), upper(2), n)(0)
-            - get(lower_lower(0), upper(1), upper(2), n)(0))
-          * (1 - factor(0))
-          + (get(upper_upper(0), upper(1), upper(2), n)(0)
-            - get(lower_upper(0), upper(1), upper(2), n)(0))
-          * factor(0)) * factor(1)) * factor(2);
-
-  gradient(1) = (((get(lower(0), upper_lower(1), lower(2), n)(0)
-          - get(lower(0), lower_lower(1), lower(2), n)(0)) * (1 - factor(0))
-        + (get(upper(0), upper_lower(1), lower(2), n)(0)
-          - get(upper(0), lower_lower(1), lower(2), n)(0)) * factor(0))
-      * (1 - factor(1))
-      + ((get(lower(0), upper_upper(1), lower(2), n)(0)
-          - get(lower(0), lower_upper(1), lower(2), n)(0)) * (1 - factor(0))
-        + (get(upper(0), upper_upper(1), lower(2), n)(0)
-          - get(upper(0), lower_upper(1), lower(2), n)(0))
-        * factor(0)) * factor(1)) * (1 - factor(2))
-    + (((get(lower(0), upper_lower(1), upper(2), n)(0)
-            - get(lower(0), lower_lower(1), upper(2), n)(0)) * (1 - factor(0))
-          + (get(upper(0), upper_lower(1), upper(2), n)(0)
-            - get(upper(0), lower_lower(1), upper(2), n)(0))
-          * factor(0)) * (1 - factor(1))
-        + ((get(lower(0), upper_upper(1), upper(2), n)(0)
-            - get(lower(0), lower_upper(1), upper(2), n)(0))
-          * (1 - factor(0))
-          + (get(upper(0), upper_upper(1), upper(2), n)(0)
-            - get(upper(0), lower_upper(1), upper(2), n)(0))
-          * factor(0)) * factor(1)) * factor(2);
-
-  gradient(2) = (((get(lower(0), lower(1), upper_lower(2), n)(0)
-          - get(lower(0), lower(1), lower_lower(2), n)(0)) * (1 - factor(0))
-        + (get(upper(0), lower(1), upper_lower(2), n)(0)
-          - get(upper(0), lower(1), lower_lower(2), n)(0)) * factor(0))
-      * (1 - factor(1))
-      + ((get(lower(0), upper(1), upper_lower(2), n)(0)
-          - get(lower(0), upper(1), lower_lower(2), n)(0)) * (1 - factor(0))
-        + (get(upper(0), upper(1), upper_lower(2), n)(0)
-          - get(upper(0), upper(1), lower_lower(2), n)(0))
-        * factor(0)) * factor(1)) * (1 - factor(2))
-    + (((get(lower(0), lower(1), upper_upper(2), n)(0)
-            - get(lower(0), lower(1), lower_upper(2), n)(0)) * (1 - factor(0))
-          + (get(upper(0), lower(1), upper_upper(2), n)(0)
-            - get(upper(0), lower(1), lower_upper(2), n)(0))
-          * factor(0)) * (1 - factor(1))
-        + ((get(lower(0), upper(1), upper_upper(2), n)(0)
-            - get(lower(0), upper(1), lower_upper(2), n)(0))
-          * (1 - factor(0))
-          + (get(upper(0), upper(1), upper_upper(2), n)(0)
-            - get(upper(0), upper(1), lower_upper(2), n)(0))
-          * factor(0)) * factor(1)) * factor(2);
-
-  return (0.5f * dim_ / size_) * gradient;
-}
-
-template <typename T>
+float Octree<T, BlockSide>::interp(const Eigen::Vector3f& pos, FieldSelector select) const {
+  // Crossing blocks are reached from their common ancestor
+  return se::interp(cursor_type(*this), pos, select);
+}
+
+template <typename T, unsigned int BlockSide>
+Eigen::Vector3f Octree<T, BlockSide>::grad(const Eigen::Vector3f& pos) const {
+  return grad(pos, [](const value_type& v) { return v(0); });
+}
+
+template <typename T, unsigned int BlockSide>
 template <typename FieldSelector>
-Eigen::Vector3f Octree<T>::grad(const Eigen::Vector3f& pos, FieldSelector select) const {
-
-   Eigen::Vector3i base = Eigen::Vector3i(math::floorf(pos).cast<int>());
-   Eigen::Vector3f factor = math::fracf(pos);
-   Eigen::Vector3i lower_lower = (base - Eigen::Vector3i::Constant(1)).cwiseMax(Eigen::Vector3i::Constant(0));
-   Eigen::Vector3i lower_upper = base.cwiseMax(Eigen::Vector3i::Constant(0));
-   Eigen::Vector3i upper_lower = (base + Eigen::Vector3i::Constant(1)).cwiseMin(
-      Eigen::Vector3i::Constant(size_) - Eigen::Vector3i::Constant(1));
-   Eigen::Vector3i upper_upper = (base + Eigen::Vector3i::Constant(2)).cwiseMin(
-      Eigen::Vector3i::Constant(size_) - Eigen::Vector3i::Constant(1));
-   Eigen::Vector3i & lower = lower_upper;
-   Eigen::Vector3i & upper = upper_lower;
-
-  Eigen::Vector3f gradient;
-
-  VoxelBlock<T> * n = fetch(base(0), base(1), base(2));
-  gradient(0) = (((select(get(upper_lower(0), lower(1), lower(2), n))
-          - select(get(lower_lower(0), lower(1), lower(2), n))) * (1 - factor(0))
-        + (select(get(upper_upper(0), lower(1), lower(2), n))
-          - select(get(lower_upper(0), lower(1), lower(2), n))) * factor(0))
-      * (1 - factor(1))
-      + ((select(get(upper_lower(0), upper(1), lower(2), n))
-          - select(get(lower_lower(0), upper(1), lower(2), n))) * (1 - factor(0))
-        + (select(get(upper_upper(0), upper(1), lower(2), n))
-          - select(get(lower_upper(0), upper(1), lower(2), n)))
-        * factor(0)) * factor(1)) * (1 - factor(2))
-    + (((select(get(upper_lower(0), lower(1), upper(2), n))
-            - select(get(lower_lower(0), lower(1), upper(2), n))) * (1 - factor(0))
-          + (select(get(upper_upper(0), lower(1), upper(2), n))
-            - select(get(lower_upper(0), lower(1), upper(2), n)))
-          * factor(0)) * (1 - factor(1))
-        + ((select(get(upper_lower(0), upper(1), upper(2), n))
-            - select(get(lower_lower(0), upper(1), upper(2), n)))
-          * (1 - factor(0))
-          + (select(get(upper_upper(0), upper(1), upper(2), n))
-            - select(get(lower_upper(0), upper(1), upper(2), n)))
-          * factor(0)) * factor(1)) * factor(2);
-
-  gradient(1) = (((select(get(lower(0), upper_lower(1), lower(2), n))
-          - select(get(lower(0), lower_lower(1), lower(2), n))) * (1 - factor(0))
-        + (select(get(upper(0), upper_lower(1), lower(2), n))
-          - select(get(upper(0), lower_lower(1), lower(2), n))) * factor(0))
-      * (1 - factor(1))
-      + ((select(get(lower(0), upper_upper(1), lower(2), n))
-          - select(get(lower(0), lower_upper(1), lower(2), n))) * (1 - factor(0))
-        + (select(get(upper(0), upper_upper(1), lower(2), n))
-          - select(get(upper(0), lower_upper(1), lower(2), n)))
-        * factor(0)) * factor(1)) * (1 - factor(2))
-    + (((select(get(lower(0), upper_lower(1), upper(2), n))
-            - select(get(lower(0), lower_lower(1), upper(2), n))) * (1 - factor(0))
-          + (select(get(upper(0), upper_lower(1), upper(2), n))
-            - select(get(upper(0), lower_lower(1), upper(2), n)))
-          * factor(0)) * (1 - factor(1))
-        + ((select(get(lower(0), upper_upper(1), upper(2), n))
-            - select(get(lower(0), lower_upper(1), upper(2), n)))
-          * (1 - factor(0))
-          + (select(get(upper(0), upper_upper(1), upper(2), n))
-            - select(get(upper(0), lower_upper(1), upper(2), n)))
-          * factor(0)) * factor(1)) * factor(2);
-
-  gradient(2) = (((select(get(lower(0), lower(1), upper_lower(2), n))
-          - select(get(lower(0), lower(1), lower_lower(2), n))) * (1 - factor(0))
-        + (select(get(upper(0), lower(1), upper_lower(2), n))
-          - select(get(upper(0), lower(1), lower_lower(2), n))) * factor(0))
-      * (1 - factor(1))
-      + ((select(get(lower(0), upper(1), upper_lower(2), n))
-          - select(get(lower(0), upper(1), lower_lower(2), n))) * (1 - factor(0))
-        + (select(get(upper(0), upper(1), upper_lower(2), n))
-          - select(get(upper(0), upper(1), lower_lower(2), n)))
-        * factor(0)) * factor(1)) * (1 - factor(2))
-    + (((select(get(lower(0), lower(1), upper_upper(2), n))
-            - select(get(lower(0), lower(1), lower_upper(2), n))) * (1 - factor(0))
-          + (select(get(upper(0), lower(1), upper_upper(2), n))
-            - select(get(upper(0), lower(1), lower_upper(2), n)))
-          * factor(0)) * (1 - factor(1))
-        + ((select(get(lower(0), upper(1), upper_upper(2), n))
-            - select(get(lower(0), upper(1), lower_upper(2), n)))
-          * (1 - factor(0))
-          + (select(get(upper(0), upper(1), upper_upper(2), n))
-            - select(get(upper(0), upper(1), lower_upper(2), n)))
-          * factor(0)) * factor(1)) * factor(2);
-
-  return (0.5f * dim_ / size_) * gradient;
-}
-
-template <typename T>
-int Octree<T>::leavesCount(){
+Eigen::Vector3f Octree<T, BlockSide>::grad(const Eigen::Vector3f& pos, FieldSelector select) const {
+  return se::grad(cursor_type(*this), pos, select);
+}
+
+template <typename T, unsigned int BlockSide>
+int Octree<T, BlockSide>::leavesCount(){
   return leavesCountRecursive(root_);
 }
 
-template <typename T>
-int Octree<T>::leavesCountRecursive(Node<T> * n){
+template <typename T, unsigned int BlockSide>
+int Octree<T, BlockSide>::leavesCountRecursive(Node<T, BlockSide> * n){
 
   if(!n) return 0;
 
@@ -759,13 +779,13 @@ int Octree<T>::leavesCountRecursive(Node<T> * n){
   return sum;
 }
 
-template <typename T>
-int Octree<T>::nodeCount(){
+template <typename T, unsigned int BlockSide>
+int Octree<T, BlockSide>::nodeCount(){
   return nodeCountRecursive(root_);
 }
 
-template <typename T>
-int Octree<T>::nodeCountRecursive(Node<T> * node){
+template <typename T, unsigned int BlockSide>
+int Octree<T, BlockSide>::nodeCountRecursive(Node<T, BlockSide> * node){
   if (!node) {
     return 0;
   }
@@ -777,8 +797,8 @@ int Octree<T>::nodeCountRecursive(Node<T> * node){
   return n;
 }
 
-template <typename T>
-void Octree<T>::reserveBuffers(const int n){
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::reserveBuffers(const int n){
 
   if(n > reserved_){
     // std::cout << "Reserving " << n << " entries in allocation buffers" << std::endl;
@@ -789,136 +809,163 @@ void Octree<T>::reserveBuffers(const int n){
   block_buffer_.reserve(n);
 }
 
-template <typename T>
-bool Octree<T>::allocate(key_t *keys, int num_elem){
-
-#if defined(_OPENMP) && !defined(__clang__)
-  __gnu_parallel::sort(keys, keys+num_elem);
-#else
-std::sort(keys, keys+num_elem);
-#endif
+template <typename T, unsigned int BlockSide>
+bool Octree<T, BlockSide>::allocate(key_t *keys, int num_elem){
 
-  num_elem = algorithms::filter_ancestors(keys, num_elem, max_level_);
   reserveBuffers(num_elem);
+  algorithms::radix_sort(keys, num_elem, keys_at_level_);
+  const size_t num_keys = algorithms::filter_ancestors(keys, num_elem, 
+      keys_at_level_, max_level_);
+
+  // Consecutive keys share most of their ancestors, hence each thread walks
+  // a contiguous run of keys
+  const key_t * sorted = keys_at_level_;
+  algorithms::for_each_chunk(num_keys, 64, 
+      [this, sorted](const size_t begin, const size_t end) {
+        allocate_sorted(sorted + begin, end - begin);
+      });
+  return true;
+}
 
-  int last_elem = 0;
-  bool success = false;
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::allocate_sorted(const key_t * keys, 
+    const size_t num_keys) {
 
   const int leaves_level = max_level_ - log2(blockSide);
   const unsigned int shift = MAX_BITS - max_level_ - 1;
-  for (int level = 1; level <= leaves_level; level++){
-    const key_t mask = MASK[level + shift] | SCALE_MASK;
-    compute_prefix(keys, keys_at_level_, num_elem, mask);
-    last_elem = algorithms::unique_multiscale(keys_at_level_, num_elem, 
-        SCALE_MASK, level);
-    success = allocate_level(keys_at_level_, last_elem, level);
-  }
-  return success;
-}
-
-template <typename T>
-bool Octree<T>::allocate_level(key_t* keys, int num_tasks, int target_level){
-
-  int leaves_level = max_level_ - log2(blockSide);
-  nodes_buffer_.reserve(num_tasks);
+  Node<T, BlockSide> * path[max_depth + 1];
+  path[0] = root_;
+  int depth = 0;
+  key_t last = 0;
+
+  // Corners of the blocks enclosing the keys, decoded in one batch
+  std::vector<key_t> block_codes(num_keys);
+  std::vector<Eigen::Vector3i> corners(num_keys);
+  for(size_t i = 0; i < num_keys; ++i) {
+    block_codes[i] = keys[i] & MASK[leaves_level + shift];
+  }
+  unpack_morton(block_codes.data(), num_keys, corners.data());
+
+  for(size_t i = 0; i < num_keys; ++i) {
+    const key_t code = keyops::code(keys[i]);
+    const int target = std::min(keyops::level(keys[i]), leaves_level);
+
+    // Resume below the deepest octant shared with the previous key, the 
+    // levels at which two codes agree end at the leading bit of their XOR
+    int level = 0;
+    if(i > 0) {
+      const key_t diff = code ^ last;
+      const int shared = diff ? 
+        max_level_ - 1 - (63 - __builtin_clzll(diff)) / 3 : max_level_;
+      level = std::min(shared, depth);
+    }
 
-#pragma omp parallel for
-  for (int i = 0; i < num_tasks; i++){
-    Node<T> ** n = &root_;
-    key_t myKey = keyops::code(keys[i]);
-    int edge = size_/2;
-
-    for (int level = 1; level <= target_level; ++level){
-      int index = child_id(myKey, level, max_level_); 
-      Node<T> * parent = *n;
-      n = &(*n)->child(index);
-
-      if(!(*n)){
-        if(level == leaves_level){
-          *n = block_buffer_.acquire_block();
-          (*n)->side_ = edge;
-          static_cast<VoxelBlock<T> *>(*n)->coordinates(Eigen::Vector3i(unpack_morton(myKey)));
-          static_cast<VoxelBlock<T> *>(*n)->active(true);
-          static_cast<VoxelBlock<T> *>(*n)->code_ = myKey | level;
-          parent->children_mask_ = parent->children_mask_ | (1 << index);
-        }
-        else  {
-          *n = nodes_buffer_.acquire_block();
-          (*n)->code_ = myKey | level;
-          (*n)->side_ = edge;
-          parent->children_mask_ = parent->children_mask_ | (1 << index);
-        }
-      }
-      edge /= 2;
+    Node<T, BlockSide> * n = path[level];
+    for(; level < target; ++level) {
+      n = link_child(n, child_id(code, level + 1, max_level_), 
+          (code & MASK[level + 1 + shift]) | (level + 1), 
+          level + 1 == leaves_level, corners[i]);
+      path[level + 1] = n;
     }
+    depth = target;
+    last = code;
   }
-  return true;
 }
 
-template <typename T>
-void Octree<T>::getBlockList(std::vector<VoxelBlock<T>*>& blocklist, bool active){
-  Node<T> * n = root_;
+template <typename T, unsigned int BlockSide>
+Node<T, BlockSide> * Octree<T, BlockSide>::link_child(
+    Node<T, BlockSide> * parent, const int idx, const key_t key, 
+    const bool leaf, const Eigen::Vector3i& corner) {
+
+  Node<T, BlockSide> *& slot = parent->child(idx);
+  Node<T, BlockSide> * child = __atomic_load_n(&slot, __ATOMIC_ACQUIRE);
+  if(child) return child;
+
+  const int level = keyops::level(key);
+  VoxelBlock<T, BlockSide> * block = NULL;
+  if(leaf) {
+    unsigned int block_slot;
+    block = block_buffer_.acquire_block(block_slot);
+    block->slot(block_slot);
+    block->coordinates(corner);
+    child = block;
+  } else {
+    child = nodes_buffer_.acquire_block();
+  }
+  child->code_ = key;
+  child->side_ = size_ >> level;
+  const bool pruned = unprune(parent, idx, child);
+
+  // Publish the fully initialised child, unless another thread linked one
+  // first in which case that one is used instead
+  Node<T, BlockSide> * expected = NULL;
+  if(!__atomic_compare_exchange_n(&slot, &expected, child, false, 
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    if(leaf) block_buffer_.release_block(block);
+    else nodes_buffer_.release_block(child);
+    return expected;
+  }
+  if(leaf) activate(block);
+  // Siblings may be linked concurrently
+  __atomic_fetch_or(&parent->children_mask_, 1 << idx, __ATOMIC_RELAXED);
+  if(pruned) {
+    __atomic_fetch_and(&parent->pruned_mask_, ~(1 << idx), __ATOMIC_RELAXED);
+  }
+  return child;
+}
+
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::getBlockList(std::vector<VoxelBlock<T, BlockSide>*>& blocklist, bool active){
+  Node<T, BlockSide> * n = root_;
   if(!n) return;
   if(active) getActiveBlockList(n, blocklist);
   else getAllocatedBlockList(n, blocklist);
 }
 
-template <typename T>
-void Octree<T>::getActiveBlockList(Node<T> *n,
-    std::vector<VoxelBlock<T>*>& blocklist){
-  using tNode = Node<T>;
-  if(!n) return;
-  std::queue<tNode *> q;
-  q.push(n);
-  while(!q.empty()){
-    tNode* node = q.front();
-    q.pop();
-
-    if(node->isLeaf()){
-      VoxelBlock<T>* block = static_cast<VoxelBlock<T> *>(node);
-      if(block->active()) blocklist.push_back(block);
-      continue;
-    }
-
-    for(int i = 0; i < 8; ++i){
-      if(node->child(i)) q.push(node->child(i));
-    }
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::getActiveBlockList(Node<T, BlockSide> *,
+    std::vector<VoxelBlock<T, BlockSide>*>& blocklist){
+  for(const unsigned int slot : active_blocks_.slots()) {
+    blocklist.push_back(block_buffer_[slot]);
   }
 }
 
-template <typename T>
-void Octree<T>::getAllocatedBlockList(Node<T> *,
-    std::vector<VoxelBlock<T>*>& blocklist){
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::getAllocatedBlockList(Node<T, BlockSide> *,
+    std::vector<VoxelBlock<T, BlockSide>*>& blocklist){
   for(unsigned int i = 0; i < block_buffer_.size(); ++i) {
-      blocklist.push_back(block_buffer_[i]);
+      if(block_buffer_.used(i)) blocklist.push_back(block_buffer_[i]);
     }
   }
 
-template <typename T>
-void Octree<T>::save(const std::string& filename) {
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::save(const std::string& filename) {
   {
     std::ofstream os (filename, std::ios::binary); 
+    internal::write_header(os);
     os.write(reinterpret_cast<char *>(&size_), sizeof(size_));
     os.write(reinterpret_cast<char *>(&dim_), sizeof(dim_));
 
-    size_t n = nodes_buffer_.size();
+    size_t n = nodes_buffer_.size() - nodes_buffer_.free_count();
     os.write(reinterpret_cast<char *>(&n), sizeof(size_t));
-    for(size_t i = 0; i < n; ++i)
-      internal::serialise(os, *nodes_buffer_[i]);
+    for(size_t i = 0; i < nodes_buffer_.size(); ++i)
+      if(nodes_buffer_.used(i)) internal::serialise(os, *nodes_buffer_[i]);
 
-    n = block_buffer_.size();
+    n = block_buffer_.size() - block_buffer_.free_count();
     os.write(reinterpret_cast<char *>(&n), sizeof(size_t));
-    for(size_t i = 0; i < n; ++i)
-      internal::serialise(os, *block_buffer_[i]);
+    for(size_t i = 0; i < block_buffer_.size(); ++i)
+      if(block_buffer_.used(i)) internal::serialise(os, *block_buffer_[i]);
   }
 }
 
-template <typename T>
-void Octree<T>::load(const std::string& filename) {
+template <typename T, unsigned int BlockSide>
+void Octree<T, BlockSide>::load(const std::string& filename) {
   {
     std::cout << "Loading octree from disk... " << filename << std::endl;
     std::ifstream is (filename, std::ios::binary); 
-    int size, dim;
+    const uint32_t version = internal::read_header(is);
+    int size;
+    float dim;
     is.read(reinterpret_cast<char *>(&size), sizeof(size));
     is.read(reinterpret_cast<char *>(&dim), sizeof(dim));
 
@@ -929,25 +976,27 @@ void Octree<T>::load(const std::string& filename) {
     nodes_buffer_.reserve(n);
     std::cout << "Reading " << n << " nodes " << std::endl;
     for(size_t i = 0; i < n; ++i) {
-      Node<T> tmp;
-      internal::deserialise(tmp, is);
+      Node<T, BlockSide> tmp;
+      internal::deserialise(tmp, is, version);
       Eigen::Vector3i coords = keyops::decode(tmp.code_);
-      Node<T> * n = insert(coords(0), coords(1), coords(2), keyops::level(tmp.code_));
+      Node<T, BlockSide> * n = insert(coords(0), coords(1), coords(2), keyops::level(tmp.code_));
       std::memcpy(n->value_, tmp.value_, sizeof(tmp.value_));
+      n->pruned_mask_ = tmp.pruned_mask_;
     }
 
     is.read(reinterpret_cast<char *>(&n), sizeof(size_t));
     std::cout << "Reading " << n << " blocks " << std::endl;
     for(size_t i = 0; i < n; ++i) {
-      VoxelBlock<T> tmp;
+      VoxelBlock<T, BlockSide> tmp;
       internal::deserialise(tmp, is);
       Eigen::Vector3i coords = tmp.coordinates();
-      VoxelBlock<T> * n = 
-        static_cast<VoxelBlock<T> *>(insert(coords(0), coords(1), coords(2), keyops::level(tmp.code_)));
-      std::memcpy(n->getBlockRawPtr(), tmp.getBlockRawPtr(), sizeof(*(tmp.getBlockRawPtr())));
+      VoxelBlock<T, BlockSide> * n = 
+        static_cast<VoxelBlock<T, BlockSide> *>(insert(coords(0), coords(1), coords(2), keyops::level(tmp.code_)));
+      n->storage() = tmp.storage();
     }
   }
 }
 ;
 }
+#include "octree_cursor.hpp"
 #endif // OCTREE_H
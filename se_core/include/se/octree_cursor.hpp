@@ -0,0 +1,176 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+#ifndef SE_OCTREE_CURSOR_HPP
+#define SE_OCTREE_CURSOR_HPP
+#include "octree.hpp"
+
+/*****************************************************************************
+ *
+ *
+ * Octree cursor
+ *
+ * Caches the root-to-leaf path of the last query. The coordinates of two 
+ * voxels agree above the highest bit of their XOR, which is the leading bit
+ * of the XOR of their morton codes divided by three, hence the deepest common
+ * ancestor is found without touching the tree and the descent resumes from
+ * there instead of from the root. Queries along a ray or inside a block are
+ * resolved in a few steps, often zero. 
+ *
+ * A cursor is not thread safe: use one per thread. It must not outlive the
+ * octree nor be used across deallocations.
+ *
+*****************************************************************************/
+
+template <typename T, unsigned int BlockSide>
+class se::octree_cursor {
+
+  public:
+    typedef voxel_traits<T> traits_type;
+    typedef typename traits_type::value_type value_type;
+
+    octree_cursor(const Octree<T, BlockSide>& m) : map_(m), depth_(-1) {
+      max_level_ = log2(map_.size());
+      leaves_level_ = max_level_ - math::log2_const(BlockSide);
+    }
+
+    inline int size() const { return map_.size(); }
+    inline float dim() const { return map_.dim(); }
+
+    /*! \brief Fetch the voxel block which contains voxel (x,y,z)
+     */
+    VoxelBlock<T, BlockSide> * fetch(const int x, const int y, const int z) const {
+      int level;
+      Node<T, BlockSide> * n = descend(x, y, z, leaves_level_, level);
+      return level == leaves_level_ ? 
+        static_cast<VoxelBlock<T, BlockSide> *>(n) : NULL;
+    }
+
+    /*! \brief Fetch the octant (x,y,z) at level depth, see Octree::fetch_octant
+     */
+    Node<T, BlockSide> * fetch_octant(const int x, const int y, const int z,
+        const int depth) const {
+      const int target = std::max(0, std::min(depth, leaves_level_));
+      int level;
+      Node<T, BlockSide> * n = descend(x, y, z, target, level);
+      return level == target ? n : NULL;
+    }
+
+    /*! \brief Same semantics as Octree::get
+     */
+    value_type get(const int x, const int y, const int z) const {
+      int level;
+      Node<T, BlockSide> * n = descend(x, y, z, leaves_level_, level);
+      if(!n) return traits_type::initValue();
+      if(level == leaves_level_) {
+        return static_cast<VoxelBlock<T, BlockSide> *>(n)->data(
+            Eigen::Vector3i(x, y, z));
+      }
+      const unsigned edge = map_.size() >> (level + 1);
+      return n->value_[((x & edge) > 0) + 2 * ((y & edge) > 0) + 
+        4 * ((z & edge) > 0)];
+    }
+
+    /*! \brief Same semantics as Octree::get_fine
+     */
+    value_type get_fine(const int x, const int y, const int z) const {
+      int level;
+      Node<T, BlockSide> * n = descend(x, y, z, leaves_level_, level);
+      if(!n) return traits_type::initValue();
+      if(level == leaves_level_) {
+        return static_cast<VoxelBlock<T, BlockSide> *>(n)->data(
+            Eigen::Vector3i(x, y, z));
+      }
+      const unsigned edge = map_.size() >> (level + 1);
+      const int idx = ((x & edge) > 0) + 2 * ((y & edge) > 0) + 
+        4 * ((z & edge) > 0);
+      return (n->pruned_mask_ & (1 << idx)) ? n->value_[idx] : 
+        traits_type::initValue();
+    }
+
+    /*! \brief Same semantics as Octree::interp
+     */
+    template <typename FieldSelect>
+    float interp(const Eigen::Vector3f& pos, FieldSelect select) const {
+      return se::interp(*this, pos, select);
+    }
+
+    /*! \brief Forget the cached path.
+     */
+    void reset() { depth_ = -1; }
+
+  private:
+
+    /*
+     * Descend towards the octant at level depth containing (x,y,z), starting
+     * from the deepest cached ancestor. Returns the deepest allocated octant 
+     * reached and stores its level in level.
+     */
+    Node<T, BlockSide> * descend(const int x, const int y, const int z, 
+        const int depth, int& level) const {
+      if(depth_ < 0) {
+        path_[0] = map_.root();
+        depth_ = 0;
+        level = 0;
+      } else {
+        const unsigned diff = (x ^ x_) | (y ^ y_) | (z ^ z_);
+        const int shared = diff ? 
+          max_level_ - 1 - (31 - __builtin_clz(diff)) : depth_;
+        level = std::max(0, std::min(std::min(shared, depth_), depth));
+      }
+
+      Node<T, BlockSide> * n = path_[level];
+      if(!n) return NULL;
+      while(level < depth) {
+        const unsigned edge = map_.size() >> (level + 1);
+        Node<T, BlockSide> * child = n->child((x & edge) > 0u, 
+            (y & edge) > 0u, (z & edge) > 0u);
+        if(!child) break;
+        n = child;
+        path_[++level] = n;
+      }
+      depth_ = level;
+      x_ = x;
+      y_ = y;
+      z_ = z;
+      return n;
+    }
+
+    const Octree<T, BlockSide>& map_;
+    int max_level_;
+    int leaves_level_;
+    mutable Node<T, BlockSide> * path_[Octree<T, BlockSide>::max_depth + 1];
+    mutable int depth_;
+    mutable int x_;
+    mutable int y_;
+    mutable int z_;
+};
+#endif
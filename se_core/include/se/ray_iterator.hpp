@@ -46,11 +46,11 @@
  * 
 *****************************************************************************/
 
-template <typename T>
+template <typename T, unsigned int BlockSide>
 class se::ray_iterator {
 
   public:
-    ray_iterator(const Octree<T>& m, const Eigen::Vector3f& origin, 
+    ray_iterator(const Octree<T, BlockSide>& m, const Eigen::Vector3f& origin, 
         const Eigen::Vector3f& direction, float nearPlane, float farPlane) : map_(m) {
 
       pos_ = Eigen::Vector3f(1.0f, 1.0f, 1.0f);
@@ -59,7 +59,7 @@ class se::ray_iterator {
       child_ = NULL;
       scale_exp2_ = 0.5f;
       scale_ = CAST_STACK_DEPTH-1;
-      min_scale_ = CAST_STACK_DEPTH - log2(m.size_/Octree<T>::blockSide);
+      min_scale_ = CAST_STACK_DEPTH - log2(m.size_/Octree<T, BlockSide>::blockSide);
       static const float epsilon = exp2f(-log2(map_.size_));
       voxelSize_ = map_.dim_/map_.size_;
       state_ = INIT; 
@@ -202,7 +202,7 @@ class se::ray_iterator {
      * Returns the next leaf along the ray direction.
      */
 
-    VoxelBlock<T>* next() {
+    VoxelBlock<T, BlockSide>* next() {
 
       if(state_ == ADVANCE) advance_ray();
       else if (state_ == FINISHED) return nullptr;
@@ -215,7 +215,7 @@ class se::ray_iterator {
 
         if (scale_ == min_scale_ && child_ != NULL){
           state_ = ADVANCE;
-          return static_cast<VoxelBlock<T> *>(child_); 
+          return static_cast<VoxelBlock<T, BlockSide> *>(child_); 
         } else if (child_ != NULL && t_min_ <= t_max_){  // If the child is valid, descend the tree hierarchy.
           descend();
           continue;
@@ -252,7 +252,7 @@ class se::ray_iterator {
   private:
     struct stack_entry {
       int scale;
-      Node<T> * parent;
+      Node<T, BlockSide> * parent;
       float t_max;
     };
 
@@ -262,15 +262,15 @@ class se::ray_iterator {
       FINISHED
     } STATE;
 
-    const Octree<T>& map_;
+    const Octree<T, BlockSide>& map_;
     float voxelSize_; 
     Eigen::Vector3f origin_;
     Eigen::Vector3f direction_;
     Eigen::Vector3f t_coef_;
     Eigen::Vector3f t_bias_;
     struct stack_entry stack[CAST_STACK_DEPTH];
-    Node<T> * parent_;
-    Node<T> * child_;
+    Node<T, BlockSide> * parent_;
+    Node<T, BlockSide> * child_;
     int idx_;
     Eigen::Vector3f pos_;
     int scale;
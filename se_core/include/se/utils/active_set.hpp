@@ -0,0 +1,181 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef ACTIVE_SET_HPP
+#define ACTIVE_SET_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace se {
+/*! \brief Set of slots of a MemoryPool, kept as a bitmap indexed by slot
+ * together with a compact list of the slots, so that the set is walked in
+ * O(size) rather than O(pool size). insert, erase and contains are thread 
+ * safe. Erased slots are dropped from the list lazily, by slots().
+ *
+ * The bitmap is paged like the pool: pages are published with a CAS by the
+ * first insertion that needs them.
+ */
+class active_set {
+  public:
+    active_set() {
+      pages_ = new std::atomic<Page *>[max_pages];
+      for(int p = 0; p < max_pages; ++p) pages_[p] = NULL;
+    }
+
+    ~active_set() {
+      for(int p = 0; p < max_pages; ++p) delete pages_[p].load();
+      delete [] pages_;
+    }
+
+    /*! \brief Add slot to the set.
+     * \return false if slot was already in the set
+     */
+    bool insert(const unsigned int slot) {
+      Page * pg = page(slot / pagesize_);
+      const int word = (slot % pagesize_) / 64;
+      const uint64_t bit = uint64_t(1) << (slot % 64);
+      if(pg->active[word].load(std::memory_order_relaxed) & bit) return false;
+      if(pg->active[word].fetch_or(bit) & bit) return false;
+      // Slots erased but not yet dropped from the list are still there
+      if(!(pg->listed[word].fetch_or(bit) & bit)) {
+        std::lock_guard<std::mutex> lock(list_lock_);
+        list_.push_back(slot);
+      }
+      return true;
+    }
+
+    /*! \brief Remove slot from the set.
+     * \return false if slot was not in the set
+     */
+    bool erase(const unsigned int slot) {
+      Page * pg = pages_[slot / pagesize_].load(std::memory_order_acquire);
+      if(!pg) return false;
+      const int word = (slot % pagesize_) / 64;
+      const uint64_t bit = uint64_t(1) << (slot % 64);
+      if(!(pg->active[word].load(std::memory_order_relaxed) & bit)) 
+        return false;
+      return pg->active[word].fetch_and(~bit) & bit;
+    }
+
+    /*! \brief Insert the slot of block and raise its active flag. The flag
+     * is raised after the slot is inserted, so that the common case of an 
+     * already active block costs a single load.
+     */
+    template <typename BlockT>
+    void activate(BlockT * block) {
+      if(block->active()) return;
+      insert(block->slot());
+      block->active(true);
+    }
+
+    /*! \brief Lower the active flag of block and erase its slot.
+     */
+    template <typename BlockT>
+    void deactivate(BlockT * block) {
+      if(!block->active()) return;
+      block->active(false);
+      erase(block->slot());
+    }
+
+    bool contains(const unsigned int slot) const {
+      const Page * pg = pages_[slot / pagesize_].load(std::memory_order_acquire);
+      return pg && (pg->active[(slot % pagesize_) / 64].load(
+            std::memory_order_relaxed) & (uint64_t(1) << (slot % 64)));
+    }
+
+    /*! \brief Slots in the set, in insertion order up to the erased ones. 
+     * Not thread safe.
+     */
+    const std::vector<unsigned int>& slots() {
+      size_t last = 0;
+      for(size_t i = 0; i < list_.size(); ++i) {
+        const unsigned int slot = list_[i];
+        if(contains(slot)) {
+          list_[last++] = slot;
+        } else {
+          Page * pg = pages_[slot / pagesize_].load();
+          pg->listed[(slot % pagesize_) / 64] &= ~(uint64_t(1) << (slot % 64));
+        }
+      }
+      list_.resize(last);
+      return list_;
+    }
+
+    /*! \brief Empty the set, keeping the pages. Not thread safe.
+     */
+    void clear() {
+      for(int p = 0; p < max_pages; ++p) {
+        Page * pg = pages_[p].load();
+        if(pg) pg->reset();
+      }
+      list_.clear();
+    }
+
+  private:
+    static constexpr int pagesize_ = 4096; // # of slots per page
+    static constexpr int max_pages = (1 << 25) / pagesize_;
+
+    struct Page {
+      Page() { reset(); }
+      void reset() {
+        for(int i = 0; i < pagesize_ / 64; ++i) {
+          active[i] = 0;
+          listed[i] = 0;
+        }
+      }
+      std::atomic<uint64_t> active[pagesize_ / 64];
+      // Slots present in list_, erased ones included
+      std::atomic<uint64_t> listed[pagesize_ / 64];
+    };
+
+    std::atomic<Page *> * pages_;
+    std::vector<unsigned int> list_;
+    std::mutex list_lock_;
+
+    Page * page(const int p) {
+      Page * pg = pages_[p].load(std::memory_order_acquire);
+      if(pg) return pg;
+      Page * fresh = new Page;
+      if(!pages_[p].compare_exchange_strong(pg, fresh, 
+            std::memory_order_acq_rel)) {
+        delete fresh;
+        return pg;
+      }
+      return fresh;
+    }
+
+    active_set(const active_set&) = delete;
+    active_set& operator=(const active_set&) = delete;
+};
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef BLOCK_LAYOUT_HPP
+#define BLOCK_LAYOUT_HPP
+#include <cstdint>
+
+namespace se {
+
+/*! \brief Row-major voxel ordering inside a block: x + y*side + z*side^2.
+ * A 2x2x2 neighbourhood spans four rows and up to four cache lines.
+ */
+struct linear_layout {
+
+  template <unsigned int Side>
+  static inline unsigned int index(const int x, const int y, const int z) {
+    return x + y*Side + z*Side*Side;
+  }
+
+  template <unsigned int Side, typename StorageT, typename ValueT>
+  static inline void gather(const StorageT& data, const int x, const int y, 
+      const int z, ValueT values[8]) {
+    const unsigned int idx = index<Side>(x, y, z);
+    values[0] = data[idx];
+    values[1] = data[idx + 1];
+    values[2] = data[idx + Side];
+    values[3] = data[idx + Side + 1];
+    values[4] = data[idx + Side*Side];
+    values[5] = data[idx + Side*Side + 1];
+    values[6] = data[idx + Side*Side + Side];
+    values[7] = data[idx + Side*Side + Side + 1];
+  }
+};
+
+/*! \brief Z-order voxel ordering inside a block. The eight voxels of a
+ * 2x2x2 cell whose lower corner has even coordinates are contiguous, in the
+ * same x-fastest order used by the interpolation offsets.
+ */
+struct morton_layout {
+
+  /*! \brief Spread the four low bits of v so that bit i lands on bit 3i.
+   * Blocks are at most 16 voxels wide, hence four bits are enough.
+   */
+  static inline unsigned int dilate(const unsigned int v) {
+    static constexpr unsigned short table[16] = {
+      0x000, 0x001, 0x008, 0x009, 0x040, 0x041, 0x048, 0x049, 
+      0x200, 0x201, 0x208, 0x209, 0x240, 0x241, 0x248, 0x249};
+    return table[v & 0xF];
+  }
+
+  template <unsigned int Side>
+  static inline unsigned int index(const int x, const int y, const int z) {
+    return dilate(x) | (dilate(y) << 1) | (dilate(z) << 2);
+  }
+
+  template <unsigned int Side, typename StorageT, typename ValueT>
+  static inline void gather(const StorageT& data, const int x, const int y, 
+      const int z, ValueT values[8]) {
+    if(((x | y | z) & 1) == 0) {
+      const unsigned int cell = index<Side>(x, y, z);
+      for(int i = 0; i < 8; ++i) values[i] = data[cell + i];
+      return;
+    }
+    const unsigned int x0 = dilate(x), x1 = dilate(x + 1);
+    const unsigned int y0 = dilate(y) << 1, y1 = dilate(y + 1) << 1;
+    const unsigned int z0 = dilate(z) << 2, z1 = dilate(z + 1) << 2;
+    values[0] = data[x0 | y0 | z0];
+    values[1] = data[x1 | y0 | z0];
+    values[2] = data[x0 | y1 | z0];
+    values[3] = data[x1 | y1 | z0];
+    values[4] = data[x0 | y0 | z1];
+    values[5] = data[x1 | y0 | z1];
+    values[6] = data[x0 | y1 | z1];
+    values[7] = data[x1 | y1 | z1];
+  }
+};
+
+/*! \brief Selects the intra-block layout used by VoxelBlock<T>. Defaults to
+ * linear_layout; specialise it to morton_layout to opt a field type into
+ * Z-order storage.
+ */
+template <typename T>
+struct block_layout {
+  typedef linear_layout type;
+};
+}
+#endif
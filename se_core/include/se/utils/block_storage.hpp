@@ -0,0 +1,98 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef BLOCK_STORAGE_HPP
+#define BLOCK_STORAGE_HPP
+#include <type_traits>
+#include "../voxel_traits.hpp"
+
+namespace se {
+
+/*! \brief Array of structs voxel storage, one value_type per voxel.
+ */
+struct aos_storage {
+
+  template <typename ValueT, unsigned int Size>
+  struct array {
+    typedef ValueT value_type;
+
+    const value_type& operator[](const unsigned int i) const { return data_[i]; }
+    void set(const unsigned int i, const value_type& v) { data_[i] = v; }
+    value_type * data() { return data_; }
+
+    value_type data_[Size];
+  };
+};
+
+/*! \brief Structure of arrays voxel storage for two-field {x, y} voxels. 
+ * Each field is held in its own contiguous, 32-byte aligned array, so that
+ * a row of a linear_layout block loads with a single vector instruction.
+ */
+struct soa_storage {
+
+  template <typename ValueT, unsigned int Size>
+  struct array {
+    typedef ValueT value_type;
+    typedef decltype(ValueT::x) x_type;
+    typedef decltype(ValueT::y) y_type;
+
+    value_type operator[](const unsigned int i) const { return {x_[i], y_[i]}; }
+    void set(const unsigned int i, const value_type& v) { 
+      x_[i] = v.x; 
+      y_[i] = v.y; 
+    }
+    x_type * x() { return x_; }
+    y_type * y() { return y_; }
+
+    alignas(32) x_type x_[Size];
+    alignas(32) y_type y_[Size];
+  };
+};
+
+namespace internal {
+template <typename...> struct make_void { typedef void type; };
+}
+
+/*! \brief Selects the voxel storage of VoxelBlock<T>. Defaults to 
+ * aos_storage; a voxel_traits<T> declaring a storage_type typedef, e.g. 
+ * soa_storage, opts T into that storage instead.
+ */
+template <typename T, typename = void>
+struct block_storage {
+  typedef aos_storage type;
+};
+
+template <typename T>
+struct block_storage<T, typename internal::make_void<
+  typename voxel_traits<T>::storage_type>::type> {
+  typedef typename voxel_traits<T>::storage_type type;
+};
+}
+#endif
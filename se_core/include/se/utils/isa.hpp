@@ -0,0 +1,140 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef SE_ISA_HPP
+#define SE_ISA_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace se {
+namespace isa {
+
+/*! \brief Instruction sets the hot kernels are compiled for, each level 
+ * implying the ones below it. generic is the compiler's baseline.
+ */
+enum class level { generic, sse42, avx2, avx512 };
+
+inline const char * name(const level l) {
+  switch(l) {
+    case level::sse42:  return "sse4.2";
+    case level::avx2:   return "avx2";
+    case level::avx512: return "avx512";
+    default:            return "generic";
+  }
+}
+
+/*! \brief Parses a level name as returned by name(), false if unknown. */
+inline bool parse(const char * str, level& l) {
+  for(level candidate : {level::generic, level::sse42, level::avx2, 
+      level::avx512}) {
+    if(std::strcmp(str, name(candidate)) == 0) {
+      l = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*! \brief Highest level supported by the CPU and enabled by the OS, 
+ * queried through cpuid.
+ */
+inline level detect() {
+#if defined(__x86_64__) && defined(__GNUC__)
+  __builtin_cpu_init();
+  const bool avx2 = __builtin_cpu_supports("avx2") && 
+    __builtin_cpu_supports("fma");
+  if(avx2 && __builtin_cpu_supports("avx512f") && 
+      __builtin_cpu_supports("avx512dq") && 
+      __builtin_cpu_supports("avx512bw") && 
+      __builtin_cpu_supports("avx512vl")) return level::avx512;
+  if(avx2) return level::avx2;
+  if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) 
+    return level::sse42;
+#endif
+  return level::generic;
+}
+
+/*! \brief Level the kernels run at, resolved once per process. This is 
+ * detect(), unless the SE_ISA environment variable names a lower level 
+ * (generic, sse4.2, avx2 or avx512). Levels the CPU lacks are ignored.
+ */
+inline level selected() {
+  static const level l = [] {
+    const level detected = detect();
+    const char * env = std::getenv("SE_ISA");
+    level requested;
+    if(env == NULL) return detected;
+    if(!parse(env, requested)) {
+      std::cerr << "Unknown SE_ISA " << env << ", using " 
+        << name(detected) << std::endl;
+      return detected;
+    }
+    if(requested > detected) {
+      std::cerr << "SE_ISA " << env << " unsupported by this CPU, using " 
+        << name(detected) << std::endl;
+      return detected;
+    }
+    return requested;
+  }();
+  return l;
+}
+
+/*! \brief True if the CPU has BMI2 and executes pdep and pext in a single
+ * micro-op. AMD processors before Zen 3 microcode them (tens to hundreds of
+ * cycles), so they are reported as slow. Resolved once per process and only
+ * true from level::avx2 up, so that SE_ISA=generic also turns BMI2 off.
+ */
+inline bool fast_bmi2() {
+  static const bool fast = [] {
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    return selected() >= level::avx2 && __builtin_cpu_supports("bmi2") &&
+      !__builtin_cpu_is("amdfam15h") && !__builtin_cpu_is("amdfam17h");
+#else
+    return false;
+#endif
+  }();
+  return fast;
+}
+
+/*! \brief Runs a callable in place. Generic se_core algorithms hand their 
+ * per-block work to a callable like this one; kernels compiled for a given 
+ * level pass instead an equivalent one compiled (and flattened) for that 
+ * level, so that the block work runs with the kernel's instruction set.
+ */
+struct inline_call {
+  template <typename F>
+  void operator()(const F& f) const { f(); }
+};
+}
+}
+#endif
@@ -0,0 +1,149 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef KEY_BUFFER_HPP
+#define KEY_BUFFER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace se {
+/*! \brief Octant keys collected by a parallel loop, one buffer per thread, 
+ * so that threads neither share a counter nor write to the same cache lines.
+ * Rays cast from neighbouring pixels hit the same octants over and over, 
+ * hence each buffer drops the keys it has recently seen, see local::push. 
+ * merge() concatenates the buffers, leaving the keys nearly but not exactly 
+ * unique: consumers must still sort and unique them.
+ */
+template <typename KeyT>
+class key_buffer {
+  public:
+    /*! \brief Keys pushed by one thread, filtered through a small open 
+     * addressing table. The table forgets a key when a probe sequence is 
+     * full, after which the key is accepted again.
+     */
+    class local {
+      public:
+        local() { clear(); }
+
+        /*! \brief Append key unless it is in the table.
+         */
+        void push(const KeyT key) {
+          const unsigned int home = hash(key);
+          for(unsigned int p = 0; p < max_probes; ++p) {
+            KeyT& entry = table_[(home + p) & (table_size - 1)];
+            if(entry == key) return;
+            if(entry == empty_key) {
+              entry = key;
+              keys_.push_back(key);
+              return;
+            }
+          }
+          table_[home] = key;
+          keys_.push_back(key);
+        }
+
+        void clear() {
+          const KeyT empty = empty_key;
+          keys_.clear();
+          std::fill(table_, table_ + table_size, empty);
+        }
+
+        const std::vector<KeyT>& keys() const { return keys_; }
+
+      private:
+        static constexpr unsigned int table_bits = 12;
+        static constexpr unsigned int table_size = 1 << table_bits;
+        static constexpr unsigned int max_probes = 8;
+        static constexpr KeyT empty_key = ~KeyT(0);
+
+        static unsigned int hash(const KeyT key) {
+          return (uint64_t(key) * 0x9E3779B97F4A7C15ull) >> (64 - table_bits);
+        }
+
+        std::vector<KeyT> keys_;
+        KeyT table_[table_size];
+        /* Keep the vector of the next thread off our cache lines */
+        char pad_[64];
+    };
+
+    /*! \brief Empty the buffers of all threads.
+     */
+    void clear() {
+#ifdef _OPENMP
+      locals_.resize(omp_get_max_threads());
+#else
+      locals_.resize(1);
+#endif
+      for(auto& l : locals_) l.clear();
+    }
+
+    /*! \brief Buffer of the calling thread. Thread ids are only unique inside
+     * a parallel region, call clear() before entering it.
+     */
+    local& thread_buffer() {
+#ifdef _OPENMP
+      return locals_[omp_get_thread_num()];
+#else
+      return locals_[0];
+#endif
+    }
+
+    /*! \brief Concatenate the buffers of all threads into out.
+     * \return number of keys written
+     */
+    size_t merge(std::vector<KeyT>& out) const {
+      const int num = locals_.size();
+      std::vector<size_t> offset(num + 1, 0);
+      for(int i = 0; i < num; ++i) {
+        offset[i + 1] = offset[i] + locals_[i].keys().size();
+      }
+      out.resize(offset[num]);
+#pragma omp parallel for
+      for(int i = 0; i < num; ++i) {
+        const std::vector<KeyT>& keys = locals_[i].keys();
+        if(!keys.empty()) {
+          std::memcpy(out.data() + offset[i], keys.data(), 
+              sizeof(KeyT) * keys.size());
+        }
+      }
+      return offset[num];
+    }
+
+  private:
+    std::vector<local> locals_;
+};
+}
+#endif
@@ -35,63 +35,306 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <iostream>
 #include <vector>
 #include <atomic>
-#include <mutex>
+#include <algorithm>
+#include <new>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <type_traits>
+#include "page_allocator.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace se {
-template <typename BlockType>
+namespace detail {
+  /* Process wide id of the calling thread, handed out on first use. Unlike
+   * omp_get_thread_num it is unique across OpenMP teams and std::threads. */
+  inline unsigned int thread_slot() {
+    static std::atomic<unsigned int> next_slot(0);
+    thread_local const unsigned int slot = next_slot++;
+    return slot;
+  }
+}
+
+/*! \brief Paged pool of default constructed objects. Slots are handed out by
+ * bumping a counter or, once released, recycled through a lock-free free 
+ * stack fronted by small per-thread caches. Released slots stay in the
+ * [0, size()) range, hence iterations over the pool must skip the slots for
+ * which used() is false. Pages are aligned to their size rounded up to a 
+ * power of two, hence release_block maps an object back to its slot from its
+ * address alone. Objects of 1KB or more are padded to whole cache lines, 
+ * smaller ones are packed.
+ *
+ * Pages live in a fixed size directory and are published with a CAS by the 
+ * first thread which needs them, hence the pool grows safely while other 
+ * threads are acquiring and reserve() is only a hint. Page storage comes 
+ * from PageAllocator (see page_allocator.hpp) and each object is constructed
+ * by the thread that first acquires its slot.
+ */
+template <typename BlockType, typename PageAllocator = default_page_allocator>
   class MemoryPool {
     public:
       MemoryPool(){
         current_block_ = 0;
-        num_pages_ = 0;
-        reserved_ = 0;
+        pages_ = new std::atomic<Page *>[max_pages];
+        for(int p = 0; p < max_pages; ++p) pages_[p] = NULL;
+        free_head_ = pack(0, end_idx);
+        free_count_ = 0;
+#ifdef _OPENMP
+        num_caches_ = omp_get_max_threads();
+#else
+        num_caches_ = 0;
+#endif
+        // std::allocator ignores over-alignment before C++17
+        caches_ = static_cast<ThreadCache *>(heap_page_allocator::allocate(
+              cache_bytes()));
+        for(size_t i = 0; i < num_caches_; ++i) new (caches_ + i) ThreadCache;
       }
 
       ~MemoryPool(){
-        for(auto&& i : pages_){
-          delete [] i;
+        for(unsigned int i = 0; i < size(); ++i){
+          (*this)[i]->~BlockType();
         }
+        for(int p = 0; p < max_pages; ++p){
+          Page * pg = pages_[p].load();
+          if(pg) destroy(pg);
+        }
+        delete [] pages_;
+        heap_page_allocator::deallocate(caches_, cache_bytes());
       }
 
-      size_t size() const { return current_block_; };
+      /*! \brief Number of slots handed out so far, released ones included. 
+       */
+      size_t size() const { 
+        // A failed acquisition leaves the counter past the capacity
+        const size_t n = current_block_;
+        return n < capacity ? n : capacity;
+      };
+
+      /*! \brief Number of released slots waiting to be recycled.
+       */
+      size_t free_count() const { return free_count_; };
+
+      /*! \brief False if slot i has been released.
+       */
+      bool used(const size_t i) const { 
+        return state(i).load(std::memory_order_relaxed) == used_idx;
+      }
 
       BlockType* operator[](const size_t i) const {
         const int page_idx = i / pagesize_;
         const int ptr_idx = i % pagesize_;
-        return pages_[page_idx] + (ptr_idx);
+        return pages_[page_idx].load(std::memory_order_acquire)->block(ptr_idx);
       }
 
+      /*! \brief Publish the pages needed by n more acquisitions ahead of 
+       * time. Optional, not thread safe.
+       */
       void reserve(const size_t n){
-        bool requires_realloc = (current_block_ + n) > reserved_;
-        if(requires_realloc) expand(n);
+        flush();
+        const size_t recycled = std::min(n, free_count_.load());
+        const size_t last = current_block_ + n - recycled;
+        for(size_t i = current_block_; i < last; i += pagesize_) page(i / pagesize_);
+        if(last > current_block_) page((last - 1) / pagesize_);
       }
 
+      /*! \brief Hand out a default constructed object. Throws 
+       * std::bad_alloc once every page of the directory is in use.
+       */
       BlockType * acquire_block(){
-        // Fetch-add returns the value before increment
-        int current = current_block_.fetch_add(1);
-        const int page_idx = current / pagesize_;
-        const int ptr_idx = current % pagesize_;
-        BlockType * ptr = pages_[page_idx] + (ptr_idx);
-        return ptr;
+        unsigned int idx;
+        return acquire_block(idx);
+      }
+
+      /*! \brief acquire_block, also returning the slot of the object. 
+       */
+      BlockType * acquire_block(unsigned int& idx){
+        if(!pop_cached(idx) && !pop(idx)) {
+          // Fetch-add returns the value before increment
+          idx = current_block_.fetch_add(1);
+          // First touch of the slot happens on the acquiring thread
+          new (&page(idx / pagesize_)->slots[idx % pagesize_].storage) 
+            BlockType();
+        } else {
+          --free_count_;
+        }
+        state(idx).store(used_idx, std::memory_order_relaxed);
+        return (*this)[idx];
+      }
+
+      /*! \brief Return a slot to the pool. The object is reset to its default
+       * constructed state. Safe to call concurrently with acquire_block.
+       */
+      void release_block(BlockType * ptr){
+        const unsigned int idx = index_of(ptr);
+        ptr->~BlockType();
+        new (ptr) BlockType();
+        state(idx).store(end_idx, std::memory_order_relaxed);
+        ++free_count_;
+        if(!push_cached(idx)) push(idx);
+      }
+
+      /*! \brief Release every slot while keeping the pages for reuse. Not 
+       * thread safe.
+       */
+      void clear(){
+        for(unsigned int i = 0; i < size(); ++i){
+          (*this)[i]->~BlockType();
+        }
+        for(size_t i = 0; i < num_caches_; ++i) caches_[i].count = 0;
+        current_block_ = 0;
+        free_head_ = pack(0, end_idx);
+        free_count_ = 0;
       }
 
     private:
-      size_t reserved_;
+      static constexpr int pagesize_ = 1024; // # of blocks per page
+      static constexpr int max_pages = 1 << 15;
+      static constexpr size_t capacity = size_t(max_pages) * pagesize_;
+      static constexpr unsigned int used_idx = ~0u;
+      static constexpr unsigned int end_idx = ~0u - 1;
+      static constexpr int cache_size = 30;
+      // Padding to a cache line costs at most 6% from here on
+      static constexpr size_t pad_threshold = 1024;
+
+      // Two cache lines per thread, aligned so that threads never share one
+      struct alignas(64) ThreadCache {
+        ThreadCache() : count(0) {}
+        unsigned int count;
+        unsigned int ids[cache_size];
+        unsigned int padding;
+      };
+      static_assert(sizeof(ThreadCache) == 128, "ThreadCache spans two lines");
+
+      static constexpr size_t slot_alignment = 
+        sizeof(BlockType) >= pad_threshold && alignof(BlockType) < 64 ? 
+        64 : alignof(BlockType);
+
+      // Raw object storage, constructed when first acquired
+      struct alignas(slot_alignment) Slot {
+        typename std::aligned_storage<sizeof(BlockType), 
+                 alignof(BlockType)>::type storage;
+      };
+
+      struct Page {
+        Page(const unsigned int p) : index(p) {
+          for(int i = 0; i < pagesize_; ++i) states[i] = end_idx;
+        }
+        BlockType * block(const int i) {
+          return reinterpret_cast<BlockType *>(&slots[i].storage);
+        }
+        // First member, index_of relies on it
+        Slot slots[pagesize_];
+        // Free stack link of each slot, used_idx while the slot is in use
+        std::atomic<unsigned int> states[pagesize_];
+        unsigned int index;
+      };
+
+      static constexpr size_t pow2(const size_t n, const size_t p = 1) {
+        return p >= n ? p : pow2(n, 2 * p);
+      }
+      static constexpr size_t page_alignment = pow2(sizeof(Page));
+
       std::atomic<unsigned int> current_block_;
-      const int pagesize_ = 1024; // # of blocks per page
-      int num_pages_;
-      std::vector<BlockType *> pages_;
-
-      void expand(const size_t n){
-
-        // std::cout << "Allocating " << n << " blocks" << std::endl;
-        const int new_pages = std::ceil(n/pagesize_);
-        for(int p = 0; p <= new_pages; ++p){
-          pages_.push_back(new BlockType[pagesize_]);
-          ++num_pages_;
-          reserved_ += pagesize_;
+      std::atomic<Page *> * pages_;
+      // ABA tag in the upper 32 bits, top of the stack in the lower ones
+      std::atomic<uint64_t> free_head_;
+      std::atomic<size_t> free_count_;
+      ThreadCache * caches_;
+      size_t num_caches_;
+
+      static uint64_t pack(const uint64_t tag, const unsigned int idx) {
+        return (tag << 32) | idx;
+      }
+
+      std::atomic<unsigned int>& state(const size_t i) const {
+        return pages_[i / pagesize_].load(std::memory_order_acquire)->
+          states[i % pagesize_];
+      }
+
+      static void destroy(Page * pg){
+        pg->~Page();
+        PageAllocator::deallocate(pg, sizeof(Page));
+      }
+
+      size_t cache_bytes() const {
+        return std::max(num_caches_, size_t(1)) * sizeof(ThreadCache);
+      }
+
+      /* Page p, allocated and published if nobody did it yet. */
+      Page * page(const int p){
+        if(p >= max_pages) throw std::bad_alloc();
+        Page * pg = pages_[p].load(std::memory_order_acquire);
+        if(pg) return pg;
+        Page * fresh = new (PageAllocator::allocate(sizeof(Page), 
+              page_alignment)) Page(p);
+        if(!pages_[p].compare_exchange_strong(pg, fresh, 
+              std::memory_order_acq_rel)) {
+          // Lost the race, pg now holds the published page
+          destroy(fresh);
+          return pg;
+        }
+        return fresh;
+      }
+
+      /* The page starts at the aligned address below the object */
+      static unsigned int index_of(const BlockType * ptr){
+        const uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+        const uintptr_t base = addr & ~uintptr_t(page_alignment - 1);
+        return reinterpret_cast<const Page *>(base)->index * pagesize_ + 
+          (addr - base) / sizeof(Slot);
+      }
+
+      void push(const unsigned int idx){
+        uint64_t head = free_head_.load();
+        do {
+          state(idx).store(head & 0xFFFFFFFF, std::memory_order_relaxed);
+        } while(!free_head_.compare_exchange_weak(head, 
+              pack((head >> 32) + 1, idx)));
+      }
+
+      bool pop(unsigned int& idx){
+        uint64_t head = free_head_.load();
+        do {
+          idx = head & 0xFFFFFFFF;
+          if(idx == end_idx) return false;
+        } while(!free_head_.compare_exchange_weak(head, 
+              pack((head >> 32) + 1, state(idx).load(std::memory_order_relaxed))));
+        return true;
+      }
+
+      ThreadCache * local_cache(){
+        // Threads past the first num_caches_ go straight to the free stack
+        const size_t tid = detail::thread_slot();
+        return tid < num_caches_ ? &caches_[tid] : NULL;
+      }
+
+      bool pop_cached(unsigned int& idx){
+        ThreadCache * c = local_cache();
+        if(!c || c->count == 0) return false;
+        idx = c->ids[--c->count];
+        return true;
+      }
+
+      bool push_cached(const unsigned int idx){
+        ThreadCache * c = local_cache();
+        if(!c) return false;
+        if(c->count == cache_size) {
+          // Hand half of the cache over to the other threads
+          for(int i = cache_size / 2; i < cache_size; ++i) push(c->ids[i]);
+          c->count = cache_size / 2;
+        }
+        c->ids[c->count++] = idx;
+        return true;
+      }
+
+      void flush(){
+        for(size_t i = 0; i < num_caches_; ++i) {
+          ThreadCache& c = caches_[i];
+          for(unsigned int j = 0; j < c.count; ++j) push(c.ids[j]);
+          c.count = 0;
         }
-        // std::cout << "Reserved " << reserved_ << " blocks" << std::endl;
       }
 
       // Disabling copy-constructor
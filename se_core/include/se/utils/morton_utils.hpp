@@ -30,11 +30,38 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #ifndef MORTON_UTILS_HPP
 #define MORTON_UTILS_HPP
+#include <cstddef>
 #include <cstdint>
 #include "../octree_defines.h"
 #include "math_utils.h"
+#include "isa.hpp"
+#include "simd.hpp"
 
-inline uint64_t expand(unsigned long long value) {
+/*
+ * Morton codes interleave the low 21 bits of x, y and z as 
+ * ...z1y1x1z0y0x0. With BMI2 (pdep/pext) each coordinate is one instruction,
+ * otherwise it takes the five steps of magic-mask bit spreading below.
+ *
+ * Single codes are computed inline and only use BMI2 when the compiler
+ * targets it (e.g. -march=native, SE_NATIVE_ARCH). Checking the CPU on every
+ * call costs more than the bit spreading it saves and stops the compiler from
+ * vectorising loops over the magic-mask version. Arrays of codes go through
+ * the batch overloads of compute_morton and unpack_morton instead, which
+ * check the CPU once per batch.
+ */
+
+#if defined(SE_SIMD_X86)
+#define SE_MORTON_BMI2 __attribute__((target("bmi2")))
+#endif
+
+namespace se {
+namespace morton {
+
+static constexpr uint64_t mask_x = 0x1249249249249249;
+static constexpr uint64_t mask_y = mask_x << 1;
+static constexpr uint64_t mask_z = mask_x << 2;
+
+inline uint64_t expand_magic(uint64_t value) {
   uint64_t x = value & 0x1fffff;
   x = (x | x << 32) & 0x1f00000000ffff;
   x = (x | x << 16) & 0x1f0000ff0000ff;
@@ -44,7 +71,7 @@ inline uint64_t expand(unsigned long long value) {
   return x;
 }
 
-inline uint64_t compact(uint64_t value) {
+inline uint64_t compact_magic(uint64_t value) {
   uint64_t x = value & 0x1249249249249249;
   x = (x | x >> 2)   & 0x10c30c30c30c30c3;
   x = (x | x >> 4)   & 0x100f00f00f00f00f;
@@ -54,6 +81,75 @@ inline uint64_t compact(uint64_t value) {
   return x;
 }
 
+/*! \brief Batch encoding with magic masks, written so that the compiler 
+ * vectorises it for the instruction set of the caller.
+ */
+inline void encode_magic(const Eigen::Vector3i* in, const std::size_t n, 
+    se::key_t* out) {
+  for(std::size_t i = 0; i < n; ++i) {
+    out[i] = expand_magic(in[i].x()) | (expand_magic(in[i].y()) << 1) |
+      (expand_magic(in[i].z()) << 2);
+  }
+}
+
+inline void decode_magic(const se::key_t* in, const std::size_t n, 
+    Eigen::Vector3i* out) {
+  for(std::size_t i = 0; i < n; ++i) {
+    out[i] = Eigen::Vector3i(compact_magic(in[i]), compact_magic(in[i] >> 1),
+        compact_magic(in[i] >> 2));
+  }
+}
+
+#if defined(SE_SIMD_X86)
+/*! \brief encode_magic vectorised four codes per AVX2 register, for CPUs 
+ * with AVX2 but slow pdep. Only call when the CPU supports AVX2.
+ */
+SE_SIMD_AVX2 inline void encode_avx2(const Eigen::Vector3i* in, 
+    const std::size_t n, se::key_t* out) {
+  encode_magic(in, n, out);
+}
+
+SE_SIMD_AVX2 inline void decode_avx2(const se::key_t* in, 
+    const std::size_t n, Eigen::Vector3i* out) {
+  decode_magic(in, n, out);
+}
+
+/*! \brief Batch encoding with pdep. Only call when the CPU supports BMI2. */
+SE_MORTON_BMI2 inline void encode_bmi2(const Eigen::Vector3i* in, 
+    const std::size_t n, se::key_t* out) {
+  for(std::size_t i = 0; i < n; ++i) {
+    out[i] = _pdep_u64(in[i].x(), mask_x) | _pdep_u64(in[i].y(), mask_y) |
+      _pdep_u64(in[i].z(), mask_z);
+  }
+}
+
+SE_MORTON_BMI2 inline void decode_bmi2(const se::key_t* in, 
+    const std::size_t n, Eigen::Vector3i* out) {
+  for(std::size_t i = 0; i < n; ++i) {
+    out[i] = Eigen::Vector3i(_pext_u64(in[i], mask_x), 
+        _pext_u64(in[i], mask_y), _pext_u64(in[i], mask_z));
+  }
+}
+#endif
+}
+}
+
+inline uint64_t expand(unsigned long long value) {
+#if defined(__BMI2__)
+  return _pdep_u64(value, se::morton::mask_x);
+#else
+  return se::morton::expand_magic(value);
+#endif
+}
+
+inline uint64_t compact(uint64_t value) {
+#if defined(__BMI2__)
+  return _pext_u64(value, se::morton::mask_x);
+#else
+  return se::morton::compact_magic(value);
+#endif
+}
+
 inline Eigen::Vector3i unpack_morton(uint64_t code){
   return Eigen::Vector3i(compact(code >> 0ull), compact(code >> 1ull), 
                     compact(code >> 2ull));
@@ -71,6 +167,33 @@ inline uint64_t compute_morton(uint64_t x,
   return code;
 }
 
+/*! \brief Morton codes of n coordinates, with pdep on CPUs where it is fast
+ * (see se::isa::fast_bmi2), else with magic masks vectorised for AVX2 or the
+ * compiler's baseline.
+ */
+inline void compute_morton(const Eigen::Vector3i* in, const std::size_t n,
+    se::key_t* out) {
+#if defined(SE_SIMD_X86)
+  if(se::isa::fast_bmi2()) return se::morton::encode_bmi2(in, n, out);
+  if(se::isa::selected() >= se::isa::level::avx2) 
+    return se::morton::encode_avx2(in, n, out);
+#endif
+  se::morton::encode_magic(in, n, out);
+}
+
+/*! \brief Coordinates of n Morton codes, the inverse of the batch 
+ * compute_morton.
+ */
+inline void unpack_morton(const se::key_t* in, const std::size_t n,
+    Eigen::Vector3i* out) {
+#if defined(SE_SIMD_X86)
+  if(se::isa::fast_bmi2()) return se::morton::decode_bmi2(in, n, out);
+  if(se::isa::selected() >= se::isa::level::avx2) 
+    return se::morton::decode_avx2(in, n, out);
+#endif
+  se::morton::decode_magic(in, n, out);
+}
+
 static inline void compute_prefix(const se::key_t * in, se::key_t * out,
     unsigned int num_keys, const se::key_t mask){
 
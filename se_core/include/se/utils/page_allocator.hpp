@@ -0,0 +1,156 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+#ifndef PAGE_ALLOCATOR_HPP
+#define PAGE_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace se {
+
+/*! \brief Raw storage policies for the pages of se::MemoryPool. A policy 
+ * provides allocate(bytes, alignment), returning memory aligned to the 
+ * given power of two and at least to a cache line, and deallocate(ptr, 
+ * bytes). The memory is not touched: the pool constructs each object on the
+ * thread that acquires it, so that with a first-touch NUMA policy a block 
+ * lands on the node of the thread that allocated it. Octree::allocate hands
+ * out contiguous runs of Morton keys to its threads while integration 
+ * schedules the active blocks statically, hence blocks end up near the 
+ * threads that integrate them only approximately.
+ */
+struct heap_page_allocator {
+  static constexpr size_t alignment = 64;
+
+  static void * allocate(const size_t bytes, const size_t align = alignment) {
+    void * ptr = NULL;
+    // Not std::max, which would odr-use alignment
+    if(posix_memalign(&ptr, align > alignment ? align : alignment, bytes) != 0)
+      throw std::bad_alloc();
+    return ptr;
+  }
+
+  static void deallocate(void * ptr, const size_t) {
+    free(ptr);
+  }
+};
+
+/*! \brief Pages backed by anonymous mappings rounded to 2MB huge pages. 
+ * Explicit pages (MAP_HUGETLB) require hugepages reserved by the system, if 
+ * none are available or Explicit is false the mapping is advised for 
+ * transparent huge pages instead. Mappings are over-allocated by the 
+ * requested alignment, at least 2MB, and trimmed to it: otherwise the first
+ * and last huge pages of a transparent one would never be backed by one.
+ * Falls back to heap_page_allocator where mmap is unavailable.
+ */
+template <bool Explicit = false>
+struct huge_page_allocator {
+  static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+  static size_t round(const size_t bytes) {
+    return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+  }
+
+  static void * allocate(const size_t bytes, 
+      const size_t alignment = huge_page_size) {
+#ifdef __linux__
+    const size_t length = round(bytes);
+    const size_t align = alignment > huge_page_size ? 
+      alignment : huge_page_size;
+    void * ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(Explicit) {
+      // Already aligned to a huge page
+      ptr = map(length, align, align - huge_page_size, MAP_HUGETLB);
+    }
+#endif
+    if(ptr == MAP_FAILED) {
+      ptr = map(length, align, align, 0);
+      if(ptr == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+      madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+    }
+    return ptr;
+#else
+    return heap_page_allocator::allocate(bytes, alignment);
+#endif
+  }
+
+  /* ptr is the 2MB aligned address returned by allocate, hence the range 
+   * unmapped is exactly the one left mapped there. */
+  static void deallocate(void * ptr, const size_t bytes) {
+#ifdef __linux__
+    munmap(ptr, round(bytes));
+#else
+    heap_page_allocator::deallocate(ptr, bytes);
+#endif
+  }
+
+#ifdef __linux__
+  private:
+  /* Map length bytes plus extra and unmap the head and the tail around the
+   * first align boundary. */
+  static void * map(const size_t length, const size_t align, 
+      const size_t extra, const int flags) {
+    void * raw = mmap(NULL, length + extra, PROT_READ | PROT_WRITE, 
+        MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if(raw == MAP_FAILED) return raw;
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+    const uintptr_t aligned = (begin + align - 1) & ~uintptr_t(align - 1);
+    // Unmap the head and the tail, leaving [aligned, aligned + length)
+    if(aligned > begin) munmap(raw, aligned - begin);
+    if(begin + extra > aligned) {
+      munmap(reinterpret_cast<void *>(aligned + length), 
+          begin + extra - aligned);
+    }
+    return reinterpret_cast<void *>(aligned);
+  }
+#endif
+};
+
+typedef heap_page_allocator default_page_allocator;
+
+/* Pages of the voxel block pools. Only these get huge pages: a block pool 
+ * page spans megabytes and is swept by the integration every frame, while
+ * node pages are small and mostly visited through pointers. */
+#ifdef SE_HUGE_PAGES
+typedef huge_page_allocator<> block_page_allocator;
+#else
+typedef heap_page_allocator block_page_allocator;
+#endif
+}
+#endif
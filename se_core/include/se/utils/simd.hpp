@@ -0,0 +1,339 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef SE_SIMD_HPP
+#define SE_SIMD_HPP
+#include <cmath>
+#include <cstdint>
+#if defined(__GNUC__)
+/* Helpers generic in the lane count are inlined into their caller, and so
+ * compiled for the caller's instruction set. */
+#define SE_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define SE_SIMD_INLINE inline
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SE_SIMD_X86
+/* Wide lanes are compiled for their own instruction set whatever the 
+ * compiler flags, so that kernels built for several instruction sets in one
+ * translation unit can use them (see se/utils/isa.hpp). They are only ever
+ * called from code compiled for that instruction set. */
+#define SE_SIMD_AVX2 __attribute__((target("avx2,fma")))
+#define SE_SIMD_AVX512 \
+  __attribute__((target("avx2,fma,avx512f,avx512dq,avx512bw,avx512vl")))
+#endif
+
+/*
+ * Thin wrappers over the float lanes of a vector unit, so that kernels are
+ * written once for every width. Width 1 is the portable scalar fallback, 
+ * width 8 needs AVX2 and FMA, width 16 needs AVX-512F.
+ */
+namespace se {
+namespace simd {
+
+template <int W> struct vfloat;
+template <int W> struct vint;
+template <int W> struct vmask;
+
+/******************************************************************************
+ * Scalar lanes
+ ******************************************************************************/
+
+template <>
+struct vmask<1> {
+  bool v;
+  vmask() {}
+  vmask(bool b) : v(b) {}
+  vmask operator&(const vmask& o) const { return v && o.v; }
+  vmask operator|(const vmask& o) const { return v || o.v; }
+  bool any() const { return v; }
+  unsigned bits() const { return v; }
+};
+
+template <>
+struct vint<1> {
+  int v;
+  vint() {}
+  vint(int i) : v(i) {}
+  vint operator+(const vint& o) const { return v + o.v; }
+  vint operator*(const int s) const { return v * s; }
+};
+
+template <>
+struct vfloat<1> {
+  static constexpr int width = 1;
+  typedef vmask<1> mask_type;
+  typedef vint<1> int_type;
+  float v;
+
+  vfloat() {}
+  vfloat(float f) : v(f) {}
+  static vfloat iota() { return 0.f; }
+  static vfloat load(const float * p) { return *p; }
+  void store(float * p) const { *p = v; }
+  /*! \brief Lanes of a - p[i], computed in double precision. */
+  static vfloat sub_double(const double a, const double * p) { 
+    return static_cast<float>(a - *p); 
+  }
+
+  vfloat operator+(const vfloat& o) const { return v + o.v; }
+  vfloat operator-(const vfloat& o) const { return v - o.v; }
+  vfloat operator*(const vfloat& o) const { return v * o.v; }
+  vfloat operator/(const vfloat& o) const { return v / o.v; }
+  mask_type operator<(const vfloat& o) const { return v < o.v; }
+  mask_type operator>(const vfloat& o) const { return v > o.v; }
+  mask_type operator<=(const vfloat& o) const { return v <= o.v; }
+  mask_type operator>=(const vfloat& o) const { return v >= o.v; }
+  mask_type operator!=(const vfloat& o) const { return v != o.v; }
+
+  friend vfloat min(const vfloat& a, const vfloat& b) { return std::fmin(a.v, b.v); }
+  friend vfloat max(const vfloat& a, const vfloat& b) { return std::fmax(a.v, b.v); }
+  friend vfloat sqrt(const vfloat& a) { return std::sqrt(a.v); }
+  friend vfloat select(const mask_type& m, const vfloat& a, const vfloat& b) { 
+    return m.v ? a : b; 
+  }
+  friend int_type truncate(const vfloat& a) { return static_cast<int>(a.v); }
+  /*! \brief a exponent and mantissa, a = m * 2^e with m in [1, 2). */
+  friend void frexp2(const vfloat& a, vfloat& m, vfloat& e) {
+    int exponent;
+    m.v = 2.f * std::frexp(a.v, &exponent);
+    e.v = exponent - 1;
+  }
+  /*! \brief base[idx] in the lanes of m, fallback elsewhere. */
+  friend vfloat gather(const float * base, const int_type& idx, 
+      const mask_type& m, const vfloat& fallback) {
+    return m.v ? base[idx.v] : fallback.v;
+  }
+};
+
+#if defined(SE_SIMD_X86)
+/******************************************************************************
+ * AVX2 lanes
+ ******************************************************************************/
+
+template <>
+struct vmask<8> {
+  __m256 v;
+  vmask() {}
+  SE_SIMD_AVX2 vmask(__m256 m) : v(m) {}
+  SE_SIMD_AVX2 vmask operator&(const vmask& o) const { return _mm256_and_ps(v, o.v); }
+  SE_SIMD_AVX2 vmask operator|(const vmask& o) const { return _mm256_or_ps(v, o.v); }
+  SE_SIMD_AVX2 bool any() const { return _mm256_movemask_ps(v) != 0; }
+  SE_SIMD_AVX2 unsigned bits() const { return _mm256_movemask_ps(v); }
+};
+
+template <>
+struct vint<8> {
+  __m256i v;
+  vint() {}
+  SE_SIMD_AVX2 vint(__m256i i) : v(i) {}
+  SE_SIMD_AVX2 vint operator+(const vint& o) const { return _mm256_add_epi32(v, o.v); }
+  SE_SIMD_AVX2 vint operator*(const int s) const { 
+    return _mm256_mullo_epi32(v, _mm256_set1_epi32(s)); 
+  }
+};
+
+template <>
+struct vfloat<8> {
+  static constexpr int width = 8;
+  typedef vmask<8> mask_type;
+  typedef vint<8> int_type;
+  __m256 v;
+
+  vfloat() {}
+  SE_SIMD_AVX2 vfloat(__m256 f) : v(f) {}
+  SE_SIMD_AVX2 vfloat(float f) : v(_mm256_set1_ps(f)) {}
+  SE_SIMD_AVX2 static vfloat iota() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+  SE_SIMD_AVX2 static vfloat load(const float * p) { return _mm256_loadu_ps(p); }
+  SE_SIMD_AVX2 void store(float * p) const { _mm256_storeu_ps(p, v); }
+  SE_SIMD_AVX2 static vfloat sub_double(const double a, const double * p) { 
+    const __m256d ad = _mm256_set1_pd(a);
+    const __m128 lo = _mm256_cvtpd_ps(_mm256_sub_pd(ad, _mm256_loadu_pd(p)));
+    const __m128 hi = _mm256_cvtpd_ps(_mm256_sub_pd(ad, _mm256_loadu_pd(p + 4)));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+  }
+
+  SE_SIMD_AVX2 vfloat operator+(const vfloat& o) const { return _mm256_add_ps(v, o.v); }
+  SE_SIMD_AVX2 vfloat operator-(const vfloat& o) const { return _mm256_sub_ps(v, o.v); }
+  SE_SIMD_AVX2 vfloat operator*(const vfloat& o) const { return _mm256_mul_ps(v, o.v); }
+  SE_SIMD_AVX2 vfloat operator/(const vfloat& o) const { return _mm256_div_ps(v, o.v); }
+  SE_SIMD_AVX2 mask_type operator<(const vfloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LT_OQ); }
+  SE_SIMD_AVX2 mask_type operator>(const vfloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_GT_OQ); }
+  SE_SIMD_AVX2 mask_type operator<=(const vfloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LE_OQ); }
+  SE_SIMD_AVX2 mask_type operator>=(const vfloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_GE_OQ); }
+  SE_SIMD_AVX2 mask_type operator!=(const vfloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_NEQ_UQ); }
+
+  friend SE_SIMD_AVX2 vfloat min(const vfloat& a, const vfloat& b) { return _mm256_min_ps(a.v, b.v); }
+  friend SE_SIMD_AVX2 vfloat max(const vfloat& a, const vfloat& b) { return _mm256_max_ps(a.v, b.v); }
+  friend SE_SIMD_AVX2 vfloat sqrt(const vfloat& a) { return _mm256_sqrt_ps(a.v); }
+  friend SE_SIMD_AVX2 vfloat select(const mask_type& m, const vfloat& a, const vfloat& b) { 
+    return _mm256_blendv_ps(b.v, a.v, m.v); 
+  }
+  friend SE_SIMD_AVX2 int_type truncate(const vfloat& a) { return _mm256_cvttps_epi32(a.v); }
+  friend SE_SIMD_AVX2 void frexp2(const vfloat& a, vfloat& m, vfloat& e) {
+    const __m256i bits = _mm256_castps_si256(a.v);
+    e.v = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+          _mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    m.v = _mm256_castsi256_ps(_mm256_or_si256(
+          _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), 
+          _mm256_set1_epi32(0x3F800000)));
+  }
+  friend SE_SIMD_AVX2 vfloat gather(const float * base, const int_type& idx, 
+      const mask_type& m, const vfloat& fallback) {
+    return _mm256_mask_i32gather_ps(fallback.v, base, idx.v, m.v, 4);
+  }
+};
+
+/******************************************************************************
+ * AVX-512 lanes
+ ******************************************************************************/
+
+template <>
+struct vmask<16> {
+  __mmask16 v;
+  vmask() {}
+  SE_SIMD_AVX512 vmask(__mmask16 m) : v(m) {}
+  SE_SIMD_AVX512 vmask operator&(const vmask& o) const { return v & o.v; }
+  SE_SIMD_AVX512 vmask operator|(const vmask& o) const { return v | o.v; }
+  SE_SIMD_AVX512 bool any() const { return v != 0; }
+  SE_SIMD_AVX512 unsigned bits() const { return v; }
+};
+
+template <>
+struct vint<16> {
+  __m512i v;
+  vint() {}
+  SE_SIMD_AVX512 vint(__m512i i) : v(i) {}
+  SE_SIMD_AVX512 vint operator+(const vint& o) const { return _mm512_add_epi32(v, o.v); }
+  SE_SIMD_AVX512 vint operator*(const int s) const { 
+    return _mm512_mullo_epi32(v, _mm512_set1_epi32(s)); 
+  }
+};
+
+template <>
+struct vfloat<16> {
+  static constexpr int width = 16;
+  typedef vmask<16> mask_type;
+  typedef vint<16> int_type;
+  // The zero-masked forms of some intrinsics below avoid the spurious 
+  // -Wmaybe-uninitialized of the unmasked ones with GCC 12.
+  static constexpr __mmask16 all = 0xFFFF;
+  __m512 v;
+
+  vfloat() {}
+  SE_SIMD_AVX512 vfloat(__m512 f) : v(f) {}
+  SE_SIMD_AVX512 vfloat(float f) : v(_mm512_set1_ps(f)) {}
+  SE_SIMD_AVX512 static vfloat iota() { 
+    return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); 
+  }
+  SE_SIMD_AVX512 static vfloat load(const float * p) { return _mm512_loadu_ps(p); }
+  SE_SIMD_AVX512 void store(float * p) const { _mm512_storeu_ps(p, v); }
+  SE_SIMD_AVX512 static vfloat sub_double(const double a, const double * p) { 
+    const __m512d ad = _mm512_set1_pd(a);
+    const __m256 lo = _mm512_cvtpd_ps(_mm512_sub_pd(ad, _mm512_loadu_pd(p)));
+    const __m256 hi = _mm512_cvtpd_ps(_mm512_sub_pd(ad, _mm512_loadu_pd(p + 8)));
+    return _mm512_castpd_ps(_mm512_insertf64x4(
+          _mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+  }
+
+  SE_SIMD_AVX512 vfloat operator+(const vfloat& o) const { return _mm512_add_ps(v, o.v); }
+  SE_SIMD_AVX512 vfloat operator-(const vfloat& o) const { return _mm512_sub_ps(v, o.v); }
+  SE_SIMD_AVX512 vfloat operator*(const vfloat& o) const { return _mm512_mul_ps(v, o.v); }
+  SE_SIMD_AVX512 vfloat operator/(const vfloat& o) const { return _mm512_div_ps(v, o.v); }
+  SE_SIMD_AVX512 mask_type operator<(const vfloat& o) const { return _mm512_cmp_ps_mask(v, o.v, _CMP_LT_OQ); }
+  SE_SIMD_AVX512 mask_type operator>(const vfloat& o) const { return _mm512_cmp_ps_mask(v, o.v, _CMP_GT_OQ); }
+  SE_SIMD_AVX512 mask_type operator<=(const vfloat& o) const { return _mm512_cmp_ps_mask(v, o.v, _CMP_LE_OQ); }
+  SE_SIMD_AVX512 mask_type operator>=(const vfloat& o) const { return _mm512_cmp_ps_mask(v, o.v, _CMP_GE_OQ); }
+  SE_SIMD_AVX512 mask_type operator!=(const vfloat& o) const { return _mm512_cmp_ps_mask(v, o.v, _CMP_NEQ_UQ); }
+
+  friend SE_SIMD_AVX512 vfloat min(const vfloat& a, const vfloat& b) { 
+    return _mm512_maskz_min_ps(all, a.v, b.v); 
+  }
+  friend SE_SIMD_AVX512 vfloat max(const vfloat& a, const vfloat& b) { 
+    return _mm512_maskz_max_ps(all, a.v, b.v); 
+  }
+  friend SE_SIMD_AVX512 vfloat sqrt(const vfloat& a) { return _mm512_sqrt_ps(a.v); }
+  friend SE_SIMD_AVX512 vfloat select(const mask_type& m, const vfloat& a, const vfloat& b) { 
+    return _mm512_mask_blend_ps(m.v, b.v, a.v); 
+  }
+  friend SE_SIMD_AVX512 int_type truncate(const vfloat& a) { return _mm512_cvttps_epi32(a.v); }
+  friend SE_SIMD_AVX512 void frexp2(const vfloat& a, vfloat& m, vfloat& e) {
+    e.v = _mm512_maskz_getexp_ps(all, a.v);
+    m.v = _mm512_maskz_getmant_ps(all, a.v, _MM_MANT_NORM_1_2, 
+        _MM_MANT_SIGN_src);
+  }
+  friend SE_SIMD_AVX512 vfloat gather(const float * base, const int_type& idx, 
+      const mask_type& m, const vfloat& fallback) {
+    return _mm512_mask_i32gather_ps(fallback.v, m.v, idx.v, base, 4);
+  }
+};
+#endif
+
+/*! \brief Widest lane count enabled by the compiler flags. */
+#if defined(__AVX512F__)
+constexpr int native_width = 16;
+#elif defined(__AVX2__)
+constexpr int native_width = 8;
+#else
+constexpr int native_width = 1;
+#endif
+
+/*! \brief Widest lane count up to MaxWidth dividing Side, the lanes a row 
+ * kernel processes at once for blocks of that side.
+ */
+template <unsigned int Side, int MaxWidth = native_width>
+struct row_width {
+  static constexpr int value = MaxWidth >= 16 && Side % 16 == 0 ? 16 : 
+    (MaxWidth >= 8 && Side % 8 == 0 ? 8 : 1);
+};
+
+/*! \brief log2 of positive normal floats, within 1e-6 of std::log2. 
+ * The mantissa is reduced to [sqrt(1/2), sqrt(2)) and log(m) expanded as
+ * 2 atanh((m - 1) / (m + 1)).
+ */
+template <int W>
+SE_SIMD_INLINE vfloat<W> log2(const vfloat<W>& a) {
+  vfloat<W> m, e;
+  frexp2(a, m, e);
+  const typename vfloat<W>::mask_type big = m > vfloat<W>(1.41421356f);
+  m = select(big, m * vfloat<W>(0.5f), m);
+  e = select(big, e + vfloat<W>(1.f), e);
+  const vfloat<W> t = (m - vfloat<W>(1.f)) / (m + vfloat<W>(1.f));
+  const vfloat<W> t2 = t * t;
+  const vfloat<W> series = vfloat<W>(1.f) + t2 * (vfloat<W>(1.f / 3.f) + 
+      t2 * (vfloat<W>(1.f / 5.f) + t2 * (vfloat<W>(1.f / 7.f) + 
+      t2 * vfloat<W>(1.f / 9.f))));
+  return e + t * series * vfloat<W>(2.f / 0.69314718f);
+}
+}
+}
+#endif
@@ -0,0 +1,137 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "algorithms/parallel.hpp"
+#include "algorithms/unique.hpp"
+#include "algorithms/filter.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+typedef float testT;
+
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+class ParallelTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      // Block and node keys of a 1024^3 tree, with plenty of repetitions
+      std::mt19937 gen(11);
+      std::uniform_int_distribution<int> coord(0, 1023);
+      std::uniform_int_distribution<int> level(4, 7);
+      for(int i = 0; i < 50000; ++i) {
+        const int l = level(gen);
+        keys_.push_back(se::keyops::encode(coord(gen), coord(gen), 
+              coord(gen), l, max_depth_));
+        if(i % 3 == 0) keys_.push_back(keys_.back());
+      }
+    }
+
+    std::vector<se::key_t> keys_;
+    const int max_depth_ = 10;
+};
+
+TEST_F(ParallelTest, RadixSort) {
+  std::vector<se::key_t> expected = keys_;
+  std::sort(expected.begin(), expected.end());
+  se::algorithms::radix_sort(keys_.data(), keys_.size());
+  ASSERT_EQ(keys_, expected);
+
+  std::vector<se::key_t> few = {7, 3};
+  se::algorithms::radix_sort(few.data(), few.size());
+  ASSERT_EQ(few, std::vector<se::key_t>({3, 7}));
+}
+
+TEST_F(ParallelTest, UniqueCopy) {
+  se::algorithms::radix_sort(keys_.data(), keys_.size());
+  std::vector<se::key_t> out(keys_.size());
+  const size_t last = se::algorithms::unique_copy(keys_.data(), 
+      keys_.size(), out.data());
+  out.resize(last);
+  keys_.erase(std::unique(keys_.begin(), keys_.end()), keys_.end());
+  ASSERT_EQ(out, keys_);
+}
+
+TEST_F(ParallelTest, FilterAncestorsMatchesSerial) {
+  se::algorithms::radix_sort(keys_.data(), keys_.size());
+  std::vector<se::key_t> out(keys_.size());
+  const size_t last = se::algorithms::filter_ancestors(keys_.data(), 
+      keys_.size(), out.data(), max_depth_);
+  out.resize(last);
+  const int serial = se::algorithms::filter_ancestors(keys_.data(), 
+      keys_.size(), max_depth_);
+  keys_.resize(serial);
+  ASSERT_EQ(out, keys_);
+}
+
+TEST_F(ParallelTest, CompactAndHistogram) {
+  std::vector<se::key_t> odd;
+  se::algorithms::compact(keys_.data(), keys_.size(), odd, 
+      [this](const size_t i) { return se::keyops::level(keys_[i]) % 2; });
+  std::vector<se::key_t> expected;
+  std::copy_if(keys_.begin(), keys_.end(), std::back_inserter(expected),
+      [](const se::key_t k) { return se::keyops::level(k) % 2; });
+  ASSERT_EQ(odd, expected);
+
+  size_t bins[8];
+  se::algorithms::histogram(keys_.size(), 8, 
+      [this](const size_t i) { return se::keyops::level(keys_[i]); }, bins);
+  size_t levels[8] = {0};
+  for(const se::key_t k : keys_) ++levels[se::keyops::level(k)];
+  for(int b = 0; b < 8; ++b) ASSERT_EQ(bins[b], levels[b]);
+}
+
+TEST(ParallelFilter, SkipsReleasedBlocks) {
+  typedef se::VoxelBlock<testT, 8> BlockType;
+  se::MemoryPool<BlockType> pool;
+  pool.reserve(100);
+  std::vector<BlockType *> blocks;
+  for(int i = 0; i < 100; ++i) {
+    blocks.push_back(pool.acquire_block());
+    blocks.back()->coordinates(Eigen::Vector3i(8 * i, 0, 0));
+  }
+  pool.release_block(blocks[10]);
+
+  std::vector<BlockType *> out;
+  se::algorithms::filter(out, pool, [](const BlockType * b) { 
+      return b->coordinates().x() < 160; });
+  ASSERT_EQ(out.size(), 19u);
+  for(const BlockType * b : out) {
+    ASSERT_NE(b, blocks[10]);
+    ASSERT_LT(b->coordinates().x(), 160);
+  }
+}
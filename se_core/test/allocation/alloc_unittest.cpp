@@ -25,7 +25,10 @@
   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
 */
+#include <functional>
 #include <random>
+#include <set>
+#include <thread>
 #include "octree.hpp"
 #include "utils/math_utils.h"
 #include "utils/morton_utils.hpp"
@@ -121,3 +124,428 @@ TEST(AllocationTest, MortonPrefixMask) {
     edge = edge/2;
   }
 }
+
+TEST(AllocationTest, MixedLevelKeys) {
+  // Keys at several levels, repeated, some ancestors of others, allocated 
+  // in two batches: every octant on their paths exists exactly once
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(512, 5);
+  const int max_level = 9;
+  const int leaves_level = max_level - 3;
+  const unsigned int shift = MAX_BITS - max_level - 1;
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<int> coord(0, 511);
+  std::uniform_int_distribution<int> level(3, 7);
+  std::set<se::key_t> octants;
+  for(int batch = 0; batch < 2; ++batch) {
+    std::vector<se::key_t> keys;
+    for(int i = 0; i < 2000; ++i) {
+      const se::key_t k = oct.hash(coord(gen), coord(gen), coord(gen), 
+          level(gen));
+      keys.push_back(k);
+      if(i % 4 == 0) keys.push_back(k);
+      if(i % 7 == 0) keys.push_back(parent(k, max_level));
+    }
+    for(const se::key_t k : keys) {
+      const int target = std::min(se::keyops::level(k), leaves_level);
+      for(int l = 1; l <= target; ++l) {
+        octants.insert((se::keyops::code(k) & MASK[l + shift]) | l);
+      }
+    }
+    oct.allocate(keys.data(), keys.size());
+    ASSERT_EQ(oct.nodeCount(), octants.size() + 1);
+  }
+
+  for(const se::key_t k : octants) {
+    const Eigen::Vector3i c = unpack_morton(se::keyops::code(k));
+    const int l = se::keyops::level(k);
+    se::Node<float> * n = oct.fetch_octant(c.x(), c.y(), c.z(), l);
+    ASSERT_TRUE(n != NULL);
+    ASSERT_EQ(n->code_, k);
+    ASSERT_EQ(n->side_, 512 >> l);
+  }
+}
+
+TEST(AllocationTest, ConcurrentInsert) {
+  // Threads insert overlapping sets of blocks and nodes into the live tree
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(512, 5);
+  const int num_threads = 8;
+  const int per_thread = 3000;
+  std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i> > 
+    points;
+  std::mt19937 gen(9);
+  std::uniform_int_distribution<int> coord(0, 255);
+  for(int i = 0; i < per_thread; ++i) {
+    points.push_back(Eigen::Vector3i(coord(gen), coord(gen), coord(gen)));
+  }
+
+  std::vector<std::vector<se::Node<float> *> > inserted(num_threads);
+  std::vector<std::thread> threads;
+  for(int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for(int i = 0; i < per_thread; ++i) {
+        const Eigen::Vector3i& p = points[(i + 97 * t) % per_thread];
+        inserted[t].push_back((i + t) % 5 == 0 ? 
+            oct.insert(p.x(), p.y(), p.z(), 4) : 
+            oct.insert(p.x(), p.y(), p.z()));
+      }
+    });
+  }
+  for(auto& t : threads) t.join();
+
+  std::set<se::key_t> octants;
+  const unsigned int shift = MAX_BITS - 9 - 1;
+  for(int t = 0; t < num_threads; ++t) {
+    for(int i = 0; i < per_thread; ++i) {
+      const Eigen::Vector3i& p = points[(i + 97 * t) % per_thread];
+      const int level = (i + t) % 5 == 0 ? 4 : 6;
+      ASSERT_EQ(inserted[t][i], oct.fetch_octant(p.x(), p.y(), p.z(), level));
+      const se::key_t code = oct.hash(p.x(), p.y(), p.z(), level);
+      for(int l = 1; l <= level; ++l) {
+        octants.insert((se::keyops::code(code) & MASK[l + shift]) | l);
+      }
+    }
+  }
+  ASSERT_EQ(oct.nodeCount(), octants.size() + 1);
+  ASSERT_EQ(oct.activeBlocks().slots().size(), (size_t) oct.leavesCount());
+}
+
+TEST(AllocationTest, DeallocateSubtree) {
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(256, 5);
+  const int side = OctreeF::blockSide;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 64; z += side)
+    for(int y = 0; y < 64; y += side)
+      for(int x = 0; x < 64; x += side)
+        keys.push_back(oct.hash(x, y, z));
+  oct.allocate(keys.data(), keys.size());
+  const int blocks = oct.leavesCount();
+  const int nodes = oct.nodeCount();
+
+  // The 32^3 octant at the origin holds an eighth of the blocks
+  ASSERT_TRUE(oct.deallocate(0, 0, 0, 3));
+  ASSERT_FALSE(oct.deallocate(0, 0, 0, 3));
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 3), nullptr);
+  ASSERT_EQ(oct.fetch(0, 0, 0), nullptr);
+  ASSERT_NE(oct.fetch(32, 0, 0), nullptr);
+  ASSERT_EQ(oct.leavesCount(), blocks - blocks / 8);
+  ASSERT_EQ(oct.getBlockBuffer().free_count(), blocks / 8);
+
+  std::vector<se::VoxelBlock<float> *> list;
+  oct.getBlockList(list, false);
+  ASSERT_EQ(list.size(), blocks - blocks / 8);
+
+  // Reallocation recycles the released slots
+  const size_t block_slots = oct.getBlockBuffer().size();
+  const size_t node_slots = oct.getNodesBuffer().size();
+  oct.allocate(keys.data(), keys.size());
+  ASSERT_EQ(oct.leavesCount(), blocks);
+  ASSERT_EQ(oct.nodeCount(), nodes);
+  ASSERT_EQ(oct.getBlockBuffer().size(), block_slots);
+  ASSERT_EQ(oct.getNodesBuffer().size(), node_slots);
+  ASSERT_EQ(oct.getBlockBuffer().free_count(), 0);
+  se::VoxelBlock<float> * block = oct.fetch(0, 0, 0);
+  ASSERT_NE(block, nullptr);
+  ASSERT_TRUE(block->coordinates() == Eigen::Vector3i(0, 0, 0));
+  ASSERT_EQ(block->data(Eigen::Vector3i(1, 1, 1)), 
+      voxel_traits<float>::initValue());
+}
+
+TEST(AllocationTest, Clear) {
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(256, 5);
+  const Eigen::Vector3i vox = {25, 65, 127};
+  se::key_t allocList[1] = {oct.hash(vox(0), vox(1), vox(2))};
+  oct.allocate(allocList, 1);
+  oct.fetch(vox(0), vox(1), vox(2))->data(vox, 2.f);
+
+  oct.clear();
+  ASSERT_EQ(oct.leavesCount(), 0);
+  ASSERT_EQ(oct.getBlockBuffer().size(), 0);
+  ASSERT_EQ(oct.get(vox(0), vox(1), vox(2)), voxel_traits<float>::initValue());
+
+  allocList[0] = oct.hash(vox(0), vox(1), vox(2));
+  oct.allocate(allocList, 1);
+  ASSERT_EQ(oct.leavesCount(), 1);
+  ASSERT_EQ(oct.get(vox(0), vox(1), vox(2)), voxel_traits<float>::initValue());
+}
+
+TEST(AllocationTest, PruneUniformBlocks) {
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(256, 5);
+  const int side = OctreeF::blockSide;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 32; z += side)
+    for(int y = 0; y < 32; y += side)
+      for(int x = 0; x < 32; x += side)
+        keys.push_back(oct.hash(x, y, z));
+  oct.allocate(keys.data(), keys.size());
+  std::vector<se::VoxelBlock<float> *> list;
+  oct.getBlockList(list, false);
+  for(auto block : list)
+    for(int i = 0; i < side * side * side; ++i) block->data(i, 3.f);
+  const Eigen::Vector3i odd(25, 26, 27);
+  oct.fetch(odd(0), odd(1), odd(2))->data(odd, 5.f);
+  const int blocks = oct.leavesCount();
+  const int nodes = oct.nodeCount();
+
+  // Seven of the eight 16^3 octants collapse into the 32^3 one
+  ASSERT_EQ(oct.prune(), blocks - 1);
+  ASSERT_EQ(oct.leavesCount(), 1);
+  ASSERT_EQ(oct.nodeCount(), nodes - 7 - (blocks - 1));
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 4), nullptr);
+  ASSERT_NE(oct.fetch_octant(0, 0, 0, 3), nullptr);
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 3)->pruned_mask_, 0x7F);
+
+  OctreeF::cursor_type cursor(oct);
+  ASSERT_EQ(oct.get(1, 2, 3), 3.f);
+  ASSERT_EQ(oct.get_fine(1, 2, 3), 3.f);
+  ASSERT_EQ(oct.get_fine(17, 2, 3), 3.f);
+  ASSERT_EQ(oct.get_fine(odd(0), odd(1), odd(2)), 5.f);
+  ASSERT_EQ(oct.get_fine(20, 26, 27), 3.f);
+  ASSERT_EQ(oct.get_fine(40, 2, 3), voxel_traits<float>::initValue());
+  ASSERT_EQ(cursor.get_fine(17, 2, 3), 3.f);
+  ASSERT_EQ(cursor.get_fine(20, 26, 27), 3.f);
+  ASSERT_EQ(cursor.get_fine(40, 2, 3), voxel_traits<float>::initValue());
+  ASSERT_FLOAT_EQ(oct.interp(Eigen::Vector3f(10.5f, 3.2f, 7.7f), 
+        [](const float& val) { return val; }), 3.f);
+
+  // Allocating inside a collapsed octant restores its value
+  se::key_t allocList[1] = {oct.hash(0, 0, 0)};
+  oct.allocate(allocList, 1);
+  ASSERT_EQ(oct.leavesCount(), 2);
+  se::VoxelBlock<float> * block = oct.fetch(0, 0, 0);
+  ASSERT_NE(block, nullptr);
+  ASSERT_EQ(block->data(Eigen::Vector3i(7, 7, 7)), 3.f);
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 4)->pruned_mask_, 0xFE);
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 3)->pruned_mask_, 0x7E);
+  ASSERT_EQ(oct.get_fine(9, 9, 9), 3.f);
+}
+
+TEST(AllocationTest, PruneBlockList) {
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(256, 5);
+  const int side = OctreeF::blockSide;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 32; z += side)
+    for(int y = 0; y < 32; y += side)
+      for(int x = 0; x < 32; x += side)
+        keys.push_back(oct.hash(x, y, z));
+  oct.allocate(keys.data(), keys.size());
+  std::vector<se::VoxelBlock<float> *> list;
+  oct.getBlockList(list, false);
+  for(auto block : list)
+    for(int i = 0; i < side * side * side; ++i) block->data(i, 3.f);
+  const int blocks = oct.leavesCount();
+
+  // Only the listed blocks are considered
+  std::vector<se::VoxelBlock<float> *> first(1, oct.fetch(0, 0, 0));
+  ASSERT_EQ(oct.prune(first, std::equal_to<float>()), 1);
+  ASSERT_EQ(oct.leavesCount(), blocks - 1);
+  ASSERT_EQ(oct.fetch(0, 0, 0), nullptr);
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 4)->pruned_mask_, 0x01);
+  ASSERT_EQ(oct.get_fine(1, 2, 3), 3.f);
+
+  // Nodes collapse once all their children did
+  list.clear();
+  oct.getBlockList(list, false);
+  ASSERT_EQ(oct.prune(list, std::equal_to<float>()), blocks - 1);
+  ASSERT_EQ(oct.leavesCount(), 0);
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 3), nullptr);
+  ASSERT_EQ(oct.get_fine(20, 26, 27), 3.f);
+}
+
+TEST(AllocationTest, PruneToleranceDoesNotAddUp) {
+  typedef se::Octree<float> OctreeF;
+  OctreeF oct;
+  oct.init(256, 5);
+  const int side = OctreeF::blockSide;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 2 * side; z += side)
+    for(int y = 0; y < 2 * side; y += side)
+      for(int x = 0; x < 2 * side; x += side)
+        keys.push_back(oct.hash(x, y, z));
+  oct.allocate(keys.data(), keys.size());
+  std::vector<se::VoxelBlock<float> *> list;
+  oct.getBlockList(list, false);
+  // Uniform blocks whose values are all within the tolerance of each other
+  for(auto block : list) {
+    const Eigen::Vector3i c = block->coordinates() / side;
+    for(int i = 0; i < side * side * side; ++i) 
+      block->data(i, 3.f + 0.01f * (c(0) + 2 * c(1) + 4 * c(2)));
+  }
+  const int nodes = oct.nodeCount();
+
+  ASSERT_EQ(oct.prune(list, [](const float a, const float b) {
+        return std::fabs(a - b) <= 0.1f;
+      }), 8);
+  ASSERT_EQ(oct.leavesCount(), 0);
+  // The parent keeps eight distinct values rather than collapsing further
+  ASSERT_EQ(oct.nodeCount(), nodes - 8);
+  ASSERT_EQ(oct.fetch_octant(0, 0, 0, 4)->pruned_mask_, 0xFF);
+  ASSERT_EQ(oct.get_fine(side + 1, side + 1, side + 1), 3.f + 0.01f * 7);
+}
+
+TEST(AllocationTest, ConcurrentRecycling) {
+  se::MemoryPool<se::Node<float> > pool;
+  const int num_threads = 4;
+  const int rounds = 10000;
+  pool.reserve(num_threads * 8);
+  std::vector<std::thread> threads;
+  for(int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&pool, t]() {
+      se::Node<float> * held[8];
+      for(int r = 0; r < rounds; ++r) {
+        for(int i = 0; i < 8; ++i) {
+          held[i] = pool.acquire_block();
+          held[i]->code_ = t;
+        }
+        for(int i = 0; i < 8; ++i) {
+          // Nobody else may have been handed the same slot
+          ASSERT_EQ(held[i]->code_, t);
+          pool.release_block(held[i]);
+        }
+      }
+    });
+  }
+  for(auto& t : threads) t.join();
+  ASSERT_LE(pool.size(), num_threads * 8);
+  ASSERT_EQ(pool.free_count(), pool.size());
+}
+
+TEST(AllocationTest, RecyclingFromSeveralTeams) {
+  // OpenMP thread ids repeat across the teams of different std::threads
+  se::MemoryPool<se::Node<float> > pool;
+  const int num_threads = 4;
+  // Held slots plus a full cache for each OpenMP thread
+  pool.reserve(num_threads * 4 * (40 + 30));
+  std::vector<std::thread> threads;
+  for(int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&pool, t]() {
+#pragma omp parallel for num_threads(4)
+      for(int r = 0; r < 2000; ++r) {
+        const se::key_t tag = (t << 16) | r;
+        se::Node<float> * held[40];
+        for(int i = 0; i < 40; ++i) {
+          held[i] = pool.acquire_block();
+          held[i]->code_ = tag;
+        }
+        for(int i = 0; i < 40; ++i) {
+          EXPECT_EQ(held[i]->code_, tag);
+          pool.release_block(held[i]);
+        }
+      }
+    });
+  }
+  for(auto& t : threads) t.join();
+  ASSERT_EQ(pool.free_count(), pool.size());
+}
+
+TEST(AllocationTest, ConcurrentGrowth) {
+  // No reserve: pages are published by the acquiring threads
+  se::MemoryPool<se::Node<float> > pool;
+  const int num_threads = 8;
+  const int per_thread = 5000;
+  std::vector<std::vector<se::Node<float> *> > acquired(num_threads);
+  std::vector<std::thread> threads;
+  for(int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&pool, &acquired, t]() {
+      for(int i = 0; i < per_thread; ++i) {
+        se::Node<float> * n = pool.acquire_block();
+        n->code_ = t * per_thread + i;
+        acquired[t].push_back(n);
+      }
+    });
+  }
+  for(auto& t : threads) t.join();
+  ASSERT_EQ(pool.size(), num_threads * per_thread);
+  std::vector<bool> seen(num_threads * per_thread, false);
+  for(unsigned int i = 0; i < pool.size(); ++i) {
+    ASSERT_TRUE(pool.used(i));
+    const se::key_t code = pool[i]->code_;
+    ASSERT_LT(code, seen.size());
+    ASSERT_FALSE(seen[code]);
+    seen[code] = true;
+  }
+  for(int t = 0; t < num_threads; ++t)
+    for(int i = 0; i < per_thread; ++i)
+      ASSERT_EQ(acquired[t][i]->code_, t * per_thread + i);
+}
+
+TEST(AllocationTest, ReleaseAcrossPages) {
+  se::MemoryPool<se::Node<float> > pool;
+  const int num_blocks = 5000;
+  pool.reserve(num_blocks);
+  std::vector<se::Node<float> *> blocks;
+  for(int i = 0; i < num_blocks; ++i) blocks.push_back(pool.acquire_block());
+#pragma omp parallel for
+  for(int i = 0; i < num_blocks; i += 7) pool.release_block(blocks[i]);
+  for(int i = 0; i < num_blocks; ++i) ASSERT_EQ(pool.used(i), i % 7 != 0);
+  ASSERT_EQ(pool.free_count(), (num_blocks + 6) / 7);
+}
+
+TEST(AllocationTest, SlotAlignment) {
+  // Nodes are small and packed, blocks are padded to whole cache lines
+  se::MemoryPool<se::Node<float> > nodes;
+  se::MemoryPool<se::VoxelBlock<float> > blocks;
+  for(int i = 0; i < 3000; ++i) {
+    nodes.acquire_block();
+    se::VoxelBlock<float> * b = blocks.acquire_block();
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % 64, 0);
+  }
+  ASSERT_EQ(reinterpret_cast<char *>(nodes[1]) - 
+      reinterpret_cast<char *>(nodes[0]), sizeof(se::Node<float>));
+  for(int i : {0, 1023, 1024, 1234, 2999}) {
+    nodes.release_block(nodes[i]);
+    blocks.release_block(blocks[i]);
+    ASSERT_FALSE(nodes.used(i));
+    ASSERT_FALSE(blocks.used(i));
+  }
+  ASSERT_TRUE(nodes.used(1233));
+  ASSERT_TRUE(blocks.used(1235));
+  ASSERT_EQ(nodes.free_count(), 5u);
+}
+
+TEST(AllocationTest, HugePageAlignment) {
+  typedef se::huge_page_allocator<> allocator;
+  const size_t sizes[] = {1, 4096, allocator::huge_page_size, 
+    3 * allocator::huge_page_size + 17};
+  for(const size_t bytes : sizes) {
+    char * ptr = static_cast<char *>(allocator::allocate(bytes));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % allocator::huge_page_size, 0);
+    ptr[0] = 1;
+    ptr[allocator::round(bytes) - 1] = 1;
+    allocator::deallocate(ptr, bytes);
+  }
+  const size_t align = 4 * allocator::huge_page_size;
+  void * ptr = allocator::allocate(align + 1, align);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % align, 0);
+  allocator::deallocate(ptr, align + 1);
+}
+
+TEST(AllocationTest, HugePagePool) {
+  // Explicit huge pages fall back to transparent ones when none are reserved
+  se::MemoryPool<se::VoxelBlock<float>, se::huge_page_allocator<true> > pool;
+  std::vector<se::VoxelBlock<float> *> blocks;
+  for(int i = 0; i < 3000; ++i) {
+    se::VoxelBlock<float> * b = pool.acquire_block();
+    ASSERT_EQ(b->data(0), voxel_traits<float>::initValue());
+    b->coordinates(Eigen::Vector3i::Constant(i));
+    blocks.push_back(b);
+  }
+  for(int i = 0; i < 3000; ++i)
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(pool[i]) % 64, 0);
+  pool.release_block(blocks[1500]);
+  ASSERT_FALSE(pool.used(1500));
+  ASSERT_EQ(pool.acquire_block(), blocks[1500]);
+  ASSERT_TRUE(blocks[1500]->coordinates() == Eigen::Vector3i::Zero());
+  ASSERT_TRUE(blocks[2999]->coordinates() == Eigen::Vector3i::Constant(2999));
+}
@@ -0,0 +1,280 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "utils/math_utils.h"
+#include "gtest/gtest.h"
+#include "functors/projective_functor.hpp"
+#include "image/depth_pyramid.hpp"
+
+typedef struct {
+  float x;
+  float y;
+} testVoxel;
+
+struct aosT {};
+struct soaT {};
+
+template <>
+struct voxel_traits<aosT> {
+  typedef testVoxel value_type;
+  static inline value_type empty(){ return {0.f, 0.f}; }
+  static inline value_type initValue(){ return {0.f, 0.f}; }
+};
+
+template <>
+struct voxel_traits<soaT> {
+  typedef testVoxel value_type;
+  typedef se::soa_storage storage_type;
+  static inline value_type empty(){ return {0.f, 0.f}; }
+  static inline value_type initValue(){ return {0.f, 0.f}; }
+};
+
+/*
+ * Stores the camera depth of the voxel and the depth sample it projects to,
+ * voxel by voxel or a block row at a time.
+ */
+struct record_update {
+
+  template <typename DataHandlerT>
+  void operator()(DataHandlerT& handler, const Eigen::Vector3i&, 
+      const Eigen::Vector3f& pos, const Eigen::Vector2f& pixel) {
+    const Eigen::Vector2i px = pixel.cast<int>();
+    handler.set({pos(2), depth[px(0) + size(0)*px(1)]});
+  }
+
+  template <typename BlockT>
+  typename std::enable_if<se::functor::soa_rows<BlockT, float, float>::value, 
+           bool>::type
+  update_row(BlockT * block, const int y, const int z, 
+      const Eigen::Vector3f& pos, const Eigen::Vector3f& delta, 
+      const Eigen::Vector3f& pix_hom, const Eigen::Vector3f& pix_delta) {
+    constexpr int W = se::simd::row_width<BlockT::side>::value;
+    ++rows;
+    bool visible = false;
+    for(unsigned int x = 0; x < BlockT::side; x += W) {
+      const se::functor::row_lanes<W> row(x, pos, delta, pix_hom, pix_delta, 
+          depth, size);
+      visible |= row.visible.any();
+      const se::simd::vfloat<W> zs = se::simd::vfloat<W>::load(block->row_x(y, z) + x);
+      select(row.visible, row.z, zs).store(block->row_x(y, z) + x);
+      const se::simd::vfloat<W> ds = se::simd::vfloat<W>::load(block->row_y(y, z) + x);
+      select(row.visible, row.depth, ds).store(block->row_y(y, z) + x);
+    }
+    return visible;
+  }
+
+  const float * depth;
+  Eigen::Vector2i size;
+  int rows;
+};
+
+/*
+ * Stores the camera depth of the voxels at most band behind the depth 
+ * sample they project to, skipping whole octants through tiles if set.
+ */
+struct band_update {
+
+  template <typename DataHandlerT>
+  void operator()(DataHandlerT& handler, const Eigen::Vector3i&, 
+      const Eigen::Vector3f& pos, const Eigen::Vector2f& pixel) {
+    const Eigen::Vector2i px = pixel.cast<int>();
+    const float sample = depth[px(0) + size(0)*px(1)];
+    if(sample <= 0.f || pos(2) - sample >= band) return;
+    handler.set({pos(2), sample});
+  }
+
+  bool skip_octant(const Eigen::Vector2i& lower, const Eigen::Vector2i& upper,
+      const float z_min) const {
+    if(!tiles) return false;
+    const Eigen::Vector2f range = tiles->range(lower, upper);
+    return range(1) == 0.f || z_min - range(1) >= band;
+  }
+
+  const float * depth;
+  Eigen::Vector2i size;
+  float band;
+  const se::depth_pyramid * tiles;
+};
+
+class ProjectiveTest : public ::testing::Test {
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  protected:
+    virtual void SetUp() {
+      K_ = Eigen::Matrix4f::Identity();
+      K_(0, 0) = K_(1, 1) = 100.f;
+      K_(0, 2) = 40.f;
+      K_(1, 2) = 30.f;
+      size_ = Eigen::Vector2i(80, 60);
+      depth_.resize(size_.prod());
+      for(int v = 0; v < size_(1); ++v)
+        for(int u = 0; u < size_(0); ++u)
+          depth_[u + v*size_(0)] = 1.f + 0.001f * u + 0.002f * v;
+
+      // Camera in the middle of the volume face looking along z, rolled
+      Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+      pose.topLeftCorner<3, 3>() = 
+        Eigen::AngleAxisf(0.3f, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+      pose.topRightCorner<3, 1>() = Eigen::Vector3f(1.28f, 1.28f, 0.f);
+      Tcw_ = Sophus::SE3f(pose).inverse();
+    }
+
+    template <typename T>
+    void allocate(se::Octree<T>& map) {
+      map.init(256, 2.56f);
+      std::vector<se::key_t> keys;
+      for(int z = 64; z < 96; z += 8)
+        for(int y = 96; y < 160; y += 8)
+          for(int x = 96; x < 160; x += 8)
+            keys.push_back(map.hash(x, y, z));
+      map.allocate(keys.data(), keys.size());
+    }
+
+  Eigen::Matrix4f K_;
+  Eigen::Vector2i size_;
+  std::vector<float> depth_;
+  Sophus::SE3f Tcw_;
+};
+
+TEST_F(ProjectiveTest, RowDispatch) {
+  static_assert(!se::functor::has_row_update<record_update, 
+      se::VoxelBlock<aosT> >::value, "AoS blocks take the per-voxel update");
+  static_assert(se::functor::has_row_update<record_update, 
+      se::VoxelBlock<soaT> >::value, "SoA blocks take the row update");
+
+  record_update funct = {depth_.data(), size_, 0};
+  se::Octree<soaT> map;
+  allocate(map);
+  se::functor::projective_functor<soaT, BLOCK_SIDE, se::Octree, record_update &>
+    it(map, funct, Tcw_, K_, size_);
+  it.apply();
+  ASSERT_EQ(funct.rows, map.leavesCount() * BLOCK_SIDE * BLOCK_SIDE);
+}
+
+TEST_F(ProjectiveTest, RowUpdateMatchesVoxelUpdate) {
+  se::Octree<aosT> voxelwise;
+  se::Octree<soaT> rowwise;
+  allocate(voxelwise);
+  allocate(rowwise);
+  record_update funct = {depth_.data(), size_, 0};
+  se::functor::projective_map(voxelwise, Tcw_, K_, size_, funct);
+  se::functor::projective_map(rowwise, Tcw_, K_, size_, funct);
+
+  std::vector<se::VoxelBlock<aosT>*> blocks;
+  voxelwise.getBlockList(blocks, false);
+  int updated = 0;
+  for(auto block : blocks) {
+    const Eigen::Vector3i base = block->coordinates();
+    se::VoxelBlock<soaT> * other = rowwise.fetch(base(0), base(1), base(2));
+    ASSERT_EQ(block->active(), other->active());
+    for(int i = 0; i < BLOCK_SIDE * BLOCK_SIDE * BLOCK_SIDE; ++i) {
+      ASSERT_NEAR(block->data(i).x, other->data(i).x, 1e-5f);
+      ASSERT_NEAR(block->data(i).y, other->data(i).y, 1e-2f);
+      updated += block->data(i).x > 0.f;
+    }
+  }
+  ASSERT_GT(updated, 0);
+}
+
+TEST_F(ProjectiveTest, NodesInViewOnly) {
+  se::Octree<aosT> visible;
+  se::Octree<aosT> scanned;
+  for(auto map : {&visible, &scanned}) {
+    map->init(256, 2.56f);
+    std::vector<se::key_t> keys;
+    for(int z = 0; z < 256; z += 32)
+      for(int y = 0; y < 256; y += 32)
+        for(int x = 0; x < 256; x += 32)
+          keys.push_back(map->hash(x, y, z));
+    map->allocate(keys.data(), keys.size());
+  }
+
+  record_update funct = {depth_.data(), size_, 0};
+  se::functor::projective_map(visible, Tcw_, K_, size_, funct);
+  se::functor::projective_functor<aosT, BLOCK_SIDE, se::Octree, record_update>
+    it(scanned, funct, Tcw_, K_, size_);
+  auto& nodes = scanned.getNodesBuffer();
+  for(unsigned int i = 0; i < nodes.size(); ++i)
+    if(nodes.used(i)) it.update_node(nodes[i], scanned.dim() / scanned.size());
+
+  auto& culled = visible.getNodesBuffer();
+  ASSERT_EQ(culled.size(), nodes.size());
+  int updated = 0;
+  for(unsigned int i = 0; i < culled.size(); ++i) {
+    const se::Node<aosT> * node = culled[i];
+    const Eigen::Vector3i c = se::keyops::decode(node->code_);
+    const se::Node<aosT> * other = scanned.fetch_octant(c(0), c(1), c(2), 
+        se::keyops::level(node->code_));
+    ASSERT_EQ(node->side_, other->side_);
+    for(int j = 0; j < 8; ++j) {
+      ASSERT_EQ(node->value_[j].x, other->value_[j].x);
+      ASSERT_EQ(node->value_[j].y, other->value_[j].y);
+      updated += node->value_[j].x > 0.f;
+    }
+  }
+  ASSERT_GT(updated, 0);
+}
+
+TEST_F(ProjectiveTest, OctantSkipMatchesVoxelUpdate) {
+  static_assert(se::functor::has_octant_skip<band_update>::value, 
+      "band_update skips octants");
+  // Holes and a step in depth, so that some blocks are skipped
+  se::Image<float> depth(size_(0), size_(1));
+  for(int v = 0; v < size_(1); ++v)
+    for(int u = 0; u < size_(0); ++u)
+      depth(u, v) = u < 16 ? 0.f : (v < 30 ? 0.7f : 1.f + 0.001f * u);
+  se::depth_pyramid tiles;
+  tiles.build(depth);
+
+  se::Octree<aosT> skipped;
+  se::Octree<aosT> voxelwise;
+  allocate(skipped);
+  allocate(voxelwise);
+  se::functor::projective_map(skipped, Tcw_, K_, size_, 
+      band_update{depth.data(), size_, 0.05f, &tiles});
+  se::functor::projective_map(voxelwise, Tcw_, K_, size_, 
+      band_update{depth.data(), size_, 0.05f, NULL});
+
+  std::vector<se::VoxelBlock<aosT>*> blocks;
+  voxelwise.getBlockList(blocks, false);
+  int updated = 0;
+  for(auto block : blocks) {
+    const Eigen::Vector3i base = block->coordinates();
+    se::VoxelBlock<aosT> * other = skipped.fetch(base(0), base(1), base(2));
+    for(int i = 0; i < BLOCK_SIDE * BLOCK_SIDE * BLOCK_SIDE; ++i) {
+      ASSERT_EQ(block->data(i).x, other->data(i).x);
+      ASSERT_EQ(block->data(i).y, other->data(i).y);
+      updated += block->data(i).x > 0.f;
+    }
+  }
+  ASSERT_GT(updated, 0);
+}
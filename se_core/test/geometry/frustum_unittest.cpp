@@ -0,0 +1,204 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "hash_map.hpp"
+#include "linear_octree.hpp"
+#include "geometry/frustum.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace se::geometry;
+typedef float testT;
+
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 1.f; }
+};
+
+class FrustumTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      K_ = Eigen::Matrix4f::Identity();
+      K_(0, 0) = K_(1, 1) = 100.f;
+      K_(0, 2) = 40.f;
+      K_(1, 2) = 30.f;
+      size_ = Eigen::Vector2i(80, 60);
+
+      // Camera in the middle of the volume looking along z, rolled
+      Eigen::Matrix4f pose = Eigen::Matrix4f::Identity();
+      pose.topLeftCorner<3, 3>() = 
+        Eigen::AngleAxisf(0.3f, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+      pose.topRightCorner<3, 1>() = Eigen::Vector3f(2.56f, 2.56f, 1.28f);
+      Tcw_ = Sophus::SE3f(pose).inverse();
+
+      oct_.init(512, 5.12f);
+      std::vector<se::key_t> keys;
+      for(int z = 0; z < 512; z += 24)
+        for(int y = 0; y < 512; y += 24)
+          for(int x = 0; x < 512; x += 24)
+            keys.push_back(oct_.hash(x, y, z));
+      oct_.allocate(keys.data(), keys.size());
+    }
+
+    /* Does any voxel of the block project inside the frame */
+    bool projects(const se::VoxelBlock<testT>* block, const float near_plane,
+        const float far_plane) const {
+      const float voxel_size = oct_.dim() / oct_.size();
+      const Eigen::Vector3i base = block->coordinates();
+      for(int z = 0; z < BLOCK_SIDE; ++z)
+        for(int y = 0; y < BLOCK_SIDE; ++y)
+          for(int x = 0; x < BLOCK_SIDE; ++x) {
+            const Eigen::Vector3f pos = Tcw_ * (voxel_size * 
+                (base + Eigen::Vector3i(x, y, z)).cast<float>());
+            if(pos(2) < near_plane || pos(2) > far_plane) continue;
+            const Eigen::Vector3f pix = K_.topLeftCorner<3, 3>() * pos;
+            const float u = pix(0) / pix(2);
+            const float v = pix(1) / pix(2);
+            if(u >= 0.f && u <= size_(0) - 2.f && v >= 0.f && 
+               v <= size_(1) - 2.f) return true;
+          }
+      return false;
+    }
+
+  Eigen::Matrix4f K_;
+  Eigen::Vector2i size_;
+  Sophus::SE3f Tcw_;
+  se::Octree<testT> oct_;
+};
+
+TEST_F(FrustumTest, Classify) {
+  const frustum view(K_, Tcw_, size_, 0.1f, 2.f);
+  const Eigen::Vector3f ahead = Tcw_.inverse() * Eigen::Vector3f(0, 0, 1.f);
+  EXPECT_EQ(view.classify(ahead, 0.05f), frustum_status::inside);
+  const Eigen::Vector3f behind = Tcw_.inverse() * Eigen::Vector3f(0, 0, -1.f);
+  EXPECT_EQ(view.classify(behind, 0.05f), frustum_status::outside);
+  const Eigen::Vector3f beyond = Tcw_.inverse() * Eigen::Vector3f(0, 0, 3.f);
+  EXPECT_EQ(view.classify(beyond, 0.05f), frustum_status::outside);
+  const Eigen::Vector3f around = Tcw_.inverse() * Eigen::Vector3f(0, 0, 0);
+  EXPECT_EQ(view.classify(around - Eigen::Vector3f::Constant(2.f), 4.f), 
+      frustum_status::intersects);
+}
+
+TEST_F(FrustumTest, BlocksAreConservative) {
+  const float near_plane = 0.0001f;
+  const float far_plane = 1.5f;
+  std::vector<se::VoxelBlock<testT>*> visible;
+  frustum_blocks(visible, oct_, 
+      frustum(K_, Tcw_, size_, near_plane, far_plane));
+  std::sort(visible.begin(), visible.end());
+
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  oct_.getBlockList(blocks, false);
+  int projecting = 0;
+  for(auto block : blocks) {
+    if(!projects(block, near_plane, far_plane)) continue;
+    ++projecting;
+    ASSERT_TRUE(std::binary_search(visible.begin(), visible.end(), block));
+  }
+  ASSERT_GT(projecting, 0);
+  ASSERT_LT(visible.size(), blocks.size() / 10);
+}
+
+TEST_F(FrustumTest, Bounds) {
+  const frustum view(K_, Tcw_, size_, 0.1f, 2.f);
+  const Eigen::Vector3f ahead = Tcw_.inverse() * Eigen::Vector3f(0, 0, 1.f);
+  ASSERT_TRUE((view.lower().array() <= ahead.array()).all());
+  ASSERT_TRUE((view.upper().array() >= ahead.array()).all());
+  const Eigen::Vector3f beyond = Tcw_.inverse() * Eigen::Vector3f(0, 0, 3.f);
+  ASSERT_FALSE((view.lower().array() <= beyond.array()).all() && 
+      (view.upper().array() >= beyond.array()).all());
+  const frustum unbounded(K_, Tcw_, size_, 0.1f, 
+      std::numeric_limits<float>::infinity());
+  ASSERT_TRUE(std::isinf(unbounded.lower()(0)));
+  ASSERT_TRUE(std::isinf(unbounded.upper()(0)));
+}
+
+/* Codes of the blocks and nodes of map visited within view */
+template <typename MapT>
+void visit_codes(const MapT& map, const frustum& view, 
+    std::vector<se::key_t>& blocks, std::vector<se::key_t>& nodes) {
+  frustum_visit(map, view,
+      [&blocks](se::VoxelBlock<testT>* block) { 
+        blocks.push_back(block->code_); 
+      },
+      [&nodes](typename MapT::node_type* node) { 
+        nodes.push_back(node->code_); 
+      });
+  std::sort(blocks.begin(), blocks.end());
+  std::sort(nodes.begin(), nodes.end());
+}
+
+TEST_F(FrustumTest, HashMapBlocksMatchOctree) {
+  se::HashMap<testT> map;
+  map.init(512, 5.12f);
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 512; z += 24)
+    for(int y = 0; y < 512; y += 24)
+      for(int x = 0; x < 512; x += 24)
+        keys.push_back(map.hash(x, y, z));
+  map.allocate(keys.data(), keys.size());
+
+  // A bounded frustum walks the block grid, an unbounded one scans the map
+  for(const float far_plane : {1.5f, std::numeric_limits<float>::infinity()}) {
+    const frustum view(K_, Tcw_, size_, 0.0001f, far_plane);
+    std::vector<se::key_t> blocks_oct, nodes_oct, blocks_map, nodes_map;
+    visit_codes(oct_, view, blocks_oct, nodes_oct);
+    visit_codes(map, view, blocks_map, nodes_map);
+    ASSERT_GT(blocks_map.size(), 0u);
+    ASSERT_TRUE(blocks_oct == blocks_map);
+    ASSERT_TRUE(nodes_map.empty());
+  }
+}
+
+TEST_F(FrustumTest, LinearOctreeMatchesOctree) {
+  se::LinearOctree<testT> map;
+  map.init(512, 5.12f);
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 512; z += 24)
+    for(int y = 0; y < 512; y += 24)
+      for(int x = 0; x < 512; x += 24)
+        keys.push_back(map.hash(x, y, z));
+  map.allocate(keys.data(), keys.size());
+
+  for(const float far_plane : {1.5f, std::numeric_limits<float>::infinity()}) {
+    const frustum view(K_, Tcw_, size_, 0.0001f, far_plane);
+    std::vector<se::key_t> blocks_oct, nodes_oct, blocks_map, nodes_map;
+    visit_codes(oct_, view, blocks_oct, nodes_oct);
+    visit_codes(map, view, blocks_map, nodes_map);
+    ASSERT_GT(blocks_map.size(), 0u);
+    ASSERT_TRUE(blocks_oct == blocks_map);
+    ASSERT_TRUE(nodes_oct == nodes_map);
+  }
+}
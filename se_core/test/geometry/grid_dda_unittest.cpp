@@ -0,0 +1,125 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "geometry/grid_dda.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace se::geometry;
+
+typedef std::vector<Eigen::Vector3i, Eigen::aligned_allocator<Eigen::Vector3i> > 
+  cell_list;
+
+static cell_list walk(const Eigen::Vector3f& origin, 
+    const Eigen::Vector3f& direction, const float t_end, const int side, 
+    const int size) {
+  cell_list cells;
+  for(grid_dda dda(origin, direction, 0.f, t_end, side, size); dda.valid(); 
+      dda.next()) {
+    cells.push_back(dda.cell());
+  }
+  return cells;
+}
+
+struct cell_less {
+  bool operator()(const Eigen::Vector3i& a, const Eigen::Vector3i& b) const {
+    return std::lexicographical_compare(a.data(), a.data() + 3, 
+        b.data(), b.data() + 3);
+  }
+};
+
+TEST(GridDDA, AxisAligned) {
+  const cell_list cells = walk(Eigen::Vector3f(1.5f, 9.f, 3.f), 
+      Eigen::Vector3f(1.f, 0.f, 0.f), 30.f, 8, 64);
+  ASSERT_EQ(cells.size(), 4u);
+  for(int i = 0; i < 4; ++i) {
+    ASSERT_EQ(cells[i], Eigen::Vector3i(8 * i, 8, 0));
+  }
+}
+
+TEST(GridDDA, ClippedToGrid) {
+  const cell_list cells = walk(Eigen::Vector3f(-20.f, 60.5f, 4.f), 
+      Eigen::Vector3f(1.f, 0.f, 0.f), 200.f, 8, 64);
+  ASSERT_EQ(cells.size(), 8u);
+  EXPECT_EQ(cells.front(), Eigen::Vector3i(0, 56, 0));
+  EXPECT_EQ(cells.back(), Eigen::Vector3i(56, 56, 0));
+  EXPECT_TRUE(walk(Eigen::Vector3f(-20.f, 70.f, 4.f), 
+      Eigen::Vector3f(1.f, 0.f, 0.f), 200.f, 8, 64).empty());
+}
+
+TEST(GridDDA, CoversDenseSampling) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> pos(-8.f, 72.f);
+  std::normal_distribution<float> dir(0.f, 1.f);
+  const int size = 64;
+  const int side = 8;
+  for(int r = 0; r < 200; ++r) {
+    const Eigen::Vector3f origin(pos(gen), pos(gen), pos(gen));
+    const Eigen::Vector3f direction = 
+      Eigen::Vector3f(dir(gen), dir(gen), dir(gen)).normalized();
+    const float t_end = 40.f;
+    const cell_list cells = walk(origin, direction, t_end, side, size);
+
+    // Each cell once, consecutive cells share a face
+    std::set<Eigen::Vector3i, cell_less> visited(cells.begin(), cells.end());
+    ASSERT_EQ(visited.size(), cells.size());
+    for(size_t i = 1; i < cells.size(); ++i) {
+      ASSERT_EQ((cells[i] - cells[i - 1]).cwiseAbs().sum(), side);
+    }
+
+    for(float t = 0.f; t < t_end; t += 0.01f) {
+      const Eigen::Vector3f p = origin + t * direction;
+      if((p.array() < 0.f).any() || (p.array() >= size).any()) continue;
+      const Eigen::Vector3i cell = 
+        (p / side).array().floor().cast<int>() * side;
+      ASSERT_TRUE(visited.count(cell)) << "ray " << r << " t " << t;
+    }
+  }
+}
+
+TEST(GridDDA, ChangeSide) {
+  // Fine cells up to t = 16, then cells twice as large
+  const Eigen::Vector3f origin(0.5f, 0.5f, 0.5f);
+  const Eigen::Vector3f direction(1.f, 0.f, 0.f);
+  cell_list cells;
+  grid_dda dda(origin, direction, 0.f, 60.f, 4, 64);
+  while(dda.valid()) {
+    cells.push_back(dda.cell());
+    EXPECT_EQ(dda.side(), cells.back().x() < 16 ? 4 : 8);
+    dda.next(dda.t_exit() < 15.f ? 4 : 8);
+  }
+  ASSERT_EQ(cells.size(), 4u + 6u);
+  EXPECT_EQ(cells[3], Eigen::Vector3i(12, 0, 0));
+  EXPECT_EQ(cells[4], Eigen::Vector3i(16, 0, 0));
+  EXPECT_EQ(cells.back(), Eigen::Vector3i(56, 0, 0));
+}
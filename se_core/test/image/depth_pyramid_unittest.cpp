@@ -0,0 +1,88 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+#include <limits>
+#include <random>
+#include <image/depth_pyramid.hpp>
+#include "gtest/gtest.h"
+
+TEST(DepthPyramidTest, RangeCoversPixels) {
+  // Not a multiple of the tile side, with holes
+  const int width  = 150;
+  const int height = 99;
+  se::Image<float> depth(width, height);
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> dis(0.5f, 5.f);
+  for(int y = 0; y < height; ++y)
+    for(int x = 0; x < width; ++x)
+      depth(x, y) = (x / 20 + y / 20) % 3 == 0 ? 0.f : dis(gen);
+
+  se::depth_pyramid tiles;
+  tiles.build(depth);
+  ASSERT_EQ(tiles.levels(), 6);
+
+  std::uniform_int_distribution<int> xs(0, width - 1);
+  std::uniform_int_distribution<int> ys(0, height - 1);
+  for(int i = 0; i < 1000; ++i) {
+    Eigen::Vector2i lower(xs(gen), ys(gen));
+    Eigen::Vector2i upper(xs(gen), ys(gen));
+    const Eigen::Vector2i a = lower.cwiseMin(upper);
+    upper = lower.cwiseMax(upper);
+    lower = a;
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = 0.f;
+    for(int y = lower.y(); y <= upper.y(); ++y)
+      for(int x = lower.x(); x <= upper.x(); ++x) {
+        if(depth(x, y) == 0.f) continue;
+        lo = std::min(lo, depth(x, y));
+        hi = std::max(hi, depth(x, y));
+      }
+    const Eigen::Vector2f range = tiles.range(lower, upper);
+    ASSERT_LE(range(0), lo);
+    ASSERT_GE(range(1), hi);
+  }
+
+  const Eigen::Vector2f all = tiles.range();
+  ASSERT_GE(all(0), 0.5f);
+  ASSERT_LE(all(1), 5.f);
+  ASSERT_TRUE(tiles.empty(0, 0));
+  ASSERT_FALSE(tiles.empty(3, 0));
+}
+
+TEST(DepthPyramidTest, NoMeasurement) {
+  se::Image<float> depth(64, 48, 0.f);
+  se::depth_pyramid tiles;
+  tiles.build(depth);
+  const Eigen::Vector2f range = tiles.range(Eigen::Vector2i(3, 5), 
+      Eigen::Vector2i(60, 40));
+  ASSERT_EQ(range(0), std::numeric_limits<float>::infinity());
+  ASSERT_EQ(range(1), 0.f);
+}
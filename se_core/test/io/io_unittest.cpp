@@ -164,3 +164,89 @@ TEST(SerialiseUnitTest, SerialiseTree) {
   ASSERT_EQ(block_buffer_base.size(), block_buffer_copy.size());
 }
 
+TEST(SerialiseUnitTest, SerialisePrunedTree) {
+  se::Octree<testT> tree;
+  tree.init(256, 5);
+  const int side = se::VoxelBlock<testT>::side;
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 2 * side; z += side)
+    for(int y = 0; y < 2 * side; y += side)
+      for(int x = 0; x < 2 * side; x += side)
+        keys.push_back(tree.hash(x, y, z));
+  tree.allocate(keys.data(), keys.size());
+  tree.fetch(0, 0, 0)->data(0, 3.f);
+  ASSERT_EQ(tree.prune(), 7);
+
+  std::string filename = "octree-pruned-test.bin";
+  tree.save(filename);
+  se::Octree<testT> tree_copy;
+  tree_copy.load(filename);
+  ASSERT_EQ(tree_copy.leavesCount(), 1);
+  ASSERT_EQ(tree_copy.fetch_octant(0, 0, 0, 4)->pruned_mask_, 0xFE);
+  ASSERT_EQ(tree_copy.get_fine(0, 0, 0), 3.f);
+  ASSERT_EQ(tree_copy.get_fine(side + 1, 1, 1), 10.f);
+}
+
+/*
+ * Files written before the format header was introduced start with the map
+ * size and their nodes have no pruned mask.
+ */
+TEST(SerialiseUnitTest, LoadHeaderlessFile) {
+  const int size = 256;
+  const float dim = 5.f;
+  const int max_level = log2(size);
+  const int side = se::VoxelBlock<testT>::side;
+  const Eigen::Vector3i corner(40, 48, 56);
+  std::string filename = "octree-headerless-test.bin";
+  {
+    std::ofstream os (filename, std::ios::binary); 
+    os.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    os.write(reinterpret_cast<const char *>(&dim), sizeof(dim));
+    size_t n = 1;
+    os.write(reinterpret_cast<char *>(&n), sizeof(n));
+    se::key_t code = se::keyops::encode(0, 0, 0, 1, max_level);
+    int node_side = size / 2;
+    float values[8] = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f};
+    os.write(reinterpret_cast<char *>(&code), sizeof(code));
+    os.write(reinterpret_cast<char *>(&node_side), sizeof(node_side));
+    os.write(reinterpret_cast<char *>(values), sizeof(values));
+    os.write(reinterpret_cast<char *>(&n), sizeof(n));
+    code = se::keyops::encode(corner(0), corner(1), corner(2), 
+        max_level - log2(side), max_level);
+    os.write(reinterpret_cast<char *>(&code), sizeof(code));
+    os.write(reinterpret_cast<const char *>(corner.data()), 
+        sizeof(Eigen::Vector3i));
+    for(int i = 0; i < side * side * side; ++i) {
+      const float v = i;
+      os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+  }
+
+  se::Octree<testT> tree;
+  tree.load(filename);
+  ASSERT_EQ(tree.size(), size);
+  ASSERT_EQ(tree.dim(), dim);
+  se::Node<testT> * node = tree.fetch_octant(0, 0, 0, 1);
+  ASSERT_NE(node, nullptr);
+  ASSERT_EQ(node->pruned_mask_, 0);
+  for(int i = 0; i < 8; ++i) ASSERT_EQ(node->value_[i], i + 1.f);
+  se::VoxelBlock<testT> * block = tree.fetch(corner(0), corner(1), corner(2));
+  ASSERT_NE(block, nullptr);
+  for(int z = 0; z < side; ++z)
+    for(int y = 0; y < side; ++y)
+      for(int x = 0; x < side; ++x)
+        ASSERT_EQ(block->data(corner + Eigen::Vector3i(x, y, z)), 
+            x + y * side + z * side * side);
+}
+
+TEST(SerialiseUnitTest, RejectNewerVersion) {
+  std::string filename = "octree-newer-test.bin";
+  {
+    std::ofstream os (filename, std::ios::binary); 
+    const uint32_t version = se::map_version + 1;
+    os.write(se::map_magic, sizeof(se::map_magic));
+    os.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  }
+  se::Octree<testT> tree;
+  ASSERT_THROW(tree.load(filename), std::runtime_error);
+}
@@ -104,6 +104,24 @@ TEST_F(MultiscaleTest, Iterator) {
   }
 }
 
+TEST_F(MultiscaleTest, IteratorSkipsReleased) {
+  const int side = se::VoxelBlock<testT>::side;
+  std::vector<se::key_t> alloc_list;
+  for(int z = 0; z < 128; z += side)
+    for(int y = 0; y < 128; y += side)
+      for(int x = 0; x < 128; x += side)
+        alloc_list.push_back(oct_.hash(x, y, z));
+  oct_.allocate(alloc_list.data(), alloc_list.size());
+
+  // Leaves thousands of consecutive released slots in both pools
+  ASSERT_TRUE(oct_.deallocate(0, 0, 0, 2));
+  se::node_iterator<testT> it(oct_);
+  int visited = 0;
+  for(se::Node<testT> * node = it.next(); node != nullptr; node = it.next())
+    ++visited;
+  EXPECT_EQ(visited, oct_.nodeCount());
+}
+
 TEST_F(MultiscaleTest, ChildrenMaskTest) {
   const Eigen::Vector3i blocks[10] = {{56, 12, 254}, {87, 32, 423}, {128, 128, 128},
     {136, 128, 128}, {128, 136, 128}, {136, 136, 128}, 
@@ -0,0 +1,156 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <random>
+#include "octree.hpp"
+#include "utils/math_utils.h"
+#include "utils/block_layout.hpp"
+
+struct Triangle {
+  Eigen::Vector3f vertexes[3];
+};
+#include "algorithms/meshing.hpp"
+#include "gtest/gtest.h"
+
+typedef float linearT;
+typedef double mortonT;
+
+template <>
+struct voxel_traits<linearT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+template <>
+struct voxel_traits<mortonT> {
+  typedef double value_type;
+  static inline value_type empty(){ return 0.; }
+  static inline value_type initValue(){ return 0.; }
+};
+
+namespace se {
+template <>
+struct block_layout<mortonT> {
+  typedef morton_layout type;
+};
+}
+
+template <typename T>
+class BlockLayoutTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      oct_.init(64, 64);
+      const int side = se::VoxelBlock<T>::side;
+      std::vector<se::key_t> keys;
+      for(int z = 0; z < 32; z += side)
+        for(int y = 0; y < 32; y += side)
+          for(int x = 0; x < 32; x += side)
+            keys.push_back(oct_.hash(x, y, z));
+      oct_.allocate(keys.data(), keys.size());
+      for(int z = 0; z < 32; ++z)
+        for(int y = 0; y < 32; ++y)
+          for(int x = 0; x < 32; ++x)
+            oct_.set(x, y, z, field(x, y, z));
+    }
+
+    // Affine field, hence central differences are exact everywhere.
+    static float field(const int x, const int y, const int z) {
+      return x + 2*y + 3*z;
+    }
+
+  se::Octree<T> oct_;
+};
+
+typedef ::testing::Types<linearT, mortonT> LayoutTypes;
+TYPED_TEST_CASE(BlockLayoutTest, LayoutTypes);
+
+TEST(BlockLayout, MortonIndexIsPermutation) {
+  const int side = BLOCK_SIDE;
+  std::vector<bool> seen(side*side*side, false);
+  for(int z = 0; z < side; ++z)
+    for(int y = 0; y < side; ++y)
+      for(int x = 0; x < side; ++x) {
+        const unsigned idx = se::morton_layout::index<BLOCK_SIDE>(x, y, z);
+        ASSERT_LT(idx, seen.size());
+        ASSERT_FALSE(seen[idx]);
+        ASSERT_EQ(idx, compute_morton(x, y, z));
+        seen[idx] = true;
+      }
+}
+
+TYPED_TEST(BlockLayoutTest, DataRoundTrip) {
+  for(int z = 0; z < 32; ++z)
+    for(int y = 0; y < 32; ++y)
+      for(int x = 0; x < 32; ++x)
+        ASSERT_EQ(this->oct_.get(x, y, z), this->field(x, y, z));
+}
+
+TYPED_TEST(BlockLayoutTest, GatherMatchesData) {
+  const int side = se::VoxelBlock<TypeParam>::side;
+  std::vector<se::VoxelBlock<TypeParam>*> blocks;
+  this->oct_.getBlockList(blocks, false);
+  for(auto block : blocks) {
+    const Eigen::Vector3i base = block->coordinates();
+    for(int z = 0; z < side - 1; ++z)
+      for(int y = 0; y < side - 1; ++y)
+        for(int x = 0; x < side - 1; ++x) {
+          typename se::VoxelBlock<TypeParam>::value_type values[8];
+          const Eigen::Vector3i pos = base + Eigen::Vector3i(x, y, z);
+          block->gather(pos, values);
+          for(int i = 0; i < 8; ++i)
+            ASSERT_EQ(values[i], block->data(pos + se::interp_offsets[i]));
+        }
+  }
+}
+
+TYPED_TEST(BlockLayoutTest, MeshingGatherOrder) {
+  se::VoxelBlock<TypeParam>* block = this->oct_.fetch(1, 1, 1);
+  typename se::VoxelBlock<TypeParam>::value_type cached[8], fine[8];
+  se::meshing::gather_points(block, cached, 1, 2, 1);
+  se::meshing::gather_points(this->oct_, fine, 1, 2, 1);
+  for(int i = 0; i < 8; ++i)
+    EXPECT_EQ(cached[i], fine[i]);
+}
+
+TYPED_TEST(BlockLayoutTest, InterpAndGrad) {
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> dis(1.f, 29.f);
+  auto select = [](const auto& val) { return static_cast<float>(val); };
+  for(int i = 0; i < 1000; ++i) {
+    const Eigen::Vector3f p(dis(gen), dis(gen), dis(gen));
+    const float expected = p(0) + 2*p(1) + 3*p(2);
+    EXPECT_NEAR(this->oct_.interp(p, select), expected, 1e-3f);
+    const Eigen::Vector3f grad = this->oct_.grad(p, select);
+    EXPECT_NEAR(grad(0), 1.f, 1e-5f);
+    EXPECT_NEAR(grad(1), 2.f, 1e-5f);
+    EXPECT_NEAR(grad(2), 3.f, 1e-5f);
+  }
+}
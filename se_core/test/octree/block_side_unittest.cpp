@@ -0,0 +1,115 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "linear_octree.hpp"
+#include "utils/math_utils.h"
+#include "gtest/gtest.h"
+#include "functors/axis_aligned_functor.hpp"
+#include <type_traits>
+
+typedef float testT;
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+template <typename BlockSideT>
+class BlockSideTest : public ::testing::Test {
+  protected:
+    static constexpr unsigned int side = BlockSideT::value;
+    virtual void SetUp() {
+      oct_.init(size_, 5.f);
+      lin_.init(size_, 5.f);
+      const int leaves_level = log2(size_) - log2(side);
+      for(int z = 0; z < 32; z += side)
+        for(int y = 0; y < 32; y += side)
+          for(int x = 0; x < 32; x += side) {
+            const Eigen::Vector3i p = Eigen::Vector3i(x, y, z) + offset_;
+            alloc_list_.push_back(oct_.hash(p(0), p(1), p(2), leaves_level));
+          }
+      std::vector<se::key_t> keys = alloc_list_;
+      oct_.allocate(keys.data(), keys.size());
+      keys = alloc_list_;
+      lin_.allocate(keys.data(), keys.size());
+    }
+
+    const unsigned int size_ = 256;
+    const Eigen::Vector3i offset_ = Eigen::Vector3i(64, 96, 128);
+    se::Octree<testT, side> oct_;
+    se::LinearOctree<testT, side> lin_;
+    std::vector<se::key_t> alloc_list_;
+};
+
+typedef ::testing::Types<std::integral_constant<unsigned int, 4>, 
+        std::integral_constant<unsigned int, 8>,
+        std::integral_constant<unsigned int, 16> > BlockSides;
+TYPED_TEST_CASE(BlockSideTest, BlockSides);
+
+TYPED_TEST(BlockSideTest, Allocation) {
+  const unsigned int side = TestFixture::side;
+  const unsigned int blocks = (32 / side) * (32 / side) * (32 / side);
+  ASSERT_EQ(this->oct_.getBlockBuffer().size(), blocks);
+  ASSERT_EQ(this->lin_.leavesCount(), blocks);
+  for(unsigned int i = 0; i < this->oct_.getBlockBuffer().size(); ++i) {
+    auto * block = this->oct_.getBlockBuffer()[i];
+    const Eigen::Vector3i c = block->coordinates();
+    ASSERT_TRUE(block->isLeaf());
+    ASSERT_EQ(block->side_, side);
+    ASSERT_EQ(se::keyops::decode(block->code_), c);
+    ASSERT_EQ(this->oct_.fetch(c(0), c(1), c(2)), block);
+    ASSERT_EQ(this->lin_.fetch(c(0), c(1), c(2))->code_, block->code_);
+  }
+  for(unsigned int i = 0; i < this->oct_.getNodesBuffer().size(); ++i) {
+    ASSERT_FALSE(this->oct_.getNodesBuffer()[i]->isLeaf());
+  }
+}
+
+TYPED_TEST(BlockSideTest, UpdateAndInterp) {
+  auto fill = [](auto& handler, const Eigen::Vector3i& v) {
+    handler.set(v(0) + 2.f * v(1) + 3.f * v(2));
+  };
+  se::functor::axis_aligned_map(this->oct_, fill);
+  se::functor::axis_aligned_map(this->lin_, fill);
+  auto select = [](const auto& val) { return val; };
+  for(int z = 0; z < 31; ++z)
+    for(int y = 0; y < 31; ++y)
+      for(int x = 0; x < 31; ++x) {
+        const Eigen::Vector3i p = Eigen::Vector3i(x, y, z) + this->offset_;
+        const float expected = p(0) + 2.f * p(1) + 3.f * p(2);
+        ASSERT_EQ(this->oct_.get(p(0), p(1), p(2)), expected);
+        ASSERT_EQ(this->lin_.get(p(0), p(1), p(2)), expected);
+        const Eigen::Vector3f q = p.cast<float>() + Eigen::Vector3f::Constant(0.5f);
+        ASSERT_FLOAT_EQ(this->oct_.interp(q, select), expected + 3.f);
+        ASSERT_FLOAT_EQ(this->lin_.interp(q, select), expected + 3.f);
+      }
+}
@@ -0,0 +1,134 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <cstdint>
+#include "octree.hpp"
+#include "utils/block_storage.hpp"
+#include "functors/data_handler.hpp"
+#include "gtest/gtest.h"
+
+typedef struct {
+  float x;
+  int16_t y;
+} soaT;
+
+template <>
+struct voxel_traits<soaT> {
+  typedef soaT value_type;
+  typedef se::soa_storage storage_type;
+  static inline value_type empty(){ return {0.f, 0}; }
+  static inline value_type initValue(){ return {1.f, 0}; }
+};
+
+class BlockStorageTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      oct_.init(64, 64);
+      const int side = se::VoxelBlock<soaT>::side;
+      std::vector<se::key_t> keys;
+      for(int z = 0; z < 16; z += side)
+        for(int y = 0; y < 16; y += side)
+          for(int x = 0; x < 16; x += side)
+            keys.push_back(oct_.hash(x, y, z));
+      oct_.allocate(keys.data(), keys.size());
+      for(int z = 0; z < 16; ++z)
+        for(int y = 0; y < 16; ++y)
+          for(int x = 0; x < 16; ++x)
+            oct_.set(x, y, z, field(x, y, z));
+    }
+
+    static soaT field(const int x, const int y, const int z) {
+      return {x + 2.f*y + 3.f*z, static_cast<int16_t>(x - y)};
+    }
+
+  se::Octree<soaT> oct_;
+};
+
+TEST(BlockStorage, SelectedByTraits) {
+  static_assert(std::is_same<se::block_storage<soaT>::type, 
+      se::soa_storage>::value, "soa_storage not selected");
+  static_assert(std::is_same<se::block_storage<float>::type, 
+      se::aos_storage>::value, "aos_storage is the default");
+  se::VoxelBlock<soaT> block;
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(block.storage().x()) % 32, 0u);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(block.storage().y()) % 32, 0u);
+  ASSERT_EQ(block.data(0).x, 1.f);
+  ASSERT_EQ(block.data(0).y, 0);
+}
+
+TEST_F(BlockStorageTest, DataRoundTrip) {
+  for(int z = 0; z < 16; ++z)
+    for(int y = 0; y < 16; ++y)
+      for(int x = 0; x < 16; ++x) {
+        const soaT v = oct_.get(x, y, z);
+        ASSERT_EQ(v.x, field(x, y, z).x);
+        ASSERT_EQ(v.y, field(x, y, z).y);
+      }
+}
+
+TEST_F(BlockStorageTest, GatherMatchesData) {
+  const int side = se::VoxelBlock<soaT>::side;
+  se::VoxelBlock<soaT> * block = oct_.fetch(0, 0, 0);
+  for(int z = 0; z < side - 1; ++z)
+    for(int y = 0; y < side - 1; ++y)
+      for(int x = 0; x < side - 1; ++x) {
+        soaT values[8];
+        block->gather(Eigen::Vector3i(x, y, z), values);
+        for(int i = 0; i < 8; ++i) {
+          const soaT v = field(x + (i & 1), y + ((i & 2) > 0), z + ((i & 4) > 0));
+          ASSERT_EQ(values[i].x, v.x);
+          ASSERT_EQ(values[i].y, v.y);
+        }
+      }
+}
+
+TEST_F(BlockStorageTest, RowAccess) {
+  const int side = se::VoxelBlock<soaT>::side;
+  se::VoxelBlock<soaT> * block = oct_.fetch(8, 0, 8);
+  const Eigen::Vector3i base = block->coordinates();
+  const float * xs = block->row_x(3, 5);
+  const int16_t * ys = block->row_y(3, 5);
+  for(int i = 0; i < side; ++i) {
+    const soaT v = field(base(0) + i, base(1) + 3, base(2) + 5);
+    ASSERT_EQ(xs[i], v.x);
+    ASSERT_EQ(ys[i], v.y);
+  }
+
+  // Writing through the handler rows is seen by the voxel accessors
+  const Eigen::Vector3i voxel = base + Eigen::Vector3i(2, 3, 5);
+  VoxelBlockHandler<soaT> handler(block, voxel);
+  ASSERT_EQ(handler.row_offset(), 2);
+  ASSERT_EQ(handler.row_x(), xs);
+  float * row = handler.row_x();
+  for(int i = 0; i < side; ++i) row[i] = -i;
+  ASSERT_EQ(handler.get().x, -2.f);
+  ASSERT_EQ(oct_.get(base(0) + side - 1, base(1) + 3, base(2) + 5).x, 
+      1.f - side);
+}
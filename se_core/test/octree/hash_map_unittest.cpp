@@ -0,0 +1,245 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "hash_map.hpp"
+#include "ray_iterator.hpp"
+#include "block_ray_iterator.hpp"
+#include "utils/math_utils.h"
+#include "gtest/gtest.h"
+#include "functors/axis_aligned_functor.hpp"
+#include <cstdio>
+#include <algorithm>
+#include <random>
+
+typedef float testT;
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+class HashMapTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      const unsigned size = 512;
+      const float dim = 10.f;
+      oct_.init(size, dim);
+      map_.init(size, dim);
+
+      std::mt19937 gen(1);
+      std::uniform_int_distribution<> coord(0, size - 1);
+      const int block_level = log2(size) - log2(se::Octree<testT>::blockSide);
+      std::vector<se::key_t> keys;
+      for(int i = 0; i < 1000; ++i) {
+        const int x = coord(gen), y = coord(gen), z = coord(gen);
+        keys.push_back(oct_.hash(x, y, z, block_level));
+        // Duplicates must be ignored
+        if(i % 3 == 0) keys.push_back(keys.back());
+      }
+      std::vector<se::key_t> keys_map = keys;
+      oct_.allocate(keys.data(), keys.size());
+      map_.allocate(keys_map.data(), keys_map.size());
+
+      auto fill = [](auto& handler, const Eigen::Vector3i& v) {
+        handler.set(v(0) + 1000.f * v(1) + 1000000.f * v(2));
+      };
+      se::functor::axis_aligned_map(oct_, fill);
+      se::functor::axis_aligned_map(map_, fill);
+    }
+
+  se::Octree<testT> oct_;
+  se::HashMap<testT> map_;
+};
+
+TEST_F(HashMapTest, SameBlocks) {
+  ASSERT_EQ(oct_.getBlockBuffer().size(), map_.leavesCount());
+  ASSERT_EQ(map_.nodeCount(), 0);
+  ASSERT_GE(map_.capacity(), 2u * map_.leavesCount());
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  oct_.getBlockList(blocks, false);
+  for(const auto& b : blocks) {
+    const Eigen::Vector3i c = b->coordinates();
+    se::VoxelBlock<testT> * hb = map_.fetch(c(0), c(1), c(2));
+    ASSERT_TRUE(hb != NULL);
+    ASSERT_EQ(hb->code_, b->code_);
+    ASSERT_TRUE(hb->coordinates() == c);
+  }
+}
+
+TEST_F(HashMapTest, ActiveBlocks) {
+  std::vector<se::VoxelBlock<testT>*> active;
+  map_.getBlockList(active, true);
+  ASSERT_EQ(active.size(), map_.leavesCount());
+  ASSERT_EQ(map_.activeBlocks().slots().size(), map_.leavesCount());
+  se::VoxelBlock<testT> * b = active.front();
+  map_.deactivate(b);
+  ASSERT_FALSE(b->active());
+  active.clear();
+  map_.getBlockList(active, true);
+  ASSERT_EQ(active.size(), map_.leavesCount() - 1);
+  ASSERT_TRUE(std::find(active.begin(), active.end(), b) == active.end());
+  map_.activate(b);
+  ASSERT_TRUE(b->active());
+  ASSERT_EQ(map_.activeBlocks().slots().size(), map_.leavesCount());
+}
+
+TEST_F(HashMapTest, ReleasedSlotsAreSkipped) {
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  map_.getBlockList(blocks, false);
+  const int allocated = map_.leavesCount();
+  ASSERT_EQ(blocks.size(), allocated);
+  map_.getBlockBuffer().release_block(blocks[10]);
+  blocks.clear();
+  map_.getBlockList(blocks, false);
+  ASSERT_EQ(map_.leavesCount(), allocated - 1);
+  ASSERT_EQ(blocks.size(), allocated - 1);
+}
+
+TEST_F(HashMapTest, CoarseKeysAreExpanded) {
+  se::HashMap<testT> map;
+  map.init(512, 10.f);
+  const int side = se::HashMap<testT>::blockSide;
+  const int block_level = log2(512) - log2(side);
+  std::vector<se::key_t> keys = {
+    map.hash(0, 0, 0, block_level - 1),
+    map.hash(256, 256, 256, block_level - 2),
+    // Overlaps the previous one
+    map.hash(256 + side, 256, 256, block_level),
+    // Too coarse
+    map.hash(0, 256, 0, block_level - 3)
+  };
+  ASSERT_FALSE(map.allocate(keys.data(), keys.size()));
+  ASSERT_EQ(map.leavesCount(), 8 + 64);
+  for(int z = 0; z < 2 * side; z += side)
+    for(int y = 0; y < 2 * side; y += side)
+      for(int x = 0; x < 2 * side; x += side)
+        ASSERT_TRUE(map.fetch(x, y, z) != NULL);
+  for(int z = 0; z < 4 * side; z += side)
+    for(int y = 0; y < 4 * side; y += side)
+      for(int x = 0; x < 4 * side; x += side)
+        ASSERT_TRUE(map.fetch(256 + x, 256 + y, 256 + z) != NULL);
+  ASSERT_TRUE(map.fetch(0, 256, 0) == NULL);
+  ASSERT_TRUE(map.fetch_octant(0, 0, 0, block_level - 1) == NULL);
+}
+
+TEST_F(HashMapTest, GrowsTable) {
+  const size_t capacity = map_.capacity();
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 256; z += se::HashMap<testT>::blockSide)
+    for(int y = 0; y < 256; y += se::HashMap<testT>::blockSide)
+      for(int x = 0; x < 256; x += se::HashMap<testT>::blockSide)
+        keys.push_back(map_.hash(x, y, z));
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  map_.getBlockList(blocks, false);
+  map_.allocate(keys.data(), keys.size());
+  ASSERT_GT(map_.capacity(), capacity);
+  // Blocks allocated before the table grew are still reachable
+  for(const auto& b : blocks) {
+    const Eigen::Vector3i c = b->coordinates();
+    ASSERT_EQ(map_.fetch(c(0), c(1), c(2)), b);
+  }
+  for(int z = 0; z < 256; z += se::HashMap<testT>::blockSide)
+    for(int y = 0; y < 256; y += se::HashMap<testT>::blockSide)
+      for(int x = 0; x < 256; x += se::HashMap<testT>::blockSide)
+        ASSERT_TRUE(map_.fetch(x, y, z) != NULL);
+}
+
+TEST_F(HashMapTest, PointQueries) {
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<> coord(0, oct_.size() - 1);
+  for(int i = 0; i < 100000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    ASSERT_EQ(oct_.get_fine(x, y, z), map_.get_fine(x, y, z));
+  }
+}
+
+TEST_F(HashMapTest, InterpAndGrad) {
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  oct_.getBlockList(blocks, false);
+  auto select = [](const auto& val) { return val; };
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> offset(0.f, 
+      se::Octree<testT>::blockSide - 1);
+  for(const auto& b : blocks) {
+    const Eigen::Vector3f p = b->coordinates().cast<float>() + 
+      Eigen::Vector3f(offset(gen), offset(gen), offset(gen));
+    ASSERT_FLOAT_EQ(oct_.interp(p, select), map_.interp(p, select));
+    const Eigen::Vector3f go = oct_.grad(p, select);
+    const Eigen::Vector3f gh = map_.grad(p, select);
+    // Summation order differs at block boundaries
+    for(int i = 0; i < 3; ++i)
+      ASSERT_NEAR(go(i), gh(i), 1e-5f * std::max(1.f, std::fabs(go(i))));
+  }
+}
+
+TEST_F(HashMapTest, RayIterator) {
+  std::mt19937 gen(4);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+  const Eigen::Vector3f origin = Eigen::Vector3f::Constant(oct_.dim() / 2);
+  for(int i = 0; i < 1000; ++i) {
+    const Eigen::Vector3f dir = 
+      Eigen::Vector3f(unit(gen), unit(gen), unit(gen)).normalized();
+    se::ray_iterator<testT> oct_ray(oct_, origin, dir, 0.1f, 20.f);
+    se::HashMap<testT>::ray_iterator_type map_ray(map_, origin, dir, 0.1f, 
+        20.f);
+    ASSERT_NEAR(oct_ray.tmax(), map_ray.tmax(), 1e-4f);
+    // Both must visit the same blocks in the same order
+    se::VoxelBlock<testT> * ob, * hb;
+    while((ob = oct_ray.next())) {
+      hb = map_ray.next();
+      ASSERT_TRUE(hb != NULL);
+      ASSERT_EQ(ob->code_, hb->code_);
+      ASSERT_NEAR(oct_ray.tcmin(), map_ray.tcmin(), 1e-4f);
+    }
+    ASSERT_TRUE(map_ray.next() == NULL);
+  }
+}
+
+TEST_F(HashMapTest, SaveLoad) {
+  const std::string filename = "hash_map_unittest.bin";
+  map_.save(filename);
+  se::HashMap<testT> loaded;
+  loaded.load(filename);
+  std::remove(filename.c_str());
+  ASSERT_EQ(loaded.leavesCount(), map_.leavesCount());
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  map_.getBlockList(blocks, false);
+  const int side = se::HashMap<testT>::blockSide;
+  for(const auto& b : blocks) {
+    const Eigen::Vector3i c = b->coordinates();
+    for(int z = 0; z < side; ++z)
+      for(int y = 0; y < side; ++y)
+        for(int x = 0; x < side; ++x)
+          ASSERT_EQ(loaded.get(c(0) + x, c(1) + y, c(2) + z), 
+              map_.get(c(0) + x, c(1) + y, c(2) + z));
+  }
+}
@@ -0,0 +1,255 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "linear_octree.hpp"
+#include "ray_iterator.hpp"
+#include "block_ray_iterator.hpp"
+#include "utils/math_utils.h"
+#include "gtest/gtest.h"
+#include "functors/axis_aligned_functor.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+typedef float testT;
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+class LinearOctreeTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      const unsigned size = 512;
+      const float dim = 10.f;
+      oct_.init(size, dim);
+      lin_.init(size, dim);
+
+      std::mt19937 gen(1);
+      std::uniform_int_distribution<> coord(0, size - 1);
+      std::uniform_int_distribution<> depth(3, 6);
+      const int max_level = log2(size);
+      std::vector<se::key_t> keys;
+      for(int i = 0; i < 2000; ++i) {
+        const int x = coord(gen), y = coord(gen), z = coord(gen);
+        const int level = i % 4 == 0 ? depth(gen) : 
+          max_level - log2(se::Octree<testT>::blockSide);
+        keys.push_back(oct_.hash(x, y, z, level));
+      }
+      std::vector<se::key_t> keys_lin = keys;
+      oct_.allocate(keys.data(), keys.size());
+      lin_.allocate(keys_lin.data(), keys_lin.size());
+
+      // Give every octant a position dependent value.
+      auto fill = [](auto& handler, const Eigen::Vector3i& v) {
+        handler.set(v(0) + 1000.f * v(1) + 1000000.f * v(2));
+      };
+      se::functor::axis_aligned_map(oct_, fill);
+      se::functor::axis_aligned_map(lin_, fill);
+    }
+
+  se::Octree<testT> oct_;
+  se::LinearOctree<testT> lin_;
+};
+
+TEST_F(LinearOctreeTest, SameTopology) {
+  ASSERT_EQ(oct_.getBlockBuffer().size(), lin_.leavesCount());
+  ASSERT_EQ(oct_.getNodesBuffer().size(), lin_.nodeCount());
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  oct_.getBlockList(blocks, false);
+  for(const auto& b : blocks) {
+    const Eigen::Vector3i c = b->coordinates();
+    se::VoxelBlock<testT> * lb = lin_.fetch(c(0), c(1), c(2));
+    ASSERT_TRUE(lb != NULL);
+    ASSERT_EQ(lb->code_, b->code_);
+    ASSERT_TRUE(lb->coordinates() == c);
+  }
+}
+
+TEST_F(LinearOctreeTest, ActiveBlocks) {
+  std::vector<se::VoxelBlock<testT>*> active;
+  lin_.getBlockList(active, true);
+  ASSERT_EQ(active.size(), lin_.leavesCount());
+  ASSERT_EQ(lin_.activeBlocks().slots().size(), lin_.leavesCount());
+  se::VoxelBlock<testT> * b = active.front();
+  lin_.deactivate(b);
+  ASSERT_FALSE(b->active());
+  active.clear();
+  lin_.getBlockList(active, true);
+  ASSERT_EQ(active.size(), lin_.leavesCount() - 1);
+  ASSERT_TRUE(std::find(active.begin(), active.end(), b) == active.end());
+  lin_.activate(b);
+  ASSERT_TRUE(b->active());
+  ASSERT_EQ(lin_.activeBlocks().slots().size(), lin_.leavesCount());
+}
+
+TEST_F(LinearOctreeTest, FetchOctant) {
+  auto& nodes = oct_.getNodesBuffer();
+  for(unsigned int i = 0; i < nodes.size(); ++i) {
+    const se::Node<testT> * n = nodes[i];
+    const Eigen::Vector3i c = se::keyops::decode(n->code_);
+    const int level = se::keyops::level(n->code_);
+    const se::LinearNode<testT> * ln = lin_.fetch_octant(c(0), c(1), c(2), 
+        level);
+    ASSERT_TRUE(ln != NULL);
+    ASSERT_EQ(ln->code_, n->code_);
+    ASSERT_EQ(ln->side_, n->side_);
+    ASSERT_EQ(ln->children_mask_, n->children_mask_);
+  }
+}
+
+TEST_F(LinearOctreeTest, PointQueries) {
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<> coord(0, oct_.size() - 1);
+  for(int i = 0; i < 100000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    ASSERT_EQ(oct_.get(x, y, z), lin_.get(x, y, z));
+    ASSERT_EQ(oct_.get_fine(x, y, z), lin_.get_fine(x, y, z));
+  }
+}
+
+TEST_F(LinearOctreeTest, InterpAndGrad) {
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  oct_.getBlockList(blocks, false);
+  auto select = [](const auto& val) { return val; };
+  for(const auto& b : blocks) {
+    const Eigen::Vector3f p = b->coordinates().cast<float>() + 
+      Eigen::Vector3f::Constant(6.3f);
+    ASSERT_FLOAT_EQ(oct_.interp(p, select), lin_.interp(p, select));
+    const Eigen::Vector3f g = oct_.grad(p, select);
+    const Eigen::Vector3f lg = lin_.grad(p, select);
+    for(int i = 0; i < 3; ++i) ASSERT_NEAR(g(i), lg(i), 1e-3f * std::abs(g(i)));
+  }
+}
+
+TEST_F(LinearOctreeTest, Insert) {
+  const Eigen::Vector3i p(3, 500, 257);
+  se::VoxelBlock<testT> * b = lin_.insert(p(0), p(1), p(2));
+  ASSERT_TRUE(b != NULL);
+  ASSERT_TRUE(b == lin_.fetch(p(0), p(1), p(2)));
+  ASSERT_TRUE(b->coordinates() == Eigen::Vector3i(0, 496, 256));
+  lin_.set(p(0), p(1), p(2), 42.f);
+  ASSERT_EQ(lin_.get(p(0), p(1), p(2)), 42.f);
+}
+
+TEST_F(LinearOctreeTest, InsertMany) {
+  // Enough single block insertions to go through several merges of the 
+  // side arrays, interleaved with small batches.
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<> coord(0, oct_.size() - 1);
+  for(int i = 0; i < 20000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    if(i % 100 == 0) {
+      se::key_t keys[2] = {oct_.hash(x, y, z), oct_.hash(y, z, x)};
+      se::key_t keys_lin[2] = {keys[0], keys[1]};
+      oct_.allocate(keys, 2);
+      lin_.allocate(keys_lin, 2);
+      continue;
+    }
+    oct_.insert(x, y, z);
+    se::VoxelBlock<testT> * b = lin_.insert(x, y, z);
+    ASSERT_TRUE(b == lin_.fetch(x, y, z));
+    ASSERT_TRUE(b->active());
+  }
+
+  ASSERT_EQ(oct_.getBlockBuffer().size(), lin_.leavesCount());
+  ASSERT_EQ(oct_.getNodesBuffer().size(), lin_.nodeCount());
+  std::vector<se::VoxelBlock<testT>*> blocks;
+  lin_.getBlockList(blocks, false);
+  ASSERT_EQ(blocks.size(), lin_.leavesCount());
+  for(unsigned int i = 1; i < blocks.size(); ++i) {
+    ASSERT_LT(blocks[i - 1]->code_, blocks[i]->code_);
+  }
+  auto& nodes = oct_.getNodesBuffer();
+  for(unsigned int i = 0; i < nodes.size(); ++i) {
+    const se::Node<testT> * n = nodes[i];
+    const Eigen::Vector3i c = se::keyops::decode(n->code_);
+    const se::LinearNode<testT> * ln = lin_.fetch_octant(c(0), c(1), c(2), 
+        se::keyops::level(n->code_));
+    ASSERT_TRUE(ln != NULL);
+    ASSERT_EQ(ln->children_mask_, n->children_mask_);
+  }
+  for(int i = 0; i < 100000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    ASSERT_EQ(oct_.get(x, y, z), lin_.get(x, y, z));
+    ASSERT_EQ(oct_.fetch(x, y, z) != NULL, lin_.fetch(x, y, z) != NULL);
+  }
+}
+
+TEST_F(LinearOctreeTest, Cursor) {
+  const se::LinearOctree<testT>::cursor_type cursor(lin_);
+  std::mt19937 gen(5);
+  std::uniform_int_distribution<> coord(0, oct_.size() - 1);
+  for(int i = 0; i < 100000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    ASSERT_EQ(cursor.fetch(x, y, z), lin_.fetch(x, y, z));
+    ASSERT_EQ(cursor.get(x, y, z), lin_.get(x, y, z));
+    ASSERT_EQ(cursor.get_fine(x, y, z), lin_.get_fine(x, y, z));
+  }
+}
+
+TEST_F(LinearOctreeTest, RayIterator) {
+  std::mt19937 gen(4);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+  const Eigen::Vector3f origin = Eigen::Vector3f::Constant(oct_.dim() / 2);
+  for(int i = 0; i < 1000; ++i) {
+    const Eigen::Vector3f dir = 
+      Eigen::Vector3f(unit(gen), unit(gen), unit(gen)).normalized();
+    se::ray_iterator<testT> oct_ray(oct_, origin, dir, 0.1f, 20.f);
+    se::LinearOctree<testT>::ray_iterator_type lin_ray(lin_, origin, dir, 
+        0.1f, 20.f);
+    se::VoxelBlock<testT> * ob, * lb;
+    while((ob = oct_ray.next())) {
+      lb = lin_ray.next();
+      ASSERT_TRUE(lb != NULL);
+      ASSERT_EQ(ob->code_, lb->code_);
+    }
+    ASSERT_TRUE(lin_ray.next() == NULL);
+  }
+}
+
+TEST_F(LinearOctreeTest, SaveLoad) {
+  const std::string filename = "linear_octree_unittest.bin";
+  lin_.save(filename);
+  se::LinearOctree<testT> loaded;
+  loaded.load(filename);
+  std::remove(filename.c_str());
+  ASSERT_EQ(loaded.leavesCount(), lin_.leavesCount());
+  ASSERT_EQ(loaded.nodeCount(), lin_.nodeCount());
+  std::mt19937 gen(6);
+  std::uniform_int_distribution<> coord(0, oct_.size() - 1);
+  for(int i = 0; i < 100000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    ASSERT_EQ(loaded.get(x, y, z), lin_.get(x, y, z));
+  }
+}
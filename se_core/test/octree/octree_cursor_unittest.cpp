@@ -0,0 +1,138 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include "octree.hpp"
+#include "octree_cursor.hpp"
+#include "hash_map.hpp"
+#include "utils/math_utils.h"
+#include "gtest/gtest.h"
+#include "functors/axis_aligned_functor.hpp"
+#include <random>
+
+typedef float testT;
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+class OctreeCursorTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      const unsigned size = 512;
+      const float dim = 10.f;
+      oct_.init(size, dim);
+      map_.init(size, dim);
+
+      // Clustered blocks so that neighbouring queries share deep ancestors
+      std::mt19937 gen(1);
+      std::uniform_int_distribution<> centre(0, size - 1);
+      std::normal_distribution<float> spread(0.f, 24.f);
+      const int block_level = log2(size) - log2(se::Octree<testT>::blockSide);
+      std::vector<se::key_t> keys;
+      for(int c = 0; c < 8; ++c) {
+        const Eigen::Vector3f o(centre(gen), centre(gen), centre(gen));
+        for(int i = 0; i < 200; ++i) {
+          const Eigen::Vector3i v = (o + Eigen::Vector3f(spread(gen), 
+                spread(gen), spread(gen))).cast<int>().cwiseMax(0).cwiseMin(size - 1);
+          keys.push_back(oct_.hash(v(0), v(1), v(2), block_level));
+        }
+      }
+      std::vector<se::key_t> keys_map = keys;
+      oct_.allocate(keys.data(), keys.size());
+      map_.allocate(keys_map.data(), keys_map.size());
+
+      auto fill = [](auto& handler, const Eigen::Vector3i& v) {
+        handler.set(v(0) + 1000.f * v(1) + 1000000.f * v(2));
+      };
+      se::functor::axis_aligned_map(oct_, fill);
+      se::functor::axis_aligned_map(map_, fill);
+    }
+
+  se::Octree<testT> oct_;
+  se::HashMap<testT> map_;
+};
+
+TEST_F(OctreeCursorTest, RandomQueries) {
+  se::Octree<testT>::cursor_type cursor(oct_);
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<> coord(0, oct_.size() - 1);
+  std::uniform_int_distribution<> depth(0, se::Octree<testT>::max_depth);
+  for(int i = 0; i < 100000; ++i) {
+    const int x = coord(gen), y = coord(gen), z = coord(gen);
+    const int d = depth(gen);
+    ASSERT_EQ(oct_.fetch(x, y, z), cursor.fetch(x, y, z));
+    ASSERT_EQ(oct_.fetch_octant(x, y, z, d), cursor.fetch_octant(x, y, z, d));
+    ASSERT_EQ(oct_.get(x, y, z), cursor.get(x, y, z));
+    ASSERT_EQ(oct_.get_fine(x, y, z), cursor.get_fine(x, y, z));
+  }
+}
+
+TEST_F(OctreeCursorTest, RayWalk) {
+  se::Octree<testT>::cursor_type cursor(oct_);
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> unit(-1.f, 1.f);
+  std::uniform_int_distribution<> depth(0, se::Octree<testT>::max_depth);
+  const Eigen::Vector3f origin = Eigen::Vector3f::Constant(oct_.size() / 2);
+  auto select = [](const auto& val) { return val; };
+  for(int i = 0; i < 200; ++i) {
+    const Eigen::Vector3f dir = 
+      Eigen::Vector3f(unit(gen), unit(gen), unit(gen)).normalized();
+    for(float t = 0.f; t < oct_.size(); t += 0.7f) {
+      const Eigen::Vector3f p = origin + t * dir;
+      if((p.array() < 0.f).any() || (p.array() >= oct_.size() - 1).any()) break;
+      const Eigen::Vector3i v = p.cast<int>();
+      const int d = depth(gen);
+      ASSERT_EQ(oct_.fetch(v(0), v(1), v(2)), cursor.fetch(v(0), v(1), v(2)));
+      ASSERT_EQ(oct_.fetch_octant(v(0), v(1), v(2), d), 
+          cursor.fetch_octant(v(0), v(1), v(2), d));
+      ASSERT_EQ(oct_.get(v(0), v(1), v(2)), cursor.get(v(0), v(1), v(2)));
+      ASSERT_FLOAT_EQ(oct_.interp(p, select), cursor.interp(p, select));
+    }
+  }
+}
+
+TEST_F(OctreeCursorTest, HashCursor) {
+  se::HashMap<testT>::cursor_type cursor(map_);
+  std::mt19937 gen(4);
+  std::uniform_int_distribution<> coord(0, map_.size() - 1);
+  std::uniform_int_distribution<> step(-2, 2);
+  Eigen::Vector3i v(coord(gen), coord(gen), coord(gen));
+  for(int i = 0; i < 100000; ++i) {
+    // Mix jumps with short steps to exercise the cached block
+    if(i % 100 == 0) v = Eigen::Vector3i(coord(gen), coord(gen), coord(gen));
+    else v = (v + Eigen::Vector3i(step(gen), step(gen), step(gen))).cwiseMax(0)
+      .cwiseMin(map_.size() - 1);
+    ASSERT_EQ(map_.fetch(v(0), v(1), v(2)), cursor.fetch(v(0), v(1), v(2)));
+    ASSERT_EQ(map_.get_fine(v(0), v(1), v(2)), 
+        cursor.get_fine(v(0), v(1), v(2)));
+  }
+}
@@ -32,6 +32,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "gtest/gtest.h"
 #include "octant_ops.hpp"
 #include <bitset>
+#include <random>
 
 TEST(Octree, OctantFaceNeighbours) {
   const Eigen::Vector3i octant = {112, 80, 160};
@@ -215,3 +216,119 @@ TEST(Octree, OctantSiblings) {
     ASSERT_TRUE(parent(s[i], max_depth) == parent(cell, max_depth));
   }
 }
+
+TEST(Octree, MortonArithmetic) {
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> dis(-4096, 4095);
+  const int wrap = (1 << MAX_BITS) - 1;
+  for(int i = 0; i < 1000; ++i) {
+    const Eigen::Vector3i a(dis(gen), dis(gen), dis(gen));
+    const Eigen::Vector3i b(dis(gen), dis(gen), dis(gen));
+    const se::key_t ka = compute_morton(a(0), a(1), a(2));
+    const se::key_t kb = compute_morton(b(0), b(1), b(2));
+    const Eigen::Vector3i sum = a + b;
+    const Eigen::Vector3i diff = a - b;
+    ASSERT_EQ(se::keyops::add(ka, kb), 
+        compute_morton(sum(0) & wrap, sum(1) & wrap, sum(2) & wrap));
+    ASSERT_EQ(se::keyops::sub(ka, kb), 
+        compute_morton(diff(0) & wrap, diff(1) & wrap, diff(2) & wrap));
+  }
+}
+
+TEST(Octree, OctantNeighbour) {
+  const int max_depth = 8;
+  const int level = 5;
+  const int side = 1 << (max_depth - level);
+  const Eigen::Vector3i octant = {112, 0, 248};
+  const se::key_t key = 
+    se::keyops::encode(octant(0), octant(1), octant(2), level, max_depth);
+  for(int dz = -2; dz <= 2; ++dz)
+    for(int dy = -2; dy <= 2; ++dy)
+      for(int dx = -2; dx <= 2; ++dx) {
+        const Eigen::Vector3i p = octant + side * Eigen::Vector3i(dx, dy, dz);
+        const bool in = (p.array() >= 0).all() && 
+          (p.array() < (1 << max_depth)).all();
+        const se::key_t n = se::keyops::neighbour(key, dx, dy, dz, max_depth);
+        ASSERT_EQ(in, se::keyops::inside(n, max_depth));
+        if(in) ASSERT_EQ(n, se::keyops::encode(p(0), p(1), p(2), level, 
+              max_depth));
+      }
+}
+
+TEST(Octree, OctantNeighbours26) {
+  const int max_depth = 5;
+  const int size = 1 << max_depth;
+  for(int level = 1; level <= 3; ++level) {
+    const int side = 1 << (max_depth - level);
+    for(int z = 0; z < size; z += side)
+      for(int y = 0; y < size; y += side)
+        for(int x = 0; x < size; x += side) {
+          const se::key_t key = se::keyops::encode(x, y, z, level, max_depth);
+          se::key_t expected[26];
+          int num_expected = 0;
+          for(int dz = -1; dz <= 1; ++dz)
+            for(int dy = -1; dy <= 1; ++dy)
+              for(int dx = -1; dx <= 1; ++dx) {
+                const Eigen::Vector3i p = 
+                  Eigen::Vector3i(x, y, z) + side * Eigen::Vector3i(dx, dy, dz);
+                if((dx == 0 && dy == 0 && dz == 0) || (p.array() < 0).any() ||
+                    (p.array() >= size).any()) continue;
+                expected[num_expected++] = 
+                  se::keyops::encode(p(0), p(1), p(2), level, max_depth);
+              }
+          se::key_t N[26];
+          ASSERT_EQ(neighbours(N, key, max_depth), num_expected);
+          for(int i = 0; i < num_expected; ++i) ASSERT_EQ(N[i], expected[i]);
+        }
+  }
+}
+
+TEST(Octree, FarEdgeOctantExteriorNeighbours) {
+  const int max_depth = 5;
+  const int level = 2;
+  const se::key_t cell = se::keyops::encode(24, 16, 24, level, max_depth);
+  se::key_t N[7];
+  exterior_neighbours(N, cell, level, max_depth);
+  
+  const se::key_t neighbours_gt[7] = 
+    {se::keyops::encode(24, 16, 24, level, max_depth),
+     se::keyops::encode(24, 8, 24, level, max_depth),
+     se::keyops::encode(24, 8, 24, level, max_depth),
+     se::keyops::encode(24, 16, 24, level, max_depth),
+     se::keyops::encode(24, 16, 24, level, max_depth),
+     se::keyops::encode(24, 8, 24, level, max_depth),
+     se::keyops::encode(24, 8, 24, level, max_depth)};
+  for(int i = 0; i < 7; ++i) {
+    ASSERT_TRUE(se::keyops::inside(N[i], max_depth));
+    ASSERT_EQ(neighbours_gt[i], N[i]);
+  }
+}
+
+TEST(Octree, ExteriorNeighboursAwayFromSiblings) {
+  const int max_depth = 5;
+  const int size = 1 << max_depth;
+  const int level = 2;
+  const int side = 1 << (max_depth - level);
+  for(int z = 0; z < size; z += side)
+    for(int y = 0; y < size; y += side)
+      for(int x = 0; x < size; x += side) {
+        const Eigen::Vector3i c(x, y, z);
+        const se::key_t cell = se::keyops::encode(x, y, z, level, max_depth);
+        const int idx = child_id(cell, level, max_depth);
+        se::key_t N[7];
+        exterior_neighbours(N, cell, level, max_depth);
+        for(int i = 0; i < 7; ++i) {
+          /* N[i] moves along the axes set in i + 1 */
+          Eigen::Vector3i p = c;
+          for(int d = 0; d < 3; ++d) {
+            if(!((i + 1) & (1 << d))) continue;
+            const int step = (idx & (1 << d)) ? side : -side;
+            if(c(d) + step >= 0 && c(d) + step < size) p(d) += step;
+          }
+          ASSERT_EQ(N[i], se::keyops::encode(p(0), p(1), p(2), level, 
+                max_depth));
+          ASSERT_FALSE(parent(N[i], max_depth) == parent(cell, max_depth) &&
+              N[i] != cell);
+        }
+      }
+}
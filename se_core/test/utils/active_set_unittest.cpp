@@ -0,0 +1,116 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <algorithm>
+#include <thread>
+#include "octree.hpp"
+#include "utils/active_set.hpp"
+#include "gtest/gtest.h"
+
+typedef float testT;
+
+template <>
+struct voxel_traits<testT> {
+  typedef float value_type;
+  static inline value_type empty(){ return 0.f; }
+  static inline value_type initValue(){ return 0.f; }
+};
+
+TEST(ActiveSet, InsertErase) {
+  se::active_set set;
+  ASSERT_TRUE(set.insert(3));
+  ASSERT_FALSE(set.insert(3));
+  ASSERT_TRUE(set.insert(70000));
+  ASSERT_TRUE(set.contains(3));
+  ASSERT_FALSE(set.contains(4));
+  ASSERT_TRUE(set.erase(3));
+  ASSERT_FALSE(set.erase(3));
+  ASSERT_FALSE(set.erase(123456));
+  ASSERT_EQ(set.slots(), std::vector<unsigned int>({70000}));
+
+  // Erased then inserted again before the list is compacted
+  ASSERT_TRUE(set.erase(70000));
+  ASSERT_TRUE(set.insert(70000));
+  ASSERT_TRUE(set.insert(3));
+  std::vector<unsigned int> slots = set.slots();
+  std::sort(slots.begin(), slots.end());
+  ASSERT_EQ(slots, std::vector<unsigned int>({3, 70000}));
+
+  set.clear();
+  ASSERT_FALSE(set.contains(70000));
+  ASSERT_TRUE(set.slots().empty());
+}
+
+TEST(ActiveSet, ConcurrentInsert) {
+  se::active_set set;
+  const int num_threads = 4;
+  const unsigned int num_slots = 20000;
+  std::vector<std::thread> threads;
+  for(int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&set, t]() {
+      // Threads overlap on every other slot
+      for(unsigned int i = t % 2; i < num_slots; i += 2) set.insert(i);
+    });
+  }
+  for(auto& t : threads) t.join();
+  std::vector<unsigned int> slots = set.slots();
+  std::sort(slots.begin(), slots.end());
+  ASSERT_EQ(slots.size(), num_slots);
+  for(unsigned int i = 0; i < num_slots; ++i) ASSERT_EQ(slots[i], i);
+}
+
+TEST(ActiveSet, TracksOctreeBlocks) {
+  se::Octree<testT> oct;
+  oct.init(256, 5.f);
+  std::vector<se::key_t> keys;
+  for(int z = 0; z < 64; z += 8)
+    for(int x = 0; x < 256; x += 8)
+      keys.push_back(oct.hash(x, 0, z));
+  oct.allocate(keys.data(), keys.size());
+
+  std::vector<se::VoxelBlock<testT>*> active;
+  oct.getBlockList(active, true);
+  ASSERT_EQ(active.size(), keys.size());
+  for(auto block : active) {
+    ASSERT_TRUE(block->active());
+    ASSERT_EQ(oct.getBlockBuffer()[block->slot()], block);
+  }
+
+  // Deactivated and released blocks leave the set
+  oct.deactivate(oct.fetch(0, 0, 0));
+  oct.deallocate(128, 0, 0, 1);
+  active.clear();
+  oct.getBlockList(active, true);
+  ASSERT_EQ(active.size(), keys.size() / 2 - 1);
+  for(auto block : active) {
+    ASSERT_TRUE(block->active());
+    ASSERT_LT(block->coordinates()(0), 128);
+  }
+}
@@ -0,0 +1,98 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <cmath>
+#include <vector>
+#include "utils/isa.hpp"
+#include "utils/simd.hpp"
+#include "gtest/gtest.h"
+
+template <int W>
+SE_SIMD_INLINE void log2_lanes(const std::vector<float>& in, std::vector<float>& out) {
+  typedef se::simd::vfloat<W> vfloat;
+  for(unsigned i = 0; i < in.size(); i += W) 
+    se::simd::log2(vfloat::load(in.data() + i)).store(out.data() + i);
+}
+
+#ifdef SE_SIMD_X86
+SE_SIMD_AVX2 static void log2_avx2(const std::vector<float>& in, 
+    std::vector<float>& out) {
+  log2_lanes<8>(in, out);
+}
+
+SE_SIMD_AVX512 static void log2_avx512(const std::vector<float>& in, 
+    std::vector<float>& out) {
+  log2_lanes<16>(in, out);
+}
+#endif
+
+TEST(ISA, NamesRoundTrip) {
+  for(se::isa::level l : {se::isa::level::generic, se::isa::level::sse42, 
+      se::isa::level::avx2, se::isa::level::avx512}) {
+    se::isa::level parsed;
+    ASSERT_TRUE(se::isa::parse(se::isa::name(l), parsed));
+    ASSERT_EQ(parsed, l);
+  }
+  se::isa::level parsed = se::isa::level::avx2;
+  ASSERT_FALSE(se::isa::parse("neon", parsed));
+  ASSERT_EQ(parsed, se::isa::level::avx2);
+}
+
+TEST(ISA, SelectedIsSupported) {
+  ASSERT_LE(se::isa::selected(), se::isa::detect());
+}
+
+TEST(ISA, WideLanesWithoutCompilerFlags) {
+  std::vector<float> in(64), out(64, 0.f);
+  for(unsigned i = 0; i < in.size(); ++i) in[i] = 0.03f + 0.5f * i;
+  log2_lanes<1>(in, out);
+  for(unsigned i = 0; i < in.size(); ++i) 
+    ASSERT_NEAR(out[i], std::log2(in[i]), 1e-5f);
+
+#ifdef SE_SIMD_X86
+  const se::isa::level detected = se::isa::detect();
+  if(detected >= se::isa::level::avx2) {
+    std::vector<float> wide(64, 0.f);
+    log2_avx2(in, wide);
+    for(unsigned i = 0; i < in.size(); ++i) ASSERT_FLOAT_EQ(wide[i], out[i]);
+  }
+  if(detected >= se::isa::level::avx512) {
+    std::vector<float> wide(64, 0.f);
+    log2_avx512(in, wide);
+    for(unsigned i = 0; i < in.size(); ++i) ASSERT_FLOAT_EQ(wide[i], out[i]);
+  }
+#endif
+}
+
+TEST(ISA, FastBMI2FollowsSelected) {
+  if(se::isa::selected() < se::isa::level::avx2) {
+    ASSERT_FALSE(se::isa::fast_bmi2());
+  }
+}
@@ -0,0 +1,81 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "utils/key_buffer.hpp"
+#include "gtest/gtest.h"
+
+typedef uint64_t key_type;
+
+TEST(KeyBuffer, DropsRepeatedKeys) {
+  se::key_buffer<key_type> keys;
+  keys.clear();
+  se::key_buffer<key_type>::local& local = keys.thread_buffer();
+  for(int r = 0; r < 50; ++r) {
+    for(key_type k = 1; k <= 100; ++k) local.push(k << 6 | 3);
+  }
+  std::vector<key_type> out;
+  ASSERT_EQ(keys.merge(out), 100u);
+  std::sort(out.begin(), out.end());
+  ASSERT_TRUE(std::unique(out.begin(), out.end()) == out.end());
+
+  keys.clear();
+  ASSERT_EQ(keys.merge(out), 0u);
+  ASSERT_TRUE(out.empty());
+}
+
+TEST(KeyBuffer, KeepsEveryKey) {
+  // Many more distinct keys than table entries: repeated keys may come
+  // through again, but no key is ever lost
+  se::key_buffer<key_type> keys;
+  keys.clear();
+  se::key_buffer<key_type>::local& local = keys.thread_buffer();
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<key_type> dist(0, 20000);
+  std::vector<key_type> pushed;
+  for(int i = 0; i < 100000; ++i) {
+    const key_type k = dist(gen) << 6 | 5;
+    pushed.push_back(k);
+    local.push(k);
+  }
+  std::vector<key_type> out;
+  const size_t n = keys.merge(out);
+  ASSERT_EQ(n, out.size());
+  ASSERT_LT(n, pushed.size());
+
+  std::sort(pushed.begin(), pushed.end());
+  pushed.erase(std::unique(pushed.begin(), pushed.end()), pushed.end());
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  ASSERT_EQ(out, pushed);
+}
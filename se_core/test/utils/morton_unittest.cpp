@@ -29,6 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 #include <random>
+#include <vector>
 #include "utils/math_utils.h"
 #include "utils/morton_utils.hpp"
 #include "octree_defines.h"
@@ -65,3 +66,49 @@ TEST(MortonCoding, ExhaustiveTest) {
   }
 }
 
+
+TEST(MortonCoding, BatchMatchesSingle) {
+
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<int> dis(0, (1 << 21) - 1);
+  const std::size_t n = 1003;
+  std::vector<Eigen::Vector3i> coords(n);
+  for(auto& c : coords) c = Eigen::Vector3i(dis(gen), dis(gen), dis(gen));
+  coords[0] = Eigen::Vector3i::Zero();
+  coords[1] = Eigen::Vector3i::Constant((1 << 21) - 1);
+
+  std::vector<se::key_t> expected(n);
+  for(std::size_t i = 0; i < n; ++i) 
+    expected[i] = compute_morton(coords[i](0), coords[i](1), coords[i](2));
+
+  std::vector<se::key_t> keys(n);
+  std::vector<Eigen::Vector3i> decoded(n);
+  auto check = [&]() {
+    for(std::size_t i = 0; i < n; ++i) {
+      ASSERT_EQ(keys[i], expected[i]);
+      ASSERT_EQ(decoded[i], coords[i]);
+    }
+  };
+
+  compute_morton(coords.data(), n, keys.data());
+  unpack_morton(keys.data(), n, decoded.data());
+  check();
+
+  se::morton::encode_magic(coords.data(), n, keys.data());
+  se::morton::decode_magic(keys.data(), n, decoded.data());
+  check();
+
+#if defined(SE_SIMD_X86)
+  if(se::isa::detect() >= se::isa::level::avx2) {
+    se::morton::encode_avx2(coords.data(), n, keys.data());
+    se::morton::decode_avx2(keys.data(), n, decoded.data());
+    check();
+  }
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("bmi2")) {
+    se::morton::encode_bmi2(coords.data(), n, keys.data());
+    se::morton::decode_bmi2(keys.data(), n, decoded.data());
+    check();
+  }
+#endif
+}
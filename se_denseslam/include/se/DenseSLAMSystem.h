@@ -39,11 +39,17 @@
 #include <se/commons.h>
 #include <iostream>
 #include <memory>
+#include <tuple>
 #include <perfstats.h>
 #include <timings.h>
 #include <se/config.h>
 #include <se/octree.hpp>
+#include <se/hash_map.hpp>
+#include <se/linear_octree.hpp>
 #include <se/image/image.hpp>
+#include <se/image/depth_pyramid.hpp>
+#include <se/utils/isa.hpp>
+#include <se/utils/key_buffer.hpp>
 #include "volume_traits.hpp"
 #include "continuous/volume_template.hpp"
 #include <Eigen/Dense>
@@ -52,8 +58,116 @@
  * Use SE_FIELD_TYPE macro to define the DenseSLAMSystem instance.
  */
 typedef SE_FIELD_TYPE FieldType;
-template <typename T>
-using Volume = VolumeTemplate<T, se::Octree>;
+
+/*
+ * Use SE_HASH_MAP macro to index the voxel blocks with a hash table instead
+ * of an octree, SE_LINEAR_OCTREE with a linear octree.
+ */
+#ifdef SE_HASH_MAP
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+using DiscreteMap = se::HashMap<T, BlockSide>;
+#elif defined(SE_LINEAR_OCTREE)
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+using DiscreteMap = se::LinearOctree<T, BlockSide>;
+#else
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+using DiscreteMap = se::Octree<T, BlockSide>;
+#endif
+
+template <typename T, unsigned int BlockSide = BLOCK_SIDE>
+using Volume = VolumeTemplate<T, DiscreteMap, BlockSide>;
+
+/*
+ * Collapse the uniform blocks among those that left the view since the last
+ * call, see se::Octree::prune. Blocks in view are updated every frame, and 
+ * would be restored by the next allocation if collapsed. last_active holds
+ * the slots of the blocks active at the last call. The other map backends 
+ * do not support pruning and release nothing.
+ */
+template <typename T, unsigned int BlockSide, typename EqualF>
+int prune_map(se::Octree<T, BlockSide>& map, 
+    std::vector<unsigned int>& last_active, EqualF equal) {
+  auto& pool = map.getBlockBuffer();
+  std::vector<se::VoxelBlock<T, BlockSide>*> left;
+  for(const unsigned int slot : last_active) {
+    // Slots released since the last call may hold another block by now
+    if(slot < pool.size() && pool.used(slot) && !pool[slot]->active()) 
+      left.push_back(pool[slot]);
+  }
+  const std::vector<unsigned int>& active = map.activeBlocks().slots();
+  last_active.assign(active.begin(), active.end());
+  return map.prune(left, equal);
+}
+
+template <typename MapT, typename EqualF>
+int prune_map(MapT&, std::vector<unsigned int>&, EqualF) {
+  return 0;
+}
+
+/*
+ * Memory the map would use for the octants currently collapsed by pruning.
+ * A node is only collapsed once its eight children are, hence each collapsed
+ * octant stands for its whole subtree, down to the voxel blocks.
+ */
+template <typename T, unsigned int BlockSide>
+size_t pruned_memory(se::Octree<T, BlockSide>& map) {
+  const auto& nodes = map.getNodesBuffer();
+  size_t num_nodes = 0;
+  size_t num_blocks = 0;
+  for(unsigned int i = 0; i < nodes.size(); ++i) {
+    if(!nodes.used(i) || !nodes[i]->pruned_mask_) continue;
+    // Nodes and blocks below a collapsed child of this node
+    size_t subtree_nodes = 0;
+    size_t subtree_blocks = 1;
+    for(unsigned int side = nodes[i]->side_ / 2; side > BlockSide; side /= 2) {
+      subtree_nodes += subtree_blocks;
+      subtree_blocks *= 8;
+    }
+    const int collapsed = __builtin_popcount(nodes[i]->pruned_mask_);
+    num_nodes += collapsed * subtree_nodes;
+    num_blocks += collapsed * subtree_blocks;
+  }
+  return num_nodes * sizeof(se::Node<T, BlockSide>) + 
+    num_blocks * sizeof(se::VoxelBlock<T, BlockSide>);
+}
+
+template <typename MapT>
+size_t pruned_memory(const MapT&) {
+  return 0;
+}
+
+/*
+ * Map and continuous volume instantiated for a given voxel block side.
+ */
+template <unsigned int BlockSide>
+struct VolumeInstance {
+  std::shared_ptr<DiscreteMap<FieldType, BlockSide> > map;
+  Volume<FieldType, BlockSide> volume;
+  // Slots of the blocks active at the last prune_map
+  std::vector<unsigned int> last_active;
+
+  void init(const unsigned int size, const float dim) {
+    last_active.clear();
+    map = std::make_shared<DiscreteMap<FieldType, BlockSide> >();
+    map->init(size, dim);
+    volume = Volume<FieldType, BlockSide>(size, dim, map.get());
+  }
+
+  size_t memory() const {
+    if(!map) return 0;
+    // Released slots, e.g. by pruning, are kept for reuse but not counted
+    const auto& nodes = map->getNodesBuffer();
+    const auto& blocks = map->getBlockBuffer();
+    return (nodes.size() - nodes.free_count()) * 
+             sizeof(se::Node<FieldType, BlockSide>) + 
+           (blocks.size() - blocks.free_count()) * 
+             sizeof(se::VoxelBlock<FieldType, BlockSide>);
+  }
+
+  size_t pruned() const {
+    return map ? pruned_memory(*map) : 0;
+  }
+};
 
 class DenseSLAMSystem {
 
@@ -78,9 +192,39 @@ class DenseSLAMSystem {
     se::Image<Eigen::Vector3f> vertex_;
     se::Image<Eigen::Vector3f> normal_;
 
+    // Keys of the octants to allocate, gathered per thread then merged
+    se::key_buffer<se::key_t> allocation_keys_;
     std::vector<se::key_t> allocation_list_;
-    std::shared_ptr<se::Octree<FieldType> > discrete_vol_ptr_;
-    Volume<FieldType> volume_;
+
+    // The pipeline is compiled for every supported voxel block side, the one
+    // in use is selected at runtime from Configuration::voxel_block_size.
+    unsigned int block_side_;
+    std::tuple<VolumeInstance<4>, VolumeInstance<8>, VolumeInstance<16> > 
+      volumes_;
+
+    /*
+     * Invoke f on the VolumeInstance matching the selected block side.
+     */
+    template <typename F>
+    void dispatch(F f) {
+      switch(block_side_) {
+        case 4:
+          f(std::get<VolumeInstance<4> >(volumes_));
+          break;
+        case 16:
+          f(std::get<VolumeInstance<16> >(volumes_));
+          break;
+        default:
+          f(std::get<VolumeInstance<8> >(volumes_));
+      }
+    }
+
+    // Instruction set the hot kernels run with, see se::isa::selected().
+    se::isa::level isa_;
+
+    // Pruning of occupancy maps, see Configuration::prune.
+    bool prune_;
+    float prune_tolerance_;
 
     // intra-frame
     std::vector<float> reduction_output_;
@@ -88,6 +232,8 @@ class DenseSLAMSystem {
     std::vector<se::Image<Eigen::Vector3f> > input_vertex_;
     std::vector<se::Image<Eigen::Vector3f> > input_normal_;
     se::Image<float> float_depth_;
+    // Depth range of the tiles of float_depth_, for integration early-outs
+    se::depth_pyramid depth_tiles_;
     std::vector<TrackData>  tracking_result_;
     Eigen::Matrix4f old_pose_;
     Eigen::Matrix4f raycast_pose_;
@@ -289,11 +435,56 @@ class DenseSLAMSystem {
     // Getters
     //
 
-    /*
-     * TODO Document this.
+    /**
+     * Get the map holding the reconstruction.
+     *
+     * \param[out] out The map, or a null pointer when the pipeline runs
+     * with a voxel block side other than BlockSide.
+     */
+    template <unsigned int BlockSide>
+    void getMap(std::shared_ptr<DiscreteMap<FieldType, BlockSide> >& out) {
+      out = std::get<VolumeInstance<BlockSide> >(volumes_).map;
+    }
+
+    /**
+     * Get the side of the voxel blocks in voxels.
+     *
+     * \return The block side selected by Configuration::voxel_block_size.
+     */
+    unsigned int getBlockSide() const {
+      return block_side_;
+    }
+
+    /**
+     * Get the instruction set the hot kernels run with.
+     *
+     * \return The name of the level, see se::isa::name.
+     */
+    const char * getKernelISA() const {
+      return se::isa::name(isa_);
+    }
+
+    /**
+     * Get the memory used by the allocated map nodes and voxel blocks.
+     *
+     * \return The allocated memory in bytes.
+     */
+    size_t getMapMemory() {
+      size_t bytes = 0;
+      dispatch([&bytes](const auto& v) { bytes = v.memory(); });
+      return bytes;
+    }
+
+    /**
+     * Get the memory saved by pruning, i.e. used by the nodes and voxel 
+     * blocks currently collapsed.
+     *
+     * \return The saved memory in bytes.
      */
-    void getMap(std::shared_ptr<se::Octree<FieldType> >& out) {
-      out = discrete_vol_ptr_;
+    size_t getPrunedMemory() {
+      size_t bytes = 0;
+      dispatch([&bytes](const auto& v) { bytes = v.pruned(); });
+      return bytes;
     }
 
     /*
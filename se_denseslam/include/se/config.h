@@ -83,8 +83,36 @@ struct Configuration {
    */
   Eigen::Vector3f volume_size;
 
+  /**
+   * The number of voxels per side of a voxel block. Supported values are 4,
+   * 8 and 16.
+   * <br>\em Default: 8
+   */
   int voxel_block_size;
 
+  /**
+   * Whether the benchmark should run the sequence once for every supported
+   * voxel block size and report memory usage and per-stage timings.
+   * <br>\em Default: false
+   */
+  bool block_size_sweep;
+
+  /**
+   * Collapse the uniform voxel blocks of occupancy maps once they leave the
+   * view, see se::Octree::prune. Only the se::Octree map backend supports 
+   * pruning.
+   * <br>\em Default: false
+   */
+  bool prune;
+
+  /**
+   * Largest occupancy log-odds difference between voxels that pruning 
+   * still considers equal, provided their timestamps match. 0 requires 
+   * bitwise equal voxels, i.e. lossless pruning.
+   * <br>\em Default: 0
+   */
+  float prune_tolerance;
+
   /*
    * TODO
    * <br>\em Default: (0.5, 0.5, 0)
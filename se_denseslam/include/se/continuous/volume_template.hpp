@@ -34,6 +34,7 @@
 #include <se/voxel_traits.hpp>
 #include <se/utils/memory_pool.hpp>
 #include <se/octree.hpp>
+#include <se/hash_map.hpp>
 #include <type_traits>
 #include <cstring>
 #include <Eigen/Dense>
@@ -46,16 +47,21 @@ class Void {};
  * Sparse, dynamically allocated storage accessed through the 
  * appropriate indexer (octree/hash table).
  * */ 
-template <typename FieldType, template<typename> class DiscreteMapT> 
+template <typename FieldType, 
+          template<typename, unsigned int> class DiscreteMapT,
+          unsigned int BlockSide = BLOCK_SIDE> 
 class VolumeTemplate {
 
   public:
     typedef voxel_traits<FieldType> traits_type;
     typedef typename traits_type::value_type value_type;
     typedef FieldType field_type;
+    typedef DiscreteMapT<FieldType, BlockSide> map_type;
+    typedef typename map_type::cursor_type cursor_type;
 
     VolumeTemplate(){};
-    VolumeTemplate(unsigned int s, float d, DiscreteMapT<FieldType>* m) :
+    VolumeTemplate(unsigned int s, float d, 
+        DiscreteMapT<FieldType, BlockSide>* m) :
       _map_index(m) {
         _size = s;
         _dim = d;
@@ -82,6 +88,17 @@ class VolumeTemplate {
                                     scaled_pos.z());
     }
 
+    /*! \brief Same as get, resolving the query through a cursor bound to 
+     * this volume's map so that successive nearby queries are cheaper.
+     */
+    value_type get(const Eigen::Vector3f & p, const cursor_type& cursor) const {
+      const float inverseVoxelSize = _size/_dim;
+      const Eigen::Vector4i scaled_pos = (inverseVoxelSize * p.homogeneous()).cast<int>();
+        return cursor.get_fine(scaled_pos.x(), 
+                               scaled_pos.y(), 
+                               scaled_pos.z());
+    }
+
     value_type operator[](const Eigen::Vector3f p) const {
       return _map_index->get(p.x(), p.y(), p.z());
     }
@@ -93,6 +110,14 @@ class VolumeTemplate {
       return _map_index->interp(discrete_pos, select);
     }
 
+    template <typename FieldSelector>
+    float interp(const Eigen::Vector3f& pos, FieldSelector select, 
+        const cursor_type& cursor) const {
+      const float inverseVoxelSize = _size / _dim;
+      Eigen::Vector3f discrete_pos = inverseVoxelSize * pos;
+      return cursor.interp(discrete_pos, select);
+    }
+
     template <typename FieldSelector>
     Eigen::Vector3f grad(const Eigen::Vector3f& pos, FieldSelector select) const {
 
@@ -104,7 +129,7 @@ class VolumeTemplate {
     unsigned int _size;
     float _dim;
     std::vector<se::key_t> _allocationList;
-    DiscreteMapT<FieldType> * _map_index; 
+    DiscreteMapT<FieldType, BlockSide> * _map_index; 
 
   private:
 
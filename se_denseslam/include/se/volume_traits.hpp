@@ -30,7 +30,12 @@
 #define VOLUME_H
 
 // Data types definitions
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
 #include <se/voxel_traits.hpp>
+#include <se/utils/block_layout.hpp>
+#include <se/utils/block_storage.hpp>
 
 /******************************************************************************
  *
@@ -46,6 +51,9 @@ typedef struct {
 template<>
 struct voxel_traits<SDF> {
   typedef SDF value_type;
+#ifdef SE_SOA_BLOCKS
+  typedef se::soa_storage storage_type;
+#endif
   static inline value_type empty(){ return {1.f, -1.f}; }
   static inline value_type initValue(){ return {1.f, 0.f}; }
 };
@@ -67,6 +75,9 @@ struct voxel_traits<OFusion> {
     float x;
     double y;
   } value_type;
+#ifdef SE_SOA_BLOCKS
+  typedef se::soa_storage storage_type;
+#endif
   static inline value_type empty(){ return {0.f, 0.f}; }
   static inline value_type initValue(){ return {0.f, 0.f}; }
 };
@@ -80,4 +91,149 @@ struct voxel_traits<OFusion> {
 #define TOP_CLAMP     1000.f
 #define BOTTOM_CLAMP  (-TOP_CLAMP)
 
+/******************************************************************************
+ *
+ * Quantized voxel traits. The update functors and raycasters work on the 
+ * decoded SDF and OFusion values, voxel_codec converts between the two.
+ *
+****************************************************************************/
+
+/*
+ * Identity codec of the floating point voxels.
+ */
+template <typename ValueT>
+struct voxel_codec {
+  typedef ValueT decoded_type;
+  static inline decoded_type decode(const ValueT& v){ return v; }
+  static inline ValueT encode(const decoded_type& v){ return v; }
+  static inline double elapsed(const float now, const double stamp){ 
+    return now - stamp; 
+  }
+};
+
+/*
+ * TSDF in [-1, 1] quantized to int16 and a uint8 weight, 4 bytes per voxel.
+ */
+typedef struct {
+  int16_t x;
+  uint8_t y;
+} SDF16;
+
+template<>
+struct voxel_traits<SDF16> {
+  typedef SDF16 value_type;
+#ifdef SE_SOA_BLOCKS
+  typedef se::soa_storage storage_type;
+#endif
+  static inline value_type empty(){ return {INT16_MAX, 0}; }
+  static inline value_type initValue(){ return {INT16_MAX, 0}; }
+};
+
+template <>
+struct voxel_codec<SDF16> {
+  typedef voxel_traits<SDF>::value_type decoded_type;
+  static constexpr float scale = INT16_MAX;
+  static inline decoded_type decode(const SDF16& v){ 
+    return {v.x / scale, static_cast<float>(v.y)}; 
+  }
+  static inline SDF16 encode(const decoded_type& v){ 
+    return {static_cast<int16_t>(std::lrint(std::fmax(-1.f, std::fmin(1.f, v.x)) * scale)),
+      static_cast<uint8_t>(std::fmax(0.f, std::fmin(v.y, UINT8_MAX)))};
+  }
+  static inline double elapsed(const float now, const double stamp){ 
+    return now - stamp; 
+  }
+};
+
+/*
+ * Log-odds occupancy in [BOTTOM_CLAMP, TOP_CLAMP] quantized to int16 and the
+ * frame of the last update modulo 2^16, 4 bytes per voxel. Timestamps are
+ * integration times at frame_rate, the elapsed time is recovered modulo the 
+ * 36 minutes wrap-around period.
+ */
+typedef struct {
+  int16_t  x;
+  uint16_t y;
+} OFusion16;
+
+template<>
+struct voxel_traits<OFusion16> {
+  typedef OFusion16 value_type;
+#ifdef SE_SOA_BLOCKS
+  typedef se::soa_storage storage_type;
+#endif
+  static inline value_type empty(){ return {0, 0}; }
+  static inline value_type initValue(){ return {0, 0}; }
+};
+
+template <>
+struct voxel_codec<OFusion16> {
+  typedef voxel_traits<OFusion>::value_type decoded_type;
+  static constexpr float scale = 32.f;
+  static constexpr float frame_rate = 30.f;
+  static constexpr double period = (UINT16_MAX + 1.0) / frame_rate;
+  static inline decoded_type decode(const OFusion16& v){ 
+    return {v.x / scale, v.y / frame_rate}; 
+  }
+  static inline OFusion16 encode(const decoded_type& v){ 
+    return {static_cast<int16_t>(std::lrint(
+          std::fmax(BOTTOM_CLAMP, std::fmin(TOP_CLAMP, v.x)) * scale)),
+      static_cast<uint16_t>(std::llrint(v.y * frame_rate) & UINT16_MAX)};
+  }
+  static inline double elapsed(const float now, const double stamp){ 
+    const double dt = std::fmod(now - stamp, period);
+    return dt < 0. ? dt + period : dt;
+  }
+};
+static_assert(sizeof(SDF16) == 4 && sizeof(OFusion16) == 4, 
+    "Quantized voxels must fit 4 bytes");
+
+template <typename ValueT>
+inline typename voxel_codec<ValueT>::decoded_type decode_voxel(const ValueT& v){
+  return voxel_codec<ValueT>::decode(v);
+}
+
+template <typename ValueT>
+inline ValueT encode_voxel(const typename voxel_codec<ValueT>::decoded_type& v){
+  return voxel_codec<ValueT>::encode(v);
+}
+
+/*
+ * Whether voxels of field type T decode to a TSDF or to an occupancy.
+ */
+template <typename T>
+struct is_sdf_field : std::is_same<typename voxel_codec<
+  typename voxel_traits<T>::value_type>::decoded_type, 
+  voxel_traits<SDF>::value_type> {};
+
+template <typename T>
+struct is_ofusion_field : std::is_same<typename voxel_codec<
+  typename voxel_traits<T>::value_type>::decoded_type, 
+  voxel_traits<OFusion>::value_type> {};
+
+#ifdef SE_MORTON_BLOCK_LAYOUT
+// Z-order storage inside voxel blocks, see se/utils/block_layout.hpp
+namespace se {
+template<>
+struct block_layout<SDF> {
+  typedef morton_layout type;
+};
+
+template<>
+struct block_layout<OFusion> {
+  typedef morton_layout type;
+};
+
+template<>
+struct block_layout<SDF16> {
+  typedef morton_layout type;
+};
+
+template<>
+struct block_layout<OFusion16> {
+  typedef morton_layout type;
+};
+}
+#endif
+
 #endif
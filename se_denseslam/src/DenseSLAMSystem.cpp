@@ -36,19 +36,18 @@
 
 #include <se/DenseSLAMSystem.h>
 #include <se/ray_iterator.hpp>
-#include <se/algorithms/meshing.hpp>
 #include <se/geometry/octree_collision.hpp>
 #include <se/vtk-io.h>
 #include "timings.h"
 #include <perfstats.h>
-#include "preprocessing.cpp"
-#include "tracking.cpp"
-#include "rendering.cpp"
-#include "bfusion/mapping_impl.hpp"
-#include "kfusion/mapping_impl.hpp"
+#include "kernels.hpp"
+#include "meshing_kernels.hpp"
 #include "bfusion/alloc_impl.hpp"
 #include "kfusion/alloc_impl.hpp"
 
+// Kernels off the hot path always run their baseline build.
+using namespace se::kernels::generic;
+
 
 extern PerfStats Stats;
 static bool print_kernel_timing = false;
@@ -92,6 +91,10 @@ DenseSLAMSystem::DenseSLAMSystem(const Eigen::Vector2i& inputSize,
     if (getenv("KERNEL_TIMINGS"))
       print_kernel_timing = true;
 
+    isa_ = se::isa::selected();
+    prune_ = config.prune;
+    prune_tolerance_ = config.prune_tolerance;
+
     // internal buffers to initialize
     reduction_output_.resize(8 * 32);
     tracking_result_.resize(computation_size_.x() * computation_size_.y());
@@ -119,19 +122,27 @@ DenseSLAMSystem::DenseSLAMSystem(const Eigen::Vector2i& inputSize,
 
     // ********* END : Generate the gaussian *************
 
-    discrete_vol_ptr_ = std::make_shared<se::Octree<FieldType> >();
-    discrete_vol_ptr_->init(volume_resolution_.x(), volume_dimension_.x());
-    volume_ = Volume<FieldType>(volume_resolution_.x(), volume_dimension_.x(),
-        discrete_vol_ptr_.get());
+    block_side_ = config.voxel_block_size;
+    if(block_side_ != 4 && block_side_ != 8 && block_side_ != 16) {
+      std::cerr << "Unsupported voxel block size " << block_side_ 
+        << ", using " << BLOCK_SIDE << std::endl;
+      block_side_ = BLOCK_SIDE;
+    }
+    dispatch([this](auto& instance) {
+      instance.init(volume_resolution_.x(), volume_dimension_.x());
+    });
 }
 
 bool DenseSLAMSystem::preprocessing(const unsigned short * inputDepth,
     const Eigen::Vector2i& inputSize, const bool filterInput){
 
     mm2metersKernel(float_depth_, inputDepth, inputSize);
+    depth_tiles_.build(float_depth_);
     if(filterInput){
-        bilateralFilterKernel(scaled_depth_[0], float_depth_, gaussian_,
+      dispatch_kernels(isa_, [&](auto kernels) {
+        kernels.bilateral_filter(scaled_depth_[0], float_depth_, gaussian_,
             e_delta, radius);
+      });
     }
     else {
       std::memcpy(scaled_depth_[0].data(), float_depth_.data(),
@@ -172,12 +183,14 @@ bool DenseSLAMSystem::tracking(const Eigen::Vector4f& k,
 				computation_size_.y() / (int) pow(2, level));
 		for (int i = 0; i < iterations_[level]; ++i) {
 
-      trackKernel(tracking_result_.data(), input_vertex_[level], input_normal_[level],
-          vertex_, normal_, pose_, projectReference,
-          dist_threshold, normal_threshold);
+      dispatch_kernels(isa_, [&](auto kernels) {
+        kernels.track(tracking_result_.data(), input_vertex_[level], 
+            input_normal_[level], vertex_, normal_, pose_, projectReference,
+            dist_threshold, normal_threshold);
 
-			reduceKernel(reduction_output_.data(), tracking_result_.data(), computation_size_,
-					localimagesize);
+        kernels.reduce(reduction_output_.data(), tracking_result_.data(), 
+            computation_size_, localimagesize);
+      });
 
 			if (updatePoseKernel(pose_, reduction_output_.data(), icp_threshold))
 				break;
@@ -195,9 +208,13 @@ bool DenseSLAMSystem::raycasting(const Eigen::Vector4f& k, float mu, unsigned in
   if(frame > 2) {
     raycast_pose_ = pose_;
     float step = volume_dimension_.x() / volume_resolution_.x();
-    raycastKernel(volume_, vertex_, normal_,
-        raycast_pose_ * getInverseCameraMatrix(k), nearPlane,
-        farPlane, mu, step, step*BLOCK_SIDE);
+    dispatch([&](const auto& instance) {
+      dispatch_kernels(isa_, [&](auto kernels) {
+        kernels.raycast(instance.volume, vertex_, normal_,
+            raycast_pose_ * getInverseCameraMatrix(k), nearPlane,
+            farPlane, mu, step, step*block_side_);
+      });
+    });
     doRaycast = true;
   }
   return doRaycast;
@@ -208,49 +225,66 @@ bool DenseSLAMSystem::integration(const Eigen::Vector4f& k, unsigned int integra
 
   if (((frame % integration_rate) == 0) || (frame <= 3)) {
 
-    float voxelsize =  volume_._dim/volume_._size;
-    int num_vox_per_pix = volume_._dim/((se::VoxelBlock<FieldType>::side)*voxelsize);
-    size_t total = num_vox_per_pix * computation_size_.x() *
-      computation_size_.y();
-    allocation_list_.reserve(total);
-
-    unsigned int allocated = 0;
-    if(std::is_same<FieldType, SDF>::value) {
-     allocated  = buildAllocationList(allocation_list_.data(),
-         allocation_list_.capacity(),
-        *volume_._map_index, pose_, getCameraMatrix(k), float_depth_.data(),
-        computation_size_, volume_._size,
-      voxelsize, 2*mu);
-    } else if(std::is_same<FieldType, OFusion>::value) {
-     allocated = buildOctantList(allocation_list_.data(), allocation_list_.capacity(),
-         *volume_._map_index,
-         pose_, getCameraMatrix(k), float_depth_.data(), computation_size_, voxelsize,
-         compute_stepsize, step_to_depth, 6*mu);
-    }
-
-    volume_._map_index->allocate(allocation_list_.data(), allocated);
-
-    if(std::is_same<FieldType, SDF>::value) {
-      struct sdf_update funct(float_depth_.data(),
-          Eigen::Vector2i(computation_size_.x(), computation_size_.y()), mu, 100);
-      se::functor::projective_map(*volume_._map_index,
-          Sophus::SE3f(pose_).inverse(),
-          getCameraMatrix(k),
-          Eigen::Vector2i(computation_size_.x(), computation_size_.y()),
-          funct);
-    } else if(std::is_same<FieldType, OFusion>::value) {
-
-      float timestamp = (1.f/30.f)*frame;
-      struct bfusion_update funct(float_depth_.data(),
-          Eigen::Vector2i(computation_size_.x(), computation_size_.y()), 
-          mu, timestamp, voxelsize);
-
-      se::functor::projective_map(*volume_._map_index,
-          Sophus::SE3f(pose_).inverse(),
-          getCameraMatrix(k),
-          Eigen::Vector2i(computation_size_.x(), computation_size_.y()),
-          funct);
-    }
+    dispatch([&](auto& instance) {
+      auto& volume = instance.volume;
+      float voxelsize =  volume._dim/volume._size;
+
+      if(is_sdf_field<FieldType>::value) {
+        buildAllocationList(allocation_keys_, *volume._map_index, pose_, 
+            getCameraMatrix(k), float_depth_.data(), computation_size_, 
+            volume._size, voxelsize, 2*mu, depth_tiles_);
+      } else if(is_ofusion_field<FieldType>::value) {
+        buildOctantList(allocation_keys_, *volume._map_index, pose_, 
+            getCameraMatrix(k), float_depth_.data(), computation_size_, 
+            voxelsize, compute_stepsize, step_to_depth, 6*mu, depth_tiles_);
+      }
+
+      const size_t allocated = allocation_keys_.merge(allocation_list_);
+      volume._map_index->allocate(allocation_list_.data(), allocated);
+
+      const Eigen::Vector2i frame_size(computation_size_.x(), 
+          computation_size_.y());
+      // Beyond the far plane no update changes the voxels: the TSDF is 
+      // truncated mu behind the surface and the occupancy update vanishes 
+      // six sigmas behind it, see bfusion_update for the bound on sigma.
+      const float max_depth = depth_tiles_.range()(1);
+      const float far_plane = max_depth + (is_sdf_field<FieldType>::value ? 
+          mu : 6 * fmaxf(0.05f, 2 * voxelsize));
+      const Eigen::Vector2f depth_range(0.0001f, far_plane);
+      dispatch_kernels(isa_, [&](auto kernels) {
+        if(is_sdf_field<FieldType>::value) {
+          kernels.integrate_sdf(*volume._map_index,
+              Sophus::SE3f(pose_).inverse(), getCameraMatrix(k), frame_size,
+              depth_range, float_depth_.data(), frame_size, mu, 100, 
+              &depth_tiles_);
+        } else if(is_ofusion_field<FieldType>::value) {
+
+          float timestamp = (1.f/30.f)*frame;
+          kernels.integrate_ofusion(*volume._map_index,
+              Sophus::SE3f(pose_).inverse(), getCameraMatrix(k), frame_size,
+              depth_range, float_depth_.data(), frame_size, mu, timestamp, 
+              voxelsize, &depth_tiles_);
+        }
+      });
+
+      // Free space saturates the occupancy, hence many observed blocks end
+      // up uniform. Collapsed octants are restored when allocated again.
+      if(is_ofusion_field<FieldType>::value && prune_) {
+        const float tolerance = prune_tolerance_;
+        prune_map(*volume._map_index, instance.last_active, 
+            [tolerance](const auto& a, const auto& b) {
+          if(tolerance == 0.f) {
+            // Field by field, OFusion is padded between x and y
+            return std::memcmp(&a.x, &b.x, sizeof(a.x)) == 0 && 
+              std::memcmp(&a.y, &b.y, sizeof(a.y)) == 0;
+          }
+          // Lossy on the occupancy only, timestamps must match
+          const auto da = decode_voxel(a);
+          const auto db = decode_voxel(b);
+          return da.y == db.y && fabsf(da.x - db.x) <= tolerance;
+        });
+      }
+    });
 
     // if(frame % 15 == 0) {
     //   std::stringstream f;
@@ -280,12 +314,14 @@ void DenseSLAMSystem::renderVolume(unsigned char* out,
 
 	if (frame % raycast_rendering_rate == 0) {
     const float step = volume_dimension_.x() / volume_resolution_.x();
-		renderVolumeKernel(volume_, out, outputSize,
-	*(this->viewPose_) * getInverseCameraMatrix(k), nearPlane,
-	farPlane * 2.0f, mu_, step, largestep,
-        this->viewPose_->topRightCorner<3, 1>(), ambient,
-        !(this->viewPose_->isApprox(raycast_pose_)), vertex_,
-        normal_);
+    dispatch([&](const auto& instance) {
+      renderVolumeKernel(instance.volume, out, outputSize,
+          *(this->viewPose_) * getInverseCameraMatrix(k), nearPlane,
+          farPlane * 2.0f, mu_, step, largestep,
+          this->viewPose_->topRightCorner<3, 1>(), ambient,
+          !(this->viewPose_->isApprox(raycast_pose_)), vertex_,
+          normal_);
+    });
   }
 }
 
@@ -302,21 +338,8 @@ void DenseSLAMSystem::renderDepth(unsigned char* out,
 void DenseSLAMSystem::dump_mesh(const std::string filename){
 
   std::vector<Triangle> mesh;
-  auto inside = [](const Volume<FieldType>::value_type& val) {
-    // meshing::status code;
-    // if(val.y == 0.f)
-    //   code = meshing::status::UNKNOWN;
-    // else
-    //   code = val.x < 0.f ? meshing::status::INSIDE : meshing::status::OUTSIDE;
-    // return code;
-    // std::cerr << val.x << " ";
-    return val.x < 0.f;
-  };
-
-  auto select = [](const Volume<FieldType>::value_type& val) {
-    return val.x;
-  };
-
-  se::algorithms::marching_cube(*volume_._map_index, select, inside, mesh);
+  dispatch([&](const auto& instance) {
+    se::kernels::marching_cube(isa_, instance.volume, mesh);
+  });
   writeVtkMesh(filename.c_str(), mesh);
 }
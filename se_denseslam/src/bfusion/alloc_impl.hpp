@@ -32,6 +32,9 @@
 #ifndef BFUSION_ALLOC_H
 #define BFUSION_ALLOC_H
 #include <se/utils/math_utils.h>
+#include <se/image/depth_pyramid.hpp>
+#include <se/geometry/grid_dda.hpp>
+#include <se/utils/key_buffer.hpp>
 
 /* Compute step size based on distance travelled along the ray */ 
 static inline float compute_stepsize(const float dist_travelled, const float hf_band,
@@ -50,81 +53,102 @@ static inline int step_to_depth(const float step, const int max_depth,
   return static_cast<int>(floorf(std::log2f(voxelsize/step)) + max_depth);
 }
 
-template <typename FieldType, 
-          template <typename> class OctreeT, typename HashType,
+namespace se {
+template <typename T, unsigned int BlockSide>
+class HashMap;
+}
+
+/* Coarsest depth at which a map can allocate. Octrees store octants at any
+ * depth. A HashMap expands keys into blocks only up to max_expand_levels 
+ * above the block level and drops coarser keys, hence rays must not step 
+ * through coarser octants.
+ */
+template <typename MapT>
+static inline int coarsest_depth(const MapT&, const int) {
+  return 0;
+}
+
+template <typename FieldType, unsigned int BlockSide>
+static inline int coarsest_depth(const se::HashMap<FieldType, BlockSide>&, 
+    const int leaves_depth) {
+  return std::max(0, 
+      leaves_depth - se::HashMap<FieldType, BlockSide>::max_expand_levels);
+}
+
+template <typename FieldType, unsigned int BlockSide,
+          template <typename, unsigned int> class OctreeT, typename HashType,
           typename StepF, typename DepthF>
-size_t buildOctantList(HashType* allocationList, size_t reserved,
-    OctreeT<FieldType>& map_index, const Eigen::Matrix4f& pose, 
+void buildOctantList(se::key_buffer<HashType>& keys,
+    OctreeT<FieldType, BlockSide>& map_index, const Eigen::Matrix4f& pose, 
     const Eigen::Matrix4f& K, const float *depthmap, const Eigen::Vector2i &imageSize, 
     const float voxelSize, StepF compute_stepsize, DepthF step_to_depth,
-    const float band) {
+    const float band, const se::depth_pyramid& tiles) {
 
   const float inverseVoxelSize = 1.f/voxelSize;
   Eigen::Matrix4f invK = K.inverse();
   const Eigen::Matrix4f kPose = pose * invK;
   const int size = map_index.size();
   const int max_depth = log2(size);
-  const int leaves_depth = max_depth - se::math::log2_const(OctreeT<FieldType>::blockSide);
-
-#ifdef _OPENMP
-  std::atomic<unsigned int> voxelCount;
-  std::atomic<unsigned int> leavesCount;
-#else
-  unsigned int voxelCount;
-#endif
+  const int leaves_depth = max_depth - se::math::log2_const(BlockSide);
+  const int min_depth = coarsest_depth(map_index, leaves_depth);
 
   const Eigen::Vector3f camera = pose.topRightCorner<3, 1>();
-  voxelCount = 0;
-#pragma omp parallel for
-  for (int y = 0; y < imageSize.y(); ++y) {
-    for (int x = 0; x < imageSize.x(); ++x) {
-      if(depthmap[x + y*imageSize.x()] == 0)
-        continue;
-      int tree_depth = max_depth; 
-      float stepsize = voxelSize;
-      const float depth = depthmap[x + y*imageSize.x()];
-      Eigen::Vector3f worldVertex = (kPose * Eigen::Vector3f((x + 0.5f) * depth, 
-            (y + 0.5f) * depth, depth).homogeneous()).head<3>();
-
-      Eigen::Vector3f direction = (camera - worldVertex).normalized();
-      const Eigen::Vector3f origin = worldVertex - (band * 0.5f) * direction;
-      const float dist = (camera - origin).norm(); 
-      Eigen::Vector3f step = direction*stepsize;
+  keys.clear();
+#pragma omp parallel
+  {
+    typename se::key_buffer<HashType>::local& local = keys.thread_buffer();
+#pragma omp for
+    for (int y = 0; y < imageSize.y(); ++y) {
+      for (int x = 0; x < imageSize.x(); ++x) {
+        // Rays are cast from the tiles with measurements only
+        if(x % se::depth_pyramid::base_side == 0 && 
+           tiles.empty(x / se::depth_pyramid::base_side, 
+             y / se::depth_pyramid::base_side)) {
+          x += se::depth_pyramid::base_side - 1;
+          continue;
+        }
+        if(depthmap[x + y*imageSize.x()] == 0)
+          continue;
+        const float depth = depthmap[x + y*imageSize.x()];
+        Eigen::Vector3f worldVertex = (kPose * Eigen::Vector3f((x + 0.5f) * depth, 
+              (y + 0.5f) * depth, depth).homogeneous()).head<3>();
 
-      Eigen::Vector3f voxelPos = origin;
-      float travelled = 0.f;
-      for(; travelled < dist; travelled += stepsize){
+        Eigen::Vector3f direction = (camera - worldVertex).normalized();
+        const Eigen::Vector3f origin = worldVertex - (band * 0.5f) * direction;
+        const float dist = (camera - origin).norm(); 
 
-        Eigen::Vector3f voxelScaled = (voxelPos * inverseVoxelSize).array().floor();
-        if((voxelScaled.x() < size) && (voxelScaled.y() < size) &&
-           (voxelScaled.z() < size) && (voxelScaled.x() >= 0) &&
-           (voxelScaled.y() >= 0)   && (voxelScaled.z() >= 0)){
-          const Eigen::Vector3i voxel = voxelScaled.cast<int>();
-          auto node_ptr = map_index.fetch_octant(voxel.x(), voxel.y(), voxel.z(), 
-              tree_depth);
-          if(!node_ptr){
-            HashType k = map_index.hash(voxel.x(), voxel.y(), voxel.z(), 
-                std::min(tree_depth, leaves_depth));
-            unsigned int idx = voxelCount++;
-            if(idx < reserved) {
-              allocationList[idx] = k;
-            }
-          } else if(tree_depth >= leaves_depth) { 
-            static_cast<se::VoxelBlock<FieldType>*>(node_ptr)->active(true);
+        // Walk the ray octant by octant, the octant level follows the step 
+        // size policy evaluated at the distance travelled so far
+        auto ray_depth = [&](const float travelled) {
+          const int d = step_to_depth(compute_stepsize(travelled, band, 
+                voxelSize), max_depth, voxelSize);
+          return std::max(min_depth, std::min(d, leaves_depth));
+        };
+        int tree_depth = ray_depth(0.f);
+        const typename OctreeT<FieldType, BlockSide>::cursor_type 
+          cursor(map_index);
+        se::geometry::grid_dda dda(origin * inverseVoxelSize, direction, 
+            0.f, dist * inverseVoxelSize, size >> tree_depth, size);
+        while(dda.valid()) {
+          const Eigen::Vector3i& octant = dda.cell();
+          // Blocks are fetched apart, maps may store them separately from 
+          // the nodes
+          se::VoxelBlock<FieldType, BlockSide> * block = NULL;
+          const bool allocated = tree_depth == leaves_depth ? 
+            (block = cursor.fetch(octant.x(), octant.y(), octant.z())) != NULL :
+            cursor.fetch_octant(octant.x(), octant.y(), octant.z(), 
+                tree_depth) != NULL;
+          if(!allocated){
+            local.push(map_index.hash(octant.x(), octant.y(), octant.z(), 
+                  tree_depth));
+          } else if(block) { 
+            map_index.activate(block);
           }
+          tree_depth = ray_depth(dda.t_exit() * voxelSize);
+          dda.next(size >> tree_depth);
         }
-        stepsize = compute_stepsize(travelled, band, voxelSize);  
-        // int last_depth = tree_depth;
-        tree_depth = step_to_depth(stepsize, max_depth, voxelSize);
-        // if(tree_depth != last_depth) {
-        //   std::cout << "Break Here!" << std::endl;
-        // }
-        
-        step = direction*stepsize;
-        voxelPos +=step;
       }
     }
   }
-  return (size_t) voxelCount >= reserved ? reserved : (size_t) voxelCount;
 }
 #endif
@@ -29,13 +29,17 @@
  *
  * */
 
-#ifndef BFUSION_MAPPING_HPP
-#define BFUSION_MAPPING_HPP
+/*
+ * No include guard: kernels.hpp compiles this file once per instruction set.
+ */
 
 #include <se/node.hpp>
 #include <se/functors/projective_functor.hpp>
 #include <se/constant_parameters.h>
+#include <se/volume_traits.hpp>
+#include <se/functors/row_kernel.hpp>
 #include <se/image/image.hpp>
+#include <se/image/depth_pyramid.hpp>
 #include "bspline_lookup.cc"
 
 float interpDepth(const se::Image<float>& depth, const Eigen::Vector2f proj) {
@@ -154,6 +158,11 @@ static inline float applyWindow(const float occupancy, const float ,
   return occupancy * fraction;
 }
 
+/*
+ * Lanes caps the width of the vectorised row updates, the kernels built for
+ * an instruction set pass the widest lanes it supports.
+ */
+template <int Lanes = se::simd::native_width>
 struct bfusion_update {
 
   template <typename DataHandlerT>
@@ -171,22 +180,100 @@ struct bfusion_update {
     float sample = HNew(diff/sigma, pos(2));
     if(sample == 0.5f) return;
     sample = se::math::clamp(sample, 0.03f, 0.97f);
-    auto data = handler.get();
-    const double delta_t = timestamp - data.y;
+    typedef decltype(handler.get()) value_type;
+    auto data = decode_voxel(handler.get());
+    const double delta_t = voxel_codec<value_type>::elapsed(timestamp, data.y);
     data.x = applyWindow(data.x, SURF_BOUNDARY, delta_t, CAPITAL_T);
     data.x = se::math::clamp(updateLogs(data.x, sample), BOTTOM_CLAMP, TOP_CLAMP);
     data.y = timestamp;
-    handler.set(data);
+    handler.set(encode_voxel<value_type>(data));
   } 
 
+  /*
+   * Vectorised update of a block row of OFusion voxels, with the same 
+   * arithmetic as the per-voxel update above up to the log2 approximation
+   * of se::simd::log2. See se::functor::has_row_update for the arguments.
+   */
+  template <typename BlockT>
+  typename std::enable_if<se::functor::soa_rows<BlockT, float, double>::value, 
+           bool>::type
+  update_row(BlockT * block, const int y, const int z, 
+      const Eigen::Vector3f& pos, const Eigen::Vector3f& delta, 
+      const Eigen::Vector3f& pix_hom, const Eigen::Vector3f& pix_delta) {
+    constexpr int W = se::simd::row_width<BlockT::side, Lanes>::value;
+    typedef se::simd::vfloat<W> vfloat;
+    float * occupancy = block->row_x(y, z);
+    double * stamp = block->row_y(y, z);
+    bool visible = false;
+    for(unsigned int x = 0; x < BlockT::side; x += W) {
+      const se::functor::row_lanes<W> row(x, pos, delta, pix_hom, pix_delta,
+          depth, depthSize);
+      visible |= row.visible.any();
+      auto update = row.visible & (row.depth > vfloat(0.f));
+      if(!update.any()) continue;
+
+      const vfloat inv_z = vfloat(1.f) / row.z;
+      const vfloat rx = row.x * inv_z;
+      const vfloat ry = row.y * inv_z;
+      const vfloat diff = (row.z - row.depth) * 
+        sqrt(vfloat(1.f) + rx * rx + ry * ry);
+      const vfloat sigma = min(max(vfloat(noiseFactor) * row.z * row.z,
+            vfloat(2 * voxelsize)), vfloat(0.05f));
+      const vfloat t = diff / sigma;
+      vfloat sample = bspline(t) - bspline(t - vfloat(3.f)) * vfloat(0.5f);
+      update = update & (sample != vfloat(0.5f));
+      if(!update.any()) continue;
+      sample = min(max(sample, vfloat(0.03f)), vfloat(0.97f));
+
+      const vfloat delta_t = vfloat::sub_double(timestamp, stamp + x);
+      const vfloat fraction = max(vfloat(0.5f), 
+          vfloat(1.f) / (vfloat(1.f) + delta_t / vfloat(CAPITAL_T)));
+      const vfloat prior = vfloat::load(occupancy + x);
+      const vfloat updated = min(max(prior * fraction + 
+            se::simd::log2(sample / (vfloat(1.f) - sample)), 
+            vfloat(BOTTOM_CLAMP)), vfloat(TOP_CLAMP));
+      select(update, updated, prior).store(occupancy + x);
+      for(unsigned int lanes = update.bits(); lanes; lanes &= lanes - 1)
+        stamp[x + __builtin_ctz(lanes)] = timestamp;
+    }
+    return visible;
+  }
+
+  /*
+   * Lanes of bspline_memoized.
+   */
+  template <int W>
+  static se::simd::vfloat<W> bspline(const se::simd::vfloat<W>& t) {
+    typedef se::simd::vfloat<W> vfloat;
+    const auto inside = (t >= vfloat(-3.f)) & (t <= vfloat(3.f));
+    const auto idx = truncate(((t + vfloat(3.f)) * vfloat(1/6.f)) * 
+        vfloat(bspline_num_samples - 1) + vfloat(0.5f));
+    return gather(bspline_lookup, idx, inside, 
+        select(t > vfloat(3.f), vfloat(1.f), vfloat(0.f)));
+  }
+
+  /*
+   * Octants without depth samples, or lying more than six sigmas behind all
+   * of them, are left unchanged: there the sample is 0.5. See
+   * se::functor::has_octant_skip.
+   */
+  bool skip_octant(const Eigen::Vector2i& lower, const Eigen::Vector2i& upper,
+      const float z_min) const {
+    if(!tiles) return false;
+    const Eigen::Vector2f range = tiles->range(lower, upper);
+    return range(1) == 0.f || 
+      z_min - range(1) > 6 * std::max(0.05f, 2 * voxelsize);
+  }
+
   bfusion_update(const float * d, const Eigen::Vector2i framesize, float n, 
-      float t, float vs): depth(d), depthSize(framesize), noiseFactor(n), 
-  timestamp(t), voxelsize(vs){};
+      float t, float vs, const se::depth_pyramid * dt = NULL): depth(d), 
+  depthSize(framesize), noiseFactor(n), timestamp(t), voxelsize(vs), 
+  tiles(dt){};
 
   const float * depth;
   Eigen::Vector2i depthSize;
   float noiseFactor;
   float timestamp;
   float voxelsize;
+  const se::depth_pyramid * tiles;
 };
-#endif
@@ -32,25 +32,29 @@
 #include <se/utils/math_utils.h>
 #include <type_traits>
 
-inline Eigen::Vector4f raycast(const Volume<OFusion>& volume, 
+template <typename T, unsigned int BlockSide>
+inline typename std::enable_if<is_ofusion_field<T>::value, Eigen::Vector4f>::type
+raycast(const Volume<T, BlockSide>& volume, 
     const Eigen::Vector3f origin, const Eigen::Vector3f direction, 
     const float tnear, const float tfar, const float, const float step, 
     const float) { 
 
-  auto select_occupancy = [](const auto& val){ return val.x; };
+  auto select_occupancy = [](const auto& val){ return decode_voxel(val).x; };
+  const typename Volume<T, BlockSide>::cursor_type 
+    cursor(*volume._map_index);
   if (tnear < tfar) {
     float t = tnear;
     float stepsize = step;
-    float f_t = volume.interp(origin + direction * t, select_occupancy);
+    float f_t = volume.interp(origin + direction * t, select_occupancy, cursor);
     float f_tt = 0;
 
     // if we are not already in it
     if (f_t <= SURF_BOUNDARY) { 
       for (; t < tfar; t += stepsize) {
         const Eigen::Vector3f pos =  origin + direction * t;
-        Volume<OFusion>::value_type data = volume.get(pos);
+        const auto data = decode_voxel(volume.get(pos, cursor));
         if(data.x > -100.f && data.y > 0.f){
-          f_tt = volume.interp(origin + direction * t, select_occupancy);
+          f_tt = volume.interp(origin + direction * t, select_occupancy, cursor);
         }
         if (f_tt > SURF_BOUNDARY) break;
         f_t = f_tt;
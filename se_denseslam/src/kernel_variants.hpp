@@ -0,0 +1,95 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+/*
+ * Compiles the kernel source SE_KERNEL_SOURCE once for the baseline of the
+ * compiler flags and, on x86-64 with GCC, once more for SSE4.2, AVX2 and
+ * AVX-512, each copy in namespace se::kernels::<level> with SE_KERNEL_LANES
+ * the widest float lanes of that level. Everything the source includes must
+ * be included first, outside the per instruction set namespaces. No include
+ * guard, see kernels.hpp and meshing_kernels.cpp.
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#ifndef SE_KERNEL_VARIANTS
+#define SE_KERNEL_VARIANTS
+#endif
+#endif
+
+namespace se {
+namespace kernels {
+namespace generic {
+#define SE_KERNEL_LANES se::simd::native_width
+#include SE_KERNEL_SOURCE
+#undef SE_KERNEL_LANES
+}
+}
+}
+
+#ifdef SE_KERNEL_VARIANTS
+#pragma GCC push_options
+#pragma GCC target("sse4.2,popcnt")
+namespace se {
+namespace kernels {
+namespace sse42 {
+#define SE_KERNEL_LANES 1
+#include SE_KERNEL_SOURCE
+#undef SE_KERNEL_LANES
+}
+}
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace se {
+namespace kernels {
+namespace avx2 {
+#define SE_KERNEL_LANES 8
+#include SE_KERNEL_SOURCE
+#undef SE_KERNEL_LANES
+}
+}
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,avx512f,avx512dq,avx512bw,avx512vl")
+namespace se {
+namespace kernels {
+namespace avx512 {
+#define SE_KERNEL_LANES 16
+#include SE_KERNEL_SOURCE
+#undef SE_KERNEL_LANES
+}
+}
+}
+#pragma GCC pop_options
+#endif
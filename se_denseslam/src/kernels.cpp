@@ -0,0 +1,99 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+/*
+ * Hot kernels of the pipeline, compiled once per instruction set by 
+ * kernels.hpp: each copy lives in namespace se::kernels::<level>, under a 
+ * matching #pragma GCC target, with SE_KERNEL_LANES the widest float lanes 
+ * of that level. The code they call from headers included outside the 
+ * pragma, se_core and Eigen, is only compiled for that level once inlined, 
+ * hence the kernels are __attribute__((flatten)) and the integration runs 
+ * its block work through flatten_call. No include guard.
+ */
+#include "preprocessing.cpp"
+#include "tracking.cpp"
+#include "rendering.cpp"
+#include "bfusion/mapping_impl.hpp"
+#include "kfusion/mapping_impl.hpp"
+
+/*
+ * Runs the block work of the se_core algorithms inlined into this
+ * instruction set, see se::isa::inline_call.
+ */
+struct flatten_call {
+  template <typename F>
+  __attribute__((flatten)) void operator()(const F& f) const { f(); }
+};
+
+/*
+ * Entry points of the kernels selected at runtime by dispatch_kernels.
+ */
+struct kernel_set {
+  static constexpr int lanes = SE_KERNEL_LANES;
+
+  template <typename... Args>
+  static void bilateral_filter(Args&&... args) {
+    bilateralFilterKernel(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  static void track(Args&&... args) {
+    trackKernel(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  static void reduce(Args&&... args) {
+    reduceKernel(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  static void raycast(Args&&... args) {
+    raycastKernel(std::forward<Args>(args)...);
+  }
+
+  template <typename MapT, typename... Args>
+  static void integrate_sdf(MapT& map, const Sophus::SE3f& Tcw, 
+      const Eigen::Matrix4f& K, const Eigen::Vector2i& frame_size, 
+      const Eigen::Vector2f& depth_range, Args&&... args) {
+    se::functor::projective_map(map, Tcw, K, frame_size, 
+        sdf_update<lanes>(std::forward<Args>(args)...), flatten_call(), 
+        depth_range);
+  }
+
+  template <typename MapT, typename... Args>
+  static void integrate_ofusion(MapT& map, const Sophus::SE3f& Tcw, 
+      const Eigen::Matrix4f& K, const Eigen::Vector2i& frame_size, 
+      const Eigen::Vector2f& depth_range, Args&&... args) {
+    se::functor::projective_map(map, Tcw, K, frame_size, 
+        bfusion_update<lanes>(std::forward<Args>(args)...), flatten_call(), 
+        depth_range);
+  }
+};
@@ -0,0 +1,88 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+#ifndef SE_KERNELS_HPP
+#define SE_KERNELS_HPP
+
+/*
+ * Runtime instruction set dispatch of the hot kernels. kernels.cpp is 
+ * compiled once per instruction set by kernel_variants.hpp; dispatch_kernels
+ * picks the copy for se::isa::selected(). Everything kernels.cpp includes 
+ * must be included here first, outside the per instruction set namespaces.
+ */
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sophus/se3.hpp>
+#include <se/utils/isa.hpp>
+#include <se/utils/math_utils.h>
+#include <se/utils/simd.hpp>
+#include <se/commons.h>
+#include <se/node.hpp>
+#include <se/image/image.hpp>
+#include <se/image/depth_pyramid.hpp>
+#include <se/volume_traits.hpp>
+#include <se/constant_parameters.h>
+#include <se/continuous/volume_template.hpp>
+#include <se/ray_iterator.hpp>
+#include <se/block_ray_iterator.hpp>
+#include <se/functors/projective_functor.hpp>
+#include <se/functors/row_kernel.hpp>
+#include "timings.h"
+
+#define SE_KERNEL_SOURCE "kernels.cpp"
+#include "kernel_variants.hpp"
+#undef SE_KERNEL_SOURCE
+
+/*
+ * Invoke f on the kernel_set compiled for the instruction set l, or on the
+ * closest one below it.
+ */
+template <typename F>
+void dispatch_kernels(const se::isa::level l, F f) {
+  switch(l) {
+#ifdef SE_KERNEL_VARIANTS
+    case se::isa::level::avx512:
+      f(se::kernels::avx512::kernel_set());
+      break;
+    case se::isa::level::avx2:
+      f(se::kernels::avx2::kernel_set());
+      break;
+    case se::isa::level::sse42:
+      f(se::kernels::sse42::kernel_set());
+      break;
+#endif
+    default:
+      f(se::kernels::generic::kernel_set());
+  }
+}
+#endif
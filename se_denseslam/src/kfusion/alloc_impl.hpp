@@ -33,14 +33,15 @@
 #include <se/utils/math_utils.h> 
 #include <se/node.hpp>
 #include <se/utils/morton_utils.hpp>
+#include <se/image/depth_pyramid.hpp>
+#include <se/geometry/grid_dda.hpp>
+#include <se/utils/key_buffer.hpp>
 
 /* 
  * \brief Given a depth map and camera matrix it computes the list of 
  * voxels intersected but not allocated by the rays around the measurement m in
  * a region comprised between m +/- band. 
- * \param allocationList output list of keys corresponding to voxel blocks to
- * be allocated
- * \param reserved allocated size of allocationList
+ * \param keys output keys of the voxel blocks to be allocated, per thread
  * \param map_index indexing structure used to index voxel blocks 
  * \param pose camera extrinsics matrix
  * \param K camera intrinsics matrix
@@ -49,72 +50,68 @@
  * \param size discrete extent of the map, in number of voxels
  * \param voxelSize spacing between two consegutive voxels, in metric space
  * \param band maximum extent of the allocating region, per ray
+ * \param tiles depth range of the tiles of depthmap, rays are cast from the 
+ * tiles with measurements only
  */
-template <typename FieldType, template <typename> class OctreeT, typename HashType>
-unsigned int buildAllocationList(HashType * allocationList, size_t reserved,
-    OctreeT<FieldType>& map_index, const Eigen::Matrix4f& pose, 
+template <typename FieldType, unsigned int BlockSide,
+          template <typename, unsigned int> class OctreeT, typename HashType>
+void buildAllocationList(se::key_buffer<HashType>& keys,
+    OctreeT<FieldType, BlockSide>& map_index, const Eigen::Matrix4f& pose, 
     const Eigen::Matrix4f& K, 
     const float *depthmap, const Eigen::Vector2i& imageSize, 
-    const unsigned int size,  const float voxelSize, const float band) {
+    const unsigned int size,  const float voxelSize, const float band,
+    const se::depth_pyramid& tiles) {
 
   const float inverseVoxelSize = 1/voxelSize;
-  const unsigned block_scale = log2(size) - se::math::log2_const(se::VoxelBlock<FieldType>::side);
+  const unsigned block_scale = log2(size) - se::math::log2_const(BlockSide);
 
   Eigen::Matrix4f invK = K.inverse();
   const Eigen::Matrix4f kPose = pose * invK;
-  
-
-#ifdef _OPENMP
-  std::atomic<unsigned int> voxelCount;
-#else
-  unsigned int voxelCount;
-#endif
 
   const Eigen::Vector3f camera = pose.topRightCorner<3, 1>();
-  const int numSteps = ceil(band*inverseVoxelSize);
-  voxelCount = 0;
-#pragma omp parallel for
-  for (int y = 0; y < imageSize.y(); ++y) {
-    for (int x = 0; x < imageSize.x(); ++x) {
-      if(depthmap[x + y*imageSize.x()] == 0)
-        continue;
-      const float depth = depthmap[x + y*imageSize.x()];
-      Eigen::Vector3f worldVertex = (kPose * Eigen::Vector3f((x + 0.5f) * depth, 
-            (y + 0.5f) * depth, depth).homogeneous()).head<3>();
+  const float bandScaled = band * inverseVoxelSize;
+  keys.clear();
+#pragma omp parallel
+  {
+    typename se::key_buffer<HashType>::local& local = keys.thread_buffer();
+#pragma omp for
+    for (int y = 0; y < imageSize.y(); ++y) {
+      for (int x = 0; x < imageSize.x(); ++x) {
+        if(x % se::depth_pyramid::base_side == 0 && 
+           tiles.empty(x / se::depth_pyramid::base_side, 
+             y / se::depth_pyramid::base_side)) {
+          x += se::depth_pyramid::base_side - 1;
+          continue;
+        }
+        if(depthmap[x + y*imageSize.x()] == 0)
+          continue;
+        const float depth = depthmap[x + y*imageSize.x()];
+        Eigen::Vector3f worldVertex = (kPose * Eigen::Vector3f((x + 0.5f) * depth, 
+              (y + 0.5f) * depth, depth).homogeneous()).head<3>();
 
-      Eigen::Vector3f direction = (camera - worldVertex).normalized();
-      const Eigen::Vector3f origin = worldVertex - (band * 0.5f) * direction;
-      const Eigen::Vector3f step = (direction*band)/numSteps;
+        Eigen::Vector3f direction = (camera - worldVertex).normalized();
+        const Eigen::Vector3f origin = worldVertex - (band * 0.5f) * direction;
 
-      Eigen::Vector3i voxel;
-      Eigen::Vector3f voxelPos = origin;
-      for(int i = 0; i < numSteps; i++){
-        Eigen::Vector3f voxelScaled = (voxelPos * inverseVoxelSize).array().floor();
-        if( (voxelScaled.x() < size) && (voxelScaled.y() < size) &&
-            (voxelScaled.z() < size) && (voxelScaled.x() >= 0) &&
-            (voxelScaled.y() >= 0) &&   (voxelScaled.z() >= 0)){
-          voxel = voxelScaled.cast<int>();
-          se::VoxelBlock<FieldType> * n = map_index.fetch(voxel.x(), 
-              voxel.y(), voxel.z());
+        // Visit every block crossed by the band once, the tree is queried per
+        // block instead of per voxel sized step
+        const typename OctreeT<FieldType, BlockSide>::cursor_type 
+          cursor(map_index);
+        for(se::geometry::grid_dda dda(origin * inverseVoxelSize, direction, 
+              0.f, bandScaled, BlockSide, size); dda.valid(); dda.next()) {
+          const Eigen::Vector3i& block = dda.cell();
+          se::VoxelBlock<FieldType, BlockSide> * n = cursor.fetch(block.x(), 
+              block.y(), block.z());
           if(!n){
-            HashType k = map_index.hash(voxel.x(), voxel.y(), voxel.z(), 
-                block_scale);
-            unsigned int idx = voxelCount++;
-            if(idx < reserved) {
-              allocationList[idx] = k;
-            } else
-              break;
+            local.push(map_index.hash(block.x(), block.y(), block.z(), 
+                  block_scale));
           }
           else {
-            n->active(true); 
+            map_index.activate(n); 
           }
         }
-        voxelPos +=step;
       }
     }
   }
-  const unsigned int written = voxelCount;
-  return written >= reserved ? reserved : written;
 }
 
 #endif
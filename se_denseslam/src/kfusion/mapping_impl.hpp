@@ -28,10 +28,19 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
  *
  * */
-#ifndef KFUSION_MAPPING_HPP
-#define KFUSION_MAPPING_HPP
+/*
+ * No include guard: kernels.hpp compiles this file once per instruction set.
+ */
 #include <se/node.hpp>
+#include <se/volume_traits.hpp>
+#include <se/functors/row_kernel.hpp>
+#include <se/image/depth_pyramid.hpp>
 
+/*
+ * Lanes caps the width of the vectorised row updates, the kernels built for
+ * an instruction set pass the widest lanes it supports.
+ */
+template <int Lanes = se::simd::native_width>
 struct sdf_update {
 
   template <typename DataHandlerT>
@@ -45,23 +54,75 @@ struct sdf_update {
       * std::sqrt( 1 + se::math::sq(pos(0) / pos(2)) + se::math::sq(pos(1) / pos(2)));
     if (diff > -mu) {
       const float sdf = fminf(1.f, diff / mu);
-      auto data = handler.get();
+      typedef decltype(handler.get()) value_type;
+      auto data = decode_voxel(handler.get());
       data.x = se::math::clamp(
           (static_cast<float>(data.y) * data.x + sdf) / (static_cast<float>(data.y) + 1.f), 
           -1.f,
           1.f);
       data.y = fminf(data.y + 1, maxweight);
-      handler.set(data);
+      handler.set(encode_voxel<value_type>(data));
     }
   } 
 
-  sdf_update(const float * d, const Eigen::Vector2i framesize, float m, int mw) : 
-    depth(d), depthSize(framesize), mu(m), maxweight(mw){};
+  /*
+   * Vectorised update of a block row of float SDF voxels, with the same
+   * arithmetic as the per-voxel update above. See 
+   * se::functor::has_row_update for the arguments.
+   */
+  template <typename BlockT>
+  typename std::enable_if<se::functor::soa_rows<BlockT, float, float>::value, 
+           bool>::type
+  update_row(BlockT * block, const int y, const int z, 
+      const Eigen::Vector3f& pos, const Eigen::Vector3f& delta, 
+      const Eigen::Vector3f& pix_hom, const Eigen::Vector3f& pix_delta) {
+    constexpr int W = se::simd::row_width<BlockT::side, Lanes>::value;
+    typedef se::simd::vfloat<W> vfloat;
+    float * tsdf = block->row_x(y, z);
+    float * weight = block->row_y(y, z);
+    bool visible = false;
+    for(unsigned int x = 0; x < BlockT::side; x += W) {
+      const se::functor::row_lanes<W> row(x, pos, delta, pix_hom, pix_delta,
+          depth, depthSize);
+      visible |= row.visible.any();
+      const vfloat inv_z = vfloat(1.f) / row.z;
+      const vfloat rx = row.x * inv_z;
+      const vfloat ry = row.y * inv_z;
+      const vfloat diff = (row.depth - row.z) * 
+        sqrt(vfloat(1.f) + rx * rx + ry * ry);
+      const auto update = row.visible & (row.depth > vfloat(0.f)) & 
+        (diff > vfloat(-mu));
+      if(!update.any()) continue;
+
+      const vfloat sdf = min(vfloat(1.f), diff / vfloat(mu));
+      const vfloat w = vfloat::load(weight + x);
+      const vfloat d = vfloat::load(tsdf + x);
+      const vfloat updated = min(max((w * d + sdf) / (w + vfloat(1.f)), 
+            vfloat(-1.f)), vfloat(1.f));
+      select(update, updated, d).store(tsdf + x);
+      select(update, min(w + vfloat(1.f), vfloat(maxweight)), w).store(weight + x);
+    }
+    return visible;
+  }
+
+  /*
+   * Octants without depth samples, or lying more than mu behind all of 
+   * them, are left unchanged. See se::functor::has_octant_skip.
+   */
+  bool skip_octant(const Eigen::Vector2i& lower, const Eigen::Vector2i& upper,
+      const float z_min) const {
+    if(!tiles) return false;
+    const Eigen::Vector2f range = tiles->range(lower, upper);
+    return range(1) == 0.f || z_min - range(1) >= mu;
+  }
+
+  sdf_update(const float * d, const Eigen::Vector2i framesize, float m, int mw,
+      const se::depth_pyramid * t = NULL) : 
+    depth(d), depthSize(framesize), mu(m), maxweight(mw), tiles(t){};
 
   const float * depth;
   Eigen::Vector2i depthSize;
   float mu;
   int maxweight;
+  const se::depth_pyramid * tiles;
 };
-
-#endif
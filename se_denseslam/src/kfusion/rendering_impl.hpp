@@ -31,21 +31,26 @@
 #include <se/utils/math_utils.h> 
 #include <type_traits>
 
-inline Eigen::Vector4f raycast(const Volume<SDF>& volume, const Eigen::Vector3f& origin, 
+template <typename T, unsigned int BlockSide>
+inline typename std::enable_if<is_sdf_field<T>::value, Eigen::Vector4f>::type
+raycast(const Volume<T, BlockSide>& volume, 
+    const Eigen::Vector3f& origin, 
     const Eigen::Vector3f& direction, const float tnear, const float tfar, 
     const float mu, const float step, const float largestep) { 
 
-  auto select_depth = [](const auto& val){ return val.x; };
+  auto select_depth = [](const auto& val){ return decode_voxel(val).x; };
+  const typename Volume<T, BlockSide>::cursor_type 
+    cursor(*volume._map_index);
   if (tnear < tfar) {
     // first walk with largesteps until we found a hit
     float t = tnear;
     float stepsize = largestep;
     Eigen::Vector3f position = origin + direction * t;
-    float f_t = volume.interp(position, select_depth);
+    float f_t = volume.interp(position, select_depth, cursor);
     float f_tt = 0;
     if (f_t > 0) { // ups, if we were already in it, then don't render anything here
       for (; t < tfar; t += stepsize) {
-        Volume<SDF>::value_type data = volume.get(position);
+        const auto data = decode_voxel(volume.get(position, cursor));
         if(data.y == 0){
           stepsize = largestep;
           position += stepsize*direction;
@@ -53,7 +58,7 @@ inline Eigen::Vector4f raycast(const Volume<SDF>& volume, const Eigen::Vector3f&
         }
         f_tt = data.x;
         if(f_tt <= 0.1 && f_tt >= -0.5f){
-          f_tt = volume.interp(position, select_depth);
+          f_tt = volume.interp(position, select_depth, cursor);
         }
         if (f_tt < 0)                  // got it, jump out of inner loop
           break;
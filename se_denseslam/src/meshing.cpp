@@ -0,0 +1,85 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+/*
+ * Marching cubes over the allocated voxel blocks, the per instruction set 
+ * counterpart of se::algorithms::marching_cube. Compiled once per 
+ * instruction set by meshing_kernels.cpp, no include guard.
+ */
+template <typename T, unsigned int BlockSide, typename FieldSelector, 
+          typename InsidePredicate, typename TriangleType>
+void marchingCubeKernel(const Volume<T, BlockSide>& volume, 
+    FieldSelector select, InsidePredicate inside, 
+    std::vector<TriangleType>& triangles) {
+  TICK();
+  typedef typename Volume<T, BlockSide>::map_type map_type;
+  map_type& map = *volume._map_index;
+  std::vector<se::VoxelBlock<T, BlockSide>*> blocklist;
+  map.getBlockList(blocklist, false);
+  const int size = map.size();
+  const int dim = map.dim();
+  std::mutex lck;
+
+#pragma omp parallel for
+  for(size_t i = 0; i < blocklist.size(); i++){
+    const se::VoxelBlock<T, BlockSide> * leaf = blocklist[i];
+    const Eigen::Vector3i& start = leaf->coordinates();
+    const Eigen::Vector3i top = 
+      (start + Eigen::Vector3i::Constant(BlockSide)).cwiseMin(
+          Eigen::Vector3i::Constant(size-1));
+    const typename map_type::cursor_type cursor(map);
+    // Triangles of the block, appended to the mesh at once
+    std::vector<TriangleType> local;
+    for(int x = start(0); x < top(0); x++){
+      for(int y = start(1); y < top(1); y++){
+        for(int z = start(2); z < top(2); z++){
+          const uint8_t index = se::meshing::compute_index(cursor, leaf, 
+              inside, x, y, z);
+          const int * edges = triTable[index]; 
+          for(unsigned int e = 0; edges[e] != -1 && e < 16; e += 3){
+            TriangleType temp;
+            for(int v = 0; v < 3; ++v)
+              temp.vertexes[v] = se::meshing::interp_vertexes(cursor, select, 
+                  x, y, z, edges[e + v]);
+            if(se::meshing::checkVertex(temp.vertexes[0], dim) || 
+               se::meshing::checkVertex(temp.vertexes[1], dim) || 
+               se::meshing::checkVertex(temp.vertexes[2], dim)) continue;
+            local.push_back(temp);
+          }
+        }
+      }
+    }
+    if(local.empty()) continue;
+    std::lock_guard<std::mutex> lock(lck);
+    triangles.insert(triangles.end(), local.begin(), local.end());
+  }
+  TOCK("marchingCubeKernel", blocklist.size());
+}
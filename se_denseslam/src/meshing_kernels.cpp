@@ -0,0 +1,98 @@
+/*
+
+Copyright 2016 Emanuele Vespa, Imperial College London 
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+
+*/
+
+/*
+ * Marching cubes in a translation unit of its own, compiled per instruction
+ * set like kernels.cpp. GCC bounds inlining per translation unit, and next
+ * to the hot kernels it made them call the shared Eigen instantiations out of
+ * line, which are built for the baseline instruction set.
+ */
+#include "meshing_kernels.hpp"
+#include <mutex>
+#include <vector>
+#include <se/utils/simd.hpp>
+#include <se/algorithms/meshing.hpp>
+#include <perfstats.h>
+#include "timings.h"
+
+namespace {
+  struct inside_surface {
+    template <typename ValueT>
+    bool operator()(const ValueT& val) const { 
+      return decode_voxel(val).x < 0.f; 
+    }
+  };
+
+  struct select_value {
+    template <typename ValueT>
+    float operator()(const ValueT& val) const { 
+      return decode_voxel(val).x; 
+    }
+  };
+}
+
+#define SE_KERNEL_SOURCE "meshing.cpp"
+#include "kernel_variants.hpp"
+#undef SE_KERNEL_SOURCE
+
+namespace se {
+namespace kernels {
+template <unsigned int BlockSide>
+void marching_cube(const se::isa::level l, 
+    const Volume<FieldType, BlockSide>& volume, 
+    std::vector<Triangle>& triangles) {
+  const inside_surface inside;
+  const select_value select;
+  switch(l) {
+#ifdef SE_KERNEL_VARIANTS
+    case se::isa::level::avx512:
+      avx512::marchingCubeKernel(volume, select, inside, triangles);
+      break;
+    case se::isa::level::avx2:
+      avx2::marchingCubeKernel(volume, select, inside, triangles);
+      break;
+    case se::isa::level::sse42:
+      sse42::marchingCubeKernel(volume, select, inside, triangles);
+      break;
+#endif
+    default:
+      generic::marchingCubeKernel(volume, select, inside, triangles);
+  }
+}
+
+template void marching_cube<4>(const se::isa::level, 
+    const Volume<FieldType, 4>&, std::vector<Triangle>&);
+template void marching_cube<8>(const se::isa::level, 
+    const Volume<FieldType, 8>&, std::vector<Triangle>&);
+template void marching_cube<16>(const se::isa::level, 
+    const Volume<FieldType, 16>&, std::vector<Triangle>&);
+}
+}
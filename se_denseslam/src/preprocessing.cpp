@@ -39,7 +39,7 @@
 #include <functional>
 #include <se/image/image.hpp>
 
-void bilateralFilterKernel(se::Image<float>& out, const se::Image<float>& in,
+__attribute__((flatten)) void bilateralFilterKernel(se::Image<float>& out, const se::Image<float>& in,
 		const std::vector<float>& gaussian, float e_d, int r) {
 
 	if ((in.width() != out.width()) || in.height() != out.height()) {
@@ -42,13 +42,14 @@
 #include <se/continuous/volume_template.hpp>
 #include <se/image/image.hpp>
 #include <se/ray_iterator.hpp>
+#include <se/block_ray_iterator.hpp>
 
 /* Raycasting implementations */ 
 #include "bfusion/rendering_impl.hpp"
 #include "kfusion/rendering_impl.hpp"
 
-template<typename T>
-void raycastKernel(const Volume<T>& volume, se::Image<Eigen::Vector3f>& vertex,
+template<typename T, unsigned int BlockSide>
+__attribute__((flatten)) void raycastKernel(const Volume<T, BlockSide>& volume, se::Image<Eigen::Vector3f>& vertex,
    se::Image<Eigen::Vector3f>& normal,
    const Eigen::Matrix4f& view, const float nearPlane, const float farPlane, 
    const float mu, const float step, const float largestep) {
@@ -63,7 +64,7 @@ void raycastKernel(const Volume<T>& volume, se::Image<Eigen::Vector3f>& vertex,
       const Eigen::Vector3f dir = 
         (view.topLeftCorner<3, 3>() * Eigen::Vector3f(x, y, 1.f)).normalized();
       const Eigen::Vector3f transl = view.topRightCorner<3, 1>();
-      se::ray_iterator<T> ray(*volume._map_index, transl, dir, nearPlane, farPlane);
+      typename Volume<T, BlockSide>::map_type::ray_iterator_type ray(*volume._map_index, transl, dir, nearPlane, farPlane);
       ray.next();
       const float t_min = ray.tcmin(); /* Get distance to the first intersected block */
       const Eigen::Vector4f hit = t_min > 0.f ? 
@@ -72,13 +73,13 @@ void raycastKernel(const Volume<T>& volume, se::Image<Eigen::Vector3f>& vertex,
       if(hit.w() > 0.0) {
         vertex[x + y * vertex.width()] = hit.head<3>();
         Eigen::Vector3f surfNorm = volume.grad(hit.head<3>(), 
-            [](const auto& val){ return val.x; });
+            [](const auto& val){ return decode_voxel(val).x; });
         if (surfNorm.norm() == 0) {
           //normal[pos] = normalize(surfNorm); // APN added
           normal[pos.x() + pos.y() * normal.width()] = Eigen::Vector3f(INVALID, 0, 0);
         } else {
           // Invert normals if SDF 
-          normal[pos.x() + pos.y() * normal.width()] = std::is_same<T, SDF>::value ?
+          normal[pos.x() + pos.y() * normal.width()] = is_sdf_field<T>::value ?
             (-1.f * surfNorm).normalized() : surfNorm.normalized();
         }
       } else {
@@ -211,8 +212,8 @@ void renderTrackKernel(unsigned char* out,
   TOCK("renderTrackKernel", outSize.x * outSize.y);
 }
 
-template <typename T>
-void renderVolumeKernel(const Volume<T>& volume, 
+template <typename T, unsigned int BlockSide>
+void renderVolumeKernel(const Volume<T, BlockSide>& volume, 
     unsigned char* out, // RGBW packed
     const Eigen::Vector2i& depthSize, 
     const Eigen::Matrix4f view, 
@@ -239,7 +240,7 @@ void renderVolumeKernel(const Volume<T>& volume,
         const Eigen::Vector3f dir = 
           (view.topLeftCorner<3, 3>() * Eigen::Vector3f(x, y, 1.f)).normalized();
         const Eigen::Vector3f transl = view.topRightCorner<3, 1>();
-        se::ray_iterator<typename Volume<T>::field_type> ray(*volume._map_index, 
+        typename Volume<T, BlockSide>::map_type::ray_iterator_type ray(*volume._map_index, 
             transl, dir, nearPlane, farPlane);
         ray.next();
         const float t_min = ray.tmin(); /* Get distance to the first intersected block */
@@ -248,10 +249,11 @@ void renderVolumeKernel(const Volume<T>& volume,
           Eigen::Vector4f::Constant(0.f);
         if (hit.w() > 0) {
           test = hit.head<3>();
-          surfNorm = volume.grad(test, [](const auto& val){ return val.x; });
+          surfNorm = volume.grad(test, [](const auto& val){ 
+              return decode_voxel(val).x; });
 
           // Invert normals if SDF 
-          surfNorm = std::is_same<T, SDF>::value ? -1.f * surfNorm : surfNorm;
+          surfNorm = is_sdf_field<T>::value ? -1.f * surfNorm : surfNorm;
         } else {
           surfNorm = Eigen::Vector3f(INVALID, 0, 0);
         }
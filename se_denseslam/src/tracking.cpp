@@ -63,7 +63,7 @@ static inline Eigen::Matrix<float, 6, 1> solve(const Eigen::Matrix<float, 1, 27>
 	return llt.info() == Eigen::Success ? res : Eigen::Matrix<float, 6, 1>::Constant(0.f);
 }
 
-void new_reduce(int blockIndex, float * out, TrackData* J, 
+__attribute__((flatten)) void new_reduce(int blockIndex, float * out, TrackData* J, 
     const Eigen::Vector2i& Jsize,
 		const Eigen::Vector2i& size) {
 	float *sums = out + blockIndex * 32;
@@ -202,7 +202,7 @@ void new_reduce(int blockIndex, float * out, TrackData* J,
 	sums[31] = sums31;
 
 }
-void reduceKernel(float * out, TrackData* J, const Eigen::Vector2i Jsize,
+__attribute__((flatten)) void reduceKernel(float * out, TrackData* J, const Eigen::Vector2i Jsize,
 		const Eigen::Vector2i size) {
 	TICK();
 	int blockIndex;
@@ -223,7 +223,7 @@ void reduceKernel(float * out, TrackData* J, const Eigen::Vector2i Jsize,
 	TOCK("reduceKernel", 512);
 }
 
-void trackKernel(TrackData* output, 
+__attribute__((flatten)) void trackKernel(TrackData* output, 
     const se::Image<Eigen::Vector3f>& inVertex,
 		const se::Image<Eigen::Vector3f>& inNormal, 
     const se::Image<Eigen::Vector3f>&  refVertex,